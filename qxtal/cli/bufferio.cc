@@ -0,0 +1,29 @@
+#include "bufferio.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+BufferIO::BufferIO(void)
+		 :IO()
+	{}
+
+/*****************************************************************************\
+|* Write a character, using the same translation as the stdout version
+\*****************************************************************************/
+void BufferIO::putchar(int c)
+	{
+	if (c == 0x9B)
+		_output += '\n';
+	else if (c == 0x12)
+		_output += '-';
+	else
+		_output += (char) c;
+	}
+
+/*****************************************************************************\
+|* Discard any collected output
+\*****************************************************************************/
+void BufferIO::clear(void)
+	{
+	_output.clear();
+	}
@@ -0,0 +1,35 @@
+#ifndef BUFFERIO_H
+#define BUFFERIO_H
+
+#include "properties.h"
+#include "sim/io.h"
+
+/*****************************************************************************\
+|* IO channel that collects everything written to it, so the output of a
+|* headless run can be written out in one go when the binary completes
+\*****************************************************************************/
+class BufferIO : public IO
+	{
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GET(String, output);				// Everything written so far
+
+	public:
+		/*********************************************************************\
+		|* Constructor
+		\*********************************************************************/
+		explicit BufferIO(void);
+
+		/*********************************************************************\
+		|* Write a character
+		\*********************************************************************/
+		virtual void putchar(int c);
+
+		/*********************************************************************\
+		|* Discard any collected output
+		\*********************************************************************/
+		void clear(void);
+	};
+
+#endif // BUFFERIO_H
@@ -0,0 +1,14 @@
+//
+//  main.cc
+//  qxsim
+//
+// Headless runner for the simulator: loads and runs XEX binaries without
+// the UI
+
+#include "runner.h"
+
+int main(int argc, const char * argv[])
+	{
+	Runner runner;
+	return runner.main(argc, argv);
+	}
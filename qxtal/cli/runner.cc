@@ -0,0 +1,452 @@
+//
+//  runner.cc
+//  qxsim
+//
+#include <cstdlib>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+#include "ArgParser.h"
+#include "StringUtils.h"
+#include "runner.h"
+#include "bufferio.h"
+
+#include "sim/atari.h"
+#include "sim/mathpack.h"
+#include "sim/simulator.h"
+#include "sim/tracefile.h"
+
+#define DEFAULT_CYCLE_LIMIT		100000000
+
+/****************************************************************************\
+|* Constructor
+\****************************************************************************/
+Runner::Runner()
+	   :_ap(nullptr)
+	   ,_cycleLimit(DEFAULT_CYCLE_LIMIT)
+	   ,_errorLevel(Simulator::EL_DEFAULT)
+	   ,_jobs(1)
+	   ,_debugLevel(0)
+	   ,_trace(false)
+	   ,_binaryTrace(false)
+	   ,_profile(false)
+	   ,_callGraph(false)
+	   ,_samplePeriod(0)
+	   ,_outputFiles(false)
+	   ,_reference(false)
+	   ,_blockCache(false)
+	   ,_banking(false)
+	   ,_fastMacros(false)
+	   ,_saveAt(-1)
+	   ,_loadState(false)
+	   ,_mathMode(MathPack::MP_ROM)
+	{
+	}
+
+/*****************************************************************************\
+|* Run the binaries
+\*****************************************************************************/
+int Runner::main(int argc, const char *argv[])
+	{
+	/*************************************************************************\
+	|* Configure options and flags
+	\*************************************************************************/
+	_ap = new ArgParser(argc, argv);
+
+	_cycleLimit		= _ap->intFor("-c", "--cycles", DEFAULT_CYCLE_LIMIT,
+										"Runtime",
+										"Cycle limit per binary, 0 for none");
+	_errorLevel		= _ap->intFor("-e", "--error-level",
+										Simulator::EL_DEFAULT,
+										"Runtime",
+										"Exit on errors: 0=none 1=memory 2=all");
+	_jobs			= _ap->intFor("-j", "--jobs", 1,
+										"Runtime",
+										"Number of binaries to run at once, "
+										"0 for one per core");
+	_reference		= _ap->flagFor("-r", "--reference", false,
+										"Runtime",
+										"Use the reference execution core");
+	_blockCache		= _ap->flagFor("-b", "--block-cache", false,
+										"Runtime",
+										"Use the basic-block execution core");
+	_banking		= _ap->flagFor("-k", "--banking", false,
+										"Runtime",
+										"Emulate the expansion board's bank "
+										"switching at $1C-$1F and $80-$83");
+	_fastMacros		= _ap->flagFor("-f", "--fast-macros", false,
+										"Runtime",
+										"Run the stdmacros multiply and divide "
+										"loops natively, unless tracing or "
+										"profiling");
+	String saveAt	= _ap->stringFor("-s", "--save-state", "",
+										"Runtime",
+										"Save the machine to <name>.state "
+										"when execution reaches hex addr");
+	_loadState		= _ap->flagFor("-l", "--load-state", false,
+										"Runtime",
+										"Start each binary from its saved "
+										"<name>.state instead of loading it");
+	String math		= _ap->stringFor("-m", "--mathpack", "rom",
+										"Runtime",
+										"Run the FP routines as 'rom', "
+										"natively as 'hle', or both and "
+										"compare as 'verify'");
+	String watch	= _ap->stringFor("-w", "--watch", "",
+										"Runtime",
+										"Stop on access to addresses, as "
+										"hex addr[:r|w|rw],... (default w)");
+
+	_debugLevel		= _ap->flagFor("-d", "--debug", 0,
+										"General", "increase the debug level");
+	_trace			= _ap->flagFor("-t", "--trace", false,
+										"General",
+										"Trace execution (to <name>.trace "
+										"with -O, otherwise stderr)");
+	_binaryTrace	= _ap->flagFor("-B", "--binary-trace", false,
+										"General",
+										"Trace execution and memory ops in "
+										"binary to <name>.xtr, for qxtrace");
+	_profile		= _ap->flagFor("-p", "--profile", false,
+										"General",
+										"Write profile data to <name>.prof");
+	_callGraph		= _ap->flagFor("-g", "--call-graph", false,
+										"General",
+										"Write call-graph profile to "
+										"<name>.folded and <name>.calls");
+	_samplePeriod	= _ap->intFor("-S", "--sample", 0,
+										"General",
+										"With -p or -g, sample every N cycles "
+										"rather than counting every "
+										"instruction");
+	_outputFiles	= _ap->flagFor("-O", "--output-files", false,
+										"General",
+										"Append the output of each binary to "
+										"<name>.out rather than stdout");
+
+	/*************************************************************************\
+	|* Check for help
+	\*************************************************************************/
+	bool help		= _ap->flagFor("-h", "--help", false,
+									"General", "Show this wonderful help");
+	_binaries		= _ap->remainingArgs();
+	if (help || _binaries.size() == 0 || !_parseWatches(watch) ||
+		!_parseSaveAt(saveAt) || !_parseMathPack(math))
+		_ap->usage(true);
+
+	/*************************************************************************\
+	|* Run them, either here or spread over a pool of threads
+	\*************************************************************************/
+	if (_jobs <= 0)
+		_jobs = MAX(1, (int)std::thread::hardware_concurrency());
+
+	std::atomic<int> next(0);
+	int failures = (_jobs > 1 && _binaries.size() > 1)
+				 ? _runParallel()
+				 : _runQueue(next);
+
+	return (failures == 0) ? 0 : 1;
+	}
+
+
+#pragma mark - private methods
+
+
+/*****************************************************************************\
+|* Run binaries from the queue on a machine owned by this thread
+\*****************************************************************************/
+int Runner::_runQueue(std::atomic<int>& next)
+	{
+	int failures = 0;
+
+	/*************************************************************************\
+	|* Set up the machine. It is reset before each binary is loaded
+	\*************************************************************************/
+	BufferIO io;
+	Simulator sim(0x10000);
+	Atari hw(&sim, &io, true, true);
+
+	sim.setErrorLevel((Simulator::ErrorLevel) _errorLevel);
+	sim.setCore(_reference  ? Simulator::CORE_SWITCH
+				: _blockCache ? Simulator::CORE_BLOCK
+				: Simulator::CORE_TABLE);
+	sim.setBanking(_banking);
+	sim.setFastMacros(_fastMacros);
+	hw.setMathMode(_mathMode);
+	if (_debugLevel > 0)
+		sim.setDebug(Simulator::DBG_MESSAGE);
+
+	for (int i = next++; i < (int)_binaries.size(); i = next++)
+		if (!_runOne(&sim, &hw, &io, _binaries[i]))
+			failures ++;
+
+	return failures;
+	}
+
+/*****************************************************************************\
+|* Run one binary
+\*****************************************************************************/
+bool Runner::_runOne(Simulator *sim,
+					 Atari *hw,
+					 BufferIO *io,
+					 const String& path)
+	{
+	FILE *traceFile = nullptr;
+	TraceWriter *writer = nullptr;
+	Simulator::BlockStats stats = sim->blockStats();
+
+	/*************************************************************************\
+	|* Start from scratch, or from where a previous run saved the machine
+	\*************************************************************************/
+	io->clear();
+	bool restored = false;
+	if (_loadState)
+		restored = (hw->restoreState(_sibling(path, ".state")) == 0);
+	else
+		hw->reset();
+	if (restored)
+		sim->clearProfile();
+	uint64_t start	= sim->cycles();
+
+	/*************************************************************************\
+	|* Configure tracing and profiling
+	\*************************************************************************/
+	if (_trace)
+		{
+		if (_outputFiles)
+			traceFile = fopen(_sibling(path, ".trace").c_str(), "w");
+		sim->setTraceFile(traceFile);
+		sim->setDebug(Simulator::DBG_TRACE);
+		}
+	if (_binaryTrace)
+		{
+		writer = new TraceWriter();
+		if (writer->open(_sibling(path, ".xtr")))
+			{
+			sim->setTraceWriter(writer);
+			sim->setTraceMemory(true);
+			sim->setDebug(Simulator::DBG_TRACE);
+			}
+		else
+			{
+			fprintf(stderr, "%s: cannot write trace\n", path.c_str());
+			DELETE(writer);
+			}
+		}
+	bool profiling = _profile || _callGraph;
+	sim->setDoProfiling(profiling && (_samplePeriod <= 0));
+	sim->setSampling((profiling && (_samplePeriod > 0)) ? _samplePeriod : 0);
+
+	/*************************************************************************\
+	|* Watchpoints go in before loading, as the loader may run code
+	\*************************************************************************/
+	static int zero[1] = {0};
+	PredicateInfo always = {1, zero, zero, zero, nullptr, true};
+	for (const std::pair<uint32_t, int>& watch : _watches)
+		sim->setWatchpoint(watch.first, watch.second, always);
+
+	if (_saveAt >= 0)
+		sim->setBreakpoint(_saveAt, always);
+
+	/*************************************************************************\
+	|* Load and run the binary, or carry on from the saved state
+	\*************************************************************************/
+	Simulator::ErrorCode e = Simulator::E_NONE;
+	if (_loadState)
+		{
+		if (restored)
+			{
+			sim->setCycleLimit(_cycleLimit);
+			e = sim->resume();
+			}
+		else
+			{
+			fprintf(stderr, "%s: cannot load machine state\n", path.c_str());
+			e = Simulator::E_USER;
+			}
+		}
+	else if ((e = hw->load(path)) == Simulator::E_NONE)
+		{
+		sim->setCycleLimit(_cycleLimit);
+		e = sim->call(hw->runAddress());
+		}
+	else
+		fprintf(stderr, "%s: cannot load binary\n", path.c_str());
+
+	/*************************************************************************\
+	|* Save the machine when it gets to the save address, and carry on
+	\*************************************************************************/
+	if ((e == Simulator::E_BREAKPOINT) && (sim->regs().pc == _saveAt))
+		{
+		sim->clearBreakpoint(_saveAt);
+		if (hw->saveState(_sibling(path, ".state")) != 0)
+			fprintf(stderr, "%s: cannot save machine state\n", path.c_str());
+		e = sim->resume();
+		}
+
+	if (traceFile)
+		fclose(traceFile);
+	if (writer)
+		{
+		if (!writer->close(sim->labels()))
+			fprintf(stderr, "%s: cannot write trace\n", path.c_str());
+		sim->setTraceWriter(nullptr);
+		DELETE(writer);
+		}
+
+	/*************************************************************************\
+	|* Write out the results
+	\*************************************************************************/
+	const String& out = io->output();
+	if (_outputFiles)
+		{
+		FILE *fp = fopen(_sibling(path, ".out").c_str(), "a");
+		if (fp)
+			{
+			fwrite(out.data(), 1, out.size(), fp);
+			fclose(fp);
+			}
+		else
+			fprintf(stderr, "%s: cannot write output\n", path.c_str());
+		}
+	else
+		{
+		std::lock_guard<std::mutex> lock(_outputLock);
+		fwrite(out.data(), 1, out.size(), stdout);
+		fflush(stdout);
+		}
+
+	if (_profile)
+		sim->saveProfile(_sibling(path, ".prof"));
+	if (_callGraph)
+		{
+		sim->saveCallProfile(_sibling(path, ".folded"));
+		sim->saveCallProfile(_sibling(path, ".calls"), true);
+		}
+
+	if (e == Simulator::E_WATCHPOINT)
+		fprintf(stderr, "%s: %s on $%04x at PC=$%04x after %" PRIu64 " cycles\n",
+				path.c_str(),
+				sim->errorString(e).c_str(),
+				sim->errorAddress(),
+				sim->regs().pc,
+				sim->cycles() - start);
+	else if (e != Simulator::E_NONE || _debugLevel > 0)
+		fprintf(stderr, "%s: %s after %" PRIu64 " cycles\n",
+				path.c_str(),
+				sim->errorString(e).c_str(),
+				sim->cycles() - start);
+
+	if (_blockCache && _debugLevel > 0)
+		{
+		const Simulator::BlockStats& now = sim->blockStats();
+		uint64_t hits	= now.hits - stats.hits;
+		uint64_t total	= hits + now.misses - stats.misses;
+		fprintf(stderr, "%s: block cache %.1f%% hits, %" PRIu64 " blocks, "
+						"%" PRIu64 " invalidations\n",
+				path.c_str(),
+				(total > 0) ? (100.0 * hits) / total : 0.0,
+				now.blocks,
+				now.invalidations - stats.invalidations);
+		}
+
+	return (e == Simulator::E_NONE);
+	}
+
+/*****************************************************************************\
+|* Run the binaries on a pool of threads, each with its own machine
+\*****************************************************************************/
+int Runner::_runParallel(void)
+	{
+	std::atomic<int> next(0);
+	std::atomic<int> failures(0);
+	int jobs = MIN(_jobs, (int)_binaries.size());
+
+	std::vector<std::thread> pool;
+	for (int i=0; i<jobs; i++)
+		pool.emplace_back([&]{ failures += _runQueue(next); });
+
+	for (std::thread& t : pool)
+		t.join();
+
+	return failures;
+	}
+
+/*****************************************************************************\
+|* Parse the watchpoints
+\*****************************************************************************/
+bool Runner::_parseWatches(const String& spec)
+	{
+	if (spec.empty())
+		return true;
+
+	for (const String& item : split(spec, ','))
+		{
+		StringList parts = split(item, ':');
+		if (parts.size() == 0 || parts[0].empty() || parts.size() > 2)
+			return false;
+
+		char *end		= nullptr;
+		String addr		= (parts[0][0] == '$') ? parts[0].substr(1) : parts[0];
+		uint32_t address = (uint32_t) strtoul(addr.c_str(), &end, 16);
+		if (*end != '\0' || address > 0xFFFF)
+			return false;
+
+		String how	= (parts.size() > 1) ? lcase(parts[1]) : "w";
+		int type	= 0;
+		if (how.find('r') != String::npos)
+			type |= Simulator::MS_WATCH_READ;
+		if (how.find('w') != String::npos)
+			type |= Simulator::MS_WATCH_WRITE;
+		if (type == 0)
+			return false;
+
+		_watches.push_back({address, type});
+		}
+	return true;
+	}
+
+/*****************************************************************************\
+|* Parse the address to save the machine state at
+\*****************************************************************************/
+bool Runner::_parseSaveAt(const String& spec)
+	{
+	if (spec.empty())
+		return true;
+
+	char *end		= nullptr;
+	String addr		= (spec[0] == '$') ? spec.substr(1) : spec;
+	uint32_t address = (uint32_t) strtoul(addr.c_str(), &end, 16);
+	if (addr.empty() || *end != '\0' || address > 0xFFFF)
+		return false;
+
+	_saveAt = (int) address;
+	return true;
+	}
+
+/*****************************************************************************\
+|* Parse the math pack mode
+\*****************************************************************************/
+bool Runner::_parseMathPack(const String& spec)
+	{
+	if (spec == "rom")
+		_mathMode = MathPack::MP_ROM;
+	else if (spec == "hle")
+		_mathMode = MathPack::MP_HLE;
+	else if (spec == "verify")
+		_mathMode = MathPack::MP_VERIFY;
+	else
+		return false;
+	return true;
+	}
+
+/*****************************************************************************\
+|* Return the path with the extension replaced
+\*****************************************************************************/
+String Runner::_sibling(const String& path, const char *ext)
+	{
+	return fs::path(path).replace_extension(ext).string();
+	}
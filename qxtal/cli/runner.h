@@ -0,0 +1,109 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "properties.h"
+#include "macros.h"
+
+class ArgParser;
+class Atari;
+class BufferIO;
+class Simulator;
+
+class Runner
+	{
+	NON_COPYABLE_NOR_MOVEABLE(Runner)
+
+	/*************************************************************************\
+	|* Watchpoints to set: address and Simulator::MS_WATCH_* bits
+	\*************************************************************************/
+	typedef std::vector<std::pair<uint32_t, int>> WatchList;
+
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GET(ArgParser*, ap);				// Permanent reference to the arguments
+	GET(StringList, binaries);			// XEX files to run
+	GET(uint64_t, cycleLimit);			// Max cycles per binary, 0 = none
+	GET(int, errorLevel);				// Simulator error level to exit on
+	GET(int, jobs);						// Number of binaries to run at once
+	GET(int, debugLevel);				// Message verbosity
+	GET(bool, trace);					// Trace execution
+	GET(bool, binaryTrace);				// Trace to <name>.xtr
+	GET(bool, profile);					// Write <name>.prof for each binary
+	GET(bool, callGraph);				// Write <name>.folded and .calls
+	GET(int, samplePeriod);				// Sample the profile every N cycles
+	GET(bool, outputFiles);				// Append output to <name>.out
+	GET(bool, reference);				// Use the reference execution core
+	GET(bool, blockCache);				// Use the basic-block execution core
+	GET(bool, banking);					// Emulate the expansion board
+	GET(bool, fastMacros);				// Run stdmacros mul/div natively
+	GET(WatchList, watches);			// Stop on accesses to these
+	GET(int, saveAt);					// Save <name>.state here, or -1
+	GET(bool, loadState);				// Start from <name>.state
+	GET(int, mathMode);					// MathPack::Mode for the FP routines
+
+	private:
+		std::mutex _outputLock;			// Serialise writes to stdout
+
+		/*********************************************************************\
+		|* Run one binary on an already-set-up machine
+		\*********************************************************************/
+		bool _runOne(Simulator *sim,
+					 Atari *hw,
+					 BufferIO *io,
+					 const String& path);
+
+		/*********************************************************************\
+		|* Take binaries off the shared queue and run them on a machine of
+		|* our own until there are none left. Returns # of failures
+		\*********************************************************************/
+		int _runQueue(std::atomic<int>& next);
+
+		/*********************************************************************\
+		|* Run the binaries over 'jobs' threads, one machine per thread
+		\*********************************************************************/
+		int _runParallel(void);
+
+		/*********************************************************************\
+		|* Return the path with the extension replaced
+		\*********************************************************************/
+		String _sibling(const String& path, const char *ext);
+
+		/*********************************************************************\
+		|* Parse the watchpoint list, eg: "600:w,d01f:rw". Returns false if
+		|* it doesn't make sense
+		\*********************************************************************/
+		bool _parseWatches(const String& spec);
+
+		/*********************************************************************\
+		|* Parse the address to save the machine state at, eg: "$2040".
+		|* Returns false if it doesn't make sense
+		\*********************************************************************/
+		bool _parseSaveAt(const String& spec);
+
+		/*********************************************************************\
+		|* Parse how to run the math pack: "rom", "hle" or "verify". Returns
+		|* false if it doesn't make sense
+		\*********************************************************************/
+		bool _parseMathPack(const String& spec);
+
+	public:
+		/*********************************************************************\
+		|* Constructors and Destructor
+		\*********************************************************************/
+		explicit Runner();
+
+		/*********************************************************************\
+		|* Entry point from main()
+		\*********************************************************************/
+		int main(int argc, const char *argv[]);
+	};
+
+#endif // RUNNER_H
@@ -28,7 +28,8 @@
 #define NTFY_WRK_PLAY_FORWARD	"N:wrk:play forward"
 
 /*************************************************************************\
-|* Notification constant: Trace selection changed
+|* Notification constant: Trace selection changed. Carries a pointer to
+|* the Simulator::Registers of the selected instruction
 \*************************************************************************/
 #define NTFY_TRACE_SEL_CHG		"N:trace:sel:chg"
 
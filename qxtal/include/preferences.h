@@ -4,6 +4,8 @@
 typedef struct Preferences
 	{
 	int cycleLimit;				// How many cycles to run the simulator for
+	int traceMemoryMB;			// Trace kept in RAM before spilling to disk
+	int snapshotInterval;		// Instructions between reverse-step snapshots
 	} Preferences;
 
 #endif // PREFERENCES_H
@@ -108,7 +108,10 @@ PredicateEditor::PredicateEditor(QString title, QWidget *parent)
 /*****************************************************************************\
 |* Add a row with a default value
 \*****************************************************************************/
-void PredicateEditor::addRow(const QString& defaultValue, int wIdx, int cIdx)
+void PredicateEditor::addRow(const QString& defaultValue,
+							 int wIdx,
+							 int cIdx,
+							 const QString& defaultArg)
 	{
 	if (_saLayout->count() > 0)
 		_saLayout->removeWidget(_lastEntry);
@@ -130,6 +133,13 @@ void PredicateEditor::addRow(const QString& defaultValue, int wIdx, int cIdx)
 	connect(what, &QComboBox::currentIndexChanged,
 			this, &PredicateEditor::_whatChanged);
 
+	QLineEdit *arg = new QLineEdit(defaultArg);
+	arg->setMinimumHeight(30);
+	arg->setPlaceholderText("$address");
+	arg->setObjectName("arg");
+	layout->addWidget(arg);
+	_argMap[what] = arg;
+
 	QComboBox *cond = new QComboBox(this);
 	cond->setMinimumHeight(30);
 	cond->addItems(_conditions);
@@ -160,6 +170,8 @@ void PredicateEditor::addRow(const QString& defaultValue, int wIdx, int cIdx)
 		cond->hide();
 		val->hide();
 		}
+	if (_how[wIdx] != 3)
+		arg->hide();
 
 	_checkIfLastItem();
 	}
@@ -207,8 +219,11 @@ void PredicateEditor::configure(PredicateInfo info)
 	{
 	for (int i=0; i<info.num; i++)
 		{
-		QString val = QString("%1").arg(info.values[i]);
-		addRow(val, info.what[i], info.cond[i]);
+		QString val = QString("$%1").arg(info.values[i], 0, 16);
+		QString arg = (info.args != nullptr)
+					? QString("$%1").arg(info.args[i], 4, 16, QLatin1Char('0'))
+					: QString("");
+		addRow(val, info.what[i], info.cond[i], arg);
 		}
 	}
 
@@ -235,6 +250,7 @@ void PredicateEditor::_ok(void)
 	info.what		= new int[info.num];
 	info.cond		= new int[info.num];
 	info.values		= new int[info.num];
+	info.args		= new int[info.num];
 	info.enabled	= (info.num > 0);
 
 	QScrollArea *scroll = static_cast<QScrollArea *>(_widgetMap[SCROLLAREA]);
@@ -244,7 +260,8 @@ void PredicateEditor::_ok(void)
 	for (QObject * child : kids)
 		{
 		QWidget *widget = static_cast<QWidget*>(child);
-		if (widget->objectName() == "predicate-row")
+		if ((widget->objectName() == "predicate-row") &&
+			(_hideMap.count(widget) != 0))
 			{
 			QObjectList rowkids = widget->children();
 			for (int i=0; i<rowkids.size(); i++)
@@ -272,6 +289,14 @@ void PredicateEditor::_ok(void)
 					else
 						info.values[idx] = num.toInt(nullptr, 16);
 					}
+				if (obj->objectName() == "arg")
+					{
+					QLineEdit *edit = static_cast<QLineEdit *>(obj);
+					QString num		= edit->text();
+					if (num.startsWith("$"))
+						num.remove(0,1);
+					info.args[idx] = num.toInt(nullptr, 16);
+					}
 				}
 			idx ++;
 			}
@@ -321,6 +346,11 @@ void PredicateEditor::_whatChanged(int idx)
 			_condMap[obj]->show();
 			_valMap[obj]->show();
 			}
+
+		if (_how[idx] == 3)
+			_argMap[obj]->show();
+		else
+			_argMap[obj]->hide();
 		}
 	}
 
@@ -47,6 +47,7 @@ class PredicateEditor : public QDialog
 		IntList _how;							// How to represent predicate
 		RefMap _condMap;						// Condition-widget map
 		RefMap _valMap;							// Value-widget map
+		RefMap _argMap;							// Address-widget map
 		RefMap _delMap;							// Delete-widget map
 		RefMap _hideMap;						// What to hide if <2 items
 
@@ -67,14 +68,18 @@ class PredicateEditor : public QDialog
 
 		/*********************************************************************\
 		|* Set what the 'what' ought to be, last entry defines how many
-		|* columns are used
+		|* columns are used: a digit per 'what', 0 for none, 2 for condition
+		|* and value, 3 for an address as well
 		\*********************************************************************/
 		void setWhat(QStringList& what);
 
 		/*********************************************************************\
 		|* Add a row
 		\*********************************************************************/
-		void addRow(const QString& defaultValue = "", int what = 0, int cond=0);
+		void addRow(const QString& defaultValue = "",
+					int what = 0,
+					int cond = 0,
+					const QString& defaultArg = "");
 
 		/*********************************************************************\
 		|* Set a preferred size
@@ -11,17 +11,19 @@ typedef struct PredicateInfo
 	int *what;			// The objects of the predicate
 	int *cond;			// The conditions of the predicate
 	int *values;		// The test-values of the predicate
+	int *args;			// Extra operands, eg: address for memory terms
 	bool enabled;		// Whether this predicate is enabled
 
 	void dump(void)
 		{
 		for (int i=0; i<num; i++)
-			fprintf(stderr, "%2d: %c : %d,%d,%d\n",
+			fprintf(stderr, "%2d: %c : %d,%d,%d,%d\n",
 					i,
 					(enabled == true) ? 'Y' : 'N',
 					what[i],
 					cond[i],
-					values[i]);
+					values[i],
+					(args != nullptr) ? args[i] : 0);
 		}
 
 	void release(void)
@@ -31,6 +33,7 @@ typedef struct PredicateInfo
 			DELETE_ARRAY(what);
 			DELETE_ARRAY(cond);
 			DELETE_ARRAY(values);
+			DELETE_ARRAY(args);
 			num = -1;
 			enabled = false;
 			}
@@ -42,6 +45,7 @@ typedef struct PredicateInfo
 									   nullptr,
 									   nullptr,
 									   nullptr,
+									   nullptr,
 									   false};
 		}
 	} PredicateInfo;
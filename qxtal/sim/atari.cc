@@ -1,6 +1,5 @@
 
 #include <sys/stat.h>
-#include <sys/time.h>
 
 #include "atari.h"
 #include "atarihw.h"
@@ -53,6 +52,14 @@ typedef int LoadState;
 #define ROWCRS (0x54)			// cursor row
 #define COLCRS (0x55)			// cursor column (2 byte)
 
+/*****************************************************************************\
+|* System defs. Frames are NTSC: 262 lines of 114 cycles
+\*****************************************************************************/
+#define RTCLOK (0x12)			// real-time clock, 3 bytes, high byte first
+#define ATRACT (0x4D)			// attract mode counter
+
+#define CYCLES_PER_FRAME	(262 * 114)
+
 /*****************************************************************************\
 |* SCREEN defs
 \*****************************************************************************/
@@ -189,54 +196,59 @@ static uint8_t iocv_empty[16] =
 #define VID_RAM  (0xC000)       // Video RAM from 0xC000) (4k for video)
 
 /*****************************************************************************\
-|* State, filled in by init() or constructor
+|* State, filled in by instance()
 \*****************************************************************************/
-static Atari *			_a8;			// Instance
+static Atari *			_a8;			// Shared instance for the UI
+
+/*****************************************************************************\
+|* The machine that owns a simulator's callbacks
+\*****************************************************************************/
+#define A8(sim)			((Atari *)((sim)->context()))
 
 /*****************************************************************************\
 |* Callback declarations
 \*****************************************************************************/
 Simulator::ErrorCode _cio(CB_ARGS)
-	{ return _a8->cioCB(regs, address, data); }
+	{ return A8(sim)->cioCB(regs, address, data); }
 
 Simulator::ErrorCode _editor(CB_ARGS)
-	{ return _a8->editorCB(regs, address, data); }
+	{ return A8(sim)->editorCB(regs, address, data); }
 
 Simulator::ErrorCode _keyboard(CB_ARGS)
-	{ return _a8->keyboardCB(regs, address, data); }
+	{ return A8(sim)->keyboardCB(regs, address, data); }
 
 Simulator::ErrorCode _cioErr(CB_ARGS)
-	{ return _a8->cioErrCB(regs, address, data); }
+	{ return A8(sim)->cioErrCB(regs, address, data); }
 
 Simulator::ErrorCode _printer(CB_ARGS)
-	{ return _a8->printerCB(regs, address, data); }
+	{ return A8(sim)->printerCB(regs, address, data); }
 
 Simulator::ErrorCode _cassette(CB_ARGS)
-	{ return _a8->cassetteCB(regs, address, data); }
+	{ return A8(sim)->cassetteCB(regs, address, data); }
 
 Simulator::ErrorCode _disk(CB_ARGS)
-	{ return _a8->diskCB(regs, address, data); }
+	{ return A8(sim)->diskCB(regs, address, data); }
 
 Simulator::ErrorCode _screen(CB_ARGS)
-	{ return _a8->screenOpenCB(regs, address, data); }
+	{ return A8(sim)->screenOpenCB(regs, address, data); }
 
 Simulator::ErrorCode _screenOpen(CB_ARGS)
-	{ return _a8->screenOpenCB(regs, address, data); }
+	{ return A8(sim)->screenOpenCB(regs, address, data); }
 
 Simulator::ErrorCode _screenPlot(CB_ARGS)
-	{ return _a8->screenPlotCB(regs, address, data); }
+	{ return A8(sim)->screenPlotCB(regs, address, data); }
 
 Simulator::ErrorCode _screenDraw(CB_ARGS)
-	{ return _a8->screenDrawCB(regs, address, data); }
+	{ return A8(sim)->screenDrawCB(regs, address, data); }
 
 Simulator::ErrorCode _screenLocate(CB_ARGS)
-	{ return _a8->screenLocateCB(regs, address, data); }
+	{ return A8(sim)->screenLocateCB(regs, address, data); }
 
-Simulator::ErrorCode _rtc(CB_ARGS)
-	{ return _a8->rtcCB(regs, address, data); }
+Simulator::ErrorCode _vbi(Simulator *sim, uint64_t cycle)
+	{ return A8(sim)->vbiEvent(cycle); }
 
 Simulator::ErrorCode _keyCode(CB_ARGS)
-	{ return _a8->keyCodeCB(regs, address, data); }
+	{ return A8(sim)->keyCodeCB(regs, address, data); }
 
 
 /*****************************************************************************\
@@ -497,17 +509,31 @@ static const struct
 /*****************************************************************************\
 |* Constructor - call the static init() method to create the shared instance
 \*****************************************************************************/
-Atari::Atari(Simulator* sim, IO *io, bool loadLabels)
+Atari::Atari(Simulator* sim, IO *io, bool, bool headless)
 	  :_io(io)
 	  ,_sim(sim)
+	  ,_worker(nullptr)
+	  ,_runAddress(0)
+	  ,_headless(headless)
+	  ,_mathMode(0)
 	  ,_lastRow(0)
 	  ,_lastCol(0)
+	  ,_fhand{}
+	  ,_keyCh(0xFF)
 	{
+	/*************************************************************************\
+	|* Callbacks find their way back to us via the simulator
+	\*************************************************************************/
+	_sim->setContext(this);
+
 	/*************************************************************************\
 	|* Create the background worker for simulation
 	\*************************************************************************/
-	_worker = new Worker(this);
-	_worker->start();
+	if (!headless)
+		{
+		_worker = new Worker(this);
+		_worker->start();
+		}
 
 	/*************************************************************************\
 	|* Create the display
@@ -518,8 +544,11 @@ Atari::Atari(Simulator* sim, IO *io, bool loadLabels)
 	/*************************************************************************\
 	|* Listen for reload notifications
 	\*************************************************************************/
-	auto nc = NotifyCenter::defaultNotifyCenter();
-	nc->addObserver([=](NotifyData &nd){_reload(nd);}, NTFY_XEX_CHANGED);
+	if (!headless)
+		{
+		auto nc = NotifyCenter::defaultNotifyCenter();
+		nc->addObserver([=](NotifyData &nd){_reload(nd);}, NTFY_XEX_CHANGED);
+		}
 
 	/*************************************************************************\
 	|* Reset to start
@@ -527,6 +556,21 @@ Atari::Atari(Simulator* sim, IO *io, bool loadLabels)
 	_reset();
 	}
 
+/*****************************************************************************\
+|* Destructor. The worker thread (if any) lives as long as the application
+\*****************************************************************************/
+Atari::~Atari(void)
+	{
+	for (int i=0; i<16; i++)
+		if (_fhand[i])
+			fclose(_fhand[i]);
+
+	if (_sim->context() == this)
+		_sim->setContext(nullptr);
+
+	DELETE(_dpy);
+	}
+
 /*****************************************************************************\
 |* Reset the simulator
 \*****************************************************************************/
@@ -536,6 +580,9 @@ void Atari::_reset(void)
 	|* Zero everything
 	\*************************************************************************/
 	_sim->reset();
+	_lastRow = 0;
+	_lastCol = 0;
+	_keyCh	 = 0xFF;
 
 	/*************************************************************************\
 	|* Adds 52K bytes of RAM at $0
@@ -608,7 +655,7 @@ void Atari::_reset(void)
 	/*************************************************************************\
 	|* Math Package
 	\*************************************************************************/
-	MathPack::load(_sim);
+	MathPack::load(_sim, (MathPack::Mode)_mathMode);
 
 	/*************************************************************************\
 	|* Simulate keyboard character "CH"
@@ -617,10 +664,9 @@ void Atari::_reset(void)
 	_sim->addCallback(_keyCode, 0x2FC, 1, Simulator::CB_WRITE);
 
 	/*************************************************************************\
-	|* Simulate real-time clock
+	|* Vertical blank, once a frame, which runs the real-time clock
 	\*************************************************************************/
-	_sim->addCallback(_rtc, 0x12, 3, Simulator::CB_READ);
-	_sim->addCallback(_rtc, 0x12, 3, Simulator::CB_WRITE);
+	_sim->addEvent(_vbi, _sim->cycles() + CYCLES_PER_FRAME, CYCLES_PER_FRAME);
 
 	/*************************************************************************\
 	|* Random OS addresses
@@ -650,24 +696,34 @@ void Atari::_reset(void)
 /*****************************************************************************\
 |* Create a shared, initialised instance
 \*****************************************************************************/
-Atari * Atari::instance(Simulator* sim, IO *io, bool loadLabels)
+Atari * Atari::instance(Simulator* sim, IO *io, bool loadLabels, bool headless)
 	{
 	if (_a8 == nullptr)
-		_a8 = new Atari(sim, io, loadLabels);
+		_a8 = new Atari(sim, io, loadLabels, headless);
 	return _a8;
 	}
 
+/*****************************************************************************\
+|* Reset the machine
+\*****************************************************************************/
+void Atari::reset(void)
+	{
+	_reset();
+	}
+
 /*****************************************************************************\
 |* Notification: we need to reload the binary
 \*****************************************************************************/
 void Atari::_reload(NotifyData &nd)
 	{
 	Simulator::BreakpointMap bps = _sim->breakpoints();
+	Simulator::WatchpointMap wps = _sim->watchpoints();
 	_reset();
 	String path = nd.stringValue();
 	fprintf(stderr, "Reloading %s\n", path.c_str());
 	load(path);
 	_sim->applyBreakpoints(bps);
+	_sim->applyWatchpoints(wps);
 	}
 
 
@@ -778,8 +834,12 @@ Simulator::ErrorCode Atari::load(const String& filename)
 					runAddr = sAddr;
 					}
 
-				auto nc = NotifyCenter::defaultNotifyCenter();
-				nc->notify(NTFY_BINARY_LOADED, runAddr);
+				_runAddress = runAddr;
+				if (!_headless)
+					{
+					auto nc = NotifyCenter::defaultNotifyCenter();
+					nc->notify(NTFY_BINARY_LOADED, runAddr);
+					}
 				//e = _sim->call(runAddr);
 				break;
 				}
@@ -866,6 +926,92 @@ Simulator::ErrorCode Atari::load(const String& filename)
 	return e;
 	}
 
+/*****************************************************************************\
+|* Save the machine state. Open disk files aren't part of it
+\*****************************************************************************/
+int Atari::saveState(const String& path)
+	{
+	uint16_t version	= 0x100;
+	int e				= 0;
+	FILE *fp			= fopen(path.c_str(), "wb");
+	if (!fp)
+		{
+		_sim->error("can't save machine state", strerror(errno));
+		return 1;
+		}
+
+	e = fprintf(fp, "A8:STATE\n") < 0;
+	e |= fwrite(&version, sizeof(version), 1, fp) < 1;
+	e |= fwrite(&_lastRow, sizeof(_lastRow), 1, fp) < 1;
+	e |= fwrite(&_lastCol, sizeof(_lastCol), 1, fp) < 1;
+	e |= fwrite(&_keyCh, sizeof(_keyCh), 1, fp) < 1;
+	e |= fwrite(&_runAddress, sizeof(_runAddress), 1, fp) < 1;
+	e |= !_sim->writeState(fp);
+	e |= !_dpy->write(fp);
+	e |= fclose(fp) != 0;
+
+	if (e)
+		_sim->error("can't save machine state", strerror(errno));
+	return e;
+	}
+
+/*****************************************************************************\
+|* Restore the machine state. The machine is reset first, which puts back
+|* the callbacks and events; if the file can't be read it's left that way
+\*****************************************************************************/
+int Atari::restoreState(const String& path)
+	{
+	uint16_t version	= 0;
+	int e				= 0;
+	FILE *fp			= fopen(path.c_str(), "rb");
+	if (!fp)
+		{
+		_sim->error("can't load machine state", strerror(errno));
+		return 1;
+		}
+
+	_reset();
+
+	char buf[32];
+	if (!fgets(buf, 16, fp) || strcmp(buf, "A8:STATE\n"))
+		{
+		fclose(fp);
+		_sim->error("not a machine state file");
+		return 1;
+		}
+
+	if (fread(&version, sizeof(version), 1, fp) < 1 || version != 0x100)
+		{
+		fclose(fp);
+		_sim->error("invalid machine state version %04x", version);
+		return 1;
+		}
+
+	uint32_t lastRow	= 0;
+	uint32_t lastCol	= 0;
+	int keyCh			= 0;
+	uint16_t runAddress	= 0;
+	e |= fread(&lastRow, sizeof(lastRow), 1, fp) < 1;
+	e |= fread(&lastCol, sizeof(lastCol), 1, fp) < 1;
+	e |= fread(&keyCh, sizeof(keyCh), 1, fp) < 1;
+	e |= fread(&runAddress, sizeof(runAddress), 1, fp) < 1;
+	e |= e || !_sim->readState(fp);
+	e |= e || !_dpy->read(fp);
+	fclose(fp);
+
+	if (e)
+		{
+		_sim->error("can't load machine state", strerror(errno));
+		return 1;
+		}
+
+	_lastRow	= lastRow;
+	_lastCol	= lastCol;
+	_keyCh		= keyCh;
+	_runAddress	= runAddress;
+	return 0;
+	}
+
 
 /*****************************************************************************\
 |* Check if a block is a symbol table, and if so, load it
@@ -1598,8 +1744,6 @@ FILE * Atari::_fOpen(const char *name, const char *mode)
 \*****************************************************************************/
 int Atari::diskCB(Simulator::Registers *regs, uint32_t addr, int data)
 	{
-	static FILE *fhand[16];		// One per CIO channel
-
 	// We need IOCB data
 	unsigned chn  = ((regs->x) >> 4);
 	unsigned badr = GET_IC(BAL) | (GET_IC(BAH) << 8);
@@ -1636,11 +1780,11 @@ int Atari::diskCB(Simulator::Registers *regs, uint32_t addr, int data)
 			_sim->warn("DISK OPEN #%d, %d, %d, '%s'", chn, ax1, ax2, fname);
 
 			// Test if not already open
-			if (fhand[chn])
+			if (_fhand[chn])
 				{
 				_sim->warn("DISK: Internal error, %d already open.", chn);
-				fclose(fhand[chn]);
-				fhand[chn] = 0;
+				fclose(_fhand[chn]);
+				_fhand[chn] = 0;
 				}
 
 			// Open Flag:
@@ -1671,8 +1815,8 @@ int Atari::diskCB(Simulator::Registers *regs, uint32_t addr, int data)
 					return 0;
 				}
 
-			fhand[chn] = _fOpen(fname, flags);
-			if (!fhand[chn])
+			_fhand[chn] = _fOpen(fname, flags);
+			if (!_fhand[chn])
 				{
 				_sim->warn("DISK OPEN: error %s", strerror(errno));
 				if (errno == ENOENT)
@@ -1690,23 +1834,23 @@ int Atari::diskCB(Simulator::Registers *regs, uint32_t addr, int data)
 			}
 
 		case DEVR_CLOSE:
-			if (fhand[chn])
+			if (_fhand[chn])
 				{
-				fclose(fhand[chn]);
-				fhand[chn] = 0;
+				fclose(_fhand[chn]);
+				_fhand[chn] = 0;
 				}
 			regs->y = 1;
 			return 0;
 
 		case DEVR_GET:
-			if (!fhand[chn])
+			if (!_fhand[chn])
 				{
 				_sim->warn("DISK GET: Internal error, %d closed.", chn);
 				regs->y = 133;
 				}
 			else
 				{
-				int c   = fgetc(fhand[chn]);
+				int c   = fgetc(_fhand[chn]);
 				regs->y = 1;
 				if (c == EOF)
 					regs->y = 136;
@@ -1716,14 +1860,14 @@ int Atari::diskCB(Simulator::Registers *regs, uint32_t addr, int data)
 			return 0;
 
 		case DEVR_PUT:
-			if (!fhand[chn])
+			if (!_fhand[chn])
 				{
 				_sim->warn("DISK PUT: Internal error, %d closed.", chn);
 				regs->y = 133;
 				}
 			else
 				{
-				fputc(regs->a, fhand[chn]);
+				fputc(regs->a, _fhand[chn]);
 				regs->y = 1;
 				}
 			return 0;
@@ -1749,38 +1893,24 @@ int Atari::diskCB(Simulator::Registers *regs, uint32_t addr, int data)
 #pragma mark -- system devices
 
 /*****************************************************************************\
-|* System: real-time clock
+|* System: vertical blank. As the OS's stage 1 VBI, count the frame in
+|* RTCLOK, and bump the attract-mode counter every 256 frames
 \*****************************************************************************/
-int Atari::rtcCB(Simulator::Registers *regs, uint32_t addr, int data)
+Simulator::ErrorCode Atari::vbiEvent(uint64_t)
 	{
-	static int startTime;
-
-	// Get current time
-	struct timeval tv;
-	gettimeofday(&tv, 0);
-	int curTime   = (int)(fmod(tv.tv_sec * 60 + tv.tv_usec * 0.00006, 16777216.));
-	int atariTime = curTime - startTime;
+	uint8_t clock[3];
+	for (int i=0; i<3; i++)
+		clock[i] = _peek(RTCLOK + i);
 
-	if (data == Simulator::CB_READ)
-		{
-		if (addr == 0x12)
-			return 0xFF & (atariTime >> 16);
-		else if (addr == 0x13)
-			return 0xFF & (atariTime >> 8);
-		else
-			return 0xFF & atariTime;
-		}
-	else
+	if (++clock[2] == 0)
 		{
-		if (addr == 0x12)
-			atariTime = (atariTime & 0x00FFFF) | (data << 16);
-		else if (addr == 0x13)
-			atariTime = (atariTime & 0xFF00FF) | (data << 8);
-		else
-			atariTime = (atariTime & 0xFFFF00) | data;
-		startTime = curTime - atariTime;
+		_poke(ATRACT, _peek(ATRACT) + 1);
+		if (++clock[1] == 0)
+			++clock[0];
 		}
-	return 0;
+
+	_sim->addRAM(RTCLOK, clock, 3);
+	return Simulator::E_NONE;
 	}
 
 
@@ -1790,8 +1920,7 @@ int Atari::rtcCB(Simulator::Registers *regs, uint32_t addr, int data)
 \*****************************************************************************/
 int Atari::keyCodeCB(Simulator::Registers *regs, uint32_t addr, int data)
 	{
-	static int ch = 0xFF;
-	static uint8_t kcodes[128] = {
+	static const uint8_t kcodes[128] = {
 // ;    A    B    C    D    E    F    G    H    I    J    K    L    M    N    O
 0xA0,0xBF,0x95,0x92,0xBA,0xAA,0xB8,0xBD,0xB9,0x8d,0x81,0x85,0x80,0xA5,0xA3,0x88,
 // P    Q    R    S    T    U    V    W    X    Y    Z  ESC    ^    v   <-   ->    _
@@ -1813,8 +1942,8 @@ int Atari::keyCodeCB(Simulator::Registers *regs, uint32_t addr, int data)
 	if (data == Simulator::CB_READ)
 		{
 		// Return value if we have one
-		if (ch != 0xFF)
-			return ch;
+		if (_keyCh != 0xFF)
+			return _keyCh;
 
 		// Else, see if we have a character available
 		int c = _io->peekchar();
@@ -1824,16 +1953,16 @@ int Atari::keyCodeCB(Simulator::Registers *regs, uint32_t addr, int data)
 			{
 			// Translate to key-code
 			if (c == 0x9B)
-				ch = 0x0C;
+				_keyCh = 0x0C;
 			else
-				ch = kcodes[c & 0x7F];
+				_keyCh = kcodes[c & 0x7F];
 			}
-		return ch;
+		return _keyCh;
 		}
 	else
 		{
 		// Simply write over our internal value
-		ch = data;
+		_keyCh = data;
 		}
 	return 0;
 	}
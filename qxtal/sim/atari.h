@@ -21,7 +21,10 @@ class Atari
 	GETSET(IO*, io, Io);				// Input/Output channel
 	GETSET(Simulator*, sim, Sim);		// Simulator engine
 	GETSET(Display *, dpy, Dpy);		// Simulated screen
-	GET(Worker*, worker);				// Worker thread
+	GET(Worker*, worker);				// Worker thread, null if headless
+	GET(uint16_t, runAddress);			// Run address of the last load()
+	GET(bool, headless);				// No worker thread or notifications
+	GETSET(int, mathMode, MathMode);	// MathPack::Mode, from the next reset
 
 	public:
 		/*********************************************************************\
@@ -39,6 +42,8 @@ class Atari
 	protected:
 		uint32_t		_lastRow;		// Editor's last row
 		uint32_t		_lastCol;		// Editor's last col
+		FILE *			_fhand[16];		// Disk files, one per CIO channel
+		int				_keyCh;			// Last key code in CH
 
 	private:
 		/*********************************************************************\
@@ -129,18 +134,35 @@ class Atari
 		\*********************************************************************/
 		bool _isSymbolTable(const std::vector<uint8_t> &data);
 
+	public:
 		/*********************************************************************\
-		|* Constructor
+		|* Constructor. Each Atari owns the callbacks on its simulator, so
+		|* any number of machines can run at once, one per thread
 		\*********************************************************************/
-		Atari(Simulator* sim, IO* io, bool loadLabels);
+		Atari(Simulator* sim,
+			  IO* io,
+			  bool loadLabels = true,
+			  bool headless = false);
+
+		/*********************************************************************\
+		|* Destructor
+		\*********************************************************************/
+		~Atari(void);
 
-	public:
 		/*********************************************************************\
-		|* Accessor. You have to supply the parameters on the first call
+		|* Accessor for the UI's shared machine. You have to supply the
+		|* parameters on the first call. A headless instance has no worker
+		|* thread, and is driven directly via load() and Simulator::call()
 		\*********************************************************************/
 		static Atari * instance(Simulator* sim = nullptr,
 								IO* io = nullptr,
-								bool loadLabels = true);
+								bool loadLabels = true,
+								bool headless = false);
+
+		/*********************************************************************\
+		|* Reset the machine to its power-on state
+		\*********************************************************************/
+		void reset(void);
 
 
 		/*********************************************************************\
@@ -148,6 +170,13 @@ class Atari
 		\*********************************************************************/
 		Simulator::ErrorCode load(const String& filename);
 
+		/*********************************************************************\
+		|* Save the whole machine to a state file, or start again from one.
+		|* Both return 0 on success, as the profile files do
+		\*********************************************************************/
+		int saveState(const String& path);
+		int restoreState(const String& path);
+
 		/*********************************************************************\
 		|* Callbacks: Handle CIO
 		\*********************************************************************/
@@ -205,9 +234,9 @@ class Atari
 		Simulator::ErrorCode screenLocateCB(A8_CB_ARGS);
 
 		/*********************************************************************\
-		|* Callback:  Real-time clock
+		|* Event:  vertical blank
 		\*********************************************************************/
-		Simulator::ErrorCode rtcCB(A8_CB_ARGS);
+		Simulator::ErrorCode vbiEvent(uint64_t cycle);
 
 		/*********************************************************************\
 		|* Callback:  keyboard scan
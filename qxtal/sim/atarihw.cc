@@ -47,11 +47,12 @@ static Simulator::ErrorCode _gtia(Simulator *sim,
 
 
 /*****************************************************************************\
-|* Helper function
+|* Helper function. State is per-thread, so machines on different threads
+|* don't race on it
 \*****************************************************************************/
 static int rand32(void)
 	{
-	static uint32_t a, b, c, d, seed = 0;
+	static thread_local uint32_t a, b, c, d, seed = 0;
 
 	if (!seed)
 		a = 0xf1ea5eed, b = c = d = seed = 123;
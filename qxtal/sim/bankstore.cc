@@ -0,0 +1,169 @@
+#include <cstring>
+
+#include "bankstore.h"
+
+/*****************************************************************************\
+|* The expansion board: $1C/$1D pick the 8K bank at $6000 along with the 16
+|* bytes at $B0, $1E/$1F pick the 8K bank at $8000, and $80..$83 each pick
+|* what is in 16 bytes of zero page from $C0 up
+\*****************************************************************************/
+const BankStore::Window BankStore::windows[NUM_WINDOWS] =
+	{
+	{0x6000, 0x2000, 0x1C, 2},
+	{0x00B0, 0x0010, 0x1C, 2},
+	{0x8000, 0x2000, 0x1E, 2},
+	{0x00C0, 0x0010, 0x80, 1},
+	{0x00D0, 0x0010, 0x81, 1},
+	{0x00E0, 0x0010, 0x82, 1},
+	{0x00F0, 0x0010, 0x83, 1},
+	};
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+BankStore::BankStore(void)
+	{
+	clear();
+	}
+
+/*****************************************************************************\
+|* Forget every bank
+\*****************************************************************************/
+void BankStore::clear(void)
+	{
+	_banks.clear();
+	for (int i=0; i<NUM_WINDOWS; i++)
+		_mapped[i] = 0;
+	}
+
+/*****************************************************************************\
+|* Read a window's bank register
+\*****************************************************************************/
+uint32_t BankStore::selected(int window, const uint8_t *mem)
+	{
+	const Window& w	= windows[window];
+	uint32_t bank	= mem[w.selector];
+	if (w.width > 1)
+		bank |= mem[w.selector + 1] << 8;
+	return bank;
+	}
+
+/*****************************************************************************\
+|* See if a range of memory overlaps a bank register
+\*****************************************************************************/
+bool BankStore::hasSelector(uint32_t address, uint32_t length)
+	{
+	uint32_t end = address + length;
+	for (int i=0; i<NUM_WINDOWS; i++)
+		{
+		const Window& w = windows[i];
+		if ((address < (uint32_t)w.selector + w.width) && (end > w.selector))
+			return true;
+		}
+	return false;
+	}
+
+/*****************************************************************************\
+|* Swap the bank in a window for another
+\*****************************************************************************/
+void BankStore::map(int window,
+					uint32_t bank,
+					uint8_t *mem,
+					uint8_t *memState,
+					uint8_t keep,
+					uint8_t fresh)
+	{
+	if (bank == _mapped[window])
+		return;
+
+	const Window& w	= windows[window];
+	uint8_t *m		= mem + w.base;
+	uint8_t *s		= memState + w.base;
+
+	/*************************************************************************\
+	|* Store what's there now
+	\*************************************************************************/
+	Bank& out = _banks[((uint64_t)window << 32) | _mapped[window]];
+	out.mem.assign(m, m + w.size);
+	out.state.resize(w.size);
+	for (int i=0; i<w.size; i++)
+		out.state[i] = s[i] & ~keep;
+
+	/*************************************************************************\
+	|* And bring in the new bank, which no longer needs to be stored
+	\*************************************************************************/
+	auto it = _banks.find(((uint64_t)window << 32) | bank);
+	if (it == _banks.end())
+		{
+		memset(m, 0, w.size);
+		for (int i=0; i<w.size; i++)
+			s[i] = (s[i] & keep) | (fresh & ~keep);
+		}
+	else
+		{
+		memcpy(m, it->second.mem.data(), w.size);
+		for (int i=0; i<w.size; i++)
+			s[i] = (s[i] & keep) | (it->second.state[i] & ~keep);
+		_banks.erase(it);
+		}
+
+	_mapped[window] = bank;
+	}
+
+/*****************************************************************************\
+|* Write the mapping and the stored banks
+\*****************************************************************************/
+bool BankStore::write(FILE *fp) const
+	{
+	int e			= 0;
+	uint32_t count	= (uint32_t) _banks.size();
+
+	e |= fwrite(_mapped, sizeof(_mapped[0]), NUM_WINDOWS, fp) < NUM_WINDOWS;
+	e |= fwrite(&count, sizeof(count), 1, fp) < 1;
+	for (const auto& kv : _banks)
+		{
+		size_t size = kv.second.mem.size();
+		e |= fwrite(&kv.first, sizeof(kv.first), 1, fp) < 1;
+		e |= fwrite(kv.second.mem.data(), 1, size, fp) < size;
+		e |= fwrite(kv.second.state.data(), 1, size, fp) < size;
+		}
+
+	return e == 0;
+	}
+
+/*****************************************************************************\
+|* Read the mapping and the stored banks
+\*****************************************************************************/
+bool BankStore::read(FILE *fp)
+	{
+	int e			= 0;
+	uint32_t count	= 0;
+	uint32_t mapped[NUM_WINDOWS];
+	std::unordered_map<uint64_t, Bank> banks;
+
+	e |= fread(mapped, sizeof(mapped[0]), NUM_WINDOWS, fp) < NUM_WINDOWS;
+	e |= fread(&count, sizeof(count), 1, fp) < 1;
+	for (uint32_t i=0; i<count && !e; i++)
+		{
+		uint64_t key = 0;
+		e |= fread(&key, sizeof(key), 1, fp) < 1;
+
+		uint64_t window = key >> 32;
+		if (e || (window >= NUM_WINDOWS))
+			return false;
+
+		size_t size	= windows[window].size;
+		Bank& bank	= banks[key];
+		bank.mem.resize(size);
+		bank.state.resize(size);
+		e |= fread(bank.mem.data(), 1, size, fp) < size;
+		e |= fread(bank.state.data(), 1, size, fp) < size;
+		}
+
+	if (e)
+		return false;
+
+	memcpy(_mapped, mapped, sizeof(_mapped));
+	_banks.swap(banks);
+	return true;
+	}
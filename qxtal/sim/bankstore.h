@@ -0,0 +1,106 @@
+#ifndef BANKSTORE_H
+#define BANKSTORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <unordered_map>
+#include <vector>
+
+#include "properties.h"
+
+/*****************************************************************************\
+|* Banked memory for the expansion board. Each window is a range of the
+|* address space whose contents are chosen by a bank register elsewhere in
+|* memory. The bank that is mapped in lives in the simulator's own RAM, so
+|* reads and writes cost nothing extra; the others are kept here, and are
+|* only allocated once they have been mapped in and out again
+\*****************************************************************************/
+class BankStore
+	{
+	public:
+		/*********************************************************************\
+		|* A banked window
+		\*********************************************************************/
+		typedef struct
+			{
+			uint16_t base;				// First address in the window
+			uint16_t size;				// Bytes in the window
+			uint16_t selector;			// Address of the bank register
+			uint8_t width;				// Bytes in the bank register (LE)
+			} Window;
+
+		static const int NUM_WINDOWS = 7;
+		static const Window windows[NUM_WINDOWS];
+
+	private:
+		/*********************************************************************\
+		|* A bank that isn't mapped in
+		\*********************************************************************/
+		typedef struct
+			{
+			std::vector<uint8_t> mem;	// Contents
+			std::vector<uint8_t> state;	// Memory state flags
+			} Bank;
+
+		uint32_t _mapped[NUM_WINDOWS];				// Bank in each window
+		std::unordered_map<uint64_t, Bank> _banks;	// By (window, bank)
+
+	public:
+		/*********************************************************************\
+		|* Constructor
+		\*********************************************************************/
+		BankStore(void);
+
+		/*********************************************************************\
+		|* Forget every bank, and map bank 0 into each window
+		\*********************************************************************/
+		void clear(void);
+
+		/*********************************************************************\
+		|* Number of banks stored away
+		\*********************************************************************/
+		inline size_t size(void) const
+			{
+			return _banks.size();
+			}
+
+		/*********************************************************************\
+		|* The bank mapped into a window
+		\*********************************************************************/
+		inline uint32_t mapped(int window) const
+			{
+			return _mapped[window];
+			}
+
+		/*********************************************************************\
+		|* The bank a window's register asks for
+		\*********************************************************************/
+		static uint32_t selected(int window, const uint8_t *mem);
+
+		/*********************************************************************\
+		|* Whether a range of memory holds any of the bank registers
+		\*********************************************************************/
+		static bool hasSelector(uint32_t address, uint32_t length);
+
+		/*********************************************************************\
+		|* Map a bank into a window, storing the one that was there. State
+		|* bits in 'keep' belong to the address rather than the bank, and
+		|* stay as they are. A bank that has never been seen before is zero,
+		|* with state 'fresh'
+		\*********************************************************************/
+		void map(int window,
+				 uint32_t bank,
+				 uint8_t *mem,
+				 uint8_t *memState,
+				 uint8_t keep,
+				 uint8_t fresh);
+
+		/*********************************************************************\
+		|* Write to, or read from, a machine state file. Returns false on
+		|* error, in which case a read leaves things as they were
+		\*********************************************************************/
+		bool write(FILE *fp) const;
+		bool read(FILE *fp);
+	};
+
+#endif // BANKSTORE_H
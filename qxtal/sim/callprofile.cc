@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cinttypes>
+
+#include "callprofile.h"
+
+/*****************************************************************************\
+|* The root of the call tree isn't a function
+\*****************************************************************************/
+#define ROOT_FUNC		0x10000
+#define ROOT_SP			0x100
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+CallProfile::CallProfile(void)
+	{
+	clear();
+	}
+
+/*****************************************************************************\
+|* Forget everything, leaving just the root
+\*****************************************************************************/
+void CallProfile::clear(void)
+	{
+	_nodes.clear();
+	_frames.clear();
+	_children.clear();
+
+	_nodes.push_back({ROOT_FUNC, 0, 0, 1});
+	_frames.push_back({0, ROOT_SP});
+	}
+
+/*****************************************************************************\
+|* Enter a function, finding (or making) the node for this path to it
+\*****************************************************************************/
+void CallProfile::call(uint16_t address, uint8_t s)
+	{
+	uint32_t parent	= current();
+	uint64_t key	= ((uint64_t)parent << 16) | address;
+
+	uint32_t node;
+	auto it = _children.find(key);
+	if (it != _children.end())
+		node = it->second;
+	else
+		{
+		node = (uint32_t)_nodes.size();
+		_nodes.push_back({address, parent, 0, 0});
+		_children[key] = node;
+		}
+
+	_nodes[node].calls ++;
+	_frames.push_back({node, s});
+	}
+
+/*****************************************************************************\
+|* Return from a function. Every frame the stack pointer has moved back past
+|* is finished, whether or not it was returned from directly
+\*****************************************************************************/
+void CallProfile::ret(uint8_t s)
+	{
+	while ((_frames.size() > 1) && (_frames.back().s <= s))
+		_frames.pop_back();
+	}
+
+/*****************************************************************************\
+|* Work out the per-function totals. A recursive function's inclusive time
+|* is only counted at its outermost call
+\*****************************************************************************/
+std::vector<CallProfile::FunctionStats> CallProfile::functions(void)
+	{
+	size_t count = _nodes.size();
+	std::vector<uint64_t> inclusive(count);
+	for (size_t i=0; i<count; i++)
+		inclusive[i] = _nodes[i].self;
+	for (size_t i=count-1; i>0; i--)
+		inclusive[_nodes[i].parent] += inclusive[i];
+
+	std::map<uint32_t, FunctionStats> byFunc;
+	for (size_t i=1; i<count; i++)
+		{
+		const Node& node	= _nodes[i];
+		FunctionStats& fs	= byFunc[node.func];
+		fs.address			= (uint16_t)node.func;
+		fs.calls		   += node.calls;
+		fs.exclusive	   += node.self;
+
+		bool outermost = true;
+		for (uint32_t up = node.parent; up != 0; up = _nodes[up].parent)
+			if (_nodes[up].func == node.func)
+				{
+				outermost = false;
+				break;
+				}
+		if (outermost)
+			fs.inclusive += inclusive[i];
+		}
+
+	std::vector<FunctionStats> stats;
+	for (auto& kv : byFunc)
+		stats.push_back(kv.second);
+
+	std::sort(stats.begin(), stats.end(),
+		[](const FunctionStats& a, const FunctionStats& b) -> bool
+			{
+			return a.inclusive > b.inclusive;
+			});
+	return stats;
+	}
+
+/*****************************************************************************\
+|* Write the folded stacks, one line per path with cycles of its own
+\*****************************************************************************/
+bool CallProfile::writeFolded(FILE *fp, const LabelMap& labels)
+	{
+	bool ok = true;
+	for (uint32_t i=0; i<_nodes.size() && ok; i++)
+		if (_nodes[i].self > 0)
+			ok = fprintf(fp, "%s %" PRIu64 "\n",
+						 _path(i, labels).c_str(),
+						 _nodes[i].self) > 0;
+	return ok;
+	}
+
+/*****************************************************************************\
+|* Write the per-function table
+\*****************************************************************************/
+bool CallProfile::writeSummary(FILE *fp, const LabelMap& labels)
+	{
+	uint64_t total = 0;
+	for (const Node& node : _nodes)
+		total += node.self;
+	if (total == 0)
+		total = 1;
+
+	bool ok = fprintf(fp, "%10s %12s %6s %12s %6s  %s\n",
+					  "calls", "inclusive", "%", "exclusive", "%",
+					  "function") > 0;
+
+	for (const FunctionStats& fs : functions())
+		{
+		if (!ok)
+			break;
+		ok = fprintf(fp, "%10" PRIu64 " %12" PRIu64 " %6.2f "
+						 "%12" PRIu64 " %6.2f  %s\n",
+					 fs.calls,
+					 fs.inclusive, (100.0 * fs.inclusive) / total,
+					 fs.exclusive, (100.0 * fs.exclusive) / total,
+					 _name(fs.address, labels).c_str()) > 0;
+		}
+	return ok;
+	}
+
+#pragma mark -- Private Methods
+
+/*****************************************************************************\
+|* Name a function by its label, or its address if it doesn't have one
+\*****************************************************************************/
+String CallProfile::_name(uint32_t func, const LabelMap& labels)
+	{
+	if (func == ROOT_FUNC)
+		return "(top)";
+
+	auto it = labels.find(func);
+	if (it != labels.end())
+		return it->second;
+
+	char buf[8];
+	snprintf(buf, sizeof(buf), "$%04X", func);
+	return buf;
+	}
+
+/*****************************************************************************\
+|* The names of the functions from the root down to a node. The root only
+|* appears for cycles spent outside any function
+\*****************************************************************************/
+String CallProfile::_path(uint32_t node, const LabelMap& labels)
+	{
+	if (node == 0)
+		return _name(ROOT_FUNC, labels);
+
+	String path = _name(_nodes[node].func, labels);
+	for (uint32_t up = _nodes[node].parent; up != 0; up = _nodes[up].parent)
+		path = _name(_nodes[up].func, labels) + ";" + path;
+	return path;
+	}
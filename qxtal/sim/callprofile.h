@@ -0,0 +1,133 @@
+#ifndef CALLPROFILE_H
+#define CALLPROFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "properties.h"
+#include "structures.h"
+
+/*****************************************************************************\
+|* Call-graph profile. JSR and RTS/RTI are followed on a shadow stack, and
+|* every instruction's cycles go to the node of the call tree that was
+|* current when it started, so a JSR is charged to the caller and an RTS to
+|* the callee.
+|*
+|* Code that unwinds the stack itself (PLA/PLA, or a nested call() from a
+|* callback that never returns normally) is handled by popping every frame
+|* whose caller's stack pointer is at or below the one an RTS leaves behind
+\*****************************************************************************/
+class CallProfile
+	{
+	NON_COPYABLE_NOR_MOVEABLE(CallProfile)
+
+	public:
+		/*********************************************************************\
+		|* Labels, as kept by the simulator
+		\*********************************************************************/
+		typedef std::map<uint32_t, String> LabelMap;
+
+		/*********************************************************************\
+		|* Totals for one function, over every path that reached it
+		\*********************************************************************/
+		typedef struct
+			{
+			uint16_t address;			// Entry point
+			uint64_t calls;				// Times called
+			uint64_t inclusive;			// Cycles including callees
+			uint64_t exclusive;			// Cycles in the function itself
+			} FunctionStats;
+
+	private:
+		/*********************************************************************\
+		|* A node of the call tree: a function reached by one particular path
+		\*********************************************************************/
+		typedef struct
+			{
+			uint32_t func;				// Entry point, or ROOT_FUNC
+			uint32_t parent;			// Index of parent node
+			uint64_t self;				// Cycles spent here
+			uint64_t calls;				// Times entered by this path
+			} Node;
+
+		/*********************************************************************\
+		|* A shadow stack frame
+		\*********************************************************************/
+		typedef struct
+			{
+			uint32_t node;				// Node we're running in
+			int s;						// Caller's SP, before the JSR
+			} Frame;
+
+		std::vector<Node>		_nodes;		// The call tree, root first
+		std::vector<Frame>		_frames;	// Shadow stack
+		std::unordered_map<uint64_t, uint32_t> _children;	// (parent,func)
+
+		/*********************************************************************\
+		|* Return a function's name
+		\*********************************************************************/
+		static String _name(uint32_t func, const LabelMap& labels);
+
+		/*********************************************************************\
+		|* Return the path to a node as "f1;f2;f3"
+		\*********************************************************************/
+		String _path(uint32_t node, const LabelMap& labels);
+
+	public:
+		/*********************************************************************\
+		|* Constructor
+		\*********************************************************************/
+		CallProfile(void);
+
+		/*********************************************************************\
+		|* Forget everything
+		\*********************************************************************/
+		void clear(void);
+
+		/*********************************************************************\
+		|* The node that is current now, to charge an instruction to
+		\*********************************************************************/
+		inline uint32_t current(void) const
+			{
+			return _frames.back().node;
+			}
+
+		/*********************************************************************\
+		|* Charge cycles to a node
+		\*********************************************************************/
+		inline void addCycles(uint32_t node, uint64_t cycles)
+			{
+			_nodes[node].self += cycles;
+			}
+
+		/*********************************************************************\
+		|* A JSR to 'address', made with the stack pointer at 's'
+		\*********************************************************************/
+		void call(uint16_t address, uint8_t s);
+
+		/*********************************************************************\
+		|* An RTS or RTI, which left the stack pointer at 's'
+		\*********************************************************************/
+		void ret(uint8_t s);
+
+		/*********************************************************************\
+		|* Per-function totals, most expensive (inclusive) first
+		\*********************************************************************/
+		std::vector<FunctionStats> functions(void);
+
+		/*********************************************************************\
+		|* Write folded stacks ("main;draw;mul16 1234" lines), as used by
+		|* flamegraph.pl and speedscope. Returns false on error
+		\*********************************************************************/
+		bool writeFolded(FILE *fp, const LabelMap& labels);
+
+		/*********************************************************************\
+		|* Write a table of per-function totals. Returns false on error
+		\*********************************************************************/
+		bool writeSummary(FILE *fp, const LabelMap& labels);
+	};
+
+#endif // CALLPROFILE_H
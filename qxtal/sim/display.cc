@@ -83,6 +83,46 @@ void Display::drawTo(int x, int y, uint8_t colour)
 	}
 
 
+/*****************************************************************************\
+|* Write the cursor, the size, and the colour index of every pixel
+\*****************************************************************************/
+bool Display::write(FILE *fp)
+	{
+	int e			= 0;
+	int32_t geom[4]	= {_x, _y, _w, _h};
+
+	e |= fwrite(geom, sizeof(geom[0]), 4, fp) < 4;
+	for (int y=0; y<_h && !_display.isNull(); y++)
+		e |= fwrite(_display.constScanLine(y), 1, _w, fp) < (size_t)_w;
+
+	return e == 0;
+	}
+
+/*****************************************************************************\
+|* Read the screen back, remaking it if the size has changed
+\*****************************************************************************/
+bool Display::read(FILE *fp)
+	{
+	int32_t geom[4];
+	if (fread(geom, sizeof(geom[0]), 4, fp) < 4)
+		return false;
+
+	if ((geom[2] != _w) || (geom[3] != _h) || _display.isNull())
+		{
+		_w = geom[2];
+		_h = geom[3];
+		init();
+		}
+
+	int e = 0;
+	for (int y=0; y<_h; y++)
+		e |= fread(_display.scanLine(y), 1, _w, fp) < (size_t)_w;
+
+	_x = geom[0];
+	_y = geom[1];
+	return e == 0;
+	}
+
 
 #pragma mark -- Private methods
 
@@ -71,6 +71,13 @@ class Display : public QObject
 		\*********************************************************************/
 		virtual bool inBounds(int x, int y);
 
+		/*********************************************************************\
+		|* Write the screen to, or read it from, a machine state file.
+		|* Returns false on error
+		\*********************************************************************/
+		virtual bool write(FILE *fp);
+		virtual bool read(FILE *fp);
+
 	signals:
 
 	};
@@ -0,0 +1,493 @@
+#include <cstring>
+
+#include "fastmacros.h"
+
+/*****************************************************************************\
+|* Opcodes, zero-page forms. The absolute form of each is 8 more
+\*****************************************************************************/
+#define OP_ASL		0x06
+#define OP_ROL		0x26
+#define OP_LSR		0x46
+#define OP_ROR		0x66
+#define OP_INC		0xE6
+#define OP_LDA		0xA5
+#define OP_STA		0x85
+#define OP_ADC		0x65
+#define OP_SBC		0xE5
+
+#define OP_CLC		0x18
+#define OP_SEC		0x38
+#define OP_DEX		0xCA
+#define OP_DEY		0x88
+#define OP_LDX_IMM	0xA2
+#define OP_LDY_IMM	0xA0
+#define OP_BCC		0x90
+#define OP_BCS		0xB0
+#define OP_BNE		0xD0
+#define OP_BPL		0x10
+
+/*****************************************************************************\
+|* Labels in the shapes. ANY is for a branch that's never taken
+\*****************************************************************************/
+#define L_LOOP		0
+#define L_SKIP		1
+#define L_NEXT		2
+#define NUM_LABELS	3
+#define ANY			0xFF
+
+#pragma mark -- Shapes
+
+/*****************************************************************************\
+|* _mulXXu: X = n; do { a >>= 1; if (C) r += b; b <<= 1; } while (--X)
+\*****************************************************************************/
+FastMacros::Shape FastMacros::_mulShape(int width, bool bpl)
+	{
+	Shape s;
+	s.push_back({ST_IMM, OP_LDX_IMM, 0, 0, SEG_INIT});
+	s.push_back({ST_LABEL, 0, L_LOOP, 0, 0});
+
+	s.push_back({ST_MEM, OP_LSR, OP_A, (uint8_t)(width-1), SEG_SHIFT});
+	for (int i=width-2; i>=0; i--)
+		s.push_back({ST_MEM, OP_ROR, OP_A, (uint8_t)i, SEG_SHIFT});
+	s.push_back({ST_BRANCH, OP_BCC, BR_SKIP, L_SKIP, 0});
+
+	s.push_back({ST_IMPLIED, OP_CLC, 0, 0, SEG_ADD});
+	for (int i=0; i<width; i++)
+		{
+		s.push_back({ST_MEM, OP_LDA, OP_B, (uint8_t)i, SEG_ADD});
+		s.push_back({ST_MEM, OP_ADC, OP_R, (uint8_t)i, SEG_ADD});
+		s.push_back({ST_MEM, OP_STA, OP_R, (uint8_t)i, SEG_ADD});
+		}
+
+	s.push_back({ST_LABEL, 0, L_SKIP, 0, 0});
+	s.push_back({ST_MEM, OP_ASL, OP_B, 0, SEG_NEXT});
+	for (int i=1; i<width; i++)
+		s.push_back({ST_MEM, OP_ROL, OP_B, (uint8_t)i, SEG_NEXT});
+	s.push_back({ST_IMPLIED, OP_DEX, 0, 0, SEG_NEXT});
+	s.push_back({ST_BRANCH, (uint8_t)(bpl ? OP_BPL : OP_BNE),
+				 BR_LOOP, L_LOOP, 0});
+	return s;
+	}
+
+/*****************************************************************************\
+|* _divXXu: Y = n; do { r:a <<= 1; r -= b; if (C) a++; else r += b; }
+|* while (--Y)
+\*****************************************************************************/
+FastMacros::Shape FastMacros::_divShape(int width)
+	{
+	Shape s;
+	s.push_back({ST_IMM, OP_LDY_IMM, 0, 0, SEG_INIT});
+	s.push_back({ST_LABEL, 0, L_LOOP, 0, 0});
+
+	s.push_back({ST_MEM, OP_ASL, OP_A, 0, SEG_SHIFT});
+	for (int i=1; i<width; i++)
+		s.push_back({ST_MEM, OP_ROL, OP_A, (uint8_t)i, SEG_SHIFT});
+	for (int i=0; i<width; i++)
+		s.push_back({ST_MEM, OP_ROL, OP_R, (uint8_t)i, SEG_SHIFT});
+
+	s.push_back({ST_IMPLIED, OP_SEC, 0, 0, SEG_SHIFT});
+	for (int i=0; i<width; i++)
+		{
+		s.push_back({ST_MEM, OP_LDA, OP_R, (uint8_t)i, SEG_SHIFT});
+		s.push_back({ST_MEM, OP_SBC, OP_B, (uint8_t)i, SEG_SHIFT});
+		s.push_back({ST_MEM, OP_STA, OP_R, (uint8_t)i, SEG_SHIFT});
+		}
+	s.push_back({ST_BRANCH, OP_BCS, BR_SKIP, L_SKIP, 0});
+
+	s.push_back({ST_IMPLIED, OP_CLC, 0, 0, SEG_ADD});
+	for (int i=0; i<width; i++)
+		{
+		s.push_back({ST_MEM, OP_LDA, OP_R, (uint8_t)i, SEG_ADD});
+		s.push_back({ST_MEM, OP_ADC, OP_B, (uint8_t)i, SEG_ADD});
+		s.push_back({ST_MEM, OP_STA, OP_R, (uint8_t)i, SEG_ADD});
+		}
+	s.push_back({ST_IMPLIED, OP_CLC, 0, 0, SEG_ADD});
+	s.push_back({ST_BRANCH, OP_BCC, BR_BACK, L_NEXT, 0});
+
+	s.push_back({ST_LABEL, 0, L_SKIP, 0, 0});
+	s.push_back({ST_MEM, OP_INC, OP_A, 0, SEG_INC});
+	s.push_back({ST_BRANCH, OP_BCS, BR_INC, L_NEXT, 0});
+	s.push_back({ST_BRANCH, OP_BCS, ANY, ANY, 0});
+
+	s.push_back({ST_LABEL, 0, L_NEXT, 0, 0});
+	s.push_back({ST_IMPLIED, OP_DEY, 0, 0, SEG_NEXT});
+	s.push_back({ST_BRANCH, OP_BNE, BR_LOOP, L_LOOP, 0});
+	return s;
+	}
+
+/*****************************************************************************\
+|* Every shape we look for
+\*****************************************************************************/
+const std::vector<FastMacros::Shape>& FastMacros::_shapes(void)
+	{
+	static std::vector<Shape> shapes;
+	if (shapes.empty())
+		{
+		const int widths[] = {1, 2, 4};
+		for (int w : widths)
+			{
+			shapes.push_back(_mulShape(w, false));
+			shapes.push_back(_mulShape(w, true));
+			shapes.push_back(_divShape(w));
+			}
+		}
+	return shapes;
+	}
+
+#pragma mark -- Finding loops
+
+/*****************************************************************************\
+|* See if a shape is at an address
+\*****************************************************************************/
+bool FastMacros::_match(const Shape& shape,
+						const uint8_t *mem,
+						uint32_t address,
+						uint32_t limit,
+						Loop& loop)
+	{
+	int32_t base[NUM_OPERANDS]		= {-1, -1, -1};
+	uint32_t labels[NUM_LABELS]		= {0, 0, 0};
+	uint32_t branchAt[NUM_BRANCHES+1];
+	uint32_t target[NUM_BRANCHES+1];
+	uint8_t  label[NUM_BRANCHES+1];
+	int index[NUM_BRANCHES]			= {-1, -1, -1, -1};
+	int branches					= 0;
+	uint32_t pc						= address;
+
+	memset(loop.cost, 0, sizeof(loop.cost));
+	memset(loop.taken, 0, sizeof(loop.taken));
+	for (const Step& s : shape)
+		{
+		if (s.type == ST_LABEL)
+			{
+			labels[s.arg] = pc;
+			continue;
+			}
+
+		if ((pc + 1 >= limit) || (mem[pc] != s.op && s.type != ST_MEM))
+			return false;
+
+		switch (s.type)
+			{
+			case ST_IMM:
+				loop.count		 = mem[pc+1];
+				loop.cost[s.seg]+= 2;
+				pc				+= 2;
+				break;
+
+			case ST_IMPLIED:
+				loop.cost[s.seg]+= 2;
+				pc				+= 1;
+				break;
+
+			case ST_BRANCH:
+				branchAt[branches]	= pc + 2;
+				target[branches]	= pc + 2 + (int8_t)mem[pc+1];
+				label[branches]		= s.offset;
+				if (s.arg != ANY)
+					index[s.arg] = branches;
+				branches ++;
+				pc += 2;
+				break;
+
+			case ST_MEM:
+				{
+				bool rmw		= (s.op & 0x1F) == 0x06;
+				uint32_t where	= 0;
+				int cycles		= 0;
+				if (mem[pc] == s.op)
+					{
+					where	= mem[pc+1];
+					cycles	= rmw ? 5 : 3;
+					pc	   += 2;
+					}
+				else if ((mem[pc] == s.op + 8) && (pc + 2 < limit))
+					{
+					where	= mem[pc+1] | (mem[pc+2] << 8);
+					cycles	= rmw ? 6 : 4;
+					pc	   += 3;
+					}
+				else
+					return false;
+
+				int32_t at = (int32_t)where - s.offset;
+				if ((at < 0) || ((base[s.arg] >= 0) && (base[s.arg] != at)))
+					return false;
+				base[s.arg]		 = at;
+				loop.cost[s.seg]+= cycles;
+				break;
+				}
+			}
+		}
+
+	/*************************************************************************\
+	|* Branches have to go where the shape says, and then we know how long
+	|* they take
+	\*************************************************************************/
+	for (int i=0; i<branches; i++)
+		if ((label[i] != ANY) && (target[i] != labels[label[i]]))
+			return false;
+	for (int i=0; i<NUM_BRANCHES; i++)
+		{
+		int b			= index[i];
+		if (b < 0)
+			continue;
+		bool cross		= (target[b] & 0xFF00) != (branchAt[b] & 0xFF00);
+		loop.taken[i]	= cross ? 4 : 3;
+		}
+
+	/*************************************************************************\
+	|* The operands can't overlap each other or the code, or working on
+	|* them one at a time would give a different answer
+	\*************************************************************************/
+	int width = loop.width;
+	for (int i=0; i<NUM_OPERANDS; i++)
+		{
+		if ((base[i] < 0) || (base[i] + width > 0x10000))
+			return false;
+		if (((uint32_t)base[i] < pc) && ((uint32_t)base[i] + width > address))
+			return false;
+		for (int j=i+1; j<NUM_OPERANDS; j++)
+			if ((base[i] < base[j] + width) && (base[j] < base[i] + width))
+				return false;
+		}
+
+	loop.a		= (uint16_t) base[OP_A];
+	loop.b		= (uint16_t) base[OP_B];
+	loop.r		= (uint16_t) base[OP_R];
+	loop.end	= (uint16_t) pc;
+	loop.length	= (uint8_t)(pc - address);
+	memcpy(loop.code, mem + address, loop.length);
+	return true;
+	}
+
+/*****************************************************************************\
+|* Look for loops in memory
+\*****************************************************************************/
+std::vector<uint16_t> FastMacros::scan(const uint8_t *mem,
+									   uint32_t size,
+									   uint32_t start,
+									   uint32_t end)
+	{
+	std::vector<uint16_t> found;
+	if (size > 0x10000)
+		size = 0x10000;
+	if (end > size)
+		end = size;
+
+	for (uint32_t pc=start; pc<end; pc++)
+		{
+		if ((mem[pc] != OP_LDX_IMM) && (mem[pc] != OP_LDY_IMM))
+			continue;
+
+		const std::vector<Shape>& shapes = _shapes();
+		for (size_t i=0; i<shapes.size(); i++)
+			{
+			const Shape& shape = shapes[i];
+			if (shape[0].op != mem[pc])
+				continue;
+
+			/*****************************************************************\
+			|* Shapes are stored as (mul, mul with BPL, div) for each width
+			\*****************************************************************/
+			Loop loop;
+			loop.kind	= (i % 3 == 2) ? FM_DIV : FM_MUL;
+			loop.bpl	= (i % 3 == 1);
+			loop.width	= 1 << (i / 3);
+			if (_match(shape, mem, pc, size, loop))
+				{
+				if (_loops.find(pc) == _loops.end())
+					found.push_back((uint16_t)pc);
+				_loops[(uint16_t)pc] = loop;
+				break;
+				}
+			}
+		}
+	return found;
+	}
+
+/*****************************************************************************\
+|* Forget the loops in a range of memory
+\*****************************************************************************/
+std::vector<uint16_t> FastMacros::forget(uint32_t start, uint32_t end)
+	{
+	std::vector<uint16_t> gone;
+	for (auto it = _loops.begin(); it != _loops.end(); )
+		{
+		uint32_t from = it->first;
+		if ((from < end) && (from + it->second.length > start))
+			{
+			gone.push_back(it->first);
+			it = _loops.erase(it);
+			}
+		else
+			it ++;
+		}
+	return gone;
+	}
+
+/*****************************************************************************\
+|* The loop starting at an address
+\*****************************************************************************/
+const FastMacros::Loop * FastMacros::find(uint16_t address) const
+	{
+	auto it = _loops.find(address);
+	return (it == _loops.end()) ? nullptr : &(it->second);
+	}
+
+/*****************************************************************************\
+|* Whether a loop's code is still in memory
+\*****************************************************************************/
+bool FastMacros::present(const Loop& loop, const uint8_t *mem)
+	{
+	uint16_t address = (uint16_t)(loop.end - loop.length);
+	return memcmp(mem + address, loop.code, loop.length) == 0;
+	}
+
+#pragma mark -- Running loops
+
+/*****************************************************************************\
+|* Run a loop, a step at a time as the 6502 would but without decoding, on
+|* a copy of the operands
+\*****************************************************************************/
+void FastMacros::run(const Loop& loop,
+					 const uint8_t *mem,
+					 uint8_t a,
+					 Result& res)
+	{
+	uint8_t *va			= res.va;
+	uint8_t *vb			= res.vb;
+	uint8_t *vr			= res.vr;
+	int w				= loop.width;
+	uint8_t n			= loop.count;
+	uint64_t cycles		= loop.cost[SEG_INIT];
+	bool c				= false;
+	bool v				= false;
+	bool vSet			= false;
+
+	memcpy(va, mem + loop.a, w);
+	memcpy(vb, mem + loop.b, w);
+	memcpy(vr, mem + loop.r, w);
+
+	for (;;)
+		{
+		cycles += loop.cost[SEG_SHIFT];
+		if (loop.kind == FM_MUL)
+			{
+			/*****************************************************************\
+			|* LSR/ROR a, and add b to r if a bit fell out
+			\*****************************************************************/
+			c = false;
+			for (int i=w-1; i>=0; i--)
+				{
+				bool out = va[i] & 1;
+				va[i]	 = (va[i] >> 1) | (c ? 0x80 : 0);
+				c		 = out;
+				}
+
+			if (c)
+				{
+				cycles += 2 + loop.cost[SEG_ADD];
+				c		= false;
+				for (int i=0; i<w; i++)
+					{
+					unsigned tmp = vb[i] + vr[i] + (c ? 1 : 0);
+					v			 = ((~(vb[i] ^ vr[i])) & (vb[i] ^ tmp)) & 0x80;
+					c			 = tmp > 0xFF;
+					a			 = vr[i] = tmp & 0xFF;
+					}
+				vSet = true;
+				}
+			else
+				cycles += loop.taken[BR_SKIP];
+
+			/*****************************************************************\
+			|* ASL/ROL b, DEX
+			\*****************************************************************/
+			cycles += loop.cost[SEG_NEXT];
+			c		= false;
+			for (int i=0; i<w; i++)
+				{
+				bool out = vb[i] & 0x80;
+				vb[i]	 = (vb[i] << 1) | (c ? 1 : 0);
+				c		 = out;
+				}
+			}
+		else
+			{
+			/*****************************************************************\
+			|* ASL/ROL a into r, then SEC and subtract b from r
+			\*****************************************************************/
+			c = false;
+			for (int i=0; i<w; i++)
+				{
+				bool out = va[i] & 0x80;
+				va[i]	 = (va[i] << 1) | (c ? 1 : 0);
+				c		 = out;
+				}
+			for (int i=0; i<w; i++)
+				{
+				bool out = vr[i] & 0x80;
+				vr[i]	 = (vr[i] << 1) | (c ? 1 : 0);
+				c		 = out;
+				}
+
+			c = true;
+			for (int i=0; i<w; i++)
+				{
+				unsigned tmp = vr[i] + 0xFF - vb[i] + (c ? 1 : 0);
+				v			 = ((vr[i] ^ vb[i]) & (vr[i] ^ tmp)) & 0x80;
+				c			 = tmp > 0xFF;
+				a			 = vr[i] = tmp & 0xFF;
+				}
+			vSet = true;
+
+			if (c)
+				{
+				/*************************************************************\
+				|* BCS sdv4, INC a, BCS sdv5
+				\*************************************************************/
+				cycles += loop.taken[BR_SKIP]
+						+ loop.cost[SEG_INC]
+						+ loop.taken[BR_INC];
+				va[0] ++;
+				}
+			else
+				{
+				/*************************************************************\
+				|* CLC, add b back to r, CLC, BCC sdv5
+				\*************************************************************/
+				cycles += 2 + loop.cost[SEG_ADD] + loop.taken[BR_BACK];
+				for (int i=0; i<w; i++)
+					{
+					unsigned tmp = vr[i] + vb[i] + (c ? 1 : 0);
+					v			 = ((~(vr[i] ^ vb[i])) & (vr[i] ^ tmp)) & 0x80;
+					c			 = tmp > 0xFF;
+					a			 = vr[i] = tmp & 0xFF;
+					}
+				c = false;
+				}
+
+			cycles += loop.cost[SEG_NEXT];
+			}
+
+		/*********************************************************************\
+		|* DEX/DEY, and BNE/BPL back round
+		\*********************************************************************/
+		n --;
+		bool again = loop.bpl ? ((n & 0x80) == 0) : (n != 0);
+		if (!again)
+			{
+			cycles += 2;
+			break;
+			}
+		cycles += loop.taken[BR_LOOP];
+		}
+
+	res.a		= a;
+	res.counter	= n;
+	res.c		= c;
+	res.v		= v;
+	res.vSet	= vSet;
+	res.cycles	= cycles;
+	}
@@ -0,0 +1,175 @@
+#ifndef FASTMACROS_H
+#define FASTMACROS_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/*****************************************************************************\
+|* The shift-and-add multiply and shift-and-subtract divide loops that the
+|* stdmacros.s _mul8u/_mul16u/_mul32u and _div8u/_div16u/_div32u macros (and
+|* the signed versions built on them) expand into. Loops are found by the
+|* shape of their code bytes when code is loaded, and can then be run in one
+|* go, giving the same memory, registers, flags and cycle count as running
+|* the 6502 code would
+\*****************************************************************************/
+class FastMacros
+	{
+	public:
+		/*********************************************************************\
+		|* What a loop does
+		\*********************************************************************/
+		typedef enum
+			{
+			FM_MUL = 0,					// r += b for each set bit of a
+			FM_DIV,						// a /= b, remainder in r
+			} Kind;
+
+		/*********************************************************************\
+		|* Where the cycles go, so a run can add them up per iteration
+		\*********************************************************************/
+		typedef enum
+			{
+			SEG_INIT = 0,				// LDX / LDY
+			SEG_SHIFT,					// Shifts, and the DIV subtract
+			SEG_ADD,					// The add (MUL) or add-back (DIV)
+			SEG_INC,					// DIV: set the result bit
+			SEG_NEXT,					// MUL: shift b, DEX. DIV: DEY
+			NUM_SEGS
+			} Segment;
+
+		typedef enum
+			{
+			BR_SKIP = 0,				// BCC next / BCS sdv4
+			BR_BACK,					// DIV: BCC sdv5 after the add-back
+			BR_INC,						// DIV: BCS sdv5 after the INC
+			BR_LOOP,					// BNE / BPL back to the top
+			NUM_BRANCHES
+			} Branch;
+
+		static const int MAX_CODE	= 96;
+
+		/*********************************************************************\
+		|* A loop found in memory
+		\*********************************************************************/
+		typedef struct
+			{
+			Kind kind;
+			int width;					// Bytes in each operand: 1, 2 or 4
+			uint8_t count;				// Initial X (MUL) or Y (DIV)
+			bool bpl;					// Loop closes with BPL, not BNE
+			uint16_t a, b, r;			// Operands
+			uint16_t end;				// Address after the loop
+			uint8_t cost[NUM_SEGS];		// Cycles for each segment
+			uint8_t taken[NUM_BRANCHES];// Cycles for each branch, if taken
+			uint8_t length;				// Bytes of code
+			uint8_t code[MAX_CODE];		// The code, to check it's still there
+			} Loop;
+
+		/*********************************************************************\
+		|* What running a loop does to the operands and the CPU
+		\*********************************************************************/
+		typedef struct
+			{
+			uint8_t va[4], vb[4], vr[4];// Operands afterwards
+			uint8_t a;					// Accumulator
+			uint8_t counter;			// X (MUL) or Y (DIV)
+			bool c, v;					// Carry and overflow
+			bool vSet;					// Whether V was touched
+			uint64_t cycles;			// Cycles taken
+			} Result;
+
+	private:
+		/*********************************************************************\
+		|* A step in a loop's shape
+		\*********************************************************************/
+		typedef enum
+			{
+			ST_IMM = 0,					// Opcode and any immediate byte
+			ST_IMPLIED,					// Opcode only
+			ST_MEM,						// Opcode (zero-page form) and operand
+			ST_BRANCH,					// Branch to a label
+			ST_LABEL,					// Not code: marks where a label is
+			} StepType;
+
+		typedef enum
+			{
+			OP_A = 0,
+			OP_B,
+			OP_R,
+			NUM_OPERANDS
+			} Operand;
+
+		typedef struct
+			{
+			uint8_t type;				// StepType
+			uint8_t op;					// Opcode
+			uint8_t arg;				// Operand, label, or branch index
+			uint8_t offset;				// Byte in the operand / branch label
+			uint8_t seg;				// Segment it costs cycles in
+			} Step;
+
+		typedef std::vector<Step> Shape;
+
+		/*********************************************************************\
+		|* The shapes we know, built the first time they're needed
+		\*********************************************************************/
+		static const std::vector<Shape>& _shapes(void);
+		static Shape _mulShape(int width, bool bpl);
+		static Shape _divShape(int width);
+
+		/*********************************************************************\
+		|* See if a shape is at an address, and fill in the loop if so
+		\*********************************************************************/
+		static bool _match(const Shape& shape,
+						   const uint8_t *mem,
+						   uint32_t address,
+						   uint32_t limit,
+						   Loop& loop);
+
+		std::unordered_map<uint16_t, Loop> _loops;	// By first address
+
+	public:
+		/*********************************************************************\
+		|* Forget every loop
+		\*********************************************************************/
+		inline void clear(void)
+			{
+			_loops.clear();
+			}
+
+		/*********************************************************************\
+		|* Look for loops starting between 'start' and 'end' in 'size' bytes
+		|* of memory. Returns the addresses of new ones
+		\*********************************************************************/
+		std::vector<uint16_t> scan(const uint8_t *mem,
+								   uint32_t size,
+								   uint32_t start,
+								   uint32_t end);
+
+		/*********************************************************************\
+		|* Forget the loops whose code overlaps a range of memory that's being
+		|* replaced. Returns their addresses
+		\*********************************************************************/
+		std::vector<uint16_t> forget(uint32_t start, uint32_t end);
+
+		/*********************************************************************\
+		|* The loop starting at an address, or nullptr
+		\*********************************************************************/
+		const Loop * find(uint16_t address) const;
+
+		/*********************************************************************\
+		|* Whether a loop's code is still in memory
+		\*********************************************************************/
+		static bool present(const Loop& loop, const uint8_t *mem);
+
+		/*********************************************************************\
+		|* Run a loop on the values in memory, without changing them
+		\*********************************************************************/
+		static void run(const Loop& loop,
+						const uint8_t *mem,
+						uint8_t a,
+						Result& res);
+	};
+
+#endif // FASTMACROS_H
@@ -0,0 +1,157 @@
+#include <algorithm>
+
+#include "history.h"
+#include "macros.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+History::History(int interval)
+		:_interval(MAX(interval, 1))
+		,_position(0)
+	{}
+
+/*****************************************************************************\
+|* Change the snapshot interval
+\*****************************************************************************/
+void History::setInterval(int interval)
+	{
+	clear();
+	_interval = MAX(interval, 1);
+	}
+
+/*****************************************************************************\
+|* Start recording
+\*****************************************************************************/
+void History::start(Simulator *sim)
+	{
+	clear();
+	_snapshots.resize(1);
+	sim->saveState(_snapshots[0]);
+	}
+
+/*****************************************************************************\
+|* Record an executed instruction
+\*****************************************************************************/
+void History::record(Simulator *sim, MemOpView ops)
+	{
+	if (!active())
+		return;
+
+	if (_position < _steps.size())
+		_truncate();
+
+	Step step;
+	step.regs		= sim->regs();
+	step.cycles		= sim->cycles();
+	step.firstOp	= _ops.size();
+	_steps.push_back(step);
+
+	for (const MemoryOp& op : ops)
+		if (op.isValid)
+			_ops.push_back(op);
+
+	_position ++;
+	if ((_position % _interval) == 0)
+		{
+		_snapshots.emplace_back();
+		sim->saveState(_snapshots.back());
+		}
+	}
+
+/*****************************************************************************\
+|* Move to a position in the history. If we're already between the nearest
+|* snapshot and the target, replay from here rather than from the snapshot
+\*****************************************************************************/
+bool History::seek(Simulator *sim, size_t position)
+	{
+	if (!active() || (position > _steps.size()))
+		return false;
+
+	size_t base = position / _interval;
+	size_t from = base * _interval;
+
+	if ((_position >= from) && (_position <= position))
+		from = _position;
+	else
+		sim->restoreState(_snapshots[base]);
+
+	for (size_t i = from; i < position; i++)
+		{
+		size_t last = (i + 1 < _steps.size()) ? _steps[i + 1].firstOp
+											  : _ops.size();
+		for (size_t j = _steps[i].firstOp; j < last; j++)
+			sim->replayOp(_ops[j], true);
+		}
+
+	if (position > base * _interval)
+		{
+		sim->regs()		= _steps[position - 1].regs;
+		sim->cycles()	= _steps[position - 1].cycles;
+
+		/*********************************************************************\
+		|* Events that ran at the start of the last replayed instruction are
+		|* in its op log, so they mustn't run again
+		\*********************************************************************/
+		sim->skipEvents((position > 1) ? _steps[position - 2].cycles
+									   : _snapshots[0].cycles);
+		}
+
+	_position = position;
+	return true;
+	}
+
+/*****************************************************************************\
+|* Move to the last point at or before a cycle count
+\*****************************************************************************/
+bool History::seekCycle(Simulator *sim, uint64_t cycle)
+	{
+	if (!active() || (cycle < _snapshots[0].cycles))
+		return false;
+
+	auto it = std::upper_bound(_steps.begin(), _steps.end(), cycle,
+		[](uint64_t c, const Step& step) -> bool
+			{
+			return c < step.cycles;
+			});
+
+	return seek(sim, it - _steps.begin());
+	}
+
+/*****************************************************************************\
+|* The PC at a position, ie: of the instruction about to run there
+\*****************************************************************************/
+uint16_t History::pcAt(size_t position) const
+	{
+	if (!active())
+		return 0;
+
+	position = MIN(position, _steps.size());
+	if (position == 0)
+		return _snapshots[0].regs.pc;
+	return _steps[position - 1].regs.pc;
+	}
+
+/*****************************************************************************\
+|* Forget everything
+\*****************************************************************************/
+void History::clear(void)
+	{
+	_snapshots.clear();
+	_steps.clear();
+	_ops.clear();
+	_position = 0;
+	}
+
+#pragma mark -- Private Methods
+
+/*****************************************************************************\
+|* Discard the history after the current position, when execution carries on
+|* from a point we moved back to
+\*****************************************************************************/
+void History::_truncate(void)
+	{
+	_ops.resize(_steps[_position].firstOp);
+	_steps.resize(_position);
+	_snapshots.resize(_position / _interval + 1);
+	}
@@ -0,0 +1,109 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <vector>
+
+#include "sim/memopbuffer.h"
+#include "sim/simulator.h"
+
+/*****************************************************************************\
+|* Execution history, for running backwards. A full snapshot of the machine
+|* is taken every 'interval' instructions, and the memory ops and resulting
+|* registers of every instruction are logged. Moving to an earlier point
+|* restores the nearest snapshot at or before it and replays the log from
+|* there, so nothing is re-executed.
+|*
+|* A shorter interval costs more memory (each snapshot is two copies of RAM)
+|* but means less to replay on each move
+\*****************************************************************************/
+class History
+	{
+	NON_COPYABLE_NOR_MOVEABLE(History)
+
+	/*************************************************************************\
+	|* One executed instruction
+	\*************************************************************************/
+	typedef struct
+		{
+		Simulator::Registers regs;		// Registers after execution
+		uint64_t cycles;				// Cycle count after execution
+		size_t firstOp;					// Index of first op in _ops
+		} Step;
+
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GET(int, interval);						// Instructions per snapshot
+	GET(size_t, position);					// Instructions executed so far
+
+	private:
+		std::vector<Simulator::Snapshot>	_snapshots;	// Every _interval steps
+		std::vector<Step>					_steps;		// Each instruction
+		std::vector<MemoryOp>				_ops;		// Op log
+
+		/*********************************************************************\
+		|* Forget everything after the current position
+		\*********************************************************************/
+		void _truncate(void);
+
+	public:
+		/*********************************************************************\
+		|* Constructor
+		\*********************************************************************/
+		explicit History(int interval = 10000);
+
+		/*********************************************************************\
+		|* Change the snapshot interval. Clears the history
+		\*********************************************************************/
+		void setInterval(int interval);
+
+		/*********************************************************************\
+		|* Start recording from the simulator's current state
+		\*********************************************************************/
+		void start(Simulator *sim);
+
+		/*********************************************************************\
+		|* Whether there is anything to move around in
+		\*********************************************************************/
+		inline bool active(void) const
+			{
+			return _snapshots.size() > 0;
+			}
+
+		/*********************************************************************\
+		|* Number of instructions recorded
+		\*********************************************************************/
+		inline size_t size(void) const
+			{
+			return _steps.size();
+			}
+
+		/*********************************************************************\
+		|* Record the instruction the simulator just executed. If we had moved
+		|* back, the history after that point is discarded first
+		\*********************************************************************/
+		void record(Simulator *sim, MemOpView ops);
+
+		/*********************************************************************\
+		|* Put the simulator in the state it was in after 'position'
+		|* instructions. Returns false if that is outside the history
+		\*********************************************************************/
+		bool seek(Simulator *sim, size_t position);
+
+		/*********************************************************************\
+		|* Move to the last instruction that started at or before 'cycle'
+		\*********************************************************************/
+		bool seekCycle(Simulator *sim, uint64_t cycle);
+
+		/*********************************************************************\
+		|* The PC of the instruction that ran at 'position'
+		\*********************************************************************/
+		uint16_t pcAt(size_t position) const;
+
+		/*********************************************************************\
+		|* Forget the history
+		\*********************************************************************/
+		void clear(void);
+	};
+
+#endif // HISTORY_H
@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include "mathpack.h"
 #include "simulator.h"
 
@@ -177,6 +179,39 @@ static unsigned char mathpack_bin[] = {
 
 static unsigned int mathpack_bin_len = 2048;
 
+/*****************************************************************************\
+|* Zero page used by the routines, and an RTS to leave through
+\*****************************************************************************/
+#define FR0			0xD4
+#define FR1			0xE0
+#define ZP_END		0x100
+#define MP_RTS		0xDA50
+
+/*****************************************************************************\
+|* More than this many trips round a loop means the input is nonsense, and
+|* the ROM can deal with it
+\*****************************************************************************/
+#define MAX_LOOPS	4096
+
+/*****************************************************************************\
+|* Native versions of the routines, run in place of the ROM
+\*****************************************************************************/
+const MathPack::Entry MathPack::_entries[] =
+	{
+	{0xD9AA, "IFP",  MathPack::_ifp},
+	{0xD9D2, "FPI",  MathPack::_fpi},
+	{0xDA60, "FSUB", MathPack::_fsub},
+	{0xDA66, "FADD", MathPack::_fadd},
+	{0xDADB, "FMUL", MathPack::_fmul},
+	{0xDB28, "FDIV", MathPack::_fdiv},
+	{0, nullptr, nullptr}
+	};
+
+/*****************************************************************************\
+|* Set when verifying, so the ROM can be run without us getting in the way
+\*****************************************************************************/
+static thread_local bool _inRom = false;
+
 /*****************************************************************************\
 |* Constructor
 \*****************************************************************************/
@@ -187,8 +222,953 @@ MathPack::MathPack(QObject *parent)
 /*****************************************************************************\
 |* Load the Altirra math-pack into the simulator at the correct position
 \*****************************************************************************/
-int MathPack::load(Simulator *sim)
+int MathPack::load(Simulator *sim, Mode mode)
 	{
 	sim->addROM(0xD800, mathpack_bin, mathpack_bin_len);
+
+	if (mode != MP_ROM)
+		for (const Entry *e = _entries; e->fn != nullptr; e++)
+			sim->addCallback((mode == MP_HLE) ? _hle : _verify,
+							 e->address,
+							 Simulator::CB_EXEC);
 	return 0;
 	}
+
+#pragma mark -- Callbacks
+
+/*****************************************************************************\
+|* Run a routine natively
+\*****************************************************************************/
+Simulator::ErrorCode MathPack::_hle(Simulator *sim,
+									Simulator::Registers *regs,
+									uint32_t address,
+									int)
+	{
+	State s;
+	if (_run(sim, regs, address, s))
+		_commit(sim, regs, s);
+	return Simulator::E_NONE;
+	}
+
+/*****************************************************************************\
+|* Run a routine natively and in the ROM, and complain if they differ. The
+|* machine is left as the ROM had it
+\*****************************************************************************/
+Simulator::ErrorCode MathPack::_verify(Simulator *sim,
+									   Simulator::Registers *regs,
+									   uint32_t address,
+									   int)
+	{
+	State s;
+	if (_inRom || !_run(sim, regs, address, s))
+		return Simulator::E_NONE;
+
+	uint8_t in[ZP_END - FR0];
+	memcpy(in, sim->mem() + FR0, sizeof(in));
+
+	_inRom = true;
+	Simulator::ErrorCode err = sim->call(address, regs);
+	_inRom = false;
+	if (err != Simulator::E_NONE)
+		return err;
+
+	const uint8_t *out	= sim->mem() + FR0;
+	bool carry			= (regs->p & Simulator::FLAG_C) != 0;
+	if (memcmp(out, s.z + FR0, sizeof(in)) != 0 || carry != s.c ||
+		regs->a != s.a || regs->x != s.x || regs->y != s.y)
+		{
+		const char *name = "?";
+		for (const Entry *e = _entries; e->fn != nullptr; e++)
+			if (e->address == address)
+				name = e->name;
+
+		sim->error("mathpack: %s differs from ROM for "
+				   "FR0=%02X%02X%02X%02X%02X%02X FR1=%02X%02X%02X%02X%02X%02X: "
+				   "ROM %02X%02X%02X%02X%02X%02X C=%d, "
+				   "native %02X%02X%02X%02X%02X%02X C=%d",
+				   name,
+				   in[0], in[1], in[2], in[3], in[4], in[5],
+				   in[12], in[13], in[14], in[15], in[16], in[17],
+				   out[0], out[1], out[2], out[3], out[4], out[5], carry,
+				   s.z[FR0], s.z[FR0+1], s.z[FR0+2],
+				   s.z[FR0+3], s.z[FR0+4], s.z[FR0+5], s.c);
+		}
+
+	regs->pc = MP_RTS;
+	return Simulator::E_NONE;
+	}
+
+/*****************************************************************************\
+|* Run the native version of a routine on a copy of the machine. The ROM
+|* routines all expect binary mode on entry
+\*****************************************************************************/
+bool MathPack::_run(Simulator *sim,
+					Simulator::Registers *regs,
+					uint32_t address,
+					State& s)
+	{
+	if (regs->p & Simulator::FLAG_D)
+		return false;
+
+	memcpy(s.z, sim->mem(), sizeof(s.z));
+	s.a		= regs->a;
+	s.x		= regs->x;
+	s.y		= regs->y;
+	s.c		= (regs->p & Simulator::FLAG_C) != 0;
+	s.d		= false;
+	s.mem	= sim->mem();
+	s.loops	= MAX_LOOPS;
+
+	for (const Entry *e = _entries; e->fn != nullptr; e++)
+		if (e->address == address)
+			return (*e->fn)(s) && !s.d;
+	return false;
+	}
+
+/*****************************************************************************\
+|* Write back whatever changed, so it shows up in the memory-op trace, and
+|* return to the caller through an RTS in the ROM
+\*****************************************************************************/
+void MathPack::_commit(Simulator *sim,
+					   Simulator::Registers *regs,
+					   const State& s)
+	{
+	const uint8_t *mem = sim->mem();
+	for (int i=0; i<ZP_END; i++)
+		if (mem[i] != s.z[i])
+			{
+			uint8_t val = s.z[i];
+			sim->addRAM(i, &val, 1);
+			}
+
+	regs->a		= s.a;
+	regs->x		= s.x;
+	regs->y		= s.y;
+	regs->pc	= MP_RTS;
+	sim->setFlags(Simulator::FLAG_C, s.c ? Simulator::FLAG_C : 0);
+	}
+
+#pragma mark -- 6502 arithmetic
+
+/*****************************************************************************\
+|* ADC, as Simulator::_adc()
+\*****************************************************************************/
+void MathPack::_adc(State& s, uint8_t val)
+	{
+	uint32_t tmp;
+	if (s.d)
+		{
+		tmp = (s.a & 0xF) + (val & 0xF) + (s.c ? 1 : 0);
+		if (tmp >= 10)
+			tmp = (tmp - 10) | 16;
+		tmp += (s.a & 0xF0) + (val & 0xF0);
+		if (tmp > 0x9F)
+			tmp += 0x60;
+		}
+	else
+		tmp = s.a + val + (s.c ? 1 : 0);
+
+	s.c = tmp > 0xFF;
+	s.a = tmp & 0xFF;
+	}
+
+/*****************************************************************************\
+|* SBC, as Simulator::_sbc()
+\*****************************************************************************/
+void MathPack::_sbc(State& s, uint8_t val)
+	{
+	uint32_t tmp;
+	if (s.d)
+		{
+		val = val ^ 0xFF;
+		tmp = (s.a & 0xF) + (val & 0xF) + (s.c ? 1 : 0);
+		if (tmp < 0x10)
+			tmp = (tmp - 6) & 0x0F;
+		tmp += (s.a & 0xF0) + (val & 0xF0);
+		if (tmp < 0x100)
+			tmp = (tmp - 0x60) & 0xFF;
+		}
+	else
+		tmp = s.a + 0xFF - val + (s.c ? 1 : 0);
+
+	s.c = tmp > 0xFF;
+	s.a = tmp & 0xFF;
+	}
+
+#pragma mark -- Shared routines
+
+/*****************************************************************************\
+|* Zero Y bytes of zero page from X
+\*****************************************************************************/
+void MathPack::_zero(State& s)
+	{
+	s.a = 0;
+	do
+		s.z[s.x++] = s.a;
+	while (--s.y != 0);
+	}
+
+/*****************************************************************************\
+|* Zero FR0
+\*****************************************************************************/
+void MathPack::_zfr0(State& s)
+	{
+	s.x = FR0;
+	s.y = 6;
+	_zero(s);
+	}
+
+/*****************************************************************************\
+|* Normalise FR0, shifting in from the guard byte at $DA. C is set if the
+|* exponent is out of range
+\*****************************************************************************/
+void MathPack::_normalise(State& s)
+	{
+	s.d = false;
+	s.y = 5;
+	do
+		{
+		s.a = s.z[FR0] & 0x7F;
+		if (s.a == 0)
+			{
+			s.c = false;
+			_zfr0(s);
+			return;
+			}
+
+		s.x = s.z[0xD5];
+		if (s.x != 0)
+			{
+			s.c = (s.a >= 0x0F);
+			if (!s.c)
+				_zfr0(s);
+			else
+				s.c = (s.a >= 0x71);
+			return;
+			}
+
+		s.z[FR0] --;
+		for (s.x = 0xFB; s.x != 0; s.x++)
+			{
+			s.a = s.z[(uint8_t)(0xDB + s.x)];
+			s.z[(uint8_t)(0xDA + s.x)] = s.a;
+			}
+		s.z[0xDA] = s.x;
+		}
+	while (--s.y != 0);
+
+	s.z[FR0]	= s.y;
+	s.z[0xD5]	= s.y;
+	s.c			= false;
+	}
+
+/*****************************************************************************\
+|* Carry into the mantissa bytes above X, shifting right if it falls off
+|* the top, then normalise
+\*****************************************************************************/
+void MathPack::_carryUp(State& s)
+	{
+	for (;;)
+		{
+		if ((--s.x) & 0x80)
+			{
+			_shiftRight(s);
+			break;
+			}
+
+		s.a = s.z[(uint8_t)(0xD5 + s.x)];
+		_adc(s, 0);
+		s.z[(uint8_t)(0xD5 + s.x)] = s.a;
+		if (!s.c)
+			break;
+		}
+	_normalise(s);
+	}
+
+/*****************************************************************************\
+|* Shift the FR0 mantissa right a byte, with a carried 1 at the top
+\*****************************************************************************/
+void MathPack::_shiftRight(State& s)
+	{
+	s.z[FR0] ++;
+	for (s.x = 4; s.x != 0; s.x--)
+		{
+		s.a = s.z[FR0 + s.x];
+		s.z[0xD5 + s.x] = s.a;
+		}
+	s.x ++;
+	s.z[0xD5] = s.x;
+	}
+
+/*****************************************************************************\
+|* Swap FR0 and FR1
+\*****************************************************************************/
+void MathPack::_swap(State& s)
+	{
+	for (s.x = 5; !(s.x & 0x80); s.x--)
+		{
+		s.a = s.z[FR0 + s.x];
+		s.y = s.z[FR1 + s.x];
+		s.z[FR1 + s.x] = s.a;
+		s.z[FR0 + s.x] = s.y;
+		}
+	}
+
+/*****************************************************************************\
+|* End of a subtraction: take the borrow up the mantissa, complementing it
+|* if it goes negative, then normalise by bytes and round
+\*****************************************************************************/
+void MathPack::_subFinish(State& s)
+	{
+	if (!s.c)
+		{
+		bool borrowed = true;
+		while (!((--s.x) & 0x80))
+			{
+			s.a = s.z[(uint8_t)(0xD5 + s.x)];
+			_sbc(s, 0);
+			s.z[(uint8_t)(0xD5 + s.x)] = s.a;
+			if (s.c)
+				{
+				borrowed = false;
+				break;
+				}
+			}
+
+		if (borrowed)
+			{
+			s.c = true;
+			for (s.x = 5; s.x != 0; s.x--)
+				{
+				s.a = 0;
+				_sbc(s, s.z[FR0 + s.x]);
+				s.z[FR0 + s.x] = s.a;
+				}
+			s.a			= 0x80 ^ s.z[FR0];
+			s.z[FR0]	= s.a;
+			}
+		}
+
+	for (;;)
+		{
+		s.a = s.z[FR0] & 0x7F;
+		if (s.a < 0x0F)
+			{
+			s.c = false;
+			s.d = false;
+			_zfr0(s);
+			return;
+			}
+
+		s.x = s.z[0xD5];
+		if (s.x != 0)
+			{
+			s.x = s.z[FR1];
+			if (s.x < 4)
+				{
+				s.a = s.z[(uint8_t)(0xE2 + s.x)];
+				if (s.a >= 0x50)
+					{
+					s.c = true;
+					s.x = 6;
+					_carryUp(s);
+					return;
+					}
+				}
+			s.c = false;
+			s.d = false;
+			return;
+			}
+
+		for (s.x = 0xFC; ; )
+			{
+			s.z[FR0] --;
+			s.y = s.z[(uint8_t)(0xDA + s.x)];
+			if (s.y != 0)
+				break;
+			if (++s.x == 0)
+				{
+				s.c = false;
+				s.d = false;
+				_zfr0(s);
+				return;
+				}
+			}
+
+		for (s.y = 0; s.x != 0; s.y++, s.x++)
+			{
+			s.a = s.z[(uint8_t)(0xDA + s.x)];
+			s.z[0xD5 + s.y] = s.a;
+			}
+		for (; s.y != 6; s.y++)
+			s.z[0xD5 + s.y] = s.x;
+		}
+	}
+
+/*****************************************************************************\
+|* Add A, then any carry, into zero page at $D4+X and up
+\*****************************************************************************/
+void MathPack::_addAt(State& s)
+	{
+	do
+		{
+		_adc(s, s.z[(uint8_t)(FR0 + s.x)]);
+		s.z[(uint8_t)(FR0 + s.x)] = s.a;
+		s.x --;
+		s.a = 0;
+		}
+	while (s.c);
+	}
+
+/*****************************************************************************\
+|* Convert the FR0 mantissa bytes to binary, inverted, at $E7
+\*****************************************************************************/
+void MathPack::_toBinary(State& s)
+	{
+	for (s.x = 4; !(s.x & 0x80); s.x--)
+		{
+		s.y = s.z[0xD5 + s.x] >> 4;
+		s.a = s.z[0xD5 + s.x];
+		s.c = false;
+		_adc(s, s.mem[0xDFF6 + s.y]);
+		s.a ^= 0xFF;
+		s.z[0xE7 + s.x] = s.a;
+		}
+	}
+
+/*****************************************************************************\
+|* Exponent of a product or quotient, from A and FR0, with the sign left
+|* in $E0. Returns false, having zeroed FR0, if it's out of range
+\*****************************************************************************/
+bool MathPack::_exponent(State& s)
+	{
+	s.x			= s.a;
+	s.a			= (s.a ^ s.z[FR0]) & 0x80;
+	s.z[FR1]	= s.a;
+	s.a			= s.x;
+	_adc(s, s.z[FR0]);
+	s.x			= s.a;
+	s.a			^= s.z[FR1];
+
+	if ((s.a < 0x4F) || (s.a >= 0xB1))
+		{
+		s.c = (s.a >= 0xB1);
+		_zfr0(s);
+		return false;
+		}
+
+	s.a = s.x;
+	s.c = false;
+	_sbc(s, 0x3F);
+	return true;
+	}
+
+/*****************************************************************************\
+|* Multiply the FR0 mantissa, in binary at $E7, by FR1, a bit at a time,
+|* then round and normalise
+\*****************************************************************************/
+void MathPack::_multiply(State& s)
+	{
+	_zero(s);
+	s.y			= 7;
+	s.a			= 0x50;
+	s.z[0xDB]	= s.a;
+	do
+		{
+		for (s.x = 5; s.x != 0; s.x--)
+			{
+			uint8_t& bits = s.z[(uint8_t)(0xE6 + s.x)];
+			s.c		= bits & 1;
+			bits	>>= 1;
+			if (s.c)
+				continue;
+
+			for (int i=5; i>=0; i--)
+				{
+				uint8_t at = (uint8_t)(FR0 + i + s.x);
+				s.a = s.z[at];
+				_adc(s, s.z[FR1 + i]);
+				s.z[at] = s.a;
+				}
+
+			if (s.c)
+				{
+				s.z[0xE6] = s.x;
+				s.x --;
+				s.a = 0;
+				_addAt(s);
+				s.x = s.z[0xE6];
+				}
+			}
+
+		s.c = false;
+		for (int i=5; i>=0; i--)
+			{
+			s.a = s.z[FR1 + i];
+			_adc(s, s.z[FR1 + i]);
+			s.z[FR1 + i] = s.a;
+			}
+		}
+	while (--s.y != 0);
+
+	s.a = s.z[0xD5];
+	if (s.a != 0)
+		{
+		s.a = 0x50;
+		s.x = 6;
+		_addAt(s);
+		}
+	_normalise(s);
+	}
+
+/*****************************************************************************\
+|* Set up for division: quotient at $E6, FR1 shifted up a digit if that
+|* lines it up with FR0, and the digit position in $DB/$DC
+\*****************************************************************************/
+void MathPack::_divSetup(State& s)
+	{
+	s.z[0xDA]	= s.a;
+	s.x			= 0xE7;
+	s.y			= 6;
+	_zero(s);
+
+	s.a			= 0x50;
+	s.z[0xED]	= s.a;
+	s.z[0xE6]	= s.a;
+	s.x			= 0;
+	s.z[FR0]	= s.x;
+	s.z[FR1]	= s.x;
+
+	s.a = s.z[0xE1];
+	if (s.a < 0x10)
+		{
+		for (s.y = 4; s.y != 0; s.y--)
+			for (int i=5; i>=1; i--)
+				{
+				bool out	= s.z[FR1 + i] & 0x80;
+				s.z[FR1 + i] = (s.z[FR1 + i] << 1) | ((i < 5 && s.c) ? 1 : 0);
+				s.c			= out;
+				}
+		s.x = 9;
+		}
+
+	s.z[0xDB]	= s.x;
+	s.d			= true;
+	s.x			= 0xF9;
+	s.z[0xDC]	= s.x;
+	s.c			= true;
+	}
+
+/*****************************************************************************\
+|* Add FR1 back into the remainder until it goes positive, taking one off
+|* the quotient digit each time
+\*****************************************************************************/
+bool MathPack::_divAdd(State& s)
+	{
+	do
+		{
+		s.a = 0;
+		_sbc(s, s.z[0xDB]);
+		s.x = s.z[0xDC];
+		do
+			{
+			if (--s.loops < 0)
+				return false;
+			_adc(s, s.z[(uint8_t)(0xEE + s.x)]);
+			s.z[(uint8_t)(0xEE + s.x)] = s.a;
+			s.a = 0x99;
+			s.x --;
+			}
+		while (!s.c);
+
+		s.c = false;
+		for (int i=5; i>=0; i--)
+			{
+			s.a = s.z[FR0 + i];
+			_adc(s, s.z[FR1 + i]);
+			s.z[FR0 + i] = s.a;
+			}
+		if (--s.loops < 0)
+			return false;
+		}
+	while (!s.c);
+	return true;
+	}
+
+/*****************************************************************************\
+|* Subtract FR1 from the remainder until it goes negative, adding one to
+|* the quotient digit each time
+\*****************************************************************************/
+bool MathPack::_divSub(State& s)
+	{
+	do
+		{
+		s.a = s.z[0xDB];
+		s.x = s.z[0xDC];
+		do
+			{
+			if (--s.loops < 0)
+				return false;
+			_adc(s, s.z[(uint8_t)(0xEE + s.x)]);
+			s.z[(uint8_t)(0xEE + s.x)] = s.a;
+			s.a = 0;
+			s.x --;
+			}
+		while (s.c);
+
+		s.c = true;
+		for (int i=5; i>=1; i--)
+			{
+			s.a = s.z[FR0 + i];
+			_sbc(s, s.z[FR1 + i]);
+			s.z[FR0 + i] = s.a;
+			}
+		s.a = s.z[FR0];
+		_sbc(s, 0);
+		s.z[FR0] = s.a;
+		if (--s.loops < 0)
+			return false;
+		}
+	while (s.c);
+	return true;
+	}
+
+/*****************************************************************************\
+|* Move the quotient into FR0, with its exponent
+\*****************************************************************************/
+void MathPack::_divFinish(State& s)
+	{
+	s.x = 0xE6;
+	s.y = s.z[0xDA];
+	s.a = s.z[0xE7];
+	if (s.a == 0)
+		{
+		s.x ++;
+		s.y --;
+		}
+	s.z[s.x]	= s.y;
+
+	s.y			= 0;
+	s.z[0xFC]	= s.x;
+	s.z[0xFD]	= s.y;
+	for (s.y = 5; !(s.y & 0x80); s.y--)
+		{
+		s.a = s.z[(uint8_t)(s.x + s.y)];
+		s.z[FR0 + s.y] = s.a;
+		}
+	}
+
+#pragma mark -- Entry points
+
+/*****************************************************************************\
+|* FADD: FR0 = FR0 + FR1
+\*****************************************************************************/
+bool MathPack::_fadd(State& s)
+	{
+	/*************************************************************************\
+	|* Get the larger magnitude into FR0, as far as the exponents go
+	\*************************************************************************/
+	for (;;)
+		{
+		s.a = s.z[FR1];
+		if (s.a == 0)
+			{
+			_normalise(s);
+			return true;
+			}
+
+		s.a = s.z[FR0];
+		if (s.a != 0)
+			{
+			s.a = (s.z[FR1] ^ s.z[FR0]) & 0x80;
+			s.x = s.a;
+			s.a ^= s.z[FR1];
+			s.c = false;
+			_sbc(s, s.z[FR0]);
+			if (!s.c)
+				break;
+			}
+		_swap(s);
+		}
+
+	/*************************************************************************\
+	|* Y is how many bytes of FR1 overlap FR0
+	\*************************************************************************/
+	s.c = false;
+	_adc(s, 6);
+	s.y = s.a;
+	if (s.a & 0x80)
+		{
+		_normalise(s);
+		return true;
+		}
+
+	s.d	= true;
+	s.c	= (s.x >= 0x80);
+	s.x	= 5;
+
+	/*************************************************************************\
+	|* Signs differ: subtract
+	\*************************************************************************/
+	if (s.c)
+		{
+		s.z[FR1] = s.y;
+		while (!((--s.y) & 0x80))
+			{
+			s.a = s.z[FR0 + s.x];
+			_sbc(s, s.z[0xE1 + s.y]);
+			s.z[FR0 + s.x] = s.a;
+			s.x --;
+			}
+		_subFinish(s);
+		return true;
+		}
+
+	/*************************************************************************\
+	|* Signs agree: add, rounding on the first byte of FR1 that's lost
+	\*************************************************************************/
+	s.a = (s.y < 5) ? s.z[0xE1 + s.y] : 0;
+	s.c = (s.a >= 0x50);
+	s.a = s.y;
+	for (; s.y != 0; s.y--, s.x--)
+		{
+		s.a = s.z[FR1 + s.y];
+		_adc(s, s.z[FR0 + s.x]);
+		s.z[FR0 + s.x] = s.a;
+		}
+
+	if (s.c)
+		_carryUp(s);
+	else
+		_normalise(s);
+	return true;
+	}
+
+/*****************************************************************************\
+|* FSUB: FR0 = FR0 - FR1
+\*****************************************************************************/
+bool MathPack::_fsub(State& s)
+	{
+	s.a			= s.z[FR1] ^ 0x80;
+	s.z[FR1]	= s.a;
+	return _fadd(s);
+	}
+
+/*****************************************************************************\
+|* FMUL: FR0 = FR0 * FR1
+\*****************************************************************************/
+bool MathPack::_fmul(State& s)
+	{
+	s.a = s.z[FR0];
+	if (s.a == 0)
+		{
+		s.c = false;
+		return true;
+		}
+
+	s.a = s.z[FR1];
+	s.c = false;
+	if (s.a == 0)
+		{
+		_zfr0(s);
+		return true;
+		}
+
+	_toBinary(s);
+	s.a = s.z[FR1];
+	s.c = false;
+	if (!_exponent(s))
+		return true;
+
+	s.z[FR0] = s.a;
+	s.z[FR0] ++;
+	s.x = 0xD5;
+	s.y = 0x0C;
+	s.d = true;
+	_multiply(s);
+	return true;
+	}
+
+/*****************************************************************************\
+|* FDIV: FR0 = FR0 / FR1, one decimal digit of quotient at a time
+\*****************************************************************************/
+bool MathPack::_fdiv(State& s)
+	{
+	s.a = s.z[FR1];
+	if (s.a == 0)
+		{
+		s.c = true;
+		return true;
+		}
+
+	s.a = s.z[FR0];
+	if (s.a == 0)
+		{
+		s.c = false;
+		return true;
+		}
+
+	s.a = s.z[FR1] ^ 0x7F;
+	s.c = true;
+	if (!_exponent(s))
+		return true;
+
+	_divSetup(s);
+	do
+		{
+		s.a = s.z[FR0] | s.z[0xD5];
+		if (s.a != 0)
+			if (!(s.c ? _divSub(s) : _divAdd(s)))
+				return false;
+
+		bool c = s.c;
+		for (s.x = 4; s.x != 0; s.x--)
+			for (int i=5; i>=0; i--)
+				{
+				bool out	= s.z[FR0 + i] & 0x80;
+				s.z[FR0 + i] = (s.z[FR0 + i] << 1) | ((i < 5 && s.c) ? 1 : 0);
+				s.c			= out;
+				}
+		s.c = c;
+
+		s.a			= s.z[0xDB] ^ 0x09;
+		s.z[0xDB]	= s.a;
+		}
+	while ((s.a == 0) || (++s.z[0xDC] != 0));
+
+	_divFinish(s);
+	s.d = false;
+	s.c = false;
+	return true;
+	}
+
+/*****************************************************************************\
+|* IFP: FR0 = the unsigned integer in $D4/$D5, by doubling in decimal
+\*****************************************************************************/
+bool MathPack::_ifp(State& s)
+	{
+	s.d = true;
+	s.x = 0xD6;
+	s.y = 5;
+	_zero(s);
+
+	for (s.y = 0x10; s.y != 0; s.y--)
+		{
+		s.c			= s.z[FR0] & 0x80;
+		s.z[FR0]	<<= 1;
+		bool out	= s.z[0xD5] & 0x80;
+		s.z[0xD5]	= (s.z[0xD5] << 1) | (s.c ? 1 : 0);
+		s.c			= out;
+
+		for (int i=0xD8; i>=0xD7; i--)
+			{
+			s.a = s.z[i];
+			_adc(s, s.z[i]);
+			s.z[i] = s.a;
+			}
+
+		out			= s.z[0xD6] & 0x80;
+		s.z[0xD6]	= (s.z[0xD6] << 1) | (s.c ? 1 : 0);
+		s.c			= out;
+		}
+
+	s.a			= 0x43;
+	s.z[FR0]	= s.a;
+	_normalise(s);
+	return true;
+	}
+
+/*****************************************************************************\
+|* FPI: $D4/$D5 = FR0 rounded to an unsigned integer, a byte of digits at a
+|* time using the ROM's tables. C is set if it's out of range
+\*****************************************************************************/
+bool MathPack::_fpi(State& s)
+	{
+	const uint8_t *m = s.mem;
+
+	s.a = s.z[FR0];
+	if (s.a >= 0x43)
+		{
+		s.c = true;
+		return true;
+		}
+
+	s.c = false;
+	_sbc(s, 0x3E);
+	if (!s.c)
+		{
+		_zfr0(s);
+		return true;
+		}
+
+	/*************************************************************************\
+	|* Round on the first byte after the point
+	\*************************************************************************/
+	s.x			= s.a;
+	s.y			= s.z[(uint8_t)(0xD5 + s.x)];
+	s.a			= (s.y >= 0x50) ? 1 : 0;
+	s.c			= false;
+	s.z[FR0]	= s.a;
+	s.a			= 0;
+
+	/*************************************************************************\
+	|* Units and tens
+	\*************************************************************************/
+	if (!((--s.x) & 0x80))
+		{
+		s.a = s.z[0xD5 + s.x];
+		s.y = s.a >> 4;
+		s.c = false;
+		_adc(s, s.z[FR0]);
+		_adc(s, m[0xDFF6 + s.y]);
+		s.c			= false;
+		s.z[FR0]	= s.a;
+		s.a			= 0;
+
+		/*********************************************************************\
+		|* Hundreds and thousands
+		\*********************************************************************/
+		if (!((--s.x) & 0x80))
+			{
+			s.y = s.z[0xD5 + s.x] >> 4;
+			s.c = false;
+			s.a = s.z[FR0];
+			_adc(s, m[0xDF48 + s.y]);
+			s.z[FR0] = s.a;
+			s.a = m[0xDF52 + s.y];
+			_adc(s, 0);
+			uint8_t hi = s.a;
+
+			s.y = s.z[0xD5 + s.x] & 0x0F;
+			s.a = s.z[FR0];
+			_adc(s, m[0xD8DB + s.y]);
+			s.z[FR0] = s.a;
+			s.a = hi;
+			_adc(s, m[0xDF5C + s.y]);
+
+			/*****************************************************************\
+			|* Ten thousands
+			\*****************************************************************/
+			if (!((--s.x) & 0x80))
+				{
+				s.y = s.z[0xD5 + s.x];
+				if (s.y >= 7)
+					{
+					s.c = true;
+					return true;
+					}
+
+				s.c			= false;
+				s.x			= s.a;
+				s.a			= (s.y << 4) & 0xFF;
+				_adc(s, s.z[FR0]);
+				s.z[FR0]	= s.a;
+				s.a			= s.x;
+				_adc(s, m[0xDF65 + s.y]);
+				}
+			}
+		}
+
+	s.z[0xD5] = s.a;
+	return true;
+	}
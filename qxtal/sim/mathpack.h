@@ -3,19 +3,121 @@
 
 #include <QObject>
 
-class Simulator;
+#include "simulator.h"
 
 class MathPack  : public QObject
 	{
 	Q_OBJECT
 
+	public:
+		/*************************************************************************\
+		|* How FADD, FSUB, FMUL, FDIV, IFP and FPI are run
+		\*************************************************************************/
+		typedef enum
+			{
+			MP_ROM = 0,			// Interpret the 6502 code
+			MP_HLE,				// Run native versions of the routines
+			MP_VERIFY,			// Run both, and report any difference
+			} Mode;
+
+	private:
+		/*************************************************************************\
+		|* What the routines work on: a copy of zero page, A/X/Y and the C and
+		|* D flags. Tables are read from the simulator's memory
+		\*************************************************************************/
+		typedef struct
+			{
+			uint8_t z[256];				// Zero page
+			uint8_t a, x, y;			// Registers
+			bool c, d;					// Carry and decimal flags
+			const uint8_t *mem;			// Simulator memory, for the tables
+			int loops;					// Iterations left before giving up
+			} State;
+
+		/*************************************************************************\
+		|* A routine we can run natively. Returns false if it gave up, in
+		|* which case the ROM is left to do it
+		\*************************************************************************/
+		typedef bool (*Routine)(State& s);
+		typedef struct
+			{
+			uint16_t address;			// Entry point in the ROM
+			const char *name;			// For messages
+			Routine fn;					// Native version
+			} Entry;
+
+		static const Entry _entries[];
+
+		/*************************************************************************\
+		|* 6502 arithmetic, as the simulator does it
+		\*************************************************************************/
+		static void _adc(State& s, uint8_t val);
+		static void _sbc(State& s, uint8_t val);
+
+		/*************************************************************************\
+		|* Shared pieces of the ROM, named by address
+		\*************************************************************************/
+		static void _zero(State& s);				// DA48
+		static void _zfr0(State& s);				// DA44
+		static void _normalise(State& s);			// DBFF
+		static void _carryUp(State& s);				// DAB2
+		static void _shiftRight(State& s);			// DE6A
+		static void _swap(State& s);				// DD74
+		static void _subFinish(State& s);			// DC60
+		static void _addAt(State& s);				// D8D1
+		static void _toBinary(State& s);			// DE79
+		static bool _exponent(State& s);			// DB03
+		static void _multiply(State& s);			// DCC5
+		static void _divSetup(State& s);			// DC2D
+		static bool _divAdd(State& s);				// DB43
+		static bool _divSub(State& s);				// DBB9
+		static void _divFinish(State& s);			// DBEE
+
+		/*************************************************************************\
+		|* The entry points
+		\*************************************************************************/
+		static bool _fadd(State& s);
+		static bool _fsub(State& s);
+		static bool _fmul(State& s);
+		static bool _fdiv(State& s);
+		static bool _ifp(State& s);
+		static bool _fpi(State& s);
+
+		/*************************************************************************\
+		|* Run the native version of the routine at an address on a copy of
+		|* the machine. Returns false if it can't be done natively
+		\*************************************************************************/
+		static bool _run(Simulator *sim,
+						 Simulator::Registers *regs,
+						 uint32_t address,
+						 State& s);
+
+		/*************************************************************************\
+		|* Put a result into the machine, and return through an RTS
+		\*************************************************************************/
+		static void _commit(Simulator *sim,
+							Simulator::Registers *regs,
+							const State& s);
+
+		/*************************************************************************\
+		|* Exec callbacks on the entry points, for MP_HLE and MP_VERIFY
+		\*************************************************************************/
+		static Simulator::ErrorCode _hle(Simulator *sim,
+										 Simulator::Registers *regs,
+										 uint32_t address,
+										 int data);
+		static Simulator::ErrorCode _verify(Simulator *sim,
+											Simulator::Registers *regs,
+											uint32_t address,
+											int data);
+
 	public:
 		explicit MathPack(QObject *parent = nullptr);
 
 		/*************************************************************************\
 		|* Load the math pack into the simulator
 		\*************************************************************************/
-		static int load(Simulator* sim);
+		static int load(Simulator* sim, Mode mode = MP_ROM);
 	};
 
 #endif // MATHPACK_H
@@ -0,0 +1,45 @@
+#include "memopbuffer.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+MemOpBuffer::MemOpBuffer(size_t capacity, int insns)
+			:_count(0)
+			,_instructions(0)
+	{
+	_ops.resize(capacity > 0 ? capacity : 1);
+	_marks.resize(insns > 0 ? insns : 1);
+	}
+
+/*****************************************************************************\
+|* Note the start of an instruction's ops
+\*****************************************************************************/
+void MemOpBuffer::startInstruction(void)
+	{
+	if ((size_t)_instructions == _marks.size())
+		_marks.resize(_marks.size() * 2);
+	_marks[_instructions++] = _count;
+	}
+
+/*****************************************************************************\
+|* Return the ops for one instruction
+\*****************************************************************************/
+MemOpView MemOpBuffer::instruction(int idx) const
+	{
+	if ((idx < 0) || (idx >= _instructions))
+		return MemOpView();
+
+	size_t first	= _marks[idx];
+	size_t last		= (idx + 1 < _instructions) ? _marks[idx + 1] : _count;
+	return MemOpView(_ops.data() + first, last - first);
+	}
+
+#pragma mark -- Private Methods
+
+/*****************************************************************************\
+|* Double the storage. Only happens while the buffer finds its working size
+\*****************************************************************************/
+void MemOpBuffer::_grow(void)
+	{
+	_ops.resize(_ops.size() * 2);
+	}
@@ -0,0 +1,100 @@
+#ifndef MEMOPBUFFER_H
+#define MEMOPBUFFER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "instructions.h"
+#include "properties.h"
+
+/*****************************************************************************\
+|* Read-only view of a run of memory operations inside a MemOpBuffer. It is
+|* only valid until the buffer is next cleared or added to
+\*****************************************************************************/
+class MemOpView
+	{
+	private:
+		const MemoryOp *	_ops;			// First op in the view
+		size_t				_size;			// Number of ops in the view
+
+	public:
+		MemOpView(const MemoryOp *ops = nullptr, size_t size = 0)
+			:_ops(ops)
+			,_size(size)
+			{}
+
+		inline const MemoryOp * begin(void) const	{ return _ops; }
+		inline const MemoryOp * end(void) const		{ return _ops + _size; }
+		inline size_t size(void) const				{ return _size; }
+		inline bool empty(void) const				{ return _size == 0; }
+		inline const MemoryOp& operator[] (size_t i) const
+													{ return _ops[i]; }
+	};
+
+/*****************************************************************************\
+|* Reusable arena of memory operations, recorded over one or more
+|* instructions. Storage is allocated up-front and kept across clear(), so
+|* recording doesn't allocate once the buffer has reached its working size
+\*****************************************************************************/
+class MemOpBuffer
+	{
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GET(size_t, count);						// Number of ops recorded
+	GET(int, instructions);					// Number of instructions recorded
+
+	private:
+		std::vector<MemoryOp>	_ops;		// Op storage, never shrinks
+		std::vector<size_t>		_marks;		// Index of first op of each insn
+
+		/*********************************************************************\
+		|* Make room for more ops
+		\*********************************************************************/
+		void _grow(void);
+
+	public:
+		/*********************************************************************\
+		|* Constructor
+		\*********************************************************************/
+		explicit MemOpBuffer(size_t capacity = 4096, int insns = 1024);
+
+		/*********************************************************************\
+		|* Forget everything recorded, keeping the storage
+		\*********************************************************************/
+		inline void clear(void)
+			{
+			_count			= 0;
+			_instructions	= 0;
+			}
+
+		/*********************************************************************\
+		|* Note that the ops added from here on belong to a new instruction
+		\*********************************************************************/
+		void startInstruction(void);
+
+		/*********************************************************************\
+		|* Record an op
+		\*********************************************************************/
+		inline void add(const MemoryOp& op)
+			{
+			if (_count == _ops.size())
+				_grow();
+			_ops[_count++] = op;
+			}
+
+		/*********************************************************************\
+		|* Everything recorded since the last clear()
+		\*********************************************************************/
+		inline MemOpView all(void) const
+			{
+			return MemOpView(_ops.data(), _count);
+			}
+
+		/*********************************************************************\
+		|* The ops recorded for one instruction (0 is the oldest)
+		\*********************************************************************/
+		MemOpView instruction(int idx) const;
+	};
+
+#endif // MEMOPBUFFER_H
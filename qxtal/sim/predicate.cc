@@ -0,0 +1,117 @@
+#include "predicate.h"
+#include "simulator.h"
+
+/*****************************************************************************\
+|* Constructor: never fires
+\*****************************************************************************/
+Predicate::Predicate(void)
+		  :_enabled(false)
+		  ,_hits(0)
+	{}
+
+/*****************************************************************************\
+|* Constructor: compile the editor's description
+\*****************************************************************************/
+Predicate::Predicate(const PredicateInfo& info)
+		  :_enabled(info.enabled)
+		  ,_hits(0)
+	{
+	for (int i=0; i<info.num; i++)
+		{
+		Term term;
+		term.fn		= _termFn(info.what[i], info.cond[i]);
+		term.arg	= (info.args != nullptr) ? info.args[i] & 0xFFFF : 0;
+		term.value	= info.values[i];
+		_terms.push_back(term);
+
+		/*********************************************************************\
+		|* Nothing after an 'always' term can make a difference
+		\*********************************************************************/
+		if (info.what[i] == PW_ALWAYS)
+			break;
+		}
+	}
+
+#pragma mark -- Private Methods
+
+/*****************************************************************************\
+|* A term. Everything but the fetch and the comparison is decided up front
+\*****************************************************************************/
+template <int W, int C>
+bool Predicate::_term(Simulator *sim, const Term& term, uint64_t hits)
+	{
+	int64_t val = 0;
+
+	if constexpr (W == PW_ALWAYS)
+		return true;
+	else if constexpr (W == PW_A)
+		val = sim->regs().a;
+	else if constexpr (W == PW_X)
+		val = sim->regs().x;
+	else if constexpr (W == PW_Y)
+		val = sim->regs().y;
+	else if constexpr (W == PW_P)
+		val = sim->regs().p;
+	else if constexpr (W == PW_S)
+		val = sim->regs().s;
+	else if constexpr (W == PW_MEMORY)
+		val = sim->mem()[term.arg];
+	else if constexpr (W == PW_CYCLES)
+		val = (int64_t)sim->cycles();
+	else if constexpr (W == PW_HITS)
+		val = (int64_t)hits;
+
+	if constexpr (C == PC_LT)
+		return val < term.value;
+	else if constexpr (C == PC_LE)
+		return val <= term.value;
+	else if constexpr (C == PC_EQ)
+		return val == term.value;
+	else if constexpr (C == PC_GE)
+		return val >= term.value;
+	else if constexpr (C == PC_GT)
+		return val > term.value;
+	else
+		return val != term.value;
+	}
+
+/*****************************************************************************\
+|* Look up the specialised term. Anything we don't recognise always fires,
+|* which is the safer mistake to make in a debugger
+\*****************************************************************************/
+#define TERM_ROW(w)		{ &Predicate::_term<w, PC_LT>,					\
+						  &Predicate::_term<w, PC_LE>,					\
+						  &Predicate::_term<w, PC_EQ>,					\
+						  &Predicate::_term<w, PC_GE>,					\
+						  &Predicate::_term<w, PC_GT>,					\
+						  &Predicate::_term<w, PC_NE> }
+
+Predicate::TermFn Predicate::_termFn(int what, int cond)
+	{
+	static const TermFn table[PW_MAX][PC_MAX] =
+		{
+		TERM_ROW(PW_ALWAYS),
+		TERM_ROW(PW_A),
+		TERM_ROW(PW_X),
+		TERM_ROW(PW_Y),
+		TERM_ROW(PW_P),
+		TERM_ROW(PW_S),
+		TERM_ROW(PW_MEMORY),
+		TERM_ROW(PW_CYCLES),
+		TERM_ROW(PW_HITS)
+		};
+
+	if ((what < 0) || (what >= PW_MAX))
+		{
+		fprintf(stderr, "Unknown 'what' term in predicate (%d)\n", what);
+		return table[PW_ALWAYS][0];
+		}
+	if ((cond < 0) || (cond >= PC_MAX))
+		{
+		if (what != PW_ALWAYS)
+			fprintf(stderr, "Unknown 'condition' term in predicate (%d)\n",
+					cond);
+		return table[PW_ALWAYS][0];
+		}
+	return table[what][cond];
+	}
@@ -0,0 +1,120 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "predicates/predicateinfo.h"
+#include "properties.h"
+
+class Simulator;
+
+/*****************************************************************************\
+|* A breakpoint or watchpoint condition, compiled from the PredicateInfo that
+|* the editor produces. Each term becomes a pointer to a function that is
+|* specialised on what it looks at and how it compares, so testing a term is
+|* a single call with nothing left to decode. As in the editor, the predicate
+|* is true if any of its terms are
+\*****************************************************************************/
+class Predicate
+	{
+	public:
+		/*********************************************************************\
+		|* What a term looks at. These are the indices in the editor's list
+		\*********************************************************************/
+		typedef enum
+			{
+			PW_ALWAYS	= 0,
+			PW_A,
+			PW_X,
+			PW_Y,
+			PW_P,
+			PW_S,
+			PW_MEMORY,				// Byte at the term's address
+			PW_CYCLES,				// Cycles since reset
+			PW_HITS,				// Times reached, including this one
+
+			PW_MAX
+			} What;
+
+		/*********************************************************************\
+		|* How a term compares
+		\*********************************************************************/
+		typedef enum
+			{
+			PC_LT		= 0,
+			PC_LE,
+			PC_EQ,
+			PC_GE,
+			PC_GT,
+			PC_NE,
+
+			PC_MAX
+			} Condition;
+
+	private:
+		/*********************************************************************\
+		|* A compiled term
+		\*********************************************************************/
+		struct Term;
+		typedef bool (*TermFn)(Simulator *sim, const Term& term, uint64_t hits);
+
+		struct Term
+			{
+			TermFn fn;				// Fetch-and-compare for this term
+			uint32_t arg;			// Address, for memory terms
+			int64_t value;			// Value to compare against
+			};
+
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GET(bool, enabled);						// Whether it can fire at all
+	GET(uint64_t, hits);					// Times it has been tested
+
+	private:
+		std::vector<Term> _terms;			// Or'ed together
+
+		/*********************************************************************\
+		|* A term specialised on what it fetches and how it compares
+		\*********************************************************************/
+		template <int W, int C>
+		static bool _term(Simulator *sim, const Term& term, uint64_t hits);
+
+		/*********************************************************************\
+		|* Find the specialisation for a term
+		\*********************************************************************/
+		static TermFn _termFn(int what, int cond);
+
+	public:
+		/*********************************************************************\
+		|* Constructors. The default predicate never fires
+		\*********************************************************************/
+		Predicate(void);
+		explicit Predicate(const PredicateInfo& info);
+
+		/*********************************************************************\
+		|* Count a hit and see if we should stop
+		\*********************************************************************/
+		inline bool test(Simulator *sim)
+			{
+			if (!_enabled)
+				return false;
+
+			_hits ++;
+			for (const Term& term : _terms)
+				if (term.fn(sim, term, _hits))
+					return true;
+			return false;
+			}
+
+		/*********************************************************************\
+		|* Start counting hits again
+		\*********************************************************************/
+		inline void resetHits(void)
+			{
+			_hits = 0;
+			}
+	};
+
+#endif // PREDICATE_H
@@ -0,0 +1,59 @@
+#include "sampleprofile.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+SampleProfile::SampleProfile(void)
+	:_period(0)
+	,_due(0)
+	,_last(0)
+	{
+	_samples.reserve(CAPACITY);
+	}
+
+/*****************************************************************************\
+|* Start or stop sampling
+\*****************************************************************************/
+void SampleProfile::start(uint64_t period, uint64_t now)
+	{
+	_samples.clear();
+	_period	= period;
+	rebase(now);
+	}
+
+/*****************************************************************************\
+|* Carry on from a new cycle count. Samples already taken keep their cycles
+\*****************************************************************************/
+void SampleProfile::rebase(uint64_t now)
+	{
+	if (_samples.size() == 0)
+		_last = now;
+	_due = now + _period;
+	}
+
+/*****************************************************************************\
+|* Take a sample, and work out when the next one is due. If the clock has
+|* jumped (an idle loop being skipped, say) the next one stays on the grid
+\*****************************************************************************/
+bool SampleProfile::add(uint64_t cycles, uint16_t pc, uint32_t node)
+	{
+	_samples.push_back({cycles, node, pc});
+	if (cycles >= _due)
+		_due += ((cycles - _due) / _period + 1) * _period;
+	return _samples.size() >= CAPACITY;
+	}
+
+/*****************************************************************************\
+|* Fold the samples in
+\*****************************************************************************/
+void SampleProfile::flush(uint64_t *cycles, CallProfile& calls)
+	{
+	for (const Sample& s : _samples)
+		{
+		uint64_t weight = (s.cycles > _last) ? s.cycles - _last : 0;
+		cycles[s.pc]   += weight;
+		calls.addCycles(s.node, weight);
+		_last			= s.cycles;
+		}
+	_samples.clear();
+	}
@@ -0,0 +1,98 @@
+#ifndef SAMPLEPROFILE_H
+#define SAMPLEPROFILE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "properties.h"
+#include "callprofile.h"
+
+/*****************************************************************************\
+|* Sampling profile. Rather than counting every instruction, the simulator
+|* notes the PC and the call-graph node every 'period' cycles, so a long run
+|* can be profiled at close to full speed.
+|*
+|* Samples go into a buffer of fixed size, and are folded into the same
+|* per-address cycle counts and call tree as the full profiler uses when it
+|* fills up or the profile is wanted. Each sample is charged with the cycles
+|* since the one before it, so the totals still add up to the cycles run
+\*****************************************************************************/
+class SampleProfile
+	{
+	NON_COPYABLE_NOR_MOVEABLE(SampleProfile)
+
+	public:
+		/*********************************************************************\
+		|* One sample
+		\*********************************************************************/
+		typedef struct
+			{
+			uint64_t cycles;			// Cycle count when it was taken
+			uint32_t node;				// Call-graph node that was current
+			uint16_t pc;				// Instruction about to run
+			} Sample;
+
+		static const size_t CAPACITY	= 4096;
+
+	private:
+		std::vector<Sample> _samples;	// Taken but not folded in yet
+		uint64_t _period;				// Cycles between samples, 0 = off
+		uint64_t _due;					// Cycle count of the next one
+		uint64_t _last;					// Where the first sample's cycles start
+
+	public:
+		/*********************************************************************\
+		|* Constructor
+		\*********************************************************************/
+		SampleProfile(void);
+
+		/*********************************************************************\
+		|* Sample every 'period' cycles from 'now', or stop if it's 0. Any
+		|* samples not folded in yet are dropped
+		\*********************************************************************/
+		void start(uint64_t period, uint64_t now);
+
+		/*********************************************************************\
+		|* Carry on from 'now', after the clock has been moved
+		\*********************************************************************/
+		void rebase(uint64_t now);
+
+		/*********************************************************************\
+		|* Whether we're sampling, and when the next sample is due
+		\*********************************************************************/
+		inline bool active(void) const
+			{
+			return _period != 0;
+			}
+
+		inline uint64_t period(void) const
+			{
+			return _period;
+			}
+
+		inline uint64_t due(void) const
+			{
+			return _due;
+			}
+
+		/*********************************************************************\
+		|* The samples taken since they were last folded in
+		\*********************************************************************/
+		inline const std::vector<Sample>& samples(void) const
+			{
+			return _samples;
+			}
+
+		/*********************************************************************\
+		|* Take a sample. Returns true if the buffer is now full
+		\*********************************************************************/
+		bool add(uint64_t cycles, uint16_t pc, uint32_t node);
+
+		/*********************************************************************\
+		|* Fold the samples into per-address cycle counts and the call tree
+		|* they were taken against, and empty the buffer
+		\*********************************************************************/
+		void flush(uint64_t *cycles, CallProfile& calls);
+	};
+
+#endif // SAMPLEPROFILE_H
@@ -1,6 +1,9 @@
+#include <algorithm>
+
 #include "instructions.h"
 #include "macros.h"
 #include "simulator.h"
+#include "tracefile.h"
 #include "notifications.h"
 #include "NotifyCenter.h"
 
@@ -113,22 +116,22 @@ static const InsnType _insnTypes[256] =
 /*****************************************************************************\
 |* Macros to make the code easier to read : Operations
 \*****************************************************************************/
-#define ZP_R1   val = _readByte(data & 0xFF)
-#define ZP_W1   _writeByte(data & 0xFF, val)
-#define ZPX_R1  val = _readByte((data + _regs.x) & 0xFF)
-#define ZPX_W1  _writeByte((data + _regs.x) & 0xFF, val)
-#define ZPY_R1  val = _readByte((data + _regs.y) & 0xFF)
-#define ZPY_W1  _writeByte((data + _regs.y) & 0xFF, val)
-#define ABS_R1  val = _readByte(data)
-#define ABS_W1  _writeByte(data, val)
-#define ABX_R1  val = _readByte(data + _regs.x)
-#define ABX_W1  _writeByte(data + _regs.x, val)
-#define ABY_R1  val = _readByte(data + _regs.y)
-#define ABY_W1  _writeByte(data + _regs.y, val)
-#define IND_X(op)  val = _readIndX(data); op
-#define IND_Y(op)  val = _readIndY(data); op
-#define INDW_X(op) op; _writeIndX(data, val)
-#define INDW_Y(op) op; _writeIndY(data, val)
+#define ZP_R1   val = _readByte<F>(data & 0xFF)
+#define ZP_W1   _writeByte<F>(data & 0xFF, val)
+#define ZPX_R1  val = _readByte<F>((data + _regs.x) & 0xFF)
+#define ZPX_W1  _writeByte<F>((data + _regs.x) & 0xFF, val)
+#define ZPY_R1  val = _readByte<F>((data + _regs.y) & 0xFF)
+#define ZPY_W1  _writeByte<F>((data + _regs.y) & 0xFF, val)
+#define ABS_R1  val = _readByte<F>(data)
+#define ABS_W1  _writeByte<F>(data, val)
+#define ABX_R1  val = _readByte<F>(data + _regs.x)
+#define ABX_W1  _writeByte<F>(data + _regs.x, val)
+#define ABY_R1  val = _readByte<F>(data + _regs.y)
+#define ABY_W1  _writeByte<F>(data + _regs.y, val)
+#define IND_X(op)  val = _readIndX<F>(data); op
+#define IND_Y(op)  val = _readIndY<F>(data); op
+#define INDW_X(op) op; _writeIndX<F>(data, val)
+#define INDW_Y(op) op; _writeIndY<F>(data, val)
 
 #define ORA _regs.a |= val; SETZ(_regs.a); SETN(_regs.a)
 #define AND _regs.a &= val; SETZ(_regs.a); SETN(_regs.a)
@@ -153,9 +156,9 @@ static const InsnType _insnTypes[256] =
 #define STA val = _regs.a
 #define STX val = _regs.x
 #define STY val = _regs.y
-#define POP  _regs.s = (_regs.s + 1) & 0xFF; val = _readByte(0x100 + _regs.s)
+#define POP  _regs.s = (_regs.s + 1) & 0xFF; val = _readByte<F>(0x100 + _regs.s)
 #define PUSH(val) _cycles += 3; \
-				  _writeByte(0x100 + _regs.s,val); \
+				  _writeByte<F>(0x100 + _regs.s,val); \
 				  _regs.s = (_regs.s - 1) & 0xFF
 
 // Complete ops
@@ -174,11 +177,11 @@ static const InsnType _insnTypes[256] =
 #define ZPY_R(op)   _cycles += 4; ZPY_R1; op
 #define ZPY_W(op)   _cycles += 4; op; ZPY_W1
 
-#define ABX_R(op)   _cycles += 4; _handleExtraAbsoluteX(data); ABX_R1; op
+#define ABX_R(op)   _cycles += 4; _handleExtraAbsoluteX<F>(data); ABX_R1; op
 #define ABX_W(op)   _cycles += 5; op; ABX_W1
 #define ABX_RW(op)  _cycles += 7; ABX_R1; op; ABX_W1
 
-#define ABY_R(op)   _cycles += 4; _handleExtraAbsoluteY(data); ABY_R1; op
+#define ABY_R(op)   _cycles += 4; _handleExtraAbsoluteY<F>(data); ABY_R1; op
 #define ABY_W(op)   _cycles += 5; op; ABY_W1
 
 #define IMM(op)     _cycles += 2; val = data; op
@@ -187,13 +190,13 @@ static const InsnType _insnTypes[256] =
 #define IMP_X(op)   _cycles += 2; val = _regs.x; op; _regs.x = val; SET_ZN
 #define TXS()       _cycles += 2; _regs.s = _regs.x;
 
-#define BRA_0(a)    _branch(data, a, 0)
-#define BRA_1(a)    _branch(data, a, 1)
+#define BRA_0(a)    _branch<F>(data, a, 0)
+#define BRA_1(a)    _branch<F>(data, a, 1)
 #define JMP()      _cycles += 3; _regs.pc = data
-#define JMP16()    _cycles += 5; _regs.pc = _readWord(data)
-#define JSR()      _jsr(data)
-#define RTS()      _rts()
-#define RTI()      _rti()
+#define JMP16()    _cycles += 5; _regs.pc = _readWord<F>(data)
+#define JSR()      _jsr<F>(data)
+#define RTS()      _rts<F>()
+#define RTI()      _rti<F>()
 
 #define CL_F(f)   _cycles += 2; setFlags(f, 0)
 #define SE_F(f)   _cycles += 2; setFlags(f, f)
@@ -201,8 +204,8 @@ static const InsnType _insnTypes[256] =
 #define POP_P  _cycles += 4; POP; setFlags(0xFF, val | 0x30)
 #define POP_A  _cycles += 4; POP; LDA
 
-#define BIT_ZP   _cycles += 3; _bit(data & 0xFF)
-#define BIT_ABS  _cycles += 4; _bit(data)
+#define BIT_ZP   _cycles += 3; _bit<F>(data & 0xFF)
+#define BIT_ABS  _cycles += 4; _bit<F>(data)
 
 /*****************************************************************************\
 |* Macros to aid in printing out the instructions in a trace
@@ -243,20 +246,51 @@ static const InsnType _insnTypes[256] =
 
 static const char *_hexDigits = "0123456789ABCDEF";
 
+/*****************************************************************************\
+|* Event and idle-loop bookkeeping
+\*****************************************************************************/
+#define CYCLE_NEVER		UINT64_MAX		// No cycle limit, no events
+#define IDLE_NONE		0x10000			// No backward branch seen yet
+
 
 
 #pragma mark -- Callbacks
 /*****************************************************************************\
 |* Read (PC); set appropriate error status
 \*****************************************************************************/
-static Simulator::ErrorCode _rtsCallback(Simulator *sim,
-										 Simulator::Registers *regs,
-										 uint32_t address,
-										 int data)
+static Simulator::ErrorCode _rtsCallback(Simulator *,
+										 Simulator::Registers *,
+										 uint32_t,
+										 int)
 	{
 	return Simulator::E_CALL_RET;
 	}
 
+/*****************************************************************************\
+|* Write to an expansion-board bank register
+\*****************************************************************************/
+static Simulator::ErrorCode _bankCallback(Simulator *sim,
+										  Simulator::Registers *,
+										  uint32_t address,
+										  int data)
+	{
+	uint8_t val = data;
+	sim->addRAM(address, &val, 1);
+	return Simulator::E_NONE;
+	}
+
+/*****************************************************************************\
+|* Start of a stdmacros multiply or divide loop
+\*****************************************************************************/
+static Simulator::ErrorCode _macroCallback(Simulator *sim,
+										   Simulator::Registers *,
+										   uint32_t address,
+										   int)
+	{
+	sim->runMacro(address);
+	return Simulator::E_NONE;
+	}
+
 
 
 /*****************************************************************************\
@@ -265,27 +299,56 @@ static Simulator::ErrorCode _rtsCallback(Simulator *sim,
 Simulator::Simulator(int maxRam,
 					 QObject *parent)
 		  :QObject{parent}
-		  ,_maxRam(maxRam)
-		  ,_traceFile(stderr)
-		  ,_cycles(0)
-		  ,_cycleLimit(0)
+		  ,_debug(DBG_NONE)
+		  ,_error(E_NONE)
 		  ,_errorLevel(EL_NONE)
+		  ,_cycles(0)
+		  ,_doProfiling(false)
+		  ,_maxRam(maxRam)
 		  ,_labelRange(6)
-		  ,_error(E_NONE)
 		  ,_traceMemory(false)
+		  ,_memOpBatch(1)
+		  ,_core(CORE_DEFAULT)
+		  ,_context(nullptr)
+		  ,_banking(false)
+		  ,_fastMacros(false)
+		  ,_traceWriter(nullptr)
+		  ,_cycleLimit(0)
+		  ,_cycleStop(CYCLE_NEVER)
+		  ,_traceFile(stderr)
+		  ,_traceOps(0)
+		  ,_eventOrder(0)
+		  ,_eventsRun(0)
+		  ,_labelsExact(0)
+		  ,_labelsChanged(true)
+		  ,_blocks(nullptr)
+		  ,_blocksChanged(false)
+		  ,_blockDepth(0)
+		  ,_nextDepth(0)
 	{
+	_idle.branch = IDLE_NONE;
+
 	/*************************************************************************\
 	|* Set up the dynamic memory arrays
 	\*************************************************************************/
 	_mem				= new uint8_t[_maxRam];
 	_memState			= new uint8_t[_maxRam];
-	_readCbs			= new SIM_CB[_maxRam];
-	_writeCbs			= new SIM_CB[_maxRam];
-	_execCbs			= new SIM_CB[_maxRam];
-	_profileData.cycles	= new uint64_t[_maxRam];
-	_profileData.branch	= new uint64_t[_maxRam];
-	_profileData.extra	= new uint64_t[_maxRam];
-	_profileData.mflag	= new uint64_t[_maxRam];
+	_numPages			= (_maxRam + 0xFF) >> 8;
+	_cbPages			= new CallbackPage*[_numPages]();
+	_profileData.cycles	= new uint64_t[_maxRam]();
+	_profileData.branch	= new uint64_t[_maxRam]();
+	_profileData.extra	= new uint64_t[_maxRam]();
+	_profileData.mflag	= new uint64_t[_maxRam]();
+
+	_profileData.branch_skip	= 0;
+	_profileData.branch_taken	= 0;
+	_profileData.branch_extra	= 0;
+	_profileData.abs_x_extra	= 0;
+	_profileData.abs_y_extra	= 0;
+	_profileData.ind_y_extra	= 0;
+	_profileData.instructions	= 0;
+
+	_blockStats = {0, 0, 0, 0, 0};
 
 
 	/*************************************************************************\
@@ -299,11 +362,15 @@ Simulator::Simulator(int maxRam,
 \*****************************************************************************/
 Simulator::~Simulator(void)
 	{
+	_flushBlocks();
+	_freeDeadBlocks();
+	DELETE_ARRAY(_blocks);
+
 	DELETE_ARRAY(_mem);
 	DELETE_ARRAY(_memState);
-	DELETE_ARRAY(_readCbs);
-	DELETE_ARRAY(_writeCbs);
-	DELETE_ARRAY(_execCbs);
+	for (uint32_t i=0; i<_numPages; i++)
+		DELETE(_cbPages[i]);
+	DELETE_ARRAY(_cbPages);
 	DELETE_ARRAY(_profileData.cycles);
 	DELETE_ARRAY(_profileData.branch);
 	DELETE_ARRAY(_profileData.extra);
@@ -318,19 +385,101 @@ void Simulator::reset(bool hard)
 	_regs = {0, 0, 0, 0, 0xFF, 0, 0xFF};
 	setFlags(0xFF, 0x34);
 
+	for (auto& kv : _bpPredicates)
+		kv.second.resetHits();
+	for (auto& kv : _wpPredicates)
+		kv.second.resetHits();
+
 	if (hard)
 		{
+		_flushBlocks();
 		_breakpoints.clear();
+		_bpPredicates.clear();
+		_watchpoints.clear();
+		_wpPredicates.clear();
 		_labels.clear();
+		_labelsChanged = true;
+		_flushSamples();
+		clearProfile();
+		_callProfile.clear();
+		_events.clear();
+		_updateStop();
+		for (uint32_t i=0; i<_numPages; i++)
+			DELETE(_cbPages[i]);
 		for (int i=0; i<_maxRam; i++)
 			{
-			_readCbs[i]		= nullptr;
-			_writeCbs[i]	= nullptr;
-			_execCbs[i]		= nullptr;
 			_mem[i]			= 0x0;
 			_memState[i]	= MS_UNDEFINED | MS_INVALID;
 			}
+
+		_banks.clear();
+		if (_banking)
+			_addBankCallbacks();
+		_macros.clear();
+		}
+	}
+
+/*****************************************************************************\
+|* Save the machine state
+\*****************************************************************************/
+void Simulator::saveState(Snapshot& snap)
+	{
+	snap.regs		= _regs;
+	snap.cycles		= _cycles;
+	snap.mem.assign(_mem, _mem + _maxRam);
+	snap.memState.assign(_memState, _memState + _maxRam);
+	snap.events		= _events;
+	snap.banks		= _banks;
+	}
+
+/*****************************************************************************\
+|* Restore the machine state. Decoded blocks are no longer valid, and the
+|* breakpoints and callbacks are whatever they are now, not what they were
+\*****************************************************************************/
+void Simulator::restoreState(const Snapshot& snap)
+	{
+	_flushBlocks();
+
+	int size = MIN(_maxRam, (int)snap.mem.size());
+	memcpy(_mem, snap.mem.data(), size);
+	for (int i=0; i<size; i++)
+		_memState[i] = (snap.memState[i] & ~(MS_CODE | MS_DEBUG | MS_CALLBACK))
+					 | (_memState[i] & (MS_DEBUG | MS_CALLBACK));
+
+	_regs		= snap.regs;
+	_cycles		= snap.cycles;
+	_events		= snap.events;
+	_banks		= snap.banks;
+	_error		= E_NONE;
+
+	_idle.branch = IDLE_NONE;
+	_flushSamples();
+	_sampler.rebase(_cycles);
+	_updateStop();
+	}
+
+/*****************************************************************************\
+|* Replay a memory op. Touching memory initialises it, and a successful write
+|* means it was RAM, as it did when the op first happened
+\*****************************************************************************/
+void Simulator::replayOp(const MemoryOp& op, bool forwards)
+	{
+	uint32_t address = op.address;
+	if (address >= (uint32_t)_maxRam)
+		return;
+
+	if (_memState[address] & MS_CODE)
+		_invalidateCode(address);
+
+	if (op.type == OP_WRITE)
+		{
+		if (forwards)
+			_memState[address] &= ~(MS_UNDEFINED | MS_ROM | MS_INVALID);
+		_mem[address] = forwards ? op.newVal : op.oldVal;
+		_syncBanks(address, 1);
 		}
+	else if (forwards)
+		_memState[address] &= ~MS_INVALID;
 	}
 
 /*****************************************************************************\
@@ -340,17 +489,24 @@ void Simulator::addCallback(SIM_CB cb, uint32_t address, CallbackType type)
 	{
 	if (address < _maxRam)
 		{
+		// Any cached code here (or prefetching from here) is now stale
+		_invalidateBlocks(address, 2);
+
+		CallbackPage *& page = _cbPages[address >> 8];
+		if (page == nullptr)
+			page = new CallbackPage();
+
 		_memState[address] |= MS_CALLBACK;
 		switch (type)
 			{
 			case CB_READ:
-				_readCbs[address] = cb;
+				page->read[address & 0xFF] = cb;
 				break;
 			case CB_WRITE:
-				_writeCbs[address] = cb;
+				page->write[address & 0xFF] = cb;
 				break;
 			case CB_EXEC:
-				_execCbs[address] = cb;
+				page->exec[address & 0xFF] = cb;
 
 				// Allow read from next location, as CPU always reads 2 bytes
 				if (address + 1 < _maxRam)
@@ -482,6 +638,7 @@ bool Simulator::shouldExit(void)
 		case E_CALL_RET:
 		case E_CYCLE_LIMIT:
 		case E_BREAKPOINT:
+		case E_WATCHPOINT:
 		case E_USER:
 			// Exit always
 			return 1;
@@ -519,6 +676,7 @@ String Simulator::errorString(ErrorCode e)
 		"return from emulator",
 		"cycle limit reached",
 		"breakpoint hit",
+		"watchpoint hit",
 		"user defined error"
 		};
 
@@ -547,6 +705,381 @@ void Simulator::setFlags(uint8_t mask, uint8_t value)
 void Simulator::setCycleLimit(uint64_t limit)
 	{
 	_cycleLimit = (limit) ? _cycles + limit : 0;
+	_updateStop();
+	}
+
+
+#pragma mark -- Events
+
+
+/*****************************************************************************\
+|* Heap ordering for the events: soonest first, then in the order added
+\*****************************************************************************/
+static bool _eventLater(const Simulator::Event& a, const Simulator::Event& b)
+	{
+	return (a.due > b.due) || ((a.due == b.due) && (a.order > b.order));
+	}
+
+/*****************************************************************************\
+|* Events: schedule an event
+\*****************************************************************************/
+void Simulator::addEvent(SIM_EVENT cb, uint64_t cycle, uint64_t period)
+	{
+	_events.push_back({cycle, period, _eventOrder++, cb});
+	std::push_heap(_events.begin(), _events.end(), _eventLater);
+	_updateStop();
+	}
+
+/*****************************************************************************\
+|* Events: remove every event with this handler
+\*****************************************************************************/
+void Simulator::removeEvent(SIM_EVENT cb)
+	{
+	_events.erase(std::remove_if(_events.begin(), _events.end(),
+		[cb](const Event& ev) -> bool
+			{
+			return ev.cb == cb;
+			}), _events.end());
+	std::make_heap(_events.begin(), _events.end(), _eventLater);
+	_updateStop();
+	}
+
+/*****************************************************************************\
+|* Events: move everything due at or before 'cycle' past it, dropping the
+|* one-off events
+\*****************************************************************************/
+void Simulator::skipEvents(uint64_t cycle)
+	{
+	std::vector<Event> events;
+	for (Event ev : _events)
+		{
+		if (ev.due <= cycle)
+			{
+			if (ev.period == 0)
+				continue;
+			ev.due += ((cycle - ev.due) / ev.period + 1) * ev.period;
+			}
+		events.push_back(ev);
+		}
+
+	_events = events;
+	std::make_heap(_events.begin(), _events.end(), _eventLater);
+	_updateStop();
+	}
+
+/*****************************************************************************\
+|* Events: the cores only have to look at the events and the cycle limit
+|* once the cycle count reaches _cycleStop
+\*****************************************************************************/
+void Simulator::_updateStop(void)
+	{
+	_cycleStop = (_cycleLimit) ? _cycleLimit : CYCLE_NEVER;
+	if (_events.size() > 0)
+		_cycleStop = MIN(_cycleStop, _events.front().due);
+	if (_sampler.active())
+		_cycleStop = MIN(_cycleStop, _sampler.due());
+	}
+
+/*****************************************************************************\
+|* Events: run everything that is due. A repeating event is rescheduled
+|* before it runs, so it can remove itself
+\*****************************************************************************/
+void Simulator::_runEvents(void)
+	{
+	if (_sampler.active() && (_cycles >= _sampler.due()))
+		{
+		if (_sampler.add(_cycles, _regs.pc, _callProfile.current()) ||
+			_doProfiling)
+			_flushSamples();
+		}
+
+	while ((_events.size() > 0) && (_events.front().due <= _cycles))
+		{
+		std::pop_heap(_events.begin(), _events.end(), _eventLater);
+		Event ev = _events.back();
+		_events.pop_back();
+
+		if (ev.period)
+			{
+			_events.push_back({ev.due + ev.period, ev.period, ev.order, ev.cb});
+			std::push_heap(_events.begin(), _events.end(), _eventLater);
+			}
+
+		_eventsRun ++;
+		setError(ev.cb(this, ev.due), _regs.pc);
+		if (shouldExit())
+			break;
+		}
+
+	_updateStop();
+	}
+
+
+#pragma mark -- Banking
+
+
+/*****************************************************************************\
+|* Banking: after a write that touched a bank register, swap each window that
+|* now has the wrong bank in it. Code decoded from a window goes with it,
+|* while breakpoints and callbacks stay with the address
+\*****************************************************************************/
+void Simulator::_syncBanks(uint32_t address, uint32_t length)
+	{
+	if (!_banking || !BankStore::hasSelector(address, length))
+		return;
+
+	for (int i=0; i<BankStore::NUM_WINDOWS; i++)
+		{
+		uint32_t bank = BankStore::selected(i, _mem);
+		if (bank != _banks.mapped(i))
+			{
+			const BankStore::Window& w = BankStore::windows[i];
+			_invalidateBlocks(w.base, w.size);
+			_banks.map(i, bank, _mem, _memState,
+					   MS_DEBUG | MS_CALLBACK | MS_CODE, MS_INVALID);
+			}
+		}
+	}
+
+
+/*****************************************************************************\
+|* Banking: watch for writes to the bank registers
+\*****************************************************************************/
+void Simulator::_addBankCallbacks(void)
+	{
+	for (const BankStore::Window& w : BankStore::windows)
+		for (int i=0; i<w.width; i++)
+			addCallback(::_bankCallback, w.selector + i, CB_WRITE);
+	}
+
+
+#pragma mark -- Macros
+
+
+/*****************************************************************************\
+|* Macros: look for multiply and divide loops in memory that was just loaded
+\*****************************************************************************/
+void Simulator::_scanMacros(uint32_t address, uint32_t length)
+	{
+	/*************************************************************************\
+	|* Loops that were here may not be any more
+	\*************************************************************************/
+	for (uint16_t at : _macros.forget(address, address + length))
+		{
+		CallbackPage *page = _cbPages[at >> 8];
+		if (page && (page->exec[at & 0xFF] == ::_macroCallback))
+			{
+			_invalidateBlocks(at, 2);
+			page->exec[at & 0xFF] = nullptr;
+			if (!page->read[at & 0xFF] && !page->write[at & 0xFF])
+				_memState[at] &= ~MS_CALLBACK;
+			}
+		}
+
+	/*************************************************************************\
+	|* A loop can start before the new memory and run into it
+	\*************************************************************************/
+	uint32_t from = (address > FastMacros::MAX_CODE)
+				  ? address - FastMacros::MAX_CODE
+				  : 0;
+	for (uint16_t at : _macros.scan(_mem, _maxRam, from, address + length))
+		addCallback(::_macroCallback, at, CB_EXEC);
+	}
+
+
+/*****************************************************************************\
+|* Macros: run a loop natively. Anything that would see the instructions go
+|* by - tracing, profiling, breakpoints, watchpoints, hardware behind the
+|* operands, or an event due before the loop ends - means it's interpreted
+\*****************************************************************************/
+bool Simulator::runMacro(uint32_t address)
+	{
+	const FastMacros::Loop *loop = _macros.find(address);
+	if ((loop == nullptr) || _doProfiling || _traceMemory)
+		return false;
+	if ((_debug >= DBG_TRACE) || (_regs.p & FLAG_D))
+		return false;
+	if (!FastMacros::present(*loop, _mem))
+		return false;
+
+	if (_memState[address] & MS_BREAKPOINT)
+		return false;
+	for (uint32_t i=address+1; i<=loop->end; i++)
+		if (_memState[i] & (MS_BREAKPOINT | MS_CALLBACK))
+			return false;
+
+	const uint16_t operands[] = {loop->a, loop->b, loop->r};
+	for (uint16_t base : operands)
+		for (int i=0; i<loop->width; i++)
+			if (_memState[base + i] != 0)
+				return false;
+
+	FastMacros::Result res;
+	FastMacros::run(*loop, _mem, _regs.a, res);
+	if (_cycles + res.cycles > _cycleStop)
+		return false;
+
+	/*************************************************************************\
+	|* Nothing is watching the operands, so they can be written directly
+	\*************************************************************************/
+	memcpy(_mem + loop->a, res.va, loop->width);
+	memcpy(_mem + loop->b, res.vb, loop->width);
+	memcpy(_mem + loop->r, res.vr, loop->width);
+
+	_regs.a = res.a;
+	if (loop->kind == FastMacros::FM_MUL)
+		_regs.x = res.counter;
+	else
+		_regs.y = res.counter;
+
+	uint8_t mask	= FLAG_N | FLAG_Z | FLAG_C;
+	uint8_t value	= (res.counter & FLAG_N)
+					| (res.counter == 0 ? FLAG_Z : 0)
+					| (res.c ? FLAG_C : 0);
+	if (res.vSet)
+		{
+		mask	|= FLAG_V;
+		value	|= res.v ? FLAG_V : 0;
+		}
+	setFlags(mask, value);
+
+	_regs.pc	 = loop->end;
+	_cycles		+= res.cycles;
+	return true;
+	}
+
+
+#pragma mark -- Idle loops
+
+
+/*****************************************************************************\
+|* Idle loops: called by the table core when it takes a backward branch. If
+|* it took the same branch last time, with the same registers and no events
+|* in between, and the loop can't write anything or read anything that
+|* changes by itself, then every trip round will be the same until the next
+|* event (or the cycle limit). So move the clock on by as many whole trips
+|* as fit before then, which leaves the machine exactly as running them would
+\*****************************************************************************/
+void Simulator::_idleBranch(uint16_t branch)
+	{
+	bool same =	(_idle.branch		== branch)			&&
+				(_idle.eventsRun	== _eventsRun)		&&
+				(_idle.regs.pc		== _regs.pc)		&&
+				(_idle.regs.a		== _regs.a)			&&
+				(_idle.regs.x		== _regs.x)			&&
+				(_idle.regs.y		== _regs.y)			&&
+				(_idle.regs.s		== _regs.s)			&&
+				(_idle.regs.p		== _regs.p)			&&
+				(_idle.regs.p_valid	== _regs.p_valid)	&&
+				(_idle.lazy[0]		== _lzN)			&&
+				(_idle.lazy[1]		== _lzZ)			&&
+				(_idle.lazy[2]		== _lzC)			&&
+				(_idle.lazy[3]		== _lzV);
+
+	if (same && (_cycleStop != CYCLE_NEVER) && (_cycles < _cycleStop) &&
+		_idleLoop(_regs.pc, branch))
+		{
+		uint64_t trip	= _cycles - _idle.cycles;
+		_cycles		   += ((_cycleStop - _cycles) / trip) * trip;
+		}
+
+	_idle.branch		= branch;
+	_idle.regs			= _regs;
+	_idle.lazy[0]		= _lzN;
+	_idle.lazy[1]		= _lzZ;
+	_idle.lazy[2]		= _lzC;
+	_idle.lazy[3]		= _lzV;
+	_idle.cycles		= _cycles;
+	_idle.eventsRun		= _eventsRun;
+	}
+
+/*****************************************************************************\
+|* Idle loops: the loop has to be a straight run of instructions that only
+|* read plain memory or change registers, ending in the branch. Nothing in
+|* it (code or data) can have callbacks, breakpoints or watchpoints
+\*****************************************************************************/
+bool Simulator::_idleLoop(uint16_t start, uint16_t branch)
+	{
+	if ((_memState[branch] | _memState[branch + 1]) & ~(MS_ROM | MS_CODE))
+		return false;
+
+	uint32_t addr = start;
+	while (addr < branch)
+		{
+		uint8_t insn	= _mem[addr];
+		uint8_t len		= _insnLength[insn];
+		for (uint32_t i=addr; i<addr+len; i++)
+			if (_memState[i] & ~(MS_ROM | MS_CODE))
+				return false;
+
+		uint32_t data = _mem[addr + 1];
+		if (len > 2)
+			data |= ((uint32_t)_mem[addr + 2]) << 8;
+
+		int32_t operand = -1;
+		switch (_insnMode[insn])
+			{
+			case aIMP:
+			case aACC:
+				switch (_insnTypes[insn])
+					{
+					case iBRK:
+					case iPHA:
+					case iPHP:
+					case iPLA:
+					case iPLP:
+					case iRTI:
+					case iRTS:
+						return false;
+					default:
+						break;
+					}
+				break;
+
+			case aIMM:
+				break;
+
+			case aZPG:	operand = data & 0xFF;					break;
+			case aZPX:	operand = (data + _regs.x) & 0xFF;		break;
+			case aZPY:	operand = (data + _regs.y) & 0xFF;		break;
+			case aABS:	operand = data;							break;
+			case aABX:	operand = data + _regs.x;				break;
+			case aABY:	operand = data + _regs.y;				break;
+
+			default:
+				return false;
+			}
+
+		if (operand >= 0)
+			{
+			switch (_insnTypes[insn])
+				{
+				case iLDA:
+				case iLDX:
+				case iLDY:
+				case iCMP:
+				case iCPX:
+				case iCPY:
+				case iBIT:
+				case iAND:
+				case iORA:
+				case iEOR:
+				case iADC:
+				case iSBC:
+					break;
+				default:
+					return false;
+				}
+
+			if ((operand >= _maxRam) ||
+				(_memState[operand] & ~(MS_ROM | MS_CODE)))
+				return false;
+			}
+
+		addr += len;
+		}
+
+	return addr == branch;
 	}
 
 /*****************************************************************************\
@@ -560,6 +1093,9 @@ void Simulator::addRAM(uint32_t address, uint32_t length, bool zero)
 	if (end >= _maxRam)
 		end = _maxRam;
 
+	_invalidateBlocks(address, end - address);
+
+	uint32_t start = address;
 	uint8_t flags = (zero)
 		  ? (MS_UNDEFINED | MS_ROM | MS_INVALID)
 		  : MS_UNDEFINED;
@@ -570,6 +1106,9 @@ void Simulator::addRAM(uint32_t address, uint32_t length, bool zero)
 		if (zero)
 			_mem[address] = 0;
 		}
+
+	if (zero)
+		_syncBanks(start, end - start);
 	}
 
 
@@ -584,11 +1123,34 @@ void Simulator::addRAM(uint32_t address, uint8_t *data, uint32_t length)
 	if (end >= _maxRam)
 		end = _maxRam;
 
+	uint32_t start = address;
+	_invalidateBlocks(address, end - address);
+
 	for (; address < end; address++, data++)
 		{
+		/*********************************************************************\
+		|* Hardware callbacks change memory this way, so it has to show up
+		|* in the memory-op trace alongside the CPU's own writes
+		\*********************************************************************/
+		if (_traceMemory)
+			{
+			MemoryOp op;
+			op.pc		= _oldPC;
+			op.address	= address;
+			op.oldVal	= _mem[address];
+			op.newVal	= *data;
+			op.type		= OP_WRITE;
+			op.isValid	= true;
+			_memOps.add(op);
+			}
+
 		_memState[address]	&= ~(MS_UNDEFINED | MS_ROM | MS_INVALID);
 		_mem[address]		 = *data;
 		}
+
+	_syncBanks(start, end - start);
+	if (_fastMacros)
+		_scanMacros(start, end - start);
 	}
 
 /*****************************************************************************\
@@ -602,6 +1164,8 @@ void Simulator::addROM(uint32_t address, uint8_t *data, uint32_t length)
 	if (end >= _maxRam)
 		end = _maxRam;
 
+	_invalidateBlocks(address, end - address);
+
 	for (; address < end; address++, data++)
 		{
 		_memState[address]	&= ~(MS_UNDEFINED | MS_INVALID);
@@ -612,7 +1176,8 @@ void Simulator::addROM(uint32_t address, uint8_t *data, uint32_t length)
 
 
 /*****************************************************************************\
-|* Run until some error completion
+|* Run until some error completion. The switch core's features are chosen
+|* once, here, so changing them takes effect from the next run()
 \*****************************************************************************/
 Simulator::ErrorCode Simulator::run(uint32_t address, Registers *regs)
 	{
@@ -621,8 +1186,17 @@ Simulator::ErrorCode Simulator::run(uint32_t address, Registers *regs)
 
 	_error		= E_NONE;
 	_regs.pc	= address & 0xFFFF;
-	while (!shouldExit())
-		next();
+	_idle.branch = IDLE_NONE;
+	if ((_core == CORE_BLOCK) && _tableEligible())
+		_runBlocks();
+	else if ((_core == CORE_TABLE) && _tableEligible())
+		_runTable(false);
+	else
+		{
+		StepHandler step = _nextTable[_features()];
+		while (!shouldExit())
+			(this->*step)();
+		}
 
 	if (regs)
 		*regs = _regs;
@@ -673,6 +1247,21 @@ Simulator::ErrorCode Simulator::call(uint32_t address, Registers *regs)
 	return err;
 	}
 
+/*****************************************************************************\
+|* Carry on with a call. A restored machine won't have the callback on the
+|* return address, so put it back
+\*****************************************************************************/
+Simulator::ErrorCode Simulator::resume(void)
+	{
+	addCallback(::_rtsCallback, 0xFFFF, CB_EXEC);
+
+	ErrorCode err = run(_regs.pc);
+	if (err == E_CALL_RET)
+		err = _error = E_NONE;
+
+	return err;
+	}
+
 
 /*****************************************************************************\
 |* Set the trace output
@@ -723,6 +1312,7 @@ int  Simulator::getByte(uint32_t address)
 \*****************************************************************************/
 Simulator::ProfileData Simulator::profileInfo(void)
 	{
+	_flushSamples();
 	ProfileData copy = _profileData;
 	return copy;
 	}
@@ -737,7 +1327,19 @@ Simulator::ProfileData Simulator::profileInfo(void)
 void Simulator::addLabel(uint32_t address, String label)
 	{
 	if (label.length() > 0)
+		{
 		_labels[address] = label;
+		_labelsChanged	 = true;
+		}
+	}
+
+/*****************************************************************************\
+|* Labels: replace all the labels
+\*****************************************************************************/
+void Simulator::setLabels(const AddressMap& labels)
+	{
+	_labels			= labels;
+	_labelsChanged	= true;
 	}
 
 /*****************************************************************************\
@@ -788,6 +1390,26 @@ int Simulator::loadLabels(String path)
 
 #pragma mark -- Profiling
 
+/*****************************************************************************\
+|* Zero the profile, so a run only counts itself
+\*****************************************************************************/
+void Simulator::clearProfile(void)
+	{
+	size_t bytes = _maxRam * sizeof(uint64_t);
+	memset(_profileData.cycles, 0, bytes);
+	memset(_profileData.branch, 0, bytes);
+	memset(_profileData.extra, 0, bytes);
+	memset(_profileData.mflag, 0, bytes);
+
+	_profileData.branch_skip	= 0;
+	_profileData.branch_taken	= 0;
+	_profileData.branch_extra	= 0;
+	_profileData.abs_x_extra	= 0;
+	_profileData.abs_y_extra	= 0;
+	_profileData.ind_y_extra	= 0;
+	_profileData.instructions	= 0;
+	}
+
 /*****************************************************************************\
 |* Save a profile
 \*****************************************************************************/
@@ -797,7 +1419,7 @@ int Simulator::saveProfile(String path)
 	uint16_t version	= 0x101;
 	int e				= 0;
 	FILE *fp			= fopen(path.c_str(), "wb");
-	ProfileData pd		= _profileData;
+	ProfileData pd		= profileInfo();
 
 	if (fp)
 		{
@@ -889,27 +1511,252 @@ int Simulator::loadProfile(String path)
 	return e;
 	}
 
+/*****************************************************************************\
+|* Save the call-graph profile, as folded stacks or as a per-function table
+\*****************************************************************************/
+int Simulator::saveCallProfile(String path, bool summary)
+	{
+	int ok		= 1;
+	FILE *fp	= fopen(path.c_str(), "w");
 
-#pragma mark -- Instruction disassembly
+	_flushSamples();
+	if (fp)
+		{
+		bool e = summary ? !_callProfile.writeSummary(fp, _labels)
+						 : !_callProfile.writeFolded(fp, _labels);
+		e |= fclose(fp) != 0;
 
+		if (e)
+			error("Can't save call profile", strerror(errno));
+		else
+			ok = 0;
+		}
+
+	return ok;
+	}
 
 /*****************************************************************************\
-|* Trace printing: disassemble
+|* Start or stop sampling
 \*****************************************************************************/
-char * Simulator::disassemble(char *buf, uint32_t address)
+void Simulator::setSampling(uint64_t period)
 	{
-	_printCurrentInsn(address, buf, 0);
-	return buf;
+	_flushSamples();
+	_sampler.start(period, _cycles);
+	_updateStop();
 	}
 
 /*****************************************************************************\
-|* Get instruction information
+|* Fold the samples into the profile. While every instruction is being
+|* counted they'd be counted twice, so they're dropped
 \*****************************************************************************/
-Simulator::InstructionInfo Simulator::insnInfo(uint32_t address)
+void Simulator::_flushSamples(void)
 	{
-	if (address >= _maxRam)
-		return InstructionInfo();
-
+	if (_doProfiling)
+		_sampler.start(_sampler.period(), _cycles);
+	else
+		_sampler.flush(_profileData.cycles, _callProfile);
+	}
+
+
+#pragma mark -- State files
+
+
+/*****************************************************************************\
+|* Write the machine state, in the host's byte order
+\*****************************************************************************/
+bool Simulator::writeState(FILE *fp)
+	{
+	uint16_t version	= 0x100;
+	int e				= 0;
+	Snapshot snap;
+
+	saveState(snap);
+	for (uint8_t& state : snap.memState)
+		state &= ~(MS_CODE | MS_DEBUG | MS_CALLBACK);
+
+	e = fprintf(fp, "SIM:STATE\n") < 0;
+	e |= fwrite(&version, sizeof(version), 1, fp) < 1;
+	e |= fwrite(&_maxRam, sizeof(_maxRam), 1, fp) < 1;
+	e |= fwrite(&snap.regs, sizeof(snap.regs), 1, fp) < 1;
+	e |= fwrite(&snap.cycles, sizeof(snap.cycles), 1, fp) < 1;
+	e |= fwrite(snap.mem.data(), 1, snap.mem.size(), fp) < snap.mem.size();
+	e |= fwrite(snap.memState.data(), 1, snap.memState.size(), fp)
+			< snap.memState.size();
+
+	uint32_t count = (uint32_t) snap.events.size();
+	e |= fwrite(&count, sizeof(count), 1, fp) < 1;
+	for (const Event& ev : snap.events)
+		{
+		e |= fwrite(&ev.due, sizeof(ev.due), 1, fp) < 1;
+		e |= fwrite(&ev.period, sizeof(ev.period), 1, fp) < 1;
+		e |= fwrite(&ev.order, sizeof(ev.order), 1, fp) < 1;
+		}
+
+	e |= fwrite(&_banking, sizeof(_banking), 1, fp) < 1;
+	e |= !snap.banks.write(fp);
+
+	count = (uint32_t) _labels.size();
+	e |= fwrite(&count, sizeof(count), 1, fp) < 1;
+	for (const auto& kv : _labels)
+		{
+		uint32_t len = (uint32_t) kv.second.size();
+		e |= fwrite(&kv.first, sizeof(kv.first), 1, fp) < 1;
+		e |= fwrite(&len, sizeof(len), 1, fp) < 1;
+		e |= fwrite(kv.second.data(), 1, len, fp) < len;
+		}
+
+	if (e)
+		error("Can't write machine state", strerror(errno));
+	return e == 0;
+	}
+
+/*****************************************************************************\
+|* Read the machine state. Nothing changes unless all of it can be read
+\*****************************************************************************/
+bool Simulator::readState(FILE *fp)
+	{
+	uint16_t version	= 0;
+	int maxRam			= 0;
+	int e				= 0;
+	Snapshot snap;
+
+	char buf[32];
+	if (!fgets(buf, 16, fp) || strcmp(buf, "SIM:STATE\n"))
+		{
+		error("not a machine state file");
+		return false;
+		}
+
+	if (fread(&version, sizeof(version), 1, fp) < 1 || version != 0x100)
+		{
+		error("invalid machine state version %04x", version);
+		return false;
+		}
+
+	if (fread(&maxRam, sizeof(maxRam), 1, fp) < 1 || maxRam != _maxRam)
+		{
+		error("machine state is for %d bytes of RAM, not %d", maxRam, _maxRam);
+		return false;
+		}
+
+	snap.mem.resize(_maxRam);
+	snap.memState.resize(_maxRam);
+	e |= fread(&snap.regs, sizeof(snap.regs), 1, fp) < 1;
+	e |= fread(&snap.cycles, sizeof(snap.cycles), 1, fp) < 1;
+	e |= fread(snap.mem.data(), 1, snap.mem.size(), fp) < snap.mem.size();
+	e |= fread(snap.memState.data(), 1, snap.memState.size(), fp)
+			< snap.memState.size();
+
+	/*************************************************************************\
+	|* Events get their handlers from the ones installed now, matched up in
+	|* the order they were added
+	\*************************************************************************/
+	uint32_t count = 0;
+	e |= fread(&count, sizeof(count), 1, fp) < 1;
+	if (!e && (count != _events.size()))
+		{
+		error("machine state has %u events, not %u",
+			  count, (uint32_t)_events.size());
+		return false;
+		}
+
+	snap.events.resize(count);
+	for (Event& ev : snap.events)
+		{
+		e |= fread(&ev.due, sizeof(ev.due), 1, fp) < 1;
+		e |= fread(&ev.period, sizeof(ev.period), 1, fp) < 1;
+		e |= fread(&ev.order, sizeof(ev.order), 1, fp) < 1;
+		}
+
+	auto byOrder = [](const Event& a, const Event& b)
+		{
+		return a.order < b.order;
+		};
+	std::vector<Event> now = _events;
+	std::sort(now.begin(), now.end(), byOrder);
+	std::sort(snap.events.begin(), snap.events.end(), byOrder);
+	for (uint32_t i=0; i<count; i++)
+		snap.events[i].cb = now[i].cb;
+	std::make_heap(snap.events.begin(), snap.events.end(), _eventLater);
+
+	bool banking = false;
+	e |= fread(&banking, sizeof(banking), 1, fp) < 1;
+	e |= !snap.banks.read(fp);
+
+	AddressMap labels;
+	count = 0;
+	e |= fread(&count, sizeof(count), 1, fp) < 1;
+	for (uint32_t i=0; i<count && !e; i++)
+		{
+		uint32_t address	= 0;
+		uint32_t len		= 0;
+		e |= fread(&address, sizeof(address), 1, fp) < 1;
+		e |= fread(&len, sizeof(len), 1, fp) < 1;
+		e |= len > 0x10000;
+
+		String name(e ? 0 : len, '\0');
+		e |= fread(&name[0], 1, name.size(), fp) < name.size();
+		labels[address] = name;
+		}
+
+	if (e)
+		{
+		error("can't read machine state", strerror(errno));
+		return false;
+		}
+
+	/*************************************************************************\
+	|* The bank registers have to stay live if there are banks in use
+	\*************************************************************************/
+	if (banking && !_banking)
+		{
+		_banking = true;
+		_addBankCallbacks();
+		}
+
+	restoreState(snap);
+	_eventOrder	= 0;
+	for (const Event& ev : _events)
+		_eventOrder = MAX(_eventOrder, ev.order + 1);
+	setLabels(labels);
+
+	/*************************************************************************\
+	|* The code didn't come in through addRAM(), so look for loops in it here
+	\*************************************************************************/
+	if (_fastMacros)
+		_scanMacros(0, _maxRam);
+	return true;
+	}
+
+
+#pragma mark -- Instruction disassembly
+
+
+/*****************************************************************************\
+|* Trace printing: disassemble
+\*****************************************************************************/
+char * Simulator::disassemble(char *buf, uint32_t address)
+	{
+	_printCurrentInsn(address, buf, 0);
+	return buf;
+	}
+
+/*****************************************************************************\
+|* Get the length of an instruction
+\*****************************************************************************/
+int Simulator::insnLength(uint8_t insn)
+	{
+	return _insnLength[insn];
+	}
+
+/*****************************************************************************\
+|* Get instruction information
+\*****************************************************************************/
+Simulator::InstructionInfo Simulator::insnInfo(uint32_t address)
+	{
+	if (address >= _maxRam)
+		return InstructionInfo();
+
 	InstructionInfo info;
 
 	info.addr		= (uint16_t) address;
@@ -943,46 +1790,46 @@ Simulator::InstructionInfo Simulator::insnInfo(uint32_t address)
 			break;
 
 		case aZPG:
-			_getLabel(info.arg1, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(info.arg1);
 			break;
 
 		case aABS:
-			 _getLabel(abs, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(abs);
 			break;
 
 		case aZPX:
-			_getLabel(info.arg1 + _regs.x, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(info.arg1 + _regs.x);
 			break;
 
 		case aZPY:
-			_getLabel(info.arg1 + _regs.y, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(info.arg1 + _regs.y);
 			break;
 
 		case aABX:
-			_getLabel(abs + _regs.x, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(abs + _regs.x);
 			break;
 
 		case aABY:
-			_getLabel(abs + _regs.y, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(abs + _regs.y);
 			break;
 
 		case aIND:
 			vec = _readWord(abs);
-			_getLabel(vec, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(vec);
 			break;
 
 		case aXIN:
 			vec = _readByte(info.arg1 + _regs.x) * 256;
-			_getLabel(vec, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(vec);
 			break;
 
 		case aINY:
 			vec = _readByte(info.arg1) * 256 + _regs.y;
-			_getLabel(vec, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(vec);
 			break;
 
 		case aREL:;
-			_getLabel(address + rel + 2, _labelRange, info.argLabel);
+			info.argLabel = _getNearLabel(address + rel + 2);
 			break;
 		}
 
@@ -994,7 +1841,7 @@ Simulator::InstructionInfo Simulator::insnInfo(uint32_t address)
 
 
 /*****************************************************************************\
-|* Breakpoint: return a breakpoint if one is active
+|* Breakpoint: set all of a saved map of breakpoints
 \*****************************************************************************/
 void Simulator::applyBreakpoints(BreakpointMap& bps)
 	{
@@ -1003,8 +1850,10 @@ void Simulator::applyBreakpoints(BreakpointMap& bps)
 	for (Elements<uint32_t, PredicateInfo> kv : bps)
 		{
 		int address = kv.key & 0xFFFF;
+		_invalidateBlocks(address, 1);
 		_memState[address] |= MS_BREAKPOINT;
 		_breakpoints[address] = kv.value;
+		_bpPredicates[address] = Predicate(kv.value);
 		nc->notify(NTFY_BP_RESTORE, address);
 		}
 	}
@@ -1031,8 +1880,10 @@ PredicateInfo Simulator::breakpointAt(uint32_t address)
 void Simulator::setBreakpoint(int address, PredicateInfo info)
 	{
 	address &= 0xFFFF;
+	_invalidateBlocks(address, 1);
 	_memState[address] |= MS_BREAKPOINT;
 	_breakpoints[address] = info;
+	_bpPredicates[address] = Predicate(info);
 	}
 
 
@@ -1044,74 +1895,64 @@ void Simulator::clearBreakpoint(int address)
 	address &= 0xFFFF;
 	_memState[address] &= ~MS_BREAKPOINT;
 	_breakpoints[address] = PredicateInfo::nilPredicate();
+	_bpPredicates.erase(address);
 	}
 
 /*****************************************************************************\
-|* Breakpoint: determine if a breakpoint will trigger
+|* Breakpoint: determine if a breakpoint will trigger. The predicate was
+|* compiled when the breakpoint was set
 \*****************************************************************************/
 bool Simulator::_checkBreakpoint(int address)
 	{
-	bool shouldBreak = false;
+	auto it = _bpPredicates.find(address & 0xFFFF);
+	return (it != _bpPredicates.end()) && it->second.test(this);
+	}
 
-	PredicateInfo info = breakpointAt(address);
-	if (info.enabled)
-		{
-		for (int i=0; i<info.num && (!shouldBreak); i++)
-			{
-			int what = 0;
-			switch (info.what[i])
-				{
-				case 0:
-					return true;
-				case 1:
-					what = _regs.a;
-					break;
-				case 2:
-					what = _regs.x;
-					break;
-				case 3:
-					what = _regs.y;
-					break;
-				case 4:
-					what = _regs.p;
-					break;
-				default:
-					what = 0;
-					fprintf(stderr, "Unknown 'what' term in predicate (%d)\n",
-							info.what[i]);
-					break;
-				}
+/*****************************************************************************\
+|* Watchpoint: set a watchpoint. Accesses to watched memory always take the
+|* slow path through _readByte() / _writeByte(), in every core
+\*****************************************************************************/
+void Simulator::setWatchpoint(int address, int type, PredicateInfo info)
+	{
+	address &= 0xFFFF;
+	type	&= MS_WATCH_READ | MS_WATCH_WRITE;
 
-			switch (info.cond[i])
-				{
-				case 0:
-					shouldBreak = (what < info.values[i]);
-					break;
-				case 1:
-					shouldBreak = (what <= info.values[i]);
-					break;
-				case 2:
-					shouldBreak = (what == info.values[i]);
-					break;
-				case 3:
-					shouldBreak = (what >= info.values[i]);
-					break;
-				case 4:
-					shouldBreak = (what > info.values[i]);
-					break;
-				case 5:
-					shouldBreak = (what != info.values[i]);
-					break;
-				default:
-					shouldBreak = true;
-					fprintf(stderr, "Unknown 'condition' term in predicate (%d)\n",
-							info.cond[i]);
-					break;
-				}
-			}
-		}
+	_invalidateBlocks(address, 1);
+	_memState[address] &= ~(MS_WATCH_READ | MS_WATCH_WRITE);
+	_memState[address] |= type;
+	_watchpoints[address] = {type, info};
+	_wpPredicates[address] = Predicate(info);
+	}
+
+/*****************************************************************************\
+|* Watchpoint: clear a watchpoint
+\*****************************************************************************/
+void Simulator::clearWatchpoint(int address)
+	{
+	address &= 0xFFFF;
+	_memState[address] &= ~(MS_WATCH_READ | MS_WATCH_WRITE);
+	_watchpoints.erase(address);
+	_wpPredicates.erase(address);
+	}
 
-	return shouldBreak;
+/*****************************************************************************\
+|* Watchpoint: set all of a saved map of watchpoints
+\*****************************************************************************/
+void Simulator::applyWatchpoints(WatchpointMap& wps)
+	{
+	for (Elements<uint32_t, WatchpointInfo> kv : wps)
+		setWatchpoint(kv.key, kv.value.type, kv.value.info);
+	}
+
+/*****************************************************************************\
+|* Watchpoint: see if the watchpoint on an address that was just accessed
+|* fires. The instruction completes, and the run stops after it
+\*****************************************************************************/
+void Simulator::_checkWatchpoint(uint32_t address)
+	{
+	auto it = _wpPredicates.find(address & 0xFFFF);
+	if ((it != _wpPredicates.end()) && it->second.test(this))
+		setError(E_WATCHPOINT, address & 0xFFFF);
 	}
 
 #pragma mark -- Private Methods
@@ -1120,6 +1961,7 @@ bool Simulator::_checkBreakpoint(int address)
 /*****************************************************************************\
 |* Read (PC); set appropriate error status
 \*****************************************************************************/
+template <int F>
 uint8_t Simulator::_readPC(void)
 	{
 	uint32_t address = _regs.pc;
@@ -1129,10 +1971,10 @@ uint8_t Simulator::_readPC(void)
 	op.address	= address & 0xFFFF;
 	op.oldVal	= _mem[address];
 	op.newVal	= _mem[address];
-	op.isValid	= _traceMemory;
+	op.isValid	= ((F & SF_MEMOPS) && _traceMemory);
 	op.type		= OP_INSN;
 	if (op.isValid)
-		_memOpList.push_back(op);
+		_memOps.add(op);
 
 	if (likely(!(_memState[address] & (MS_UNDEFINED | MS_INVALID))))
 		return _mem[address];
@@ -1150,6 +1992,7 @@ uint8_t Simulator::_readPC(void)
 /*****************************************************************************\
 |* Read a byte at an address; set appropriate error status
 \*****************************************************************************/
+template <int F>
 uint8_t Simulator::_readByte(uint32_t address)
 	{
 	MemoryOp op ;
@@ -1160,26 +2003,33 @@ uint8_t Simulator::_readByte(uint32_t address)
 	op.isValid	= false;
 	op.type		= _readingInsn ? OP_INSN : OP_READ;
 
-	if (likely(!(_memState[address] & (MS_UNDEFINED|MS_INVALID|MS_CALLBACK))))
+	if (likely(!(_memState[address] & (MS_UNDEFINED|MS_INVALID|MS_CALLBACK|
+										MS_WATCH_READ))))
 		{
-		op.isValid		= _traceMemory;
+		op.isValid		= ((F & SF_MEMOPS) && _traceMemory);
 		if (op.isValid)
-			_memOpList.push_back(op);
+			_memOps.add(op);
 		return _mem[address];
 		}
 	else
 		{
 		/*********************************************************************\
-		|* Unusual memory
+		|* Unusual memory. Fetching an instruction's operands doesn't count
+		|* as a read for watchpoints
 		\*********************************************************************/
-		if ((_memState[address] & MS_CALLBACK) && _readCbs[address])
+		if ((_memState[address] & MS_WATCH_READ) && !_readingInsn)
+			_checkWatchpoint(address);
+
+		SIM_CB cb = (_memState[address] & MS_CALLBACK) ? _readCb(address)
+													   : nullptr;
+		if (cb)
 			{
-			ErrorCode e = _readCbs[address](this, &_regs, address, CB_READ);
+			ErrorCode e = cb(this, &_regs, address, CB_READ);
 			setError(e, address);
 			_writeMem = true;
-			op.isValid = _traceMemory;
+			op.isValid = ((F & SF_MEMOPS) && _traceMemory);
 			if (op.isValid)
-				_memOpList.push_back(op);
+				_memOps.add(op);
 			return e;
 			}
 		else
@@ -1195,9 +2045,9 @@ uint8_t Simulator::_readByte(uint32_t address)
 				setError(E_RD_UNINIT, address);
 				_memState[address] &= ~MS_INVALID; // Initializes the memory
 				}
-			op.isValid = _traceMemory;
+			op.isValid = ((F & SF_MEMOPS) && _traceMemory);
 			if (op.isValid)
-				_memOpList.push_back(op);
+				_memOps.add(op);
 			return _mem[address];
 			}
 		}
@@ -1206,47 +2056,57 @@ uint8_t Simulator::_readByte(uint32_t address)
 /*****************************************************************************\
 |* Read a word at an address; set appropriate error status
 \*****************************************************************************/
+template <int F>
 uint16_t Simulator::_readWord(uint32_t address)
 	{
-	uint16_t d1 = _readByte(address);
-	return d1 | (_readByte(address + 1) << 8);
+	uint16_t d1 = _readByte<F>(address);
+	return d1 | (_readByte<F>(address + 1) << 8);
 	}
 
 /*****************************************************************************\
 |* Read a byte using the X-indexed addressing mode
 \*****************************************************************************/
+template <int F>
 uint8_t Simulator::_readIndX(uint32_t address)
 	{
 	_cycles += 6;
-	address = _readWord((address + _regs.x) & 0xFF);
-	return _readByte(address);
+	address = _readWord<F>((address + _regs.x) & 0xFF);
+	return _readByte<F>(address);
 	}
 
 /*****************************************************************************\
 |* Read a byte using the Y-indexed addressing mode
 \*****************************************************************************/
+template <int F>
 uint8_t Simulator::_readIndY(uint32_t address)
 	{
 	_cycles += 5;
-	address = _readWord(address & 0xFF);
+	address = _readWord<F>(address & 0xFF);
 
 	if (unlikely(((address & 0xFF) + _regs.y) > 0xFF))
 		{
 		_cycles++;
-		if (_doProfiling)
+		if ((F & SF_PROFILE) && _doProfiling)
 			{
 			_profileData.ind_y_extra ++;
 			_profileData.extra[(_regs.pc-2) & 0xFFFF] ++;
 			}
 		}
-	return _readByte(0xFFFF & (address + _regs.y));
+	return _readByte<F>(0xFFFF & (address + _regs.y));
 	}
 
 /*****************************************************************************\
 |* Write a byte at an address; set appropriate error status
 \*****************************************************************************/
+template <int F>
 void Simulator::_writeByte(uint32_t address, uint8_t val)
 	{
+	/*************************************************************************\
+	|* Writes over cached code discard the blocks decoded from it
+	\*************************************************************************/
+	if (unlikely(_memState[address] & MS_CODE))
+		_invalidateCode(address);
+
 	MemoryOp op ;
 	op.pc		= _oldPC;
 	op.address	= address & 0xFFFF;
@@ -1254,10 +2114,10 @@ void Simulator::_writeByte(uint32_t address, uint8_t val)
 	op.isValid	= false;
 	op.type		= OP_WRITE;
 
-	if (likely(!(_memState[address]) && (!_doProfiling)))
+	if (likely(!(_memState[address]) && !((F & SF_PROFILE) && _doProfiling)))
 		{
 		_mem[address] = val;
-		op.isValid = _traceMemory;
+		op.isValid = ((F & SF_MEMOPS) && _traceMemory);
 		}
 	else
 		{
@@ -1267,35 +2127,38 @@ void Simulator::_writeByte(uint32_t address, uint8_t val)
 				{
 				_writeMem		= true;
 				_mem[address]	= val;
-				op.isValid		= _traceMemory;
+				op.isValid		= ((F & SF_MEMOPS) && _traceMemory);
 				op.newVal		= val;
 				if (op.isValid)
-					_memOpList.push_back(op);
+					_memOps.add(op);
 				}
 			return;
 			}
 		_writeMem = true;
 
-		if (likely(!(_memState[address] & ~MS_INVALID)))
+		if (likely(!(_memState[address] & (MS_UNDEFINED|MS_ROM|MS_CALLBACK))))
 			{
-			_mem[address]		= val;
-			_memState[address]	= 0;
-			op.isValid			= _traceMemory;
+			_mem[address]		 = val;
+			_memState[address]	&= MS_DEBUG;
+			op.isValid			 = ((F & SF_MEMOPS) && _traceMemory);
 			}
-		else if ((_memState[address] & MS_CALLBACK) && _writeCbs[address])
-			setError(_writeCbs[address](this, &_regs, address, val), address);
+		else if ((_memState[address] & MS_CALLBACK) && _writeCb(address))
+			setError(_writeCb(address)(this, &_regs, address, val), address);
 
 		else if (_memState[address] & MS_UNDEFINED)
 			setError(E_WR_UNDEF, address);
 
 		else if (_memState[address] & MS_ROM)
 			setError(E_WR_ROM, address);
+
+		if (_memState[address] & MS_WATCH_WRITE)
+			_checkWatchpoint(address);
 		}
 
 	if (op.isValid)
 		{
 		op.newVal		= val;
-		_memOpList.push_back(op);
+		_memOps.add(op);
 		}
 	}
 
@@ -1303,21 +2166,23 @@ void Simulator::_writeByte(uint32_t address, uint8_t val)
 /*****************************************************************************\
 |* Write a byte using the X-indexed addressing mode
 \*****************************************************************************/
+template <int F>
 void Simulator::_writeIndX(uint32_t address, uint8_t val)
 	{
 	_cycles += 6;
-	address = _readWord((address + _regs.x) & 0xFF);
-	_writeByte(address, val);
+	address = _readWord<F>((address + _regs.x) & 0xFF);
+	_writeByte<F>(address, val);
 	}
 
 /*****************************************************************************\
 |* Write a byte using the Y-indexed addressing mode
 \*****************************************************************************/
+template <int F>
 void Simulator::_writeIndY(uint32_t address, uint8_t val)
 	{
 	_cycles += 6;
-	address = _readWord(address & 0xFF);
-	_writeByte(0xFFFF & (address + _regs.y), val);
+	address = _readWord<F>(address & 0xFF);
+	_writeByte<F>(0xFFFF & (address + _regs.y), val);
 	}
 
 
@@ -1326,46 +2191,81 @@ void Simulator::_writeIndY(uint32_t address, uint8_t val)
 \*****************************************************************************/
 const String& Simulator::_getLabel(uint32_t address)
 	{
-	static const String none = "";
+	if (unlikely(_labelsChanged))
+		_indexLabels();
+
+	uint32_t name = (address < _labelIndex.size()) ? _labelIndex[address] : 0;
+	return _labelNames[(name <= _labelsExact) ? name : 0];
+	}
 
-	AddressMap::iterator it = _labels.find(address);
-	if (it != _labels.end())
-		return  it->second;
+/*****************************************************************************\
+|* Return any known label for this address, or the nearest one to it
+\*****************************************************************************/
+const String& Simulator::_getNearLabel(uint32_t address)
+	{
+	if (unlikely(_labelsChanged))
+		_indexLabels();
 
-	return none;
+	uint32_t name = (address < _labelIndex.size()) ? _labelIndex[address] : 0;
+	return _labelNames[name];
 	}
 
 /*****************************************************************************\
-|* Return any known label for this address
+|* Labels: build the index. An address gets the closest label, and of two
+|* equally close the one below it, as searching outwards would find
 \*****************************************************************************/
-void Simulator::_getLabel(uint32_t address, int slack, String &label)
+void Simulator::_indexLabels(void)
 	{
-	static const String none = "";
-	label = none;
+	_labelsChanged = false;
+	_labelNames.assign(1, "");
+	_labelIndex.clear();
+	_labelsExact = 0;
 
-	label =_getLabel(address);
-	if ((slack == 0) || (label.length() > 0))
+	auto last = _labels.upper_bound(0xFFFF);
+	if (last == _labels.begin())
 		return;
 
-	int delta = 1;
-	while (delta <= slack)
-		{
-		AddressMap::iterator it = _labels.find(address-delta);
-		if (it != _labels.end())
+	/*************************************************************************\
+	|* Rank the labels near each address: 0 for one at the address, then
+	|* 2d-1 for one d below it and 2d for one d above it
+	\*************************************************************************/
+	uint32_t size = std::prev(last)->first + _labelRange + 1;
+	std::vector<const AddressMap::value_type *> owner(size, nullptr);
+	std::vector<int> rank(size, 0);
+
+	for (auto it = _labels.begin(); it != last; it++)
+		for (int d = -_labelRange; d <= _labelRange; d++)
 			{
-			label = it->second + " + "+ std::to_string(delta);
-			break;
+			int64_t at	= (int64_t)it->first + d;
+			int r		= (d > 0) ? 2 * d - 1 : -2 * d;
+			if ((at >= 0) && ((owner[at] == nullptr) || (r < rank[at])))
+				{
+				owner[at]	= &(*it);
+				rank[at]	= r;
+				}
 			}
 
-		it = _labels.find(address+delta);
-		if (it != _labels.end())
+	/*************************************************************************\
+	|* The labels get the first names, so _getLabel() can tell them apart
+	\*************************************************************************/
+	_labelIndex.assign(size, 0);
+	for (uint32_t at=0; at<size; at++)
+		if (owner[at] && (rank[at] == 0))
 			{
-			label = it->second + " - " + std::to_string(delta);
-			break;
+			_labelIndex[at] = (uint32_t)_labelNames.size();
+			_labelNames.push_back(owner[at]->second);
 			}
+	_labelsExact = (uint32_t)_labelNames.size() - 1;
 
-		delta ++;
-		}
+	for (uint32_t at=0; at<size; at++)
+		if (owner[at] && (rank[at] != 0))
+			{
+			int64_t d = (int64_t)at - owner[at]->first;
+			_labelIndex[at] = (uint32_t)_labelNames.size();
+			_labelNames.push_back(owner[at]->second
+								  + ((d > 0) ? " + " : " - ")
+								  + std::to_string((d > 0) ? d : -d));
+			}
 	}
 
 
@@ -1479,13 +2379,14 @@ void Simulator::_sbc(uint8_t val)
 /*****************************************************************************\
 |* Instruction: branch ops
 \*****************************************************************************/
+template <int F>
 void Simulator::_branch(int8_t off, uint8_t mask, int cond)
 	{
 	_cycles += 2;
 	if (!_getFlags(mask) == !cond)
 		{
 		_cycles++;
-		if (_doProfiling)
+		if ((F & SF_PROFILE) && _doProfiling)
 			{
 			_profileData.branch[(_regs.pc-2) & 0xFFFF] ++;
 			_profileData.branch_taken ++;
@@ -1495,7 +2396,7 @@ void Simulator::_branch(int8_t off, uint8_t mask, int cond)
 		if ((val & 0xFF00) != (_regs.pc & 0xFF00))
 			{
 			_cycles++;
-			if (_doProfiling)
+			if ((F & SF_PROFILE) && _doProfiling)
 				{
 				_profileData.extra[(_regs.pc-2) & 0xFFFF] ++;
 				_profileData.branch_extra ++;
@@ -1503,7 +2404,7 @@ void Simulator::_branch(int8_t off, uint8_t mask, int cond)
 			}
 		_regs.pc = val;
 		}
-	else if (_doProfiling)
+	else if ((F & SF_PROFILE) && _doProfiling)
 		_profileData.branch_skip ++;
 	}
 
@@ -1511,13 +2412,14 @@ void Simulator::_branch(int8_t off, uint8_t mask, int cond)
 /*****************************************************************************\
 |* Instruction: BIT. Special case BIT insns as sometimes are used to SKIP
 \*****************************************************************************/
+template <int F>
 void Simulator::_bit(uint32_t address)
 	{
 	if ((_memState[address] & MS_INVALID) && !(_memState[address] &  MS_CALLBACK))
 		_regs.p_valid |= (FLAG_N | FLAG_V | FLAG_Z);
 	else
 		{
-		uint8_t val = _readByte(address);
+		uint8_t val = _readByte<F>(address);
 		SETN(val);
 		SETV(val & 0x40);
 		SETZ(_regs.a & val);
@@ -1528,8 +2430,12 @@ void Simulator::_bit(uint32_t address)
 /*****************************************************************************\
 |* Instruction: JSR
 \*****************************************************************************/
+template <int F>
 void Simulator::_jsr(uint32_t address)
 	{
+	if (((F & SF_PROFILE) && _doProfiling) || unlikely(_sampler.active()))
+		_callProfile.call(address, _regs.s);
+
 	_regs.pc = (_regs.pc - 1) & 0xFFFF;
 	PUSH(_regs.pc >> 8);
 	PUSH(_regs.pc);
@@ -1540,6 +2446,7 @@ void Simulator::_jsr(uint32_t address)
 /*****************************************************************************\
 |* Instruction: RTS
 \*****************************************************************************/
+template <int F>
 void Simulator::_rts(void)
 	{
 	uint32_t val;
@@ -1549,12 +2456,16 @@ void Simulator::_rts(void)
 	_regs.pc |= (val << 8);
 	_regs.pc = (_regs.pc + 1) & 0xFFFF;
 	_cycles += 6;
+
+	if (((F & SF_PROFILE) && _doProfiling) || unlikely(_sampler.active()))
+		_callProfile.ret(_regs.s);
 	}
 
 
 /*****************************************************************************\
 |* Instruction: RTI
 \*****************************************************************************/
+template <int F>
 void Simulator::_rti(void)
 	{
 	uint32_t val;
@@ -1565,18 +2476,22 @@ void Simulator::_rti(void)
 	_regs.pc |= (val << 8);
 	_regs.pc = (_regs.pc) & 0xFFFF;
 	_cycles += 2;
+
+	if (((F & SF_PROFILE) && _doProfiling) || unlikely(_sampler.active()))
+		_callProfile.ret(_regs.s);
 	}
 
 
 /*****************************************************************************\
 |* Extra cycles due to page boundaries on X index
 \*****************************************************************************/
+template <int F>
 void Simulator::_handleExtraAbsoluteX(uint32_t address)
 	{
 	if (((address & 0xFF) + _regs.x) > 0xFF)
 		{
 		_cycles++;
-		if (_doProfiling)
+		if ((F & SF_PROFILE) && _doProfiling)
 			{
 			_profileData.extra[(_regs.pc-3) & 0xFFFF] ++;
 			_profileData.abs_x_extra ++;
@@ -1587,12 +2502,13 @@ void Simulator::_handleExtraAbsoluteX(uint32_t address)
 /*****************************************************************************\
 |* Extra cycles due to page boundaries on Y index
 \*****************************************************************************/
+template <int F>
 void Simulator::_handleExtraAbsoluteY(uint32_t address)
 	{
 	if (((address & 0xFF) + _regs.y) > 0xFF)
 		{
 		_cycles++;
-		if (_doProfiling)
+		if ((F & SF_PROFILE) && _doProfiling)
 			{
 			_profileData.extra[(_regs.pc-3) & 0xFFFF] ++;
 			_profileData.abs_y_extra ++;
@@ -1606,32 +2522,107 @@ void Simulator::_handleExtraAbsoluteY(uint32_t address)
 \*****************************************************************************/
 void Simulator::next(void)
 	{
-	uint32_t val;
-	uint64_t old_cycles = 0;
-	Registers old_regs = {0,0,0,0,0,0,0};
+	(this->*_nextTable[_features()])();
+	}
+
+/*****************************************************************************\
+|* Run the next instruction, with only the features in F compiled in
+\*****************************************************************************/
+template <int F>
+void Simulator::_next(void)
+	{
+	/*************************************************************************\
+	|* Start a new batch of memory operations once the last one is complete,
+	|* then mark where this instruction's ops start. Code run from inside a
+	|* callback (via call()) belongs to the instruction that made the call
+	\*************************************************************************/
+	if ((F & SF_MEMOPS) && _traceMemory && (_nextDepth == 0))
+		{
+		if (_memOps.instructions() >= _memOpBatch)
+			_memOps.clear();
+		_memOps.startInstruction();
+		_traceOps = _memOps.count();
+		}
+
+	_nextDepth ++;
+	if ((F == SF_NONE) && (_core != CORE_SWITCH) && _tableEligible())
+		_runTable(true);
+	else
+		_stepSwitch<F>();
+	_nextDepth --;
 
 	/*************************************************************************\
-	|* Clear the list of memory operations
+	|* The binary trace gets the ops made since it last looked, so code run
+	|* from a callback keeps its own
 	\*************************************************************************/
-	_memOpList.clear();
+	if ((F & SF_TRACE) && (F & SF_MEMOPS) && _traceWriter)
+		{
+		MemOpView all = _memOps.all();
+		if (_traceOps > all.size())
+			_traceOps = 0;
+		_traceWriter->ops(MemOpView(all.begin() + _traceOps,
+									all.size() - _traceOps));
+		_traceOps = all.size();
+		}
+	}
+
+const std::array<Simulator::StepHandler, Simulator::SF_ALL + 1>
+	Simulator::_nextTable =
+	{
+	&Simulator::_next<0>, &Simulator::_next<1>,
+	&Simulator::_next<2>, &Simulator::_next<3>,
+	&Simulator::_next<4>, &Simulator::_next<5>,
+	&Simulator::_next<6>, &Simulator::_next<7>
+	};
+
+/*****************************************************************************\
+|* Run the next instruction using the reference switch-based decoder
+\*****************************************************************************/
+template <int F>
+void Simulator::_stepSwitch(void)
+	{
+	uint32_t val;
+	uint64_t old_cycles = 0;
+	uint32_t old_node = 0;
+	Registers old_regs = {0,0,0,0,0,0,0};
 
 	/*************************************************************************\
 	|* Handle the return-from-processing states
 	\*************************************************************************/
-	if (_execCbs[_regs.pc] != nullptr)
+	SIM_CB cb = unlikely(_memState[_regs.pc] & MS_CALLBACK)
+			  ? _execCb(_regs.pc) : nullptr;
+	if (cb != nullptr)
 		{
-		setError(_execCbs[_regs.pc](this, &_regs, _regs.pc, CB_EXEC), _regs.pc);
+		setError(cb(this, &_regs, _regs.pc, CB_EXEC), _regs.pc);
 		if (shouldExit())
 			return;
 		}
 
-	if (_debug >= DBG_TRACE)
-		_traceRegs();
+	if ((F & SF_TRACE) && (_debug >= DBG_TRACE))
+		{
+		if (_traceWriter)
+			{
+			uint8_t code[3];
+			int len = _insnLength[_mem[_regs.pc]];
+			for (int i=0; i<len; i++)
+				code[i] = _mem[(_regs.pc + i) & 0xFFFF];
+			_traceWriter->insn(_cycles, _regs, code, len);
+			}
+		else
+			_traceRegs();
+		}
 
-	if (_cycleLimit && _cycles >= _cycleLimit)
+	if (unlikely(_cycles >= _cycleStop))
 		{
-		setError(E_CYCLE_LIMIT, _regs.pc);
-		return;
+		_runEvents();
+		if (shouldExit())
+			return;
+
+		if (_cycleLimit && _cycles >= _cycleLimit)
+			{
+			setError(E_CYCLE_LIMIT, _regs.pc);
+			return;
+			}
 		}
 
 	if ((_memState[_regs.pc] & MS_BREAKPOINT) == MS_BREAKPOINT)
@@ -1647,7 +2638,7 @@ void Simulator::next(void)
 	|* Read instruction
 	\*************************************************************************/
 	_readingInsn	= true;
-	uint32_t insn	= _readPC();
+	uint32_t insn	= _readPC<F>();
 
 	/*************************************************************************\
 	|* Remember PC
@@ -1657,20 +2648,21 @@ void Simulator::next(void)
 	/*************************************************************************\
 	|* Read data - always prefetched in real 6502 CPU
 	\*************************************************************************/
-	uint32_t data = _readByte(_regs.pc + 1);
+	uint32_t data = _readByte<F>(_regs.pc + 1);
 
 	// And if instruction is 3 bytes, read high byte of data
 	if (_insnLength[insn] > 2)
-		data |= ((uint32_t)(_readByte(_regs.pc + 2))) << 8;
+		data |= ((uint32_t)(_readByte<F>(_regs.pc + 2))) << 8;
 	_readingInsn = false;
 
 	/*************************************************************************\
 	|* If profiling, store old info
 	\*************************************************************************/
-	if (_doProfiling)
+	if ((F & SF_PROFILE) && _doProfiling)
 		{
 		old_cycles	= _cycles;
 		old_regs	= _regs;
+		old_node	= _callProfile.current();
 		_writeMem	= false;
 		}
 
@@ -1841,11 +2833,12 @@ void Simulator::next(void)
 	/*************************************************************************\
 	|* Update profile information
 	\*************************************************************************/
-	if (_doProfiling)
+	if ((F & SF_PROFILE) && _doProfiling)
 		{
 		uint32_t cyc = _cycles - old_cycles;
 		_profileData.instructions ++;
 		_profileData.cycles[old_regs.pc & 0xFFFF] += cyc;
+		_callProfile.addCycles(old_node, cyc);
 		if ((_regs.a == old_regs.a)							&&
 			(_regs.x == old_regs.x)							&&
 			(_regs.y == old_regs.y)							&&
@@ -2380,3 +3373,841 @@ void Simulator::_printMem(char *buf, uint32_t address)
 	else
 		memcpy(buf, "[NN]", 4);
 	}
+
+
+
+#pragma mark -- Table-driven execution core
+
+
+/*****************************************************************************\
+|* The table core keeps N,Z,C,V out of _regs.p while it runs, and only
+|* assembles the status byte when something outside the core could see it
+|* (PHP, callbacks, falling back to the switch core, or returning). The
+|* instruction macros are redefined below so the opcode bodies read the
+|* same as the switch in _stepSwitch()
+\*****************************************************************************/
+#define MS_SLOW		(MS_UNDEFINED | MS_INVALID | MS_CALLBACK | MS_WATCH_READ)
+
+#undef SETZ
+#undef SETC
+#undef SETV
+#undef SETN
+#undef GETC
+#undef GETD
+#define SETZ(a) _lzZ = (uint8_t)((a) & 0xFF)
+#define SETC(a) _lzC = (a) ? 1 : 0
+#define SETV(a) _lzV = (a) ? 1 : 0
+#define SETN(a) _lzN = (uint8_t)((a) & 0x80)
+#define GETC    _lzC
+#define GETD    (_regs.p & FLAG_D)
+
+#undef ZP_R1
+#undef ZP_W1
+#undef ZPX_R1
+#undef ZPX_W1
+#undef ZPY_R1
+#undef ZPY_W1
+#undef ABS_R1
+#undef ABS_W1
+#undef ABX_R1
+#undef ABX_W1
+#undef ABY_R1
+#undef ABY_W1
+#undef IND_X
+#undef IND_Y
+#undef INDW_X
+#undef INDW_Y
+#define ZP_R1   val = _fastRead(data & 0xFF)
+#define ZP_W1   _fastWrite(data & 0xFF, val)
+#define ZPX_R1  val = _fastRead((data + _regs.x) & 0xFF)
+#define ZPX_W1  _fastWrite((data + _regs.x) & 0xFF, val)
+#define ZPY_R1  val = _fastRead((data + _regs.y) & 0xFF)
+#define ZPY_W1  _fastWrite((data + _regs.y) & 0xFF, val)
+#define ABS_R1  val = _fastRead(data)
+#define ABS_W1  _fastWrite(data, val)
+#define ABX_R1  val = _fastRead(data + _regs.x)
+#define ABX_W1  _fastWrite(data + _regs.x, val)
+#define ABY_R1  val = _fastRead(data + _regs.y)
+#define ABY_W1  _fastWrite(data + _regs.y, val)
+#define IND_X(op)  _cycles += 6; \
+				   val = _fastRead(_fastWord((data + _regs.x) & 0xFF)); op
+#define IND_Y(op)  val = _fastIndY(data); op
+#define INDW_X(op) op; _cycles += 6; \
+				   _fastWrite(_fastWord((data + _regs.x) & 0xFF), val)
+#define INDW_Y(op) op; _cycles += 6; \
+				   _fastWrite(0xFFFF & (_fastWord(data & 0xFF) + _regs.y), val)
+
+#undef ABX_R
+#undef ABY_R
+#define ABX_R(op)  _cycles += 4; _handleExtraAbsoluteX<SF_NONE>(data); \
+				   ABX_R1; op
+#define ABY_R(op)  _cycles += 4; _handleExtraAbsoluteY<SF_NONE>(data); \
+				   ABY_R1; op
+
+#undef ADC
+#undef SBC
+#define ADC _adcLazy(val)
+#define SBC _sbcLazy(val)
+
+#undef POP
+#undef PUSH
+#define POP  _regs.s = (_regs.s + 1) & 0xFF; val = _fastRead(0x100 + _regs.s)
+#define PUSH(val) _cycles += 3; \
+				  _fastWrite(0x100 + _regs.s,val); \
+				  _regs.s = (_regs.s - 1) & 0xFF
+
+#undef BRA_0
+#undef BRA_1
+#undef JMP16
+#undef JSR
+#undef RTS
+#undef RTI
+#define BRA_0(a)   _branchLazy(data, !_lazyFlag(a))
+#define BRA_1(a)   _branchLazy(data, _lazyFlag(a) != 0)
+#define JMP16()    _cycles += 5; _regs.pc = _fastWord(data)
+#define JSR()      if (unlikely(_sampler.active())) \
+					   _callProfile.call(data, _regs.s); \
+				   _regs.pc = (_regs.pc - 1) & 0xFFFF; \
+				   PUSH(_regs.pc >> 8); \
+				   PUSH(_regs.pc); \
+				   _regs.pc = data
+#define RTS()      POP; _regs.pc = val; \
+				   POP; _regs.pc |= (val << 8); \
+				   _regs.pc = (_regs.pc + 1) & 0xFFFF; \
+				   _cycles += 6; \
+				   if (unlikely(_sampler.active())) \
+					   _callProfile.ret(_regs.s)
+#define RTI()      POP_P; \
+				   POP; _regs.pc = val; \
+				   POP; _regs.pc |= (val << 8); \
+				   _cycles += 2; \
+				   if (unlikely(_sampler.active())) \
+					   _callProfile.ret(_regs.s)
+
+#undef CL_F
+#undef SE_F
+#undef POP_P
+#undef BIT_ZP
+#undef BIT_ABS
+#define CL_F(f)   _cycles += 2; _setFlagsLazy(f, 0)
+#define SE_F(f)   _cycles += 2; _setFlagsLazy(f, f)
+#define POP_P     _cycles += 4; POP; _setFlagsLazy(0xFF, val | 0x30)
+#define BIT_ZP    _cycles += 3; _bitLazy(data & 0xFF)
+#define BIT_ABS   _cycles += 4; _bitLazy(data)
+
+
+/*****************************************************************************\
+|* Switch core: which of the optional features the settings need
+\*****************************************************************************/
+int Simulator::_features(void)
+	{
+	return ((_debug >= DBG_TRACE)	? SF_TRACE	 : 0)
+		 | (_doProfiling			? SF_PROFILE : 0)
+		 | (_traceMemory			? SF_MEMOPS  : 0);
+	}
+
+/*****************************************************************************\
+|* Table core: can we use the table core ? Tracing, profiling and memory-op
+|* recording all live in the switch core
+\*****************************************************************************/
+bool Simulator::_tableEligible(void)
+	{
+	return _features() == SF_NONE;
+	}
+
+/*****************************************************************************\
+|* Table core: write the lazy flags back into the status register
+\*****************************************************************************/
+void Simulator::_packFlags(void)
+	{
+	_regs.p = _lazyFlags();
+	}
+
+/*****************************************************************************\
+|* Table core: load the lazy flags from the status register
+\*****************************************************************************/
+void Simulator::_unpackFlags(void)
+	{
+	_lzN = _regs.p & FLAG_N;
+	_lzZ = (_regs.p & FLAG_Z) ? 0 : 1;
+	_lzC = (_regs.p & FLAG_C) ? 1 : 0;
+	_lzV = (_regs.p & FLAG_V) ? 1 : 0;
+	}
+
+/*****************************************************************************\
+|* Table core: return the status register, with the lazy flags applied
+\*****************************************************************************/
+uint8_t Simulator::_lazyFlags(void)
+	{
+	return (_regs.p & ~(FLAG_N | FLAG_Z | FLAG_C | FLAG_V))
+		 | (_lzN & FLAG_N)
+		 | (_lzZ ? 0 : FLAG_Z)
+		 | (_lzC ? FLAG_C : 0)
+		 | (_lzV ? FLAG_V : 0);
+	}
+
+/*****************************************************************************\
+|* Table core: return a single flag (non-zero if set)
+\*****************************************************************************/
+uint8_t Simulator::_lazyFlag(uint8_t mask)
+	{
+	switch (mask)
+		{
+		case FLAG_N:
+			return _lzN & FLAG_N;
+		case FLAG_Z:
+			return _lzZ ? 0 : FLAG_Z;
+		case FLAG_C:
+			return _lzC;
+		case FLAG_V:
+			return _lzV;
+		default:
+			return _regs.p & mask;
+		}
+	}
+
+/*****************************************************************************\
+|* Table core: set flags explicitly (CLC, SEC, PLP, ...)
+\*****************************************************************************/
+void Simulator::_setFlagsLazy(uint8_t mask, uint8_t value)
+	{
+	if (mask & FLAG_N)
+		_lzN = value & FLAG_N;
+	if (mask & FLAG_Z)
+		_lzZ = (value & FLAG_Z) ? 0 : 1;
+	if (mask & FLAG_C)
+		_lzC = (value & FLAG_C) ? 1 : 0;
+	if (mask & FLAG_V)
+		_lzV = (value & FLAG_V) ? 1 : 0;
+
+	setFlags(mask, value & mask);
+	}
+
+/*****************************************************************************\
+|* Table core: read a byte, handing anything unusual to _readByte()
+\*****************************************************************************/
+uint8_t Simulator::_fastRead(uint32_t address)
+	{
+	if (likely(!(_memState[address] & MS_SLOW)))
+		return _mem[address];
+
+	_packFlags();
+	uint8_t val = _readByte<SF_NONE>(address);
+	_unpackFlags();
+	return val;
+	}
+
+/*****************************************************************************\
+|* Table core: read a word, low byte first
+\*****************************************************************************/
+uint16_t Simulator::_fastWord(uint32_t address)
+	{
+	uint16_t d1 = _fastRead(address);
+	return d1 | (_fastRead(address + 1) << 8);
+	}
+
+/*****************************************************************************\
+|* Table core: read a byte using the Y-indexed addressing mode
+\*****************************************************************************/
+uint8_t Simulator::_fastIndY(uint32_t address)
+	{
+	_cycles += 5;
+	address = _fastWord(address & 0xFF);
+
+	if (unlikely(((address & 0xFF) + _regs.y) > 0xFF))
+		_cycles++;
+	return _fastRead(0xFFFF & (address + _regs.y));
+	}
+
+/*****************************************************************************\
+|* Table core: write a byte, handing anything unusual to _writeByte()
+\*****************************************************************************/
+void Simulator::_fastWrite(uint32_t address, uint8_t val)
+	{
+	if (likely(!_memState[address]))
+		_mem[address] = val;
+	else
+		{
+		_packFlags();
+		_writeByte<SF_NONE>(address, val);
+		_unpackFlags();
+		}
+	}
+
+/*****************************************************************************\
+|* Table core: ADC, same as _adc() but using the lazy flags
+\*****************************************************************************/
+void Simulator::_adcLazy(uint8_t val)
+	{
+	if (GETD)
+		{
+		uint32_t tmp = _regs.a + val + (GETC ? 1 : 0);
+		SETZ(tmp);
+
+		tmp = (_regs.a & 0xF) + (val & 0xF) + (GETC ? 1 : 0);
+		if (tmp >= 10)
+			tmp = (tmp - 10) | 16;
+		tmp += (_regs.a & 0xF0) + (val & 0xF0);
+		SETN(tmp);
+		SETV(!((_regs.a ^ val) & 0x80) && ((val ^ tmp) & 0x80));
+		if (tmp > 0x9F)
+			tmp += 0x60;
+		SETC(tmp > 0xFF);
+		_regs.a = tmp & 0xFF;
+		}
+	else
+		{
+		uint32_t tmp = _regs.a + val + (GETC ? 1 : 0);
+		SETV(((~(_regs.a ^ val)) & (_regs.a ^ tmp)) & 0x80);
+
+		SETC(tmp > 0xFF);
+		SETN(tmp);
+		SETZ(tmp);
+		_regs.a = tmp & 0xFF;
+		}
+	}
+
+/*****************************************************************************\
+|* Table core: SBC, same as _sbc() but using the lazy flags
+\*****************************************************************************/
+void Simulator::_sbcLazy(uint8_t val)
+	{
+	if (GETD)
+		{
+		val = val ^ 0xFF;
+
+		unsigned tmp = _regs.a + val + (GETC ? 1 : 0);
+		SETV((((_regs.a ^ val)) & (_regs.a ^ tmp)) & 0x80);
+		SETZ(tmp);
+
+		tmp = (_regs.a & 0xF) + (val & 0xF) + (GETC ? 1 : 0);
+		if (tmp < 0x10)
+			tmp = (tmp - 6) & 0x0F;
+
+		tmp += (_regs.a & 0xF0) + (val & 0xF0);
+		if (tmp < 0x100)
+			tmp = (tmp - 0x60) & 0xFF;
+
+		SETN(tmp);
+		SETC(tmp > 0xFF);
+		_regs.a = tmp & 0xFF;
+		}
+	else
+		{
+		unsigned tmp = _regs.a + 0xFF - val + (GETC ? 1 : 0);
+		SETV((((_regs.a ^ val)) & (_regs.a ^ tmp)) & 0x80);
+		SETC(tmp > 0xFF);
+		SETN(tmp);
+		SETZ(tmp);
+		_regs.a = tmp & 0xFF;
+		}
+	}
+
+/*****************************************************************************\
+|* Table core: branch ops. Backward branches are where idle loops are spotted
+\*****************************************************************************/
+void Simulator::_branchLazy(int8_t off, bool taken)
+	{
+	_cycles += 2;
+	if (taken)
+		{
+		_cycles++;
+		uint16_t from	= (_regs.pc - 2) & 0xFFFF;
+		uint16_t val	= (_regs.pc + off) & 0xFFFF;
+		if ((val & 0xFF00) != (_regs.pc & 0xFF00))
+			_cycles++;
+		_regs.pc = val;
+
+		if (off < 0)
+			_idleBranch(from);
+		}
+	}
+
+/*****************************************************************************\
+|* Table core: BIT. As for _bit(), reading uninitialised memory leaves the
+|* flags marked invalid, which sends the next instruction to the switch core
+\*****************************************************************************/
+void Simulator::_bitLazy(uint32_t address)
+	{
+	if ((_memState[address] & MS_INVALID) && !(_memState[address] &  MS_CALLBACK))
+		_regs.p_valid |= (FLAG_N | FLAG_V | FLAG_Z);
+	else
+		{
+		uint8_t val = _fastRead(address);
+		SETN(val);
+		SETV(val & 0x40);
+		SETZ(_regs.a & val);
+		}
+	}
+
+
+/*****************************************************************************\
+|* Table core: opcode handlers. Anything not specialised below is invalid
+\*****************************************************************************/
+template <int OP> void Simulator::_op(uint32_t)
+	{
+	setError(E_INVALID_INSN, _regs.pc - 1);
+	}
+
+#define OPCODE(code, body)											\
+	template <> void Simulator::_op<code>([[maybe_unused]] uint32_t data) \
+		{															\
+		[[maybe_unused]] uint32_t val;								\
+		body;														\
+		}
+
+OPCODE(0x00,  setError(E_BREAK, _regs.pc-1))
+OPCODE(0x01,  IND_X(ORA))
+OPCODE(0x05,  ZP_R(ORA))
+OPCODE(0x06,  ZP_RW(ASL))
+OPCODE(0x08,  PUSH(_lazyFlags()))        // PHP
+OPCODE(0x09,  IMM(ORA))
+OPCODE(0x0A,  IMP_A(ASL))
+OPCODE(0x0D,  ABS_R(ORA))
+OPCODE(0x0E,  ABS_RW(ASL))
+OPCODE(0x10,  BRA_0(FLAG_N))             // BPL
+OPCODE(0x11,  IND_Y(ORA))
+OPCODE(0x15,  ZPX_R(ORA))
+OPCODE(0x16,  ZPX_RW(ASL))
+OPCODE(0x18,  CL_F(FLAG_C))              // CLC
+OPCODE(0x19,  ABY_R(ORA))
+OPCODE(0x1d,  ABX_R(ORA))
+OPCODE(0x1e,  ABX_RW(ASL))
+OPCODE(0x20,  JSR())                     // JSR
+OPCODE(0x21,  IND_X(AND))
+OPCODE(0x24,  BIT_ZP)
+OPCODE(0x25,  ZP_R(AND))
+OPCODE(0x26,  ZP_RW(ROL))
+OPCODE(0x28,  POP_P)                     // PLP
+OPCODE(0x29,  IMM(AND))
+OPCODE(0x2a,  IMP_A(ROL))
+OPCODE(0x2c,  BIT_ABS)
+OPCODE(0x2d,  ABS_R(AND))
+OPCODE(0x2e,  ABS_RW(ROL))
+OPCODE(0x30,  BRA_1(FLAG_N))
+OPCODE(0x31,  IND_Y(AND))
+OPCODE(0x35,  ZPX_R(AND))
+OPCODE(0x36,  ZPX_RW(ROL))
+OPCODE(0x38,  SE_F(FLAG_C))              // SEC
+OPCODE(0x39,  ABY_R(AND))
+OPCODE(0x3d,  ABX_R(AND))
+OPCODE(0x3e,  ABX_RW(ROL))
+OPCODE(0x40,  RTI())                     // RTI
+OPCODE(0x41,  IND_X(EOR))
+OPCODE(0x45,  ZP_R(EOR))
+OPCODE(0x46,  ZP_RW(LSR))
+OPCODE(0x48,  PUSH(_regs.a))             // PHA
+OPCODE(0x49,  IMM(EOR))
+OPCODE(0x4a,  IMP_A(LSR))
+OPCODE(0x4c,  JMP())                     // JMP
+OPCODE(0x4d,  ABS_R(EOR))
+OPCODE(0x4e,  ABS_RW(LSR))
+OPCODE(0x50,  BRA_0(FLAG_V))
+OPCODE(0x51,  IND_Y(EOR))
+OPCODE(0x55,  ZPX_R(EOR))
+OPCODE(0x56,  ZPX_RW(LSR))
+OPCODE(0x58,  CL_F(FLAG_I))              // CLI
+OPCODE(0x59,  ABY_R(EOR))
+OPCODE(0x5d,  ABX_R(EOR))
+OPCODE(0x5e,  ABX_RW(LSR))
+OPCODE(0x60,  RTS())                     // RTS
+OPCODE(0x61,  IND_X(ADC))
+OPCODE(0x65,  ZP_R(ADC))
+OPCODE(0x66,  ZP_RW(ROR))
+OPCODE(0x68,  POP_A)                     // PLA
+OPCODE(0x69,  IMM(ADC))
+OPCODE(0x6a,  IMP_A(ROR))
+OPCODE(0x6c,  JMP16())                   // JMP ()
+OPCODE(0x6d,  ABS_R(ADC))
+OPCODE(0x6e,  ABS_RW(ROR))
+OPCODE(0x70,  BRA_1(FLAG_V))
+OPCODE(0x71,  IND_Y(ADC))
+OPCODE(0x75,  ZPX_R(ADC))
+OPCODE(0x76,  ZPX_RW(ROR))
+OPCODE(0x78,  SE_F(FLAG_I))              // SEI
+OPCODE(0x79,  ABY_R(ADC))
+OPCODE(0x7d,  ABX_R(ADC))
+OPCODE(0x7e,  ABX_RW(ROR))
+OPCODE(0x81,  INDW_X(STA))
+OPCODE(0x84,  ZP_W(STY))
+OPCODE(0x85,  ZP_W(STA))
+OPCODE(0x86,  ZP_W(STX))
+OPCODE(0x88,  IMP_Y(DEC))                // DEY
+OPCODE(0x8a,  IMP_X(LDA))                // TXA
+OPCODE(0x8c,  ABS_W(STY))
+OPCODE(0x8d,  ABS_W(STA))
+OPCODE(0x8e,  ABS_W(STX))
+OPCODE(0x90,  BRA_0(FLAG_C))             // BCC
+OPCODE(0x91,  INDW_Y(STA))
+OPCODE(0x94,  ZPX_W(STY))
+OPCODE(0x95,  ZPX_W(STA))
+OPCODE(0x96,  ZPY_W(STX))
+OPCODE(0x98,  IMP_Y(LDA))                // TYA
+OPCODE(0x99,  ABY_W(STA))
+OPCODE(0x9a,  TXS())                     // TXS
+OPCODE(0x9d,  ABX_W(STA))
+OPCODE(0xa0,  IMM(LDY))
+OPCODE(0xa1,  IND_X(LDA))
+OPCODE(0xa2,  IMM(LDX))
+OPCODE(0xa4,  ZP_R(LDY))
+OPCODE(0xa5,  ZP_R(LDA))
+OPCODE(0xa6,  ZP_R(LDX))
+OPCODE(0xa8,  IMP_A(LDY))                // TAY
+OPCODE(0xa9,  IMM(LDA))
+OPCODE(0xaa,  IMP_A(LDX))                // TAX
+OPCODE(0xac,  ABS_R(LDY))
+OPCODE(0xad,  ABS_R(LDA))
+OPCODE(0xae,  ABS_R(LDX))
+OPCODE(0xb0,  BRA_1(FLAG_C))             // BCS
+OPCODE(0xb1,  IND_Y(LDA))
+OPCODE(0xb4,  ZPX_R(LDY))
+OPCODE(0xb5,  ZPX_R(LDA))
+OPCODE(0xb6,  ZPY_R(LDX))
+OPCODE(0xb8,  CL_F(FLAG_V))              // CLV
+OPCODE(0xb9,  ABY_R(LDA))
+OPCODE(0xba,  IMP_X(val = _regs.s))      // TSX
+OPCODE(0xbc,  ABX_R(LDY))
+OPCODE(0xbd,  ABX_R(LDA))
+OPCODE(0xbe,  ABY_R(LDX))
+OPCODE(0xc0,  IMM(CPY))
+OPCODE(0xc1,  IND_X(CMP))
+OPCODE(0xc4,  ZP_R(CPY))
+OPCODE(0xc5,  ZP_R(CMP))
+OPCODE(0xc6,  ZP_RW(DEC))
+OPCODE(0xc8,  IMP_Y(INC))                // INY
+OPCODE(0xc9,  IMM(CMP))
+OPCODE(0xca,  IMP_X(DEC))                // DEX
+OPCODE(0xcc,  ABS_R(CPY))
+OPCODE(0xcd,  ABS_R(CMP))
+OPCODE(0xce,  ABS_RW(DEC))
+OPCODE(0xd0,  BRA_0(FLAG_Z))             // BNE
+OPCODE(0xd1,  IND_Y(CMP))
+OPCODE(0xd5,  ZPX_R(CMP))
+OPCODE(0xd6,  ZPX_RW(DEC))
+OPCODE(0xd8,  CL_F(FLAG_D))              // CLD
+OPCODE(0xd9,  ABY_R(CMP))
+OPCODE(0xdd,  ABX_R(CMP))
+OPCODE(0xde,  ABX_RW(DEC))
+OPCODE(0xe0,  IMM(CPX))
+OPCODE(0xe1,  IND_X(SBC))
+OPCODE(0xe4,  ZP_R(CPX))
+OPCODE(0xe5,  ZP_R(SBC))
+OPCODE(0xe6,  ZP_RW(INC))
+OPCODE(0xe8,  IMP_X(INC))                // INX
+OPCODE(0xe9,  IMM(SBC))
+OPCODE(0xea,  _cycles += 2)              // NOP
+OPCODE(0xec,  ABS_R(CPX))
+OPCODE(0xed,  ABS_R(SBC))
+OPCODE(0xee,  ABS_RW(INC))
+OPCODE(0xf0,  BRA_1(FLAG_Z))             // BEQ
+OPCODE(0xf1,  IND_Y(SBC))
+OPCODE(0xf5,  ZPX_R(SBC))
+OPCODE(0xf6,  ZPX_RW(INC))
+OPCODE(0xf8,  SE_F(FLAG_D))              // SED
+OPCODE(0xf9,  ABY_R(SBC))
+OPCODE(0xfd,  ABX_R(SBC))
+OPCODE(0xfe,  ABX_RW(INC))
+
+#undef OPCODE
+
+/*****************************************************************************\
+|* Table core: the dispatch table, one handler per opcode
+\*****************************************************************************/
+template <size_t... OPS>
+constexpr std::array<Simulator::OpHandler, 256>
+	Simulator::_buildOpTable(std::index_sequence<OPS...>)
+	{
+	return {{ &Simulator::_op<OPS>... }};
+	}
+
+const std::array<Simulator::OpHandler, 256> Simulator::_opTable =
+	Simulator::_buildOpTable(std::make_index_sequence<256>());
+
+
+/*****************************************************************************\
+|* Table core: run instructions. Anything the fast path doesn't handle
+|* (callbacks, breakpoints, uninitialised memory or flags, events and the
+|* cycle limit) is given to the switch core for that one instruction
+\*****************************************************************************/
+void Simulator::_runTable(bool single)
+	{
+	_unpackFlags();
+
+	forever
+		{
+		_stepTable();
+
+		if (single || (_error && shouldExit()))
+			break;
+		}
+
+	_packFlags();
+	}
+
+/*****************************************************************************\
+|* Table core: run one instruction, with the lazy flags unpacked
+\*****************************************************************************/
+void Simulator::_stepTable(void)
+	{
+	uint16_t pc		= _regs.pc;
+	uint32_t insn	= _mem[pc];
+	uint8_t len		= _insnLength[insn];
+	uint32_t span	= (len > 2) ? len : 2;
+
+	if (unlikely(((uint32_t) pc + span > (uint32_t) _maxRam)				||
+				 (_memState[pc] & ~(MS_ROM | MS_CODE))					||
+				 (_memState[pc + 1] & MS_SLOW)							||
+				 ((len > 2) && (_memState[pc + 2] & MS_SLOW))			||
+				 (_regs.p_valid != 0)									||
+				 (_cycles >= _cycleStop)))
+		{
+		_packFlags();
+		_stepSwitch<SF_NONE>();
+		_unpackFlags();
+		}
+	else
+		{
+		uint32_t data = _mem[pc + 1];
+		if (len > 2)
+			data |= ((uint32_t)_mem[pc + 2]) << 8;
+
+		_oldPC		= pc;
+		_regs.pc	= pc + len;
+		(this->*_opTable[insn])(data);
+		}
+	}
+
+#pragma mark -- Basic-block execution core
+
+/*****************************************************************************\
+|* Block core limits. Blocks are bounded so that invalidation only has to look
+|* a short way back from a written address for blocks that cover it
+\*****************************************************************************/
+#define MAX_BLOCK_OPS		64
+#define MAX_INSN_CYCLES		7
+#define MAX_BLOCK_BYTES		(MAX_BLOCK_OPS * 3 + 1)
+
+/*****************************************************************************\
+|* Block core: run until exit, executing pre-decoded straight-line runs of
+|* instructions. Anything a block can't handle is stepped by the table core
+\*****************************************************************************/
+void Simulator::_runBlocks(void)
+	{
+	if (_blocks == nullptr)
+		_blocks = new BasicBlock * [_maxRam]();
+
+	_blockDepth ++;
+	_unpackFlags();
+
+	forever
+		{
+		if (_blockDepth == 1)
+			_freeDeadBlocks();
+
+		uint16_t pc			= _regs.pc;
+		BasicBlock *block	= _blocks[pc];
+		if (block != nullptr)
+			_blockStats.hits ++;
+		else if ((block = _decodeBlock(pc)) != nullptr)
+			_blockStats.misses ++;
+
+		/*********************************************************************\
+		|* A block only runs if it can't overshoot the cycle limit or the
+		|* next event, so that they still happen on exactly the same
+		|* instruction
+		\*********************************************************************/
+		if ((block != nullptr) && (_regs.p_valid == 0) &&
+			(_cycles + block->maxCycles < _cycleStop))
+			{
+			_blocksChanged = false;
+			for (DecodedOp& op : block->ops)
+				{
+				_oldPC		 = _regs.pc;
+				_regs.pc	+= op.len;
+				(this->*op.fn)(op.data);
+
+				if (unlikely(_error || _regs.p_valid || _blocksChanged))
+					break;
+				}
+			}
+		else
+			{
+			_blockStats.stepped ++;
+			_stepTable();
+			}
+
+		if (_error && shouldExit())
+			break;
+		}
+
+	_packFlags();
+	_blockDepth --;
+	}
+
+/*****************************************************************************\
+|* Block core: decode the block starting at 'address'. A block ends after any
+|* instruction that can change the flow of control, and before anything that
+|* has to go through the switch core (callbacks, breakpoints, undefined
+|* memory)
+\*****************************************************************************/
+Simulator::BasicBlock * Simulator::_decodeBlock(uint32_t address)
+	{
+	BasicBlock *block	= new BasicBlock;
+	block->start		= address;
+	block->end			= address;
+
+	uint32_t limit		= (uint32_t) _maxRam;
+	uint32_t addr		= address;
+	while (block->ops.size() < MAX_BLOCK_OPS)
+		{
+		uint8_t insn	= _mem[addr];
+		uint8_t len		= _insnLength[insn];
+		uint32_t span	= (len > 2) ? len : 2;
+
+		if ((addr + span > limit)									||
+			(_memState[addr] & ~(MS_ROM | MS_CODE))					||
+			(_memState[addr + 1] & MS_SLOW)							||
+			((len > 2) && (_memState[addr + 2] & MS_SLOW)))
+			break;
+
+		uint32_t data = _mem[addr + 1];
+		if (len > 2)
+			data |= ((uint32_t)_mem[addr + 2]) << 8;
+
+		block->ops.push_back({_opTable[insn], data, len});
+		block->end	= addr + span;
+		addr	   += len;
+
+		AddressingMode mode = _insnMode[insn];
+		if ((mode == aREL) || (mode == anon)	||
+			(insn == 0x00) || (insn == 0x20)	||		// BRK, JSR
+			(insn == 0x40) || (insn == 0x60)	||		// RTI, RTS
+			(insn == 0x4C) || (insn == 0x6C))			// JMP abs, JMP ind
+			break;
+		}
+
+	if (block->ops.size() == 0)
+		{
+		delete block;
+		return nullptr;
+		}
+
+	block->maxCycles = (uint32_t)block->ops.size() * MAX_INSN_CYCLES;
+
+	_blocks[address] = block;
+	_markCode(block);
+	_blockStats.blocks ++;
+	return block;
+	}
+
+/*****************************************************************************\
+|* Block core: flag the memory a block was decoded from, so writes to it
+|* find their way to _invalidateCode()
+\*****************************************************************************/
+void Simulator::_markCode(BasicBlock *block)
+	{
+	for (uint32_t addr = block->start; addr < block->end; addr++)
+		_memState[addr] |= MS_CODE;
+	}
+
+/*****************************************************************************\
+|* Block core: discard every block that covers 'address'. The blocks may be
+|* running, so they are parked on the dead list until it is safe to free them
+\*****************************************************************************/
+void Simulator::_invalidateCode(uint32_t address)
+	{
+	if (_blocks == nullptr)
+		{
+		_memState[address] &= ~MS_CODE;
+		return;
+		}
+
+	uint32_t first	= (address >= MAX_BLOCK_BYTES - 1)
+					? address - (MAX_BLOCK_BYTES - 1)
+					: 0;
+	uint32_t lo		= address;
+	uint32_t hi		= address + 1;
+
+	for (uint32_t start = first; start <= address; start++)
+		{
+		BasicBlock *block = _blocks[start];
+		if ((block != nullptr) && (block->end > address))
+			{
+			lo = (start < lo) ? start : lo;
+			hi = (block->end > hi) ? block->end : hi;
+
+			_blocks[start] = nullptr;
+			_deadBlocks.push_back(block);
+			_blockStats.invalidations ++;
+			_blockStats.blocks --;
+			}
+		}
+
+	/*************************************************************************\
+	|* Clear the code flag over the discarded range, then put it back for any
+	|* surviving block that shares some of those bytes
+	\*************************************************************************/
+	for (uint32_t addr = lo; addr < hi; addr++)
+		_memState[addr] &= ~MS_CODE;
+
+	uint32_t scan = (lo >= MAX_BLOCK_BYTES - 1) ? lo - (MAX_BLOCK_BYTES - 1) : 0;
+	for (; scan < hi; scan++)
+		{
+		BasicBlock *block = _blocks[scan];
+		if ((block != nullptr) && (block->end > lo))
+			_markCode(block);
+		}
+
+	_blocksChanged = true;
+	}
+
+/*****************************************************************************\
+|* Block core: discard any blocks covering a range of memory
+\*****************************************************************************/
+void Simulator::_invalidateBlocks(uint32_t address, uint32_t length)
+	{
+	if ((_blocks == nullptr) || (_blockStats.blocks == 0))
+		return;
+
+	uint32_t limit	= (uint32_t) _maxRam;
+	uint32_t end	= address + length;
+	if (end > limit)
+		end = limit;
+
+	for (; address < end; address++)
+		if (_memState[address] & MS_CODE)
+			_invalidateCode(address);
+	}
+
+/*****************************************************************************\
+|* Block core: discard all the decoded blocks
+\*****************************************************************************/
+void Simulator::_flushBlocks(void)
+	{
+	if (_blocks == nullptr)
+		return;
+
+	uint32_t limit = (uint32_t) _maxRam;
+	for (uint32_t addr = 0; addr < limit; addr++)
+		{
+		if (_blocks[addr] != nullptr)
+			{
+			_deadBlocks.push_back(_blocks[addr]);
+			_blocks[addr] = nullptr;
+			}
+		_memState[addr] &= ~MS_CODE;
+		}
+
+	_blockStats.blocks	= 0;
+	_blocksChanged		= true;
+	}
+
+/*****************************************************************************\
+|* Block core: free blocks that were discarded while they might be running
+\*****************************************************************************/
+void Simulator::_freeDeadBlocks(void)
+	{
+	for (BasicBlock *block : _deadBlocks)
+		delete block;
+	_deadBlocks.clear();
+	}
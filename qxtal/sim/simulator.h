@@ -3,13 +3,25 @@
 
 #include <QObject>
 
+#include <array>
 #include <cstdarg>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <utility>
 
 #include "predicates/predicateinfo.h"
 #include "properties.h"
 #include "instructions.h"
+#include "bankstore.h"
+#include "callprofile.h"
+#include "fastmacros.h"
 #include "debug.h"
+#include "memopbuffer.h"
+#include "predicate.h"
+#include "sampleprofile.h"
+
+class TraceWriter;
 
 /*****************************************************************************\
 |* Simulator definition
@@ -49,7 +61,12 @@ class Simulator : public QObject
 				MS_ROM			= 2,
 				MS_INVALID		= 4,
 				MS_CALLBACK		= 8,
-				MS_BREAKPOINT	= 16
+				MS_BREAKPOINT	= 16,
+				MS_CODE			= 32,	// Decoded into the block cache
+				MS_WATCH_READ	= 64,	// Watchpoint on reads
+				MS_WATCH_WRITE	= 128,	// Watchpoint on writes
+
+				MS_DEBUG		= MS_BREAKPOINT | MS_WATCH_READ | MS_WATCH_WRITE
 				} MemoryState;
 
 			/*********************************************************************\
@@ -62,6 +79,22 @@ class Simulator : public QObject
 				DBG_TRACE
 				} DebugLevel;
 
+			/*********************************************************************\
+			|* Execution core. The switch core is the reference implementation,
+			|* the table core dispatches through per-opcode handlers and keeps
+			|* the N,Z,C,V flags lazily. The block core runs the table core's
+			|* handlers from a cache of pre-decoded basic blocks. All produce
+			|* identical results
+			\*********************************************************************/
+			typedef enum
+				{
+				CORE_SWITCH		= 0,
+				CORE_TABLE,
+				CORE_BLOCK,
+
+				CORE_DEFAULT = CORE_TABLE
+				} ExecutionCore;
+
 			/*********************************************************************\
 			|* Simulator error levels. Allows simulation to return on only
 			|* certain errors
@@ -96,7 +129,8 @@ class Simulator : public QObject
 				E_CALL_RET		= -9,   // 0
 				E_CYCLE_LIMIT	= -10,  // 0
 				E_BREAKPOINT	= -11,	// 0
-				E_USER			= -12   // 0
+				E_WATCHPOINT	= -12,	// 0
+				E_USER			= -13   // 0
 
 				};
 			typedef int ErrorCode;
@@ -130,6 +164,49 @@ class Simulator : public QObject
 				uint8_t p_valid;	// Which flags in the status are ok to use
 				} Registers;
 
+			/*********************************************************************\
+			|* Block cache statistics
+			\*********************************************************************/
+			typedef struct
+				{
+				uint64_t hits;			// Block found in the cache
+				uint64_t misses;		// Block had to be decoded
+				uint64_t stepped;		// Insns run one at a time, not in a block
+				uint64_t invalidations;	// Blocks discarded due to writes
+				uint64_t blocks;		// Blocks currently in the cache
+				} BlockStats;
+
+			/*********************************************************************\
+			|* Timed event handler, given the cycle it was due at. Returns
+			|* E_NONE or an error, as for the callbacks
+			\*********************************************************************/
+			typedef ErrorCode (*SIM_EVENT)(Simulator *sim, uint64_t cycle);
+
+			/*********************************************************************\
+			|* A scheduled event. Events due on the same cycle run in the order
+			|* they were added
+			\*********************************************************************/
+			typedef struct
+				{
+				uint64_t due;					// Cycle to run at
+				uint64_t period;				// Cycles between runs, 0 = once
+				uint64_t order;					// When it was added
+				SIM_EVENT cb;					// Handler
+				} Event;
+
+			/*********************************************************************\
+			|* Full machine state, for rewinding
+			\*********************************************************************/
+			typedef struct
+				{
+				Registers regs;					// Processor registers
+				uint64_t cycles;				// Cycle count
+				std::vector<uint8_t> mem;		// RAM contents
+				std::vector<uint8_t> memState;	// RAM state flags
+				std::vector<Event> events;		// Scheduled events
+				BankStore banks;				// Banks not mapped in
+				} Snapshot;
+
 			/*********************************************************************\
 			|* Profiling parameters
 			\*********************************************************************/
@@ -156,7 +233,7 @@ class Simulator : public QObject
 			/*********************************************************************\
 			|* callback function type
 			|*
-			|* @param s sim65 state.
+			|* @param s sim65 state. s->context() is the callback owner.
 			|* @param regs simulator register values before the instruction.
 			|* @param addr address of memory causing the callback.
 			|* @param data type of callback:
@@ -226,6 +303,17 @@ class Simulator : public QObject
 			\*********************************************************************/
 			typedef std::map<uint32_t, PredicateInfo> BreakpointMap;
 
+			/*********************************************************************\
+			|* Watchpoints: which accesses (MS_WATCH_READ / MS_WATCH_WRITE) to
+			|* stop on, and the predicates that have to be true as well
+			\*********************************************************************/
+			typedef struct
+				{
+				int type;						// MS_WATCH_* bits
+				PredicateInfo info;				// Conditions
+				} WatchpointInfo;
+			typedef std::map<uint32_t, WatchpointInfo> WatchpointMap;
+
 		/*************************************************************************\
 		|* Properties
 		\*************************************************************************/
@@ -238,30 +326,163 @@ class Simulator : public QObject
 		GET(Registers, regs);						// Registers in the CPU
 		GETSET(int, maxRam, MaxRam);				// Amount of memory to offer
 		GET(bool, writeMem);						// Profiler: detect writes
-		GETSET(AddressMap, labels, Labels);			// Assembly labels
+		GET(AddressMap, labels);					// Assembly labels
 		GET(int, labelRange);						// +/- to search for offsets
-		GET(MemOpList, memOpList);					// List of memory ops in next()
+		GET(MemOpBuffer, memOps);					// Memory ops recorded by next()
 		GET(uint8_t *, mem);						// Simulator RAM
 		GETSET(bool, traceMemory, TraceMemory);		// Whether to trace access
+		GETSET(int, memOpBatch, MemOpBatch);		// Insns per memory-op hand-off
 		GET(bool, readingInsn);						// Currently reading insns
 		GET(BreakpointMap, breakpoints);			// Map of breakpoints
+		GET(WatchpointMap, watchpoints);			// Map of watchpoints
+		GETSET(ExecutionCore, core, Core);			// Which execution core to use
+		GETSET(void *, context, Context);			// Owner of the callbacks
+		GET(BlockStats, blockStats);				// Block cache statistics
+		GET(CallProfile, callProfile);				// Profiler: call graph
+		GET(SampleProfile, sampler);				// Profiler: sampling mode
+		GETSET(bool, banking, Banking);				// Expansion board, from reset
+		GETSET(bool, fastMacros, FastMacros);		// Run mul/div loops natively
+		GETSET(TraceWriter *, traceWriter, TraceWriter);	// Binary trace
 
 		/*************************************************************************\
 		|* Internal state
 		\*************************************************************************/
 		private:
+			/*********************************************************************\
+			|* Callbacks for one page of memory. A page only gets one when a
+			|* callback is added to it, and they're only looked at when the
+			|* address has MS_CALLBACK set, so the interpreter never touches
+			|* them otherwise
+			\*********************************************************************/
+			typedef struct
+				{
+				SIM_CB read[256];
+				SIM_CB write[256];
+				SIM_CB exec[256];
+				} CallbackPage;
+
 			/*********************************************************************\
 			|* Simulator state
 			\*********************************************************************/
 			uint8_t * _memState;					// RAM state
-			SIM_CB * _readCbs;						// Read callbacks
-			SIM_CB * _writeCbs;						// Write callbacks
-			SIM_CB * _execCbs;						// Execute callbacks
-			int _cycleLimit;						// Limit on simulation time
+			CallbackPage ** _cbPages;				// Callbacks, per page
+			uint32_t _numPages;						// Pages in _cbPages
+			uint64_t _cycleLimit;					// Limit on simulation time
+			uint64_t _cycleStop;					// Cycle limit or next event
 			FILE * _traceFile;						// Where to trace to
+			size_t _traceOps;						// Memory ops already traced
 			ProfileData _profileData;				// Where statistics are stored
 			uint16_t _oldPC;						// PC value during next()
 
+			/*********************************************************************\
+			|* Breakpoint and watchpoint conditions, compiled when they're set
+			\*********************************************************************/
+			std::unordered_map<uint32_t, Predicate> _bpPredicates;
+			std::unordered_map<uint32_t, Predicate> _wpPredicates;
+
+			/*********************************************************************\
+			|* Scheduled events, as a heap with the soonest first
+			\*********************************************************************/
+			std::vector<Event> _events;
+			uint64_t _eventOrder;					// Order of the next event
+			uint64_t _eventsRun;					// Events run so far
+
+			/*********************************************************************\
+			|* Expansion-board banks that aren't mapped in
+			\*********************************************************************/
+			BankStore _banks;
+
+			/*********************************************************************\
+			|* stdmacros multiply and divide loops in the code that's loaded
+			\*********************************************************************/
+			FastMacros _macros;
+
+			/*********************************************************************\
+			|* Labels by address, so that looking one up is an array access.
+			|* Each address within _labelRange of a label gets the name to show
+			|* for it ("label", "label + 2"), with the labels themselves first.
+			|* Rebuilt the first time it's needed after the labels change
+			\*********************************************************************/
+			std::vector<String> _labelNames;		// [0] is no label
+			std::vector<uint32_t> _labelIndex;		// Address to _labelNames
+			uint32_t _labelsExact;					// Names that are labels
+			bool _labelsChanged;					// Index needs rebuilding
+
+			/*********************************************************************\
+			|* Idle loops: the state when a backward branch was last taken, to
+			|* compare with the next time round
+			\*********************************************************************/
+			typedef struct
+				{
+				uint32_t branch;				// Address of the branch
+				Registers regs;					// Registers after it
+				uint8_t lazy[4];				// Lazy N,Z,C,V
+				uint64_t cycles;				// Cycle count after it
+				uint64_t eventsRun;				// Events run before it
+				} IdleState;
+
+			IdleState _idle;
+
+			uint8_t _lzN;							// Lazy N flag (bit 7)
+			uint8_t _lzZ;							// Lazy Z flag (0 => set)
+			uint8_t _lzC;							// Lazy C flag (0 or 1)
+			uint8_t _lzV;							// Lazy V flag (0 or 1)
+
+			/*********************************************************************\
+			|* Switch core: optional features, as a mask for the template
+			|* argument of the switch-core functions. A feature that isn't in
+			|* the mask is compiled out, rather than tested per instruction
+			\*********************************************************************/
+			typedef enum
+				{
+				SF_NONE		= 0,
+				SF_TRACE	= (1 << 0),			// Trace to _traceFile
+				SF_PROFILE	= (1 << 1),			// Profile data, call graph
+				SF_MEMOPS	= (1 << 2),			// Record memory ops
+
+				SF_ALL		= SF_TRACE | SF_PROFILE | SF_MEMOPS
+				} SwitchFeatures;
+
+			typedef void (Simulator::*StepHandler)(void);
+			static const std::array<StepHandler, SF_ALL + 1> _nextTable;
+
+			/*********************************************************************\
+			|* Table core: per-opcode handler and the dispatch table
+			\*********************************************************************/
+			typedef void (Simulator::*OpHandler)(uint32_t data);
+			static const std::array<OpHandler, 256> _opTable;
+
+			template <int OP> void _op(uint32_t data);
+
+			template <size_t... OPS>
+			static constexpr std::array<OpHandler, 256>
+				_buildOpTable(std::index_sequence<OPS...>);
+
+			/*********************************************************************\
+			|* Block core: a decoded instruction, and a run of them that ends
+			|* at the first change of flow
+			\*********************************************************************/
+			typedef struct
+				{
+				OpHandler fn;			// Handler for the opcode
+				uint32_t data;			// Operand bytes
+				uint8_t len;			// Instruction length
+				} DecodedOp;
+
+			typedef struct
+				{
+				uint16_t start;			// Address of the first instruction
+				uint32_t end;			// One past the last byte fetched
+				uint32_t maxCycles;		// Worst-case cycles for the block
+				std::vector<DecodedOp> ops;	// Instructions in the block
+				} BasicBlock;
+
+			BasicBlock ** _blocks;					// Block starting at each addr
+			std::vector<BasicBlock *> _deadBlocks;	// Invalidated, free when safe
+			bool _blocksChanged;					// Set when blocks invalidated
+			int _blockDepth;						// Nesting of _runBlocks()
+			int _nextDepth;							// Nesting of next()
+
 
 			/*********************************************************************\
 			|* Set the processor status flags with a mask
@@ -272,46 +493,64 @@ class Simulator : public QObject
 			|* Return any known label for this address
 			\*********************************************************************/
 			const String& _getLabel(uint32_t address);
-			void _getLabel(uint32_t address, int slack, String& label);
+
+			/*********************************************************************\
+			|* Return the label for this address, or the nearest one within
+			|* _labelRange as "label + offset"
+			\*********************************************************************/
+			const String& _getNearLabel(uint32_t address);
+
+			/*********************************************************************\
+			|* Labels: build the index from the labels
+			\*********************************************************************/
+			void _indexLabels(void);
 
 			/*********************************************************************\
 			|* Read (PC); set appropriate error status
 			\*********************************************************************/
+			template <int F = SF_ALL>
 			uint8_t _readPC(void);
 
 			/*********************************************************************\
 			|* Read a byte at an address; set appropriate error status
 			\*********************************************************************/
+			template <int F = SF_ALL>
 			uint8_t  _readByte(uint32_t addr);
 
 			/*********************************************************************\
 			|* Read a byte using the X-indexed addressing mode
 			\*********************************************************************/
+			template <int F = SF_ALL>
 			uint8_t  _readIndX(uint32_t addr);
 
 			/*********************************************************************\
 			|* Read a byte using the Y-indexed addressing mode
 			\*********************************************************************/
+			template <int F = SF_ALL>
 			uint8_t  _readIndY(uint32_t addr);
 
 			/*********************************************************************\
 			|* Read a word at an address; set appropriate error status
 			\*********************************************************************/
+			template <int F = SF_ALL>
 			uint16_t _readWord(uint32_t addr);
 
 			/*********************************************************************\
 			|* Write a byte to an address; set appropriate error status
 			\*********************************************************************/
+			template <int F = SF_ALL>
 			void _writeByte(uint32_t address, uint8_t val);
 
 			/*********************************************************************\
 			|* Write a byte using the X-indexed addressing mode
 			\*********************************************************************/
+			template <int F = SF_ALL>
 			void _writeIndX(uint32_t address, uint8_t val);
 
 			/*********************************************************************\
 			|* Write a byte using the Y-indexed addressing mode
 			\*********************************************************************/
+			template <int F = SF_ALL>
 			void _writeIndY(uint32_t address, uint8_t val);
 
 
@@ -320,21 +559,186 @@ class Simulator : public QObject
 			\*********************************************************************/
 			void _adc(uint8_t val);
 			void _sbc(uint8_t val);
+			template <int F = SF_ALL>
 			void _branch(int8_t off, uint8_t mask, int cond);
+			template <int F = SF_ALL>
 			void _bit(uint32_t address);
+			template <int F = SF_ALL>
 			void _jsr(uint32_t address);
+			template <int F = SF_ALL>
 			void _rts(void);
+			template <int F = SF_ALL>
 			void _rti(void);
 
+			/*********************************************************************\
+			|* Table core: lazy-flag versions of the flag-setting instructions
+			\*********************************************************************/
+			void _adcLazy(uint8_t val);
+			void _sbcLazy(uint8_t val);
+			void _branchLazy(int8_t off, bool taken);
+			void _bitLazy(uint32_t address);
+
+			/*********************************************************************\
+			|* Table core: move flags between _regs.p and the lazy state
+			\*********************************************************************/
+			void _packFlags(void);
+			void _unpackFlags(void);
+			uint8_t _lazyFlags(void);
+			uint8_t _lazyFlag(uint8_t mask);
+			void _setFlagsLazy(uint8_t mask, uint8_t value);
+
+			/*********************************************************************\
+			|* Table core: memory access with the common case inlined
+			\*********************************************************************/
+			uint8_t _fastRead(uint32_t address);
+			uint16_t _fastWord(uint32_t address);
+			uint8_t _fastIndY(uint32_t address);
+			void _fastWrite(uint32_t address, uint8_t val);
+
+			/*********************************************************************\
+			|* Runtime: the switch-core features the current settings need
+			\*********************************************************************/
+			int _features(void);
+
+			/*********************************************************************\
+			|* Runtime: can the table core be used with the current settings
+			\*********************************************************************/
+			bool _tableEligible(void);
+
+			/*********************************************************************\
+			|* Runtime: next(), with only the features in F compiled in
+			\*********************************************************************/
+			template <int F>
+			void _next(void);
+
+			/*********************************************************************\
+			|* Runtime: the reference (switch) implementation of next()
+			\*********************************************************************/
+			template <int F>
+			void _stepSwitch(void);
+
+			/*********************************************************************\
+			|* Runtime: run the table core, for one instruction or until exit
+			\*********************************************************************/
+			void _runTable(bool single);
+
+			/*********************************************************************\
+			|* Runtime: run one instruction through the table core
+			\*********************************************************************/
+			void _stepTable(void);
+
+			/*********************************************************************\
+			|* Block core: run cached blocks until exit
+			\*********************************************************************/
+			void _runBlocks(void);
+
+			/*********************************************************************\
+			|* Block core: decode and cache the block at an address
+			\*********************************************************************/
+			BasicBlock * _decodeBlock(uint32_t address);
+
+			/*********************************************************************\
+			|* Block core: mark the bytes a block was decoded from
+			\*********************************************************************/
+			void _markCode(BasicBlock *block);
+
+			/*********************************************************************\
+			|* Block core: discard any blocks decoded from this address
+			\*********************************************************************/
+			void _invalidateCode(uint32_t address);
+
+			/*********************************************************************\
+			|* Block core: discard any blocks decoded from a range of memory
+			\*********************************************************************/
+			void _invalidateBlocks(uint32_t address, uint32_t length);
+
+			/*********************************************************************\
+			|* Block core: discard all blocks
+			\*********************************************************************/
+			void _flushBlocks(void);
+
+			/*********************************************************************\
+			|* Block core: free blocks once nothing can be running them
+			\*********************************************************************/
+			void _freeDeadBlocks(void);
+
+			/*********************************************************************\
+			|* Events: work out when we next have to stop and look
+			\*********************************************************************/
+			void _updateStop(void);
+
+			/*********************************************************************\
+			|* Events: run everything that is due
+			\*********************************************************************/
+			void _runEvents(void);
+
+			/*********************************************************************\
+			|* Profiling: fold any samples into the profile data
+			\*********************************************************************/
+			void _flushSamples(void);
+
+			/*********************************************************************\
+			|* Banking: if a write to a range of memory hit a bank register,
+			|* swap in the banks the registers now ask for
+			\*********************************************************************/
+			void _syncBanks(uint32_t address, uint32_t length);
+
+			/*********************************************************************\
+			|* Banking: install the callbacks on the bank registers
+			\*********************************************************************/
+			void _addBankCallbacks(void);
+
+			/*********************************************************************\
+			|* Macros: look for multiply and divide loops in new code, and put
+			|* an exec callback on each one found
+			\*********************************************************************/
+			void _scanMacros(uint32_t address, uint32_t length);
+
+			/*********************************************************************\
+			|* Callbacks: find the one for an address, if there is one
+			\*********************************************************************/
+			inline SIM_CB _readCb(uint32_t address) const
+				{
+				CallbackPage *page = _cbPages[address >> 8];
+				return (page) ? page->read[address & 0xFF] : nullptr;
+				}
+			inline SIM_CB _writeCb(uint32_t address) const
+				{
+				CallbackPage *page = _cbPages[address >> 8];
+				return (page) ? page->write[address & 0xFF] : nullptr;
+				}
+			inline SIM_CB _execCb(uint32_t address) const
+				{
+				CallbackPage *page = _cbPages[address >> 8];
+				return (page) ? page->exec[address & 0xFF] : nullptr;
+				}
+
+			/*********************************************************************\
+			|* Idle loops: a backward branch was taken, skip ahead if it's idle
+			\*********************************************************************/
+			void _idleBranch(uint16_t branch);
+
+			/*********************************************************************\
+			|* Idle loops: can the loop from 'start' to 'branch' change anything
+			\*********************************************************************/
+			bool _idleLoop(uint16_t start, uint16_t branch);
+
 			/*********************************************************************\
 			|* Check if a breakpoint will fire
 			\*********************************************************************/
 			bool _checkBreakpoint(int address);
 
+			/*********************************************************************\
+			|* Check a watchpoint after an access, and stop if it fires
+			\*********************************************************************/
+			void _checkWatchpoint(uint32_t address);
+
 			/*********************************************************************\
 			|* Extra cycles due to page boundaries
 			\*********************************************************************/
+			template <int F = SF_ALL>
 			void _handleExtraAbsoluteX(uint32_t address);
+			template <int F = SF_ALL>
 			void _handleExtraAbsoluteY(uint32_t address);
 
 
@@ -382,10 +786,26 @@ class Simulator : public QObject
 			void clearBreakpoint(int address);
 
 			/*********************************************************************\
-			|* Breakpoint: clear a breakpoint
+			|* Breakpoint: set all of a saved map of breakpoints
 			\*********************************************************************/
 			void applyBreakpoints(BreakpointMap& bps);
 
+			/*********************************************************************\
+			|* Watchpoint: stop on reads and/or writes of an address, if the
+			|* predicate is true after the access
+			\*********************************************************************/
+			void setWatchpoint(int address, int type, PredicateInfo info);
+
+			/*********************************************************************\
+			|* Watchpoint: clear a watchpoint
+			\*********************************************************************/
+			void clearWatchpoint(int address);
+
+			/*********************************************************************\
+			|* Watchpoint: set all of a saved map of watchpoints
+			\*********************************************************************/
+			void applyWatchpoints(WatchpointMap& wps);
+
 
 
 			/*********************************************************************\
@@ -401,11 +821,54 @@ class Simulator : public QObject
 							uint32_t len,
 							CallbackType type);
 
+			/*********************************************************************\
+			|* Events: run 'cb' when the cycle count reaches 'cycle', and then
+			|* every 'period' cycles if that isn't 0
+			\*********************************************************************/
+			void addEvent(SIM_EVENT cb, uint64_t cycle, uint64_t period = 0);
+
+			/*********************************************************************\
+			|* Events: remove every event with this handler
+			\*********************************************************************/
+			void removeEvent(SIM_EVENT cb);
+
+			/*********************************************************************\
+			|* Events: treat everything due at or before 'cycle' as having run.
+			|* Used when the clock was moved by replaying history, which
+			|* already includes what the events did
+			\*********************************************************************/
+			void skipEvents(uint64_t cycle);
+
 			/*********************************************************************\
 			|* Determine if we ought to exit based on the error
 			\*********************************************************************/
 			void reset(bool hard=true);
 
+			/*********************************************************************\
+			|* Copy the machine state into a snapshot
+			\*********************************************************************/
+			void saveState(Snapshot& snap);
+
+			/*********************************************************************\
+			|* Put the machine back into a saved state. Breakpoints set since
+			|* the snapshot was taken are kept
+			\*********************************************************************/
+			void restoreState(const Snapshot& snap);
+
+			/*********************************************************************\
+			|* Write the machine state to a state file. Callbacks and event
+			|* handlers are code, so they aren't written: read the state into
+			|* a machine that the same hardware has just reset, and the ones
+			|* it installed are kept. Both return false on error
+			\*********************************************************************/
+			bool writeState(FILE *fp);
+			bool readState(FILE *fp);
+
+			/*********************************************************************\
+			|* Re-apply (forwards) or undo (backwards) a recorded memory op
+			\*********************************************************************/
+			void replayOp(const MemoryOp& op, bool forwards);
+
 			/*********************************************************************\
 			|* Determine if we ought to exit based on the error
 			\*********************************************************************/
@@ -451,6 +914,13 @@ class Simulator : public QObject
 			\*********************************************************************/
 			void addRAM(uint32_t address, uint8_t *data,  uint32_t length);
 
+			/*********************************************************************\
+			|* Macros: run the multiply or divide loop at an address in one go,
+			|* as long as nothing would see the difference. Returns false if
+			|* it has to be interpreted instead
+			\*********************************************************************/
+			bool runMacro(uint32_t address);
+
 			/*********************************************************************\
 			|* Add initialised RAM memory to the simulator
 			\*********************************************************************/
@@ -480,6 +950,25 @@ class Simulator : public QObject
 			\*********************************************************************/
 			int loadProfile(String path);
 
+			/*********************************************************************\
+			|* Profiling: Zero the per-address counts and the totals
+			\*********************************************************************/
+			void clearProfile(void);
+
+			/*********************************************************************\
+			|* Profiling: Save the call-graph profile. Folded stacks by default,
+			|* or a table of per-function totals if 'summary' is set
+			\*********************************************************************/
+			int saveCallProfile(String path, bool summary = false);
+
+			/*********************************************************************\
+			|* Profiling: sample the PC and call stack every 'period' cycles
+			|* instead of counting every instruction, or stop if it's 0. The
+			|* samples go into the same profile data and call graph, so they
+			|* save the same way. Ignored while doProfiling() is set
+			\*********************************************************************/
+			void setSampling(uint64_t period);
+
 
 
 			/*********************************************************************\
@@ -492,6 +981,12 @@ class Simulator : public QObject
 			\*********************************************************************/
 			ErrorCode call(uint32_t address, Registers *regs = nullptr);
 
+			/*********************************************************************\
+			|* Runtime: carry on with a call() that stopped part-way, or one
+			|* that was in progress when a machine state was saved
+			\*********************************************************************/
+			ErrorCode resume(void);
+
 			/*********************************************************************\
 			|* Runtime: set where to trace to, defaults to stderr if null
 			\*********************************************************************/
@@ -502,6 +997,15 @@ class Simulator : public QObject
 			\*********************************************************************/
 			void next(void);
 
+			/*********************************************************************\
+			|* Runtime: whether memOps() holds a full batch of instructions,
+			|* which the next call to next() will discard
+			\*********************************************************************/
+			inline bool memOpsReady(void)
+				{
+				return _traceMemory && (_memOps.instructions() >= _memOpBatch);
+				}
+
 
 
 			/*********************************************************************\
@@ -519,12 +1023,22 @@ class Simulator : public QObject
 			\*********************************************************************/
 			InstructionInfo insnInfo(uint32_t addr);
 
+			/*********************************************************************\
+			|* Return the length in bytes of an opcode
+			\*********************************************************************/
+			static int insnLength(uint8_t insn);
+
 
 			/*********************************************************************\
 			|* Labels: add a label for an address
 			\*********************************************************************/
 			void addLabel(uint32_t address, String label);
 
+			/*********************************************************************\
+			|* Labels: replace all the labels
+			\*********************************************************************/
+			void setLabels(const AddressMap& labels);
+
 			/*********************************************************************\
 			|* Labels: add a label for an address
 			\*********************************************************************/
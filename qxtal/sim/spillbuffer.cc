@@ -0,0 +1,155 @@
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "macros.h"
+#include "spillbuffer.h"
+
+/*****************************************************************************\
+|* Don't bother mapping a file smaller than this
+\*****************************************************************************/
+#define MIN_MAP_BYTES		(16 * 1024 * 1024)
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+SpillBuffer::SpillBuffer(size_t recordSize, size_t spillBytes)
+			:_recordSize(recordSize)
+			,_spillBytes(spillBytes)
+			,_spilled(false)
+			,_size(0)
+			,_map(nullptr)
+			,_mapBytes(0)
+			,_fd(-1)
+	{}
+
+/*****************************************************************************\
+|* Destructor
+\*****************************************************************************/
+SpillBuffer::~SpillBuffer(void)
+	{
+	clear();
+	}
+
+/*****************************************************************************\
+|* Append a record. Returns false if there's no room left for it
+\*****************************************************************************/
+bool SpillBuffer::append(const void *data)
+	{
+	size_t offset = _size * _recordSize;
+
+	if (!_spilled)
+		{
+		if ((_spillBytes > 0) && (offset + _recordSize > _spillBytes))
+			_spill();
+		}
+
+	if (_spilled)
+		{
+		if ((offset + _recordSize > _mapBytes) &&
+			!_growMap(MAX(_mapBytes * 2, offset + _recordSize)))
+			return false;
+		memcpy(_map + offset, data, _recordSize);
+		}
+	else
+		{
+		const uint8_t *bytes = (const uint8_t *)data;
+		_mem.insert(_mem.end(), bytes, bytes + _recordSize);
+		}
+
+	_size ++;
+	return true;
+	}
+
+/*****************************************************************************\
+|* Keep only the first 'count' records
+\*****************************************************************************/
+void SpillBuffer::truncate(size_t count)
+	{
+	if (count >= _size)
+		return;
+
+	if (!_spilled)
+		_mem.resize(count * _recordSize);
+	_size = count;
+	}
+
+/*****************************************************************************\
+|* Remove everything
+\*****************************************************************************/
+void SpillBuffer::clear(void)
+	{
+	if (_map != nullptr)
+		munmap(_map, _mapBytes);
+	if (_fd >= 0)
+		close(_fd);
+
+	_map		= nullptr;
+	_mapBytes	= 0;
+	_fd			= -1;
+	_spilled	= false;
+	_size		= 0;
+
+	_mem.clear();
+	_mem.shrink_to_fit();
+	}
+
+#pragma mark -- Private Methods
+
+/*****************************************************************************\
+|* Move to a file. The file is unlinked as soon as it is open, so it goes away
+|* when we do, however we exit. If anything fails, stay in memory
+\*****************************************************************************/
+bool SpillBuffer::_spill(void)
+	{
+	std::error_code ec;
+	std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+	if (ec)
+		dir = "/tmp";
+
+	std::string path = (dir / "qxtal-trace-XXXXXX").string();
+	_fd = mkstemp(path.data());
+	if (_fd < 0)
+		{
+		_spillBytes = 0;
+		return false;
+		}
+	unlink(path.c_str());
+
+	if (!_growMap(MAX(_mem.size() * 2, (size_t)MIN_MAP_BYTES)))
+		{
+		close(_fd);
+		_fd			= -1;
+		_spillBytes	= 0;
+		return false;
+		}
+
+	memcpy(_map, _mem.data(), _mem.size());
+	_mem.clear();
+	_mem.shrink_to_fit();
+	_spilled = true;
+	return true;
+	}
+
+/*****************************************************************************\
+|* Grow the file and re-map it. The new mapping is made before the old one
+|* goes, so a failure leaves what we already have intact
+\*****************************************************************************/
+bool SpillBuffer::_growMap(size_t bytes)
+	{
+	if (ftruncate(_fd, (off_t)bytes) != 0)
+		return false;
+
+	void *map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if (map == MAP_FAILED)
+		return false;
+
+	if (_map != nullptr)
+		munmap(_map, _mapBytes);
+
+	_map		= (uint8_t *)map;
+	_mapBytes	= bytes;
+	return true;
+	}
@@ -0,0 +1,85 @@
+#ifndef SPILLBUFFER_H
+#define SPILLBUFFER_H
+
+#include <cstdint>
+#include <vector>
+
+#include "properties.h"
+
+/*****************************************************************************\
+|* Append-only array of fixed-size records. It lives in memory until it grows
+|* past 'spillBytes', then moves to an unlinked temporary file that is mapped
+|* into memory, so very long traces don't have to fit in RAM.
+|*
+|* Pointers returned by at() are only valid until the next append()
+\*****************************************************************************/
+class SpillBuffer
+	{
+	NON_COPYABLE_NOR_MOVEABLE(SpillBuffer)
+
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GET(size_t, recordSize);				// Size of one record in bytes
+	GETSET(size_t, spillBytes, SpillBytes);	// Move to disk beyond this
+	GET(bool, spilled);						// Whether we're on disk now
+
+	private:
+		size_t					_size;		// Number of records held
+		std::vector<uint8_t>	_mem;		// Records while in memory
+		uint8_t *				_map;		// Mapped file, once spilled
+		size_t					_mapBytes;	// Size of the mapping
+		int						_fd;		// Backing file, once spilled
+
+		/*********************************************************************\
+		|* Move the records to a mapped file. Returns false if we can't
+		\*********************************************************************/
+		bool _spill(void);
+
+		/*********************************************************************\
+		|* Make the mapped file bigger
+		\*********************************************************************/
+		bool _growMap(size_t bytes);
+
+	public:
+		/*********************************************************************\
+		|* Constructor and destructor
+		\*********************************************************************/
+		explicit SpillBuffer(size_t recordSize, size_t spillBytes);
+		~SpillBuffer(void);
+
+		/*********************************************************************\
+		|* Append a record, copying 'recordSize' bytes from 'data'. Returns
+		|* false if there was no room for it
+		\*********************************************************************/
+		bool append(const void *data);
+
+		/*********************************************************************\
+		|* Number of records held
+		\*********************************************************************/
+		inline size_t size(void) const
+			{
+			return _size;
+			}
+
+		/*********************************************************************\
+		|* Return a pointer to a record
+		\*********************************************************************/
+		inline const void * at(size_t idx) const
+			{
+			const uint8_t *base = (_map != nullptr) ? _map : _mem.data();
+			return base + idx * _recordSize;
+			}
+
+		/*********************************************************************\
+		|* Drop the records from 'count' onwards. The space is reused
+		\*********************************************************************/
+		void truncate(size_t count);
+
+		/*********************************************************************\
+		|* Remove all records, and any backing file
+		\*********************************************************************/
+		void clear(void);
+	};
+
+#endif // SPILLBUFFER_H
@@ -0,0 +1,42 @@
+#include "stepbatch.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+StepBatch::StepBatch(size_t reserve)
+	{
+	_steps.reserve(reserve);
+	}
+
+/*****************************************************************************\
+|* Record an instruction
+\*****************************************************************************/
+void StepBatch::add(const Simulator::Registers& regs,
+					const uint8_t *bytes,
+					int numBytes,
+					MemOpView ops)
+	{
+	Step step;
+	step.regs		= regs;
+	step.numBytes	= (uint8_t) numBytes;
+	step.firstOp	= (uint32_t) _ops.size();
+	step.numOps		= (uint32_t) ops.size();
+
+	for (int i=0; i<3; i++)
+		step.bytes[i] = (i < numBytes) ? bytes[i] : 0;
+
+	_steps.push_back(step);
+	_ops.insert(_ops.end(), ops.begin(), ops.end());
+	}
+
+/*****************************************************************************\
+|* Return the memory ops for a step
+\*****************************************************************************/
+MemOpView StepBatch::opsFor(size_t idx) const
+	{
+	if (idx >= _steps.size())
+		return MemOpView();
+
+	const Step& step = _steps[idx];
+	return MemOpView(_ops.data() + step.firstOp, step.numOps);
+	}
@@ -0,0 +1,67 @@
+#ifndef STEPBATCH_H
+#define STEPBATCH_H
+
+#include <memory>
+#include <vector>
+
+#include "sim/memopbuffer.h"
+#include "sim/simulator.h"
+
+/*****************************************************************************\
+|* A chunk of executed instructions, recorded by the Worker and handed to the
+|* UI thread in one go. Each step is kept in binary form - the registers
+|* before it ran, the instruction bytes and its slice of the memory ops - and
+|* only turned into text when something actually needs to show it
+\*****************************************************************************/
+class StepBatch
+	{
+	public:
+		/*********************************************************************\
+		|* One executed instruction
+		\*********************************************************************/
+		typedef struct
+			{
+			Simulator::Registers regs;	// Registers before execution
+			uint8_t bytes[3];			// Instruction bytes as executed
+			uint8_t numBytes;			// Number of valid bytes
+			uint32_t firstOp;			// Index of first op in _ops
+			uint32_t numOps;			// Number of ops for this step
+			} Step;
+
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GET(std::vector<Step>, steps);			// Instructions, in order run
+	GET(std::vector<MemoryOp>, ops);		// Memory ops for all the steps
+
+	public:
+		/*********************************************************************\
+		|* Constructor
+		\*********************************************************************/
+		explicit StepBatch(size_t reserve = 4096);
+
+		/*********************************************************************\
+		|* Record an instruction that has just been executed
+		\*********************************************************************/
+		void add(const Simulator::Registers& regs,
+				 const uint8_t *bytes,
+				 int numBytes,
+				 MemOpView ops);
+
+		/*********************************************************************\
+		|* Number of instructions in the batch
+		\*********************************************************************/
+		inline size_t size(void) const
+			{
+			return _steps.size();
+			}
+
+		/*********************************************************************\
+		|* The memory ops for one step
+		\*********************************************************************/
+		MemOpView opsFor(size_t idx) const;
+	};
+
+typedef std::shared_ptr<StepBatch> StepBatchPtr;
+
+#endif // STEPBATCH_H
@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <cstring>
+
+#include "tracefile.h"
+
+const char * const TraceFile::MAGIC = "SIM:TRACE\n";
+
+#pragma mark -- Writing
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+TraceWriter::TraceWriter(void)
+	:_fp(nullptr)
+	,_failed(false)
+	,_pending(false)
+	,_cycles(0)
+	,_expected(0)
+	{
+	_buf.reserve(BUFFER_SIZE);
+	_regs = {0, 0, 0, 0, 0, 0, 0};
+	memset(_code, 0, sizeof(_code));
+	}
+
+/*****************************************************************************\
+|* Destructor
+\*****************************************************************************/
+TraceWriter::~TraceWriter(void)
+	{
+	if (_fp)
+		fclose(_fp);
+	}
+
+/*****************************************************************************\
+|* Start a trace
+\*****************************************************************************/
+bool TraceWriter::open(const String& path)
+	{
+	if (_fp)
+		fclose(_fp);
+
+	_fp			= fopen(path.c_str(), "wb");
+	_failed		= false;
+	_pending	= false;
+	_cycles		= 0;
+	_expected	= 0;
+	_regs		= {0, 0, 0, 0, 0, 0, 0};
+	_buf.clear();
+	memset(_code, 0, sizeof(_code));
+	if (_fp == nullptr)
+		return false;
+
+	for (const char *c = MAGIC; *c; c++)
+		_put(*c);
+	_put16(VERSION);
+	return true;
+	}
+
+/*****************************************************************************\
+|* Add an instruction that's about to run
+\*****************************************************************************/
+void TraceWriter::insn(uint64_t cycles,
+					   const Simulator::Registers& regs,
+					   const uint8_t *code,
+					   int length)
+	{
+	if (_fp == nullptr)
+		return;
+
+	if (_pending)
+		_putRecord();
+
+	_next.cycles	= cycles;
+	_next.regs		= regs;
+	_next.length	= (uint8_t) length;
+	memcpy(_next.code, code, length);
+	_next.ops.clear();
+	_pending		= true;
+	}
+
+/*****************************************************************************\
+|* Add memory ops to the last instruction
+\*****************************************************************************/
+void TraceWriter::ops(const MemOpView& view)
+	{
+	if (!_pending)
+		return;
+
+	for (const MemoryOp& op : view)
+		if (op.type != OP_INSN)
+			_next.ops.push_back(op);
+	}
+
+/*****************************************************************************\
+|* Finish the trace, with the labels
+\*****************************************************************************/
+bool TraceWriter::close(const Simulator::AddressMap& labels)
+	{
+	if (_fp == nullptr)
+		return false;
+
+	if (_pending)
+		_putRecord();
+	_pending = false;
+	_drain();
+
+	uint64_t offset = (uint64_t) ftell(_fp);
+	_putVarint(labels.size());
+	for (const auto& kv : labels)
+		{
+		size_t len = std::min(kv.second.size(), (size_t)255);
+		_put16((uint16_t) kv.first);
+		_put((uint8_t) len);
+		for (size_t i=0; i<len; i++)
+			_put(kv.second[i]);
+		}
+	for (int i=0; i<8; i++)
+		_put((uint8_t)(offset >> (i * 8)));
+	_drain();
+
+	bool ok	= !_failed && (fclose(_fp) == 0);
+	_fp		= nullptr;
+	return ok;
+	}
+
+/*****************************************************************************\
+|* Put bytes into the buffer
+\*****************************************************************************/
+void TraceWriter::_put(uint8_t val)
+	{
+	_buf.push_back(val);
+	}
+
+void TraceWriter::_put16(uint16_t val)
+	{
+	_buf.push_back(val & 0xFF);
+	_buf.push_back(val >> 8);
+	}
+
+void TraceWriter::_putVarint(uint64_t val)
+	{
+	while (val >= 0x80)
+		{
+		_buf.push_back((val & 0x7F) | 0x80);
+		val >>= 7;
+		}
+	_buf.push_back((uint8_t) val);
+	}
+
+/*****************************************************************************\
+|* Encode the pending record as the difference from the last one
+\*****************************************************************************/
+void TraceWriter::_putRecord(void)
+	{
+	const Simulator::Registers& r = _next.regs;
+	uint8_t tag = 0;
+
+	if (r.a != _regs.a)
+		tag |= TR_A;
+	if (r.x != _regs.x)
+		tag |= TR_X;
+	if (r.y != _regs.y)
+		tag |= TR_Y;
+	if (r.p != _regs.p)
+		tag |= TR_P;
+	if (r.s != _regs.s)
+		tag |= TR_S;
+	if (r.pc != _expected)
+		tag |= TR_JUMP;
+	if ((r.pc + _next.length > 0x10000) ||
+		memcmp(_code + r.pc, _next.code, _next.length))
+		tag |= TR_CODE;
+	if (_next.ops.size())
+		tag |= TR_OPS;
+
+	_put(tag);
+	_putVarint(_next.cycles - _cycles);
+	if (tag & TR_JUMP)
+		_put16(r.pc);
+	if (tag & TR_A)
+		_put(r.a);
+	if (tag & TR_X)
+		_put(r.x);
+	if (tag & TR_Y)
+		_put(r.y);
+	if (tag & TR_P)
+		_put(r.p);
+	if (tag & TR_S)
+		_put(r.s);
+
+	if (tag & TR_CODE)
+		{
+		_put(_next.length);
+		for (int i=0; i<_next.length; i++)
+			{
+			_put(_next.code[i]);
+			_code[(uint16_t)(r.pc + i)] = _next.code[i];
+			}
+		}
+
+	if (tag & TR_OPS)
+		{
+		_putVarint(_next.ops.size());
+		for (const MemoryOp& op : _next.ops)
+			{
+			_put(op.type);
+			_put16(op.address);
+			_put(op.newVal);
+			if (op.type == OP_WRITE)
+				_put(op.oldVal);
+			}
+		}
+
+	_cycles		= _next.cycles;
+	_regs		= r;
+	_expected	= r.pc + _next.length;
+
+	if (_buf.size() >= BUFFER_SIZE)
+		_drain();
+	}
+
+/*****************************************************************************\
+|* Write out the buffer
+\*****************************************************************************/
+void TraceWriter::_drain(void)
+	{
+	if (_buf.size() && fwrite(_buf.data(), 1, _buf.size(), _fp) < _buf.size())
+		_failed = true;
+	_buf.clear();
+	}
+
+#pragma mark -- Reading
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+TraceReader::TraceReader(void)
+	:_fp(nullptr)
+	,_end(0)
+	,_expected(0)
+	{
+	_last.cycles	= 0;
+	_last.regs		= {0, 0, 0, 0, 0, 0, 0};
+	_last.length	= 0;
+	memset(_code, 0, sizeof(_code));
+	}
+
+/*****************************************************************************\
+|* Destructor
+\*****************************************************************************/
+TraceReader::~TraceReader(void)
+	{
+	if (_fp)
+		fclose(_fp);
+	}
+
+/*****************************************************************************\
+|* Open a trace, and read the labels from the end of it
+\*****************************************************************************/
+bool TraceReader::open(const String& path)
+	{
+	_fp = fopen(path.c_str(), "rb");
+	if (_fp == nullptr)
+		return false;
+
+	size_t len = strlen(MAGIC);
+	char magic[16];
+	uint16_t version = 0;
+	if ((fread(magic, 1, len, _fp) < len) || memcmp(magic, MAGIC, len) ||
+		!_get16(version) || (version != VERSION))
+		return false;
+	long start = ftell(_fp);
+
+	uint8_t off[8];
+	if (fseek(_fp, -8, SEEK_END) || (fread(off, 1, 8, _fp) < 8))
+		return false;
+	_end = 0;
+	for (int i=7; i>=0; i--)
+		_end = (_end << 8) | off[i];
+
+	uint64_t count = 0;
+	if (fseek(_fp, (long)_end, SEEK_SET) || !_getVarint(count))
+		return false;
+	for (uint64_t i=0; i<count; i++)
+		{
+		uint16_t address;
+		uint8_t size;
+		char name[256];
+		if (!_get16(address) || !_get(size) ||
+			(fread(name, 1, size, _fp) < size))
+			return false;
+		_labels[address] = String(name, size);
+		}
+
+	return fseek(_fp, start, SEEK_SET) == 0;
+	}
+
+/*****************************************************************************\
+|* Read the next instruction
+\*****************************************************************************/
+bool TraceReader::next(Record& rec)
+	{
+	uint8_t tag;
+	uint64_t delta;
+
+	if ((uint64_t) ftell(_fp) >= _end)
+		return false;
+	if (!_get(tag) || !_getVarint(delta))
+		return false;
+
+	Simulator::Registers r = _last.regs;
+	bool ok	= true;
+	r.pc	= _expected;
+	if (tag & TR_JUMP)
+		ok &= _get16(r.pc);
+	if (tag & TR_A)
+		ok &= _get(r.a);
+	if (tag & TR_X)
+		ok &= _get(r.x);
+	if (tag & TR_Y)
+		ok &= _get(r.y);
+	if (tag & TR_P)
+		ok &= _get(r.p);
+	if (tag & TR_S)
+		ok &= _get(r.s);
+
+	rec.cycles	= _last.cycles + delta;
+	rec.regs	= r;
+	if (tag & TR_CODE)
+		{
+		ok &= _get(rec.length) && (rec.length <= 3);
+		for (int i=0; ok && i<rec.length; i++)
+			ok &= _get(rec.code[i]);
+		for (int i=0; ok && i<rec.length; i++)
+			_code[(uint16_t)(r.pc + i)] = rec.code[i];
+		}
+	else
+		{
+		rec.length = Simulator::insnLength(_code[r.pc]);
+		for (int i=0; i<rec.length; i++)
+			rec.code[i] = _code[(uint16_t)(r.pc + i)];
+		}
+
+	rec.ops.clear();
+	if (tag & TR_OPS)
+		{
+		uint64_t count = 0;
+		ok &= _getVarint(count);
+		for (uint64_t i=0; ok && i<count; i++)
+			{
+			MemoryOp op;
+			uint8_t type = 0;
+			ok &= _get(type) && _get16(op.address) && _get(op.newVal);
+			if (!ok)
+				break;
+
+			op.type		= (MemOpType) type;
+			op.pc		= r.pc;
+			op.oldVal	= op.newVal;
+			op.isValid	= true;
+			if (type == OP_WRITE)
+				ok &= _get(op.oldVal);
+			rec.ops.push_back(op);
+			}
+		}
+
+	if (!ok)
+		return false;
+
+	_last.cycles	= rec.cycles;
+	_last.regs		= r;
+	_expected		= r.pc + rec.length;
+	return true;
+	}
+
+/*****************************************************************************\
+|* Get bytes from the file
+\*****************************************************************************/
+bool TraceReader::_get(uint8_t& val)
+	{
+	int c = getc(_fp);
+	val = (uint8_t) c;
+	return c != EOF;
+	}
+
+bool TraceReader::_get16(uint16_t& val)
+	{
+	uint8_t lo, hi;
+	if (!_get(lo) || !_get(hi))
+		return false;
+	val = lo | (hi << 8);
+	return true;
+	}
+
+bool TraceReader::_getVarint(uint64_t& val)
+	{
+	uint8_t byte;
+	int shift = 0;
+	val = 0;
+	do
+		{
+		if (!_get(byte) || (shift > 63))
+			return false;
+		val |= (uint64_t)(byte & 0x7F) << shift;
+		shift += 7;
+		}
+	while (byte & 0x80);
+	return true;
+	}
@@ -0,0 +1,162 @@
+#ifndef TRACEFILE_H
+#define TRACEFILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "simulator.h"
+
+/*****************************************************************************\
+|* Binary execution traces. After a "SIM:TRACE\n" magic and a version, each
+|* instruction is a record of:
+|*
+|*   tag		: TR_* bits saying what follows
+|*   cycles		: cycles since the last record (LEB128)
+|*   pc			: u16, only if TR_JUMP - otherwise it's the last PC plus the
+|*				  last instruction's length
+|*   A X Y P S	: one byte each, only the ones whose TR_ bit is set
+|*   code		: length then bytes, only if TR_CODE - otherwise they're
+|*				  the same as the last bytes any record put there
+|*   ops		: count (LEB128) then type, u16 address and new value, and
+|*				  the old value for writes, only if TR_OPS
+|*
+|* The labels come after the last record, followed by the u64 offset of the
+|* first of them, so a run that loads its labels late still gets them
+\*****************************************************************************/
+class TraceFile
+	{
+	public:
+		typedef enum
+			{
+			TR_A		= (1 << 0),		// Register changed
+			TR_X		= (1 << 1),
+			TR_Y		= (1 << 2),
+			TR_P		= (1 << 3),
+			TR_S		= (1 << 4),
+			TR_JUMP		= (1 << 5),		// PC didn't follow on
+			TR_CODE		= (1 << 6),		// Instruction bytes are new
+			TR_OPS		= (1 << 7),		// Memory ops follow
+			} Tag;
+
+		static const uint16_t VERSION = 0x100;
+		static const char * const MAGIC;
+
+		/*********************************************************************\
+		|* One decoded instruction
+		\*********************************************************************/
+		typedef struct
+			{
+			uint64_t cycles;					// Cycle count before it
+			Simulator::Registers regs;			// Registers before it
+			uint8_t code[3];					// Instruction bytes
+			uint8_t length;						// Bytes in the instruction
+			std::vector<MemoryOp> ops;			// Memory ops it made
+			} Record;
+	};
+
+/*****************************************************************************\
+|* Write a binary trace through a buffer of our own, so each instruction
+|* costs a few bytes of copying rather than a formatted line
+\*****************************************************************************/
+class TraceWriter : public TraceFile
+	{
+	private:
+		static const size_t BUFFER_SIZE = 1 << 16;
+
+		FILE *_fp;								// Trace file
+		std::vector<uint8_t> _buf;				// Bytes not written yet
+		bool _failed;							// A write failed
+
+		/*********************************************************************\
+		|* The record not written yet, as its memory ops are still coming
+		\*********************************************************************/
+		bool _pending;							// There is one
+		Record _next;							// The one
+
+		/*********************************************************************\
+		|* What the last record left things at
+		\*********************************************************************/
+		uint64_t _cycles;
+		Simulator::Registers _regs;
+		uint16_t _expected;						// PC if nothing jumps
+		uint8_t _code[0x10000];					// Code as the reader sees it
+
+		void _put(uint8_t val);
+		void _put16(uint16_t val);
+		void _putVarint(uint64_t val);
+		void _putRecord(void);
+		void _drain(void);
+
+	public:
+		TraceWriter(void);
+		~TraceWriter(void);
+
+		/*********************************************************************\
+		|* Start a trace. Returns false if the file can't be created
+		\*********************************************************************/
+		bool open(const String& path);
+
+		/*********************************************************************\
+		|* Add an instruction that's about to run
+		\*********************************************************************/
+		void insn(uint64_t cycles,
+				  const Simulator::Registers& regs,
+				  const uint8_t *code,
+				  int length);
+
+		/*********************************************************************\
+		|* Add memory ops to the last instruction. Instruction fetches are
+		|* left out, as the code is already in the record
+		\*********************************************************************/
+		void ops(const MemOpView& view);
+
+		/*********************************************************************\
+		|* Finish the trace, with the labels. Returns false if anything
+		|* couldn't be written
+		\*********************************************************************/
+		bool close(const Simulator::AddressMap& labels);
+	};
+
+/*****************************************************************************\
+|* Read a binary trace back, one instruction at a time
+\*****************************************************************************/
+class TraceReader : public TraceFile
+	{
+	private:
+		FILE *_fp;								// Trace file
+		uint64_t _end;							// Offset of the labels
+		Simulator::AddressMap _labels;			// Labels from the trace
+		Record _last;							// Previous record
+		uint16_t _expected;						// PC if nothing jumps
+		uint8_t _code[0x10000];					// Code from TR_CODE records
+
+		bool _get(uint8_t& val);
+		bool _get16(uint16_t& val);
+		bool _getVarint(uint64_t& val);
+
+	public:
+		TraceReader(void);
+		~TraceReader(void);
+
+		/*********************************************************************\
+		|* Open a trace. Returns false if it isn't one
+		\*********************************************************************/
+		bool open(const String& path);
+
+		/*********************************************************************\
+		|* The next instruction. Returns false at the end, or if the trace is
+		|* damaged
+		\*********************************************************************/
+		bool next(Record& rec);
+
+		/*********************************************************************\
+		|* Labels the program had
+		\*********************************************************************/
+		inline const Simulator::AddressMap& labels(void) const
+			{
+			return _labels;
+			}
+	};
+
+#endif // TRACEFILE_H
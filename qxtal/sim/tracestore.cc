@@ -0,0 +1,126 @@
+#include "tracestore.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+TraceStore::TraceStore(size_t spillBytes)
+		   :_full(false)
+		   ,_records(sizeof(Record), spillBytes / 2)
+		   ,_ops(sizeof(Op), spillBytes / 2)
+		   ,_opsUsed(0)
+	{}
+
+/*****************************************************************************\
+|* Set the spill size, shared between the records and the op log
+\*****************************************************************************/
+void TraceStore::setSpillBytes(size_t bytes)
+	{
+	_records.setSpillBytes(bytes / 2);
+	_ops.setSpillBytes(bytes / 2);
+	}
+
+/*****************************************************************************\
+|* Add an instruction. The ops go in first, so that a record never points
+|* at ops that aren't there
+\*****************************************************************************/
+void TraceStore::append(const Simulator::Registers& regs,
+						const uint8_t *bytes,
+						int numBytes,
+						MemOpView ops)
+	{
+	if (_full)
+		return;
+
+	Record rec;
+	rec.regs		= regs;
+	rec.numBytes	= (uint8_t) numBytes;
+	rec.firstOp		= _ops.size();
+	for (int i=0; i<3; i++)
+		rec.bytes[i] = (i < numBytes) ? bytes[i] : 0;
+
+	for (const MemoryOp& op : ops)
+		{
+		Op compact;
+		compact.address	= op.address;
+		compact.oldVal	= op.oldVal;
+		compact.newVal	= op.newVal;
+		compact.type	= (uint8_t) op.type;
+		if (!_ops.append(&compact))
+			{
+			_full = true;
+			return;
+			}
+		}
+
+	if (_records.append(&rec))
+		_opsUsed = _ops.size();
+	else
+		_full = true;
+	}
+
+/*****************************************************************************\
+|* Add a batch
+\*****************************************************************************/
+void TraceStore::append(StepBatch& batch)
+	{
+	std::vector<StepBatch::Step>& steps = batch.steps();
+	for (size_t i=0; i<steps.size(); i++)
+		append(steps[i].regs,
+			   steps[i].bytes,
+			   steps[i].numBytes,
+			   batch.opsFor(i));
+	}
+
+/*****************************************************************************\
+|* Return the memory ops for an instruction. They run up to the next record's
+|* first op, or the end of the last complete record
+\*****************************************************************************/
+void TraceStore::opsFor(size_t idx, std::vector<MemoryOp>& ops) const
+	{
+	if (idx >= size())
+		return;
+
+	Record rec		= record(idx);
+	uint64_t last	= (idx + 1 < size())
+					? record(idx + 1).firstOp
+					: _opsUsed;
+
+	for (uint64_t i = rec.firstOp; i < last; i++)
+		{
+		const Op *compact = (const Op *)_ops.at(i);
+
+		MemoryOp op;
+		op.pc		= rec.regs.pc;
+		op.address	= compact->address;
+		op.oldVal	= compact->oldVal;
+		op.newVal	= compact->newVal;
+		op.type		= (MemOpType) compact->type;
+		op.isValid	= true;
+		ops.push_back(op);
+		}
+	}
+
+/*****************************************************************************\
+|* Keep the first 'count' instructions, and the ops that belong to them
+\*****************************************************************************/
+void TraceStore::truncate(size_t count)
+	{
+	if (count >= size())
+		return;
+
+	_opsUsed = record(count).firstOp;
+	_records.truncate(count);
+	_ops.truncate(_opsUsed);
+	_full = false;
+	}
+
+/*****************************************************************************\
+|* Forget everything
+\*****************************************************************************/
+void TraceStore::clear(void)
+	{
+	_records.clear();
+	_ops.clear();
+	_opsUsed	= 0;
+	_full		= false;
+	}
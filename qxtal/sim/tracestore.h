@@ -0,0 +1,109 @@
+#ifndef TRACESTORE_H
+#define TRACESTORE_H
+
+#include <vector>
+
+#include "sim/simulator.h"
+#include "sim/spillbuffer.h"
+#include "sim/stepbatch.h"
+
+/*****************************************************************************\
+|* Compact, append-only record of an execution trace. Each instruction is a
+|* fixed-size record (registers, instruction bytes, offset into the op log)
+|* and the memory ops live in a separate log. Both move out to memory-mapped
+|* files once they get large
+\*****************************************************************************/
+class TraceStore
+	{
+	NON_COPYABLE_NOR_MOVEABLE(TraceStore)
+
+	public:
+		/*********************************************************************\
+		|* One executed instruction
+		\*********************************************************************/
+		typedef struct
+			{
+			Simulator::Registers regs;	// Registers before execution
+			uint8_t bytes[3];			// Instruction bytes as executed
+			uint8_t numBytes;			// Number of valid bytes
+			uint64_t firstOp;			// Index of first op in the op log
+			} Record;
+
+		/*********************************************************************\
+		|* One memory op. The pc comes from the owning record
+		\*********************************************************************/
+		typedef struct
+			{
+			uint16_t address;			// Address of the operation
+			uint8_t oldVal;				// Value before
+			uint8_t newVal;				// Value after
+			uint8_t type;				// MemOpType
+			} Op;
+
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GET(bool, full);					// Ran out of space, not recording
+
+	private:
+		SpillBuffer		_records;		// Record per instruction
+		SpillBuffer		_ops;			// Op log
+		uint64_t		_opsUsed;		// Ops that belong to stored records
+
+	public:
+		/*********************************************************************\
+		|* Constructor
+		\*********************************************************************/
+		explicit TraceStore(size_t spillBytes = 64 * 1024 * 1024);
+
+		/*********************************************************************\
+		|* Set the in-memory size of records + ops before moving to disk
+		\*********************************************************************/
+		void setSpillBytes(size_t bytes);
+
+		/*********************************************************************\
+		|* Add an instruction
+		\*********************************************************************/
+		void append(const Simulator::Registers& regs,
+					const uint8_t *bytes,
+					int numBytes,
+					MemOpView ops);
+
+		/*********************************************************************\
+		|* Add a batch of instructions from the worker
+		\*********************************************************************/
+		void append(StepBatch& batch);
+
+		/*********************************************************************\
+		|* Number of instructions stored
+		\*********************************************************************/
+		inline size_t size(void) const
+			{
+			return _records.size();
+			}
+
+		/*********************************************************************\
+		|* Return an instruction record
+		\*********************************************************************/
+		inline Record record(size_t idx) const
+			{
+			return *(const Record *)_records.at(idx);
+			}
+
+		/*********************************************************************\
+		|* Append the memory ops for an instruction to 'ops'
+		\*********************************************************************/
+		void opsFor(size_t idx, std::vector<MemoryOp>& ops) const;
+
+		/*********************************************************************\
+		|* Keep only the first 'count' instructions
+		\*********************************************************************/
+		void truncate(size_t count);
+
+		/*********************************************************************\
+		|* Forget the trace
+		\*********************************************************************/
+		void clear(void);
+	};
+
+#endif // TRACESTORE_H
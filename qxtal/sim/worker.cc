@@ -1,18 +1,30 @@
 #include <QDebug>
+#include <QElapsedTimer>
 
 #include "atari.h"
 #include "notifications.h"
 #include "worker.h"
 
+/*****************************************************************************\
+|* In batched mode, post steps to the UI no more often than this (~30Hz), and
+|* only look at the clock every STEP_CHECK_MASK+1 instructions
+\*****************************************************************************/
+#define STEP_POST_MS		33
+#define STEP_CHECK_MASK		1023
+
 /*****************************************************************************\
 |* Constructor
 \*****************************************************************************/
 Worker::Worker(Atari *hw)
 	   :QThread()
+	   ,_batched(true)
+	   ,_recordHistory(true)
 	   ,_active(false)
 	   ,_hw(hw)
 	{
-	_prefs.cycleLimit = 10000;
+	_prefs.cycleLimit		= 10000;
+	_prefs.traceMemoryMB	= 64;
+	_prefs.snapshotInterval	= _history.interval();
 
 	auto nc = NotifyCenter::defaultNotifyCenter();
 	nc->addObserver([=](NotifyData &nd){_prefsChanged(nd);}, NTFY_PREFS_CHANGED);
@@ -80,7 +92,7 @@ void Worker::run(void)
 			_active = false;
 		else
 			{
-			wi		= _queue.takeLast();
+			wi		= _queue.takeFirst();
 			_active	= true;
 			}
 
@@ -128,11 +140,24 @@ void Worker::run(void)
 
 
 /*****************************************************************************\
-|* Private method: play backwards
+|* Private method: play backwards, to the previous breakpoint or the start
 \*****************************************************************************/
 void Worker::_playBack(void)
 	{
-	qDebug() << "Play backwards";
+	if (_history.position() == 0)
+		return;
+
+	Simulator::BreakpointMap& bp	= _hw->sim()->breakpoints();
+	size_t position					= _history.position() - 1;
+
+	while ((position > 0) && !isInterruptionRequested())
+		{
+		if (bp.count(_history.pcAt(position)) != 0)
+			break;
+		position --;
+		}
+
+	_seek(position);
 	}
 
 /*****************************************************************************\
@@ -140,15 +165,28 @@ void Worker::_playBack(void)
 \*****************************************************************************/
 void Worker::_stepBack(void)
 	{
-	qDebug() << "Step backwards";
+	if (_history.position() > 0)
+		_seek(_history.position() - 1);
 	}
 
 /*****************************************************************************\
-|* Private method: step forwards
+|* Private method: step forwards. If we've gone back, this just moves through
+|* the history, otherwise it executes the next instruction
 \*****************************************************************************/
 void Worker::_stepForward(void)
 	{
-	qDebug() << "Step forward";
+	if (_history.position() < _history.size())
+		{
+		_seek(_history.position() + 1);
+		return;
+		}
+
+	Simulator *sim		= _prepareForward(_address);
+	StepBatchPtr batch	= std::make_shared<StepBatch>();
+
+	_execute(sim, batch);
+	emit simulationSteps(batch);
+	emit simulationDone(sim->regs().pc);
 	}
 
 
@@ -157,17 +195,15 @@ void Worker::_stepForward(void)
 \*****************************************************************************/
 void Worker::_playForward(uint32_t address)
 	{
-	/*************************************************************************\
-	|* Set up in a known state
-	\*************************************************************************/
-	Simulator *sim = _hw->sim();
-	sim->setError(Simulator::E_NONE, 0, true);
-	sim->regs().pc = _address = address;
-	sim->setCycleLimit(_prefs.cycleLimit);
+	Simulator *sim = _prepareForward(address);
 
 	/*************************************************************************\
 	|* Loop while we need to
 	\*************************************************************************/
+	StepBatchPtr batch = std::make_shared<StepBatch>();
+	QElapsedTimer timer;
+	timer.start();
+
 	while (!sim->shouldExit())
 		{
 		/*********************************************************************\
@@ -176,40 +212,138 @@ void Worker::_playForward(uint32_t address)
 		if (isInterruptionRequested())
 			break;
 
+		if (!_batched)
+			{
+			/*****************************************************************\
+			|* Disassemble and throw over to the UI thread
+			\*****************************************************************/
+			char buf[1024];
+			snprintf(buf, 1024, "$%04X : ", _address);
+			sim->disassemble(buf+8,_address);
+			Simulator::Registers regs = sim->regs();
+
+			/*****************************************************************\
+			|* Execute it
+			\*****************************************************************/
+			sim->next();
+			_address = sim->regs().pc;
+
+			/*****************************************************************\
+			|* If we altered memory, the post off the new memory values.
+			|* Nothing is recorded (or copied) unless memory tracing is on
+			\*****************************************************************/
+			MemOpView view = sim->memOps().all();
+			if (_recordHistory)
+				_history.record(sim, view);
+
+			Simulator::MemOpList ops(view.begin(), view.end());
+			emit simulationStep(buf, regs, ops);
+			continue;
+			}
 
-		/*********************************************************************\
-		|* Disassemble and throw over to the UI thread
-		\*********************************************************************/
-		char buf[1024];
-		snprintf(buf, 1024, "$%04X : ", _address);
-		sim->disassemble(buf+8,_address);
-		Simulator::Registers regs = sim->regs();
+		_execute(sim, batch);
 
-		/*********************************************************************\
-		|* Execute it
-		\*********************************************************************/
-		sim->next();
-		_address = sim->regs().pc;
+		if (((batch->size() & STEP_CHECK_MASK) == 0) &&
+			(timer.elapsed() >= STEP_POST_MS))
+			{
+			emit simulationSteps(batch);
+			batch = std::make_shared<StepBatch>();
+			timer.restart();
+			}
+		}
 
+	if (batch->size() > 0)
+		emit simulationSteps(batch);
 
-		/*********************************************************************\
-		|* If we altered memory, the post off the new memory values
-		\*********************************************************************/
-		Simulator::MemOpList ops = sim->memOpList();
-		emit simulationStep(buf, regs, ops);
+	emit simulationDone(sim->regs().pc);
+	}
 
+/*****************************************************************************\
+|* Private method: get ready to run forwards. Once there's a history we carry
+|* on from where it left off, and if that's an earlier point then everything
+|* after it is about to be replaced
+\*****************************************************************************/
+Simulator * Worker::_prepareForward(uint32_t address)
+	{
+	Simulator *sim = _hw->sim();
+	sim->setError(Simulator::E_NONE, 0, true);
+	sim->setCycleLimit(_prefs.cycleLimit);
+
+	if (_recordHistory && _history.active())
+		{
+		if (_history.position() < _history.size())
+			emit simulationTruncated(_history.position());
+		}
+	else
+		sim->regs().pc = address;
+
+	_address = sim->regs().pc;
+
+	/*************************************************************************\
+	|* The history is built from the memory ops, so they have to be recorded
+	\*************************************************************************/
+	if (_recordHistory)
+		{
+		sim->setTraceMemory(true);
+		if (!_history.active())
+			_history.start(sim);
 		}
-	emit simulationDone(sim->regs().pc);
-	//_address = sim->regs().pc;
 
+	return sim;
+	}
+
+/*****************************************************************************\
+|* Private method: execute an instruction. Keep the registers and instruction
+|* bytes as they were before execution, and leave the disassembly to the UI
+\*****************************************************************************/
+void Worker::_execute(Simulator *sim, StepBatchPtr& batch)
+	{
+	Simulator::Registers regs	= sim->regs();
+	uint8_t *mem				= sim->mem();
+	int maxRam					= sim->maxRam();
+	uint8_t bytes[3];
+	for (int i=0; i<3; i++)
+		bytes[i] = mem[(regs.pc + i) % maxRam];
+
+	sim->next();
+	_address = sim->regs().pc;
+
+	if (_recordHistory)
+		_history.record(sim, sim->memOps().all());
+
+	batch->add(regs,
+			   bytes,
+			   Simulator::insnLength(bytes[0]),
+			   sim->memOps().all());
+	}
+
+/*****************************************************************************\
+|* Private method: move to a point in the history
+\*****************************************************************************/
+void Worker::_seek(size_t position)
+	{
+	Simulator *sim = _hw->sim();
+	if (_history.seek(sim, position))
+		{
+		_address = sim->regs().pc;
+		emit simulationSeek(position);
+		}
 	}
 
 
 /*****************************************************************************\
 |* Private method: reset the simulator
 \*****************************************************************************/
-void Worker::_reset(uint32_t address)
+void Worker::_reset(uint32_t)
 	{
+	/*************************************************************************\
+	|* Prefs arrive on the UI thread, so the interval is only picked up here
+	\*************************************************************************/
+	if (_prefs.snapshotInterval > 0)
+		_history.setInterval(_prefs.snapshotInterval);
+	else
+		_history.clear();
+
 	_hw->sim()->reset(false);
 	}
 
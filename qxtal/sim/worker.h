@@ -9,7 +9,9 @@
 #include "commands.h"
 #include "properties.h"
 #include "preferences.h"
+#include "sim/history.h"
 #include "sim/simulator.h"
+#include "sim/stepbatch.h"
 
 #include "NotifyCenter.h"
 
@@ -33,6 +35,8 @@ class Worker : public QThread
 	|* Properties
 	\*************************************************************************/
 	GETSET(uint32_t, address, Address);		// Current address
+	GETSET(bool, batched, Batched);			// Post steps in batches
+	GETSET(bool, recordHistory, RecordHistory);	// Allow running backwards
 
 	private:
 		QMutex				_sync;			// Synchronisation between threads
@@ -41,6 +45,23 @@ class Worker : public QThread
 		QVector<WorkItem>	_queue;			// List of things to do
 		Atari *				_hw;			// Hardware weak reference
 		Preferences			_prefs;			// Current prefs
+		History				_history;		// What we've run, for going back
+
+		/*********************************************************************\
+		|* Get ready to run forwards, either from 'address' or from wherever
+		|* we are in the history
+		\*********************************************************************/
+		Simulator * _prepareForward(uint32_t address);
+
+		/*********************************************************************\
+		|* Execute one instruction, adding it to the batch and the history
+		\*********************************************************************/
+		void _execute(Simulator *sim, StepBatchPtr& batch);
+
+		/*********************************************************************\
+		|* Move to a point in the history and tell the UI
+		\*********************************************************************/
+		void _seek(size_t position);
 
 		/*********************************************************************\
 		|* Play backwards
@@ -99,8 +120,13 @@ class Worker : public QThread
 							Simulator::Registers regs,
 							Simulator::MemOpList ops);
 
+		void simulationSteps(StepBatchPtr batch);
 
 		void simulationDone(uint32_t pc);
+
+		void simulationSeek(uint64_t position);
+
+		void simulationTruncated(uint64_t position);
 	};
 
 #endif // WORKER_H
@@ -0,0 +1,218 @@
+//
+//  decoder.cc
+//  qxtrace
+//
+#include <algorithm>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstdio>
+
+#include "ArgParser.h"
+#include "StringUtils.h"
+#include "decoder.h"
+
+#include "sim/simulator.h"
+
+/****************************************************************************\
+|* Constructor
+\****************************************************************************/
+Decoder::Decoder()
+	   :_ap(nullptr)
+	   ,_lowAddress(0)
+	   ,_highAddress(0xFFFF)
+	   ,_firstCycle(0)
+	   ,_lastCycle(UINT64_MAX)
+	   ,_memory(false)
+	   ,_summary(false)
+	{
+	}
+
+/*****************************************************************************\
+|* Decode the traces
+\*****************************************************************************/
+int Decoder::main(int argc, const char *argv[])
+	{
+	/*************************************************************************\
+	|* Configure options and flags
+	\*************************************************************************/
+	_ap = new ArgParser(argc, argv);
+
+	String address	= _ap->stringFor("-a", "--address", "",
+										"Filter",
+										"Only instructions at hex addresses "
+										"lo-hi, eg: 2000-20ff");
+	String cycles	= _ap->stringFor("-c", "--cycles", "",
+										"Filter",
+										"Only instructions in the cycle "
+										"window lo-hi, eg: 1000-2000");
+	_label			= _ap->stringFor("-l", "--label", "",
+										"Filter",
+										"Only instructions between this "
+										"label and the next one");
+	_memory			= _ap->flagFor("-m", "--memory", false,
+										"Output",
+										"Show the memory ops of each "
+										"instruction");
+	_summary		= _ap->flagFor("-s", "--summary", false,
+										"Output",
+										"Just count the instructions that "
+										"match, and their cycles");
+
+	/*************************************************************************\
+	|* Check for help
+	\*************************************************************************/
+	uint64_t lo		= 0;
+	uint64_t hi		= 0xFFFF;
+	bool help		= _ap->flagFor("-h", "--help", false,
+									"General", "Show this wonderful help");
+	_traces			= _ap->remainingArgs();
+	if (help || _traces.size() == 0 ||
+		!_parseRange(address, 16, lo, hi) || (hi > 0xFFFF) ||
+		!_parseRange(cycles, 10, _firstCycle, _lastCycle))
+		_ap->usage(true);
+	_lowAddress		= (uint32_t) lo;
+	_highAddress	= (uint32_t) hi;
+
+	int failures = 0;
+	for (const String& path : _traces)
+		if (!_decode(path))
+			failures ++;
+
+	return (failures == 0) ? 0 : 1;
+	}
+
+
+#pragma mark - private methods
+
+
+/*****************************************************************************\
+|* Decode one trace
+\*****************************************************************************/
+bool Decoder::_decode(const String& path)
+	{
+	TraceReader reader;
+	if (!reader.open(path))
+		{
+		fprintf(stderr, "%s: not a trace\n", path.c_str());
+		return false;
+		}
+
+	uint32_t lo = _lowAddress;
+	uint32_t hi = _highAddress;
+	if (!_label.empty() && !_findLabel(reader.labels(), lo, hi))
+		{
+		fprintf(stderr, "%s: no label '%s'\n", path.c_str(), _label.c_str());
+		return false;
+		}
+
+	/*************************************************************************\
+	|* The simulator does the disassembly, from the code in the trace
+	\*************************************************************************/
+	Simulator sim(0x10000);
+	sim.setLabels(reader.labels());
+
+	TraceFile::Record rec;
+	uint64_t total	= 0;
+	uint64_t shown	= 0;
+	uint64_t cycles	= 0;
+	uint64_t last	= 0;
+	bool wasShown	= false;
+	while (reader.next(rec))
+		{
+		if (wasShown)
+			cycles += rec.cycles - last;
+		last	 = rec.cycles;
+		wasShown = (rec.regs.pc >= lo) && (rec.regs.pc <= hi) &&
+				   (rec.cycles >= _firstCycle) && (rec.cycles <= _lastCycle);
+		total ++;
+
+		if (wasShown)
+			{
+			shown ++;
+			if (!_summary)
+				_print(&sim, rec);
+			}
+		}
+
+	if (_summary)
+		printf("%s: %" PRIu64 " of %" PRIu64 " instructions, %" PRIu64
+			   " cycles\n", path.c_str(), shown, total, cycles);
+	return true;
+	}
+
+/*****************************************************************************\
+|* Print an instruction as the text trace would, and its memory ops
+\*****************************************************************************/
+void Decoder::_print(Simulator *sim, const TraceFile::Record& rec)
+	{
+	char insn[256];
+	const Simulator::Registers& r = rec.regs;
+
+	sim->addRAM(r.pc, (uint8_t *)rec.code, rec.length);
+	sim->disassemble(insn, r.pc);
+	printf("%08" PRIX64 ": A=%02X X=%02X Y=%02X P=%02X S=%02X PC=%04X %s\n",
+		   rec.cycles & 0xFFFFFFFF, r.a, r.x, r.y, r.p, r.s, r.pc, insn);
+
+	if (_memory)
+		for (const MemoryOp& op : rec.ops)
+			{
+			if (op.type == OP_WRITE)
+				printf("          W $%04X: %02X -> %02X\n",
+					   op.address, op.oldVal, op.newVal);
+			else
+				printf("          R $%04X: %02X\n", op.address, op.newVal);
+			}
+	}
+
+/*****************************************************************************\
+|* Narrow an address range to a labelled routine
+\*****************************************************************************/
+bool Decoder::_findLabel(const Simulator::AddressMap& labels,
+						 uint32_t& lo,
+						 uint32_t& hi)
+	{
+	for (auto it = labels.begin(); it != labels.end(); it++)
+		if (it->second == _label)
+			{
+			auto after	= std::next(it);
+			uint32_t end = (after == labels.end()) ? 0xFFFF : after->first - 1;
+			lo			= std::max(lo, it->first);
+			hi			= std::min(hi, end);
+			return true;
+			}
+	return false;
+	}
+
+/*****************************************************************************\
+|* Parse "lo-hi"
+\*****************************************************************************/
+bool Decoder::_parseRange(const String& spec,
+						  int base,
+						  uint64_t& lo,
+						  uint64_t& hi)
+	{
+	if (spec.empty())
+		return true;
+
+	size_t dash		= spec.find('-');
+	String ends[2]	= {spec.substr(0, dash),
+					   (dash == String::npos) ? spec : spec.substr(dash + 1)};
+	uint64_t *vals[2] = {&lo, &hi};
+
+	for (int i=0; i<2; i++)
+		{
+		String num = (ends[i].size() && ends[i][0] == '$')
+				   ? ends[i].substr(1)
+				   : ends[i];
+		if (num.empty())
+			continue;
+
+		char *end	= nullptr;
+		uint64_t v	= strtoull(num.c_str(), &end, base);
+		if (*end != '\0')
+			return false;
+		*vals[i] = v;
+		}
+
+	return lo <= hi;
+	}
@@ -0,0 +1,72 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+
+#include "sim/tracefile.h"
+
+class ArgParser;
+
+class Decoder
+	{
+	NON_COPYABLE_NOR_MOVEABLE(Decoder)
+
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GET(ArgParser*, ap);				// Permanent reference to the arguments
+	GET(StringList, traces);			// Trace files to decode
+	GET(uint32_t, lowAddress);			// Only instructions from here ...
+	GET(uint32_t, highAddress);			// ... to here
+	GET(uint64_t, firstCycle);			// Only instructions from this cycle
+	GET(uint64_t, lastCycle);			// ... to this one
+	GET(String, label);					// Only instructions in this routine
+	GET(bool, memory);					// Show the memory ops
+	GET(bool, summary);					// Only count what would be shown
+
+	private:
+		/*********************************************************************\
+		|* Decode one trace. Returns false if it can't be read
+		\*********************************************************************/
+		bool _decode(const String& path);
+
+		/*********************************************************************\
+		|* Print an instruction as the text trace would, and its memory ops
+		\*********************************************************************/
+		void _print(Simulator *sim, const TraceFile::Record& rec);
+
+		/*********************************************************************\
+		|* Narrow an address range to the code between the label and the one
+		|* after it. Returns false if the label isn't there
+		\*********************************************************************/
+		bool _findLabel(const Simulator::AddressMap& labels,
+						uint32_t& lo,
+						uint32_t& hi);
+
+		/*********************************************************************\
+		|* Parse "lo-hi", in hex for addresses or decimal for cycles. Either
+		|* end may be left out. Returns false if it doesn't make sense
+		\*********************************************************************/
+		bool _parseRange(const String& spec,
+						 int base,
+						 uint64_t& lo,
+						 uint64_t& hi);
+
+	public:
+		/*********************************************************************\
+		|* Constructors and Destructor
+		\*********************************************************************/
+		explicit Decoder();
+
+		/*********************************************************************\
+		|* Entry point from main()
+		\*********************************************************************/
+		int main(int argc, const char *argv[]);
+	};
+
+#endif // DECODER_H
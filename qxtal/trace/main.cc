@@ -0,0 +1,13 @@
+//
+//  main.cc
+//  qxtrace
+//
+// Decode, filter and print the binary traces that qxsim -B writes
+
+#include "decoder.h"
+
+int main(int argc, const char * argv[])
+	{
+	Decoder decoder;
+	return decoder.main(argc, argv);
+	}
@@ -5,7 +5,6 @@
 
 #include "notifications.h"
 #include "StringUtils.h"
-#include "traceitem.h"
 #include "ui/fontmgr.h"
 
 #include "predicates/predicateeditor.h"
@@ -331,11 +330,11 @@ void AsmWidget::_simulatorReady(NotifyData& nd)
 \*****************************************************************************/
 void AsmWidget::_traceSelection(NotifyData& nd)
 	{
-	TraceItem *item = static_cast<TraceItem *>(nd.voidValue());
-	if ((item != nullptr) && _itemMap.find(item->regs().pc) != _itemMap.end())
+	Simulator::Registers *regs = static_cast<Simulator::Registers *>(nd.voidValue());
+	if ((regs != nullptr) && _itemMap.find(regs->pc) != _itemMap.end())
 		{
 		_propagateSelection = false;
-		setCurrentItem(_itemMap[item->regs().pc]);
+		setCurrentItem(_itemMap[regs->pc]);
 		}
 	}
 
@@ -444,7 +443,8 @@ void AsmWidget::_toggleBreakpoint(AsmItem *item, bool shift)
 
 		pe->setContext(pci);
 
-		QStringList what = {"Always", "A", "X", "Y", "Status", "02222"};
+		QStringList what = {"Always", "A", "X", "Y", "Status", "Stack ptr",
+							"Memory at", "Cycles", "Hit count", "022222322"};
 		pe->setWhat(what);
 
 		QStringList cond = {"is less than",
@@ -242,7 +242,9 @@ void MainWindow::_simulationDone(NotifyData& nd)
 \*****************************************************************************/
 void MainWindow::_prefsAccepted(void)
 	{
-	_prefVals.cycleLimit = prefs->cyclesLimit->text().toInt();
+	_prefVals.cycleLimit		= prefs->cyclesLimit->text().toInt();
+	_prefVals.traceMemoryMB		= prefs->traceMemory->text().toInt();
+	_prefVals.snapshotInterval	= prefs->snapshotInterval->text().toInt();
 
 	auto nc = NotifyCenter::defaultNotifyCenter();
 	nc->notify(NTFY_PREFS_CHANGED, &_prefVals);
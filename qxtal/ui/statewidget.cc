@@ -2,7 +2,6 @@
 #include "notifications.h"
 #include "statewidget.h"
 #include "StringUtils.h"
-#include "traceitem.h"
 
 #include <QPainter>
 #include <QColor>
@@ -94,10 +93,10 @@ void StateWidget::paintEvent(QPaintEvent *)
 \*****************************************************************************/
 void StateWidget::_stateChanged(NotifyData &nd)
 	{
-	TraceItem *item = static_cast<TraceItem *>(nd.voidValue());
-	if (item)
+	Simulator::Registers *regs = static_cast<Simulator::Registers *>(nd.voidValue());
+	if (regs)
 		{
-		_regs = item->regs();
+		_regs = *regs;
 		repaint();
 		}
 	}
@@ -0,0 +1,141 @@
+#include <climits>
+
+#include "macros.h"
+#include "tracemodel.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+TraceModel::TraceModel(QObject *parent)
+		   :QAbstractListModel(parent)
+		   ,_sim(nullptr)
+		   ,_rows(0)
+	{
+	}
+
+/*****************************************************************************\
+|* Number of rows
+\*****************************************************************************/
+int TraceModel::rowCount(const QModelIndex& parent) const
+	{
+	if (parent.isValid())
+		return 0;
+	return _rows;
+	}
+
+/*****************************************************************************\
+|* Return the data for a row. The disassembly comes from memory as it is now,
+|* so point out if the code has been changed since the instruction ran
+\*****************************************************************************/
+QVariant TraceModel::data(const QModelIndex& index, int role) const
+	{
+	if (!index.isValid() || (index.row() >= _rows))
+		return QVariant();
+
+	if (role == Qt::FontRole)
+		return _font;
+
+	if ((role != Qt::DisplayRole) || (_sim == nullptr))
+		return QVariant();
+
+	TraceStore::Record rec = _store.record(index.row());
+
+	char buf[1024];
+	snprintf(buf, 1024, " $%04X : ", rec.regs.pc);
+	_sim->disassemble(buf+9, rec.regs.pc);
+	QString text = buf;
+
+	uint8_t *mem	= _sim->mem();
+	int maxRam		= _sim->maxRam();
+	for (int i=0; i<rec.numBytes; i++)
+		if (mem[(rec.regs.pc + i) % maxRam] != rec.bytes[i])
+			{
+			text += " (since modified)";
+			break;
+			}
+
+	return text;
+	}
+
+/*****************************************************************************\
+|* Add a single instruction, taking its bytes from memory
+\*****************************************************************************/
+void TraceModel::append(const Simulator::Registers& regs, MemOpView ops)
+	{
+	if (_store.full())
+		return;
+
+	uint8_t bytes[3] = {0, 0, 0};
+	int numBytes = 0;
+	if (_sim != nullptr)
+		{
+		uint8_t *mem	= _sim->mem();
+		int maxRam		= _sim->maxRam();
+		for (int i=0; i<3; i++)
+			bytes[i] = mem[(regs.pc + i) % maxRam];
+		numBytes = Simulator::insnLength(bytes[0]);
+		}
+
+	_store.append(regs, bytes, numBytes, ops);
+	_publishRows();
+	}
+
+/*****************************************************************************\
+|* Add a batch of instructions
+\*****************************************************************************/
+void TraceModel::append(StepBatchPtr batch)
+	{
+	if (_store.full() || (batch->size() == 0))
+		return;
+
+	_store.append(*batch);
+	_publishRows();
+	}
+
+/*****************************************************************************\
+|* Drop the rows from 'count' onwards, when execution carries on from an
+|* earlier point
+\*****************************************************************************/
+void TraceModel::truncate(size_t count)
+	{
+	if (count >= _store.size())
+		return;
+
+	if ((int)count < _rows)
+		{
+		beginRemoveRows(QModelIndex(), (int)count, _rows - 1);
+		_store.truncate(count);
+		_rows = (int)count;
+		endRemoveRows();
+		}
+	else
+		_store.truncate(count);
+	}
+
+/*****************************************************************************\
+|* Remove everything
+\*****************************************************************************/
+void TraceModel::clear(void)
+	{
+	beginResetModel();
+	_store.clear();
+	_rows = 0;
+	endResetModel();
+	}
+
+#pragma mark -- Private Methods
+
+/*****************************************************************************\
+|* The store may fill up part-way through a batch, so only announce the rows
+|* that actually made it in. A view can't show more than INT_MAX rows
+\*****************************************************************************/
+void TraceModel::_publishRows(void)
+	{
+	int rows = (int) MIN(_store.size(), (size_t)INT_MAX);
+	if (rows > _rows)
+		{
+		beginInsertRows(QModelIndex(), _rows, rows - 1);
+		_rows = rows;
+		endInsertRows();
+		}
+	}
@@ -0,0 +1,68 @@
+#ifndef TRACEMODEL_H
+#define TRACEMODEL_H
+
+#include <QAbstractListModel>
+#include <QFont>
+
+#include "sim/simulator.h"
+#include "sim/stepbatch.h"
+#include "sim/tracestore.h"
+
+/*****************************************************************************\
+|* List model over the trace store. Nothing is kept per row: the text for a
+|* row is disassembled when the view asks for it
+\*****************************************************************************/
+class TraceModel : public QAbstractListModel
+	{
+	Q_OBJECT
+
+	/*************************************************************************\
+	|* Properties
+	\*************************************************************************/
+	GETSET(Simulator*, sim, Sim);		// Used to disassemble on demand
+	GETSET(QFont, font, Font);			// Monospaced font
+	GET(TraceStore, store);				// The trace itself
+
+	private:
+		int _rows;						// Rows the views know about
+
+		/*********************************************************************\
+		|* Tell the views about rows that have been added to the store
+		\*********************************************************************/
+		void _publishRows(void);
+
+	public:
+		/*********************************************************************\
+		|* Constructor
+		\*********************************************************************/
+		explicit TraceModel(QObject *parent = nullptr);
+
+		/*********************************************************************\
+		|* Model interface
+		\*********************************************************************/
+		int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+		QVariant data(const QModelIndex& index,
+					  int role = Qt::DisplayRole) const override;
+
+		/*********************************************************************\
+		|* Add a single instruction
+		\*********************************************************************/
+		void append(const Simulator::Registers& regs, MemOpView ops);
+
+		/*********************************************************************\
+		|* Add a batch of instructions from the worker
+		\*********************************************************************/
+		void append(StepBatchPtr batch);
+
+		/*********************************************************************\
+		|* Keep only the first 'count' rows
+		\*********************************************************************/
+		void truncate(size_t count);
+
+		/*********************************************************************\
+		|* Remove all the rows
+		\*********************************************************************/
+		void clear(void);
+	};
+
+#endif // TRACEMODEL_H
@@ -1,10 +1,12 @@
 #include <QFontDatabase>
 
+#include "macros.h"
 #include "memorywidget.h"
+#include "tracemodel.h"
 #include "tracewidget.h"
-#include "traceitem.h"
 
 #include "notifications.h"
+#include "preferences.h"
 #include "sim/worker.h"
 #include "ui/fontmgr.h"
 
@@ -12,19 +14,30 @@
 |* Constructor
 \*****************************************************************************/
 TraceWidget::TraceWidget(QWidget *parent)
-			:QListWidget{parent}
+			:QListView{parent}
 			,_propagateSelection(true)
 			,_previousRow(0)
 	{
 	_font = FontMgr::monospacedFont();
 
+	_traceModel = new TraceModel(this);
+	_traceModel->setFont(_font);
+	setModel(_traceModel);
+
+	/*************************************************************************\
+	|* All rows are the same height, so the view only needs to ask for the
+	|* text of the rows it is showing
+	\*************************************************************************/
+	setUniformItemSizes(true);
+
 	auto nc = NotifyCenter::defaultNotifyCenter();
 	nc->addObserver([=](NotifyData &nd){_simulatorReady(nd);}, NTFY_SIM_AVAILABLE);
 	nc->addObserver([=](NotifyData &nd){_asmSelectionChanged(nd);}, NTFY_ASM_SEL_CHG);
 	nc->addObserver([=](NotifyData &nd){_prepareToSimulate(nd);}, NTFY_SIM_START);
 	nc->addObserver([=](NotifyData &nd){_reload(nd);}, NTFY_XEX_CHANGED);
+	nc->addObserver([=](NotifyData &nd){_prefsChanged(nd);}, NTFY_PREFS_CHANGED);
 
-	QObject::connect(this, &TraceWidget::currentItemChanged,
+	QObject::connect(selectionModel(), &QItemSelectionModel::currentChanged,
 					 this, &TraceWidget::_handleSelectionChanged);
 
 	}
@@ -36,16 +49,16 @@ void TraceWidget::addTraceItem(const QString& text,
 							   Simulator::Registers regs,
 							   Simulator::MemOpList ops)
 	{
-	TraceItem *item = new TraceItem(" "+text, regs, ops);
-	//fprintf(stderr, "$%04x: %d %d\n", regs.pc, op0.isValid, op1.isValid);
-
-	item->setData(Qt::FontRole, _font);
-	_itemMap[regs.pc].push_back(item);
-	addItem(item);
-
-	_lastItem = item;
+	_traceModel->append(regs, MemOpView(ops.data(), ops.size()));
 	}
 
+/*****************************************************************************\
+|* Public slot - add a batch of items from the worker
+\*****************************************************************************/
+void TraceWidget::addTraceSteps(StepBatchPtr batch)
+	{
+	_traceModel->append(batch);
+	}
 
 
 /*****************************************************************************\
@@ -56,7 +69,35 @@ void TraceWidget::simulationDone(uint32_t address)
 	auto nc = NotifyCenter::defaultNotifyCenter();
 	nc->notify(NTFY_SIM_DONE, (int)address);
 
-	setCurrentItem(_lastItem);
+	int rows = _traceModel->rowCount();
+	if (rows > 0)
+		setCurrentIndex(_traceModel->index(rows - 1));
+	}
+
+/*****************************************************************************\
+|* Public slot - the simulator moved to a point in its history. Each row
+|* holds the state before its instruction ran, so that's the row to show
+\*****************************************************************************/
+void TraceWidget::simulationSeek(uint64_t position)
+	{
+	int rows = _traceModel->rowCount();
+	if (rows > 0)
+		{
+		int row			= (int)MIN(position, (uint64_t)(rows - 1));
+		QModelIndex idx	= _traceModel->index(row);
+		scrollTo(idx, QAbstractItemView::EnsureVisible);
+		setCurrentIndex(idx);
+		}
+	}
+
+/*****************************************************************************\
+|* Public slot - execution is carrying on from an earlier point, so the rows
+|* after it no longer happened
+\*****************************************************************************/
+void TraceWidget::simulationTruncated(uint64_t position)
+	{
+	_traceModel->truncate(position);
+	_previousRow = (int)MIN((uint64_t)_previousRow, position);
 	}
 
 #pragma mark -- Private Methods
@@ -68,9 +109,7 @@ void TraceWidget::simulationDone(uint32_t address)
 \*****************************************************************************/
 void TraceWidget::_clearCurrentSelection(void)
 	{
-	for (TraceItem * item : _selected)
-		item->setSelected(false);
-	_selected.clear();
+	selectionModel()->clearSelection();
 	}
 
 
@@ -93,10 +132,18 @@ void TraceWidget::_reload(NotifyData &nd)
 void TraceWidget::_simulatorReady(NotifyData &nd)
 	{
 	_hw = static_cast<Atari *>(nd.voidValue());
+	_traceModel->setSim(_hw->sim());
+
 	QObject::connect(_hw->worker(), &Worker::simulationStep,
 					 this, &TraceWidget::addTraceItem);
+	QObject::connect(_hw->worker(), &Worker::simulationSteps,
+					 this, &TraceWidget::addTraceSteps);
 	QObject::connect(_hw->worker(), &Worker::simulationDone,
 					 this, &TraceWidget::simulationDone);
+	QObject::connect(_hw->worker(), &Worker::simulationSeek,
+					 this, &TraceWidget::simulationSeek);
+	QObject::connect(_hw->worker(), &Worker::simulationTruncated,
+					 this, &TraceWidget::simulationTruncated);
 	}
 
 
@@ -106,7 +153,34 @@ void TraceWidget::_simulatorReady(NotifyData &nd)
 void TraceWidget::_asmSelectionChanged(NotifyData &nd)
 	{
 	int address = nd.integerValue();
-	if (_itemMap.find(address) != _itemMap.end())
+
+	/*************************************************************************\
+	|* Find the runs of rows that executed this address. There's no index by
+	|* address, so this scans the trace
+	\*************************************************************************/
+	const TraceStore& store = _traceModel->store();
+	QItemSelection selection;
+	int first	= -1;
+	int rows	= _traceModel->rowCount();
+
+	int runStart	= -1;
+
+	for (int row=0; row<=rows; row++)
+		{
+		bool match = (row < rows) && (store.record(row).regs.pc == address);
+		if (match && (runStart < 0))
+			runStart = row;
+		else if (!match && (runStart >= 0))
+			{
+			selection.select(_traceModel->index(runStart),
+							 _traceModel->index(row - 1));
+			if (first < 0)
+				first = runStart;
+			runStart = -1;
+			}
+		}
+
+	if (first >= 0)
 		{
 		/*********************************************************************\
 		|* Clear any previous selection, do not propagate the selection-change
@@ -118,14 +192,9 @@ void TraceWidget::_asmSelectionChanged(NotifyData &nd)
 		setSelectionMode(QAbstractItemView::MultiSelection);
 
 		/*********************************************************************\
-		|* For each call to the address, set it to be selected so it can be
-		|* seen
+		|* Select each call to the address so it can be seen
 		\*********************************************************************/
-		for (TraceItem * item : _itemMap[address])
-			{
-			item->setSelected(true);
-			_selected.push_back(item);
-			}
+		selectionModel()->select(selection, QItemSelectionModel::Select);
 
 
 		/*********************************************************************\
@@ -133,11 +202,9 @@ void TraceWidget::_asmSelectionChanged(NotifyData &nd)
 		|* for any of the just-selected items being visible and not move if
 		|* so. In fact: FIXME: do that
 		\*********************************************************************/
-		if (_selected.size())
-			{
-			scrollToItem(_selected[0], QAbstractItemView::EnsureVisible);
-			setCurrentItem(_selected[0], QItemSelectionModel::Current);
-			}
+		QModelIndex idx = _traceModel->index(first);
+		scrollTo(idx, QAbstractItemView::EnsureVisible);
+		selectionModel()->setCurrentIndex(idx, QItemSelectionModel::Current);
 		}
 	}
 
@@ -147,12 +214,21 @@ void TraceWidget::_asmSelectionChanged(NotifyData &nd)
 \*****************************************************************************/
 void TraceWidget::_prepareToSimulate(NotifyData& nd)
 	{
-	clear();
-	_selected.clear();
-	_itemMap.clear();
+	_traceModel->clear();
 	_previousRow = 0;
 	}
 
+/*****************************************************************************\
+|* Notification: the preferences changed
+\*****************************************************************************/
+void TraceWidget::_prefsChanged(NotifyData& nd)
+	{
+	Preferences *prefs = static_cast<Preferences *>(nd.voidValue());
+	if (prefs->traceMemoryMB > 0)
+		_traceModel->store().setSpillBytes((size_t)prefs->traceMemoryMB
+										   * 1024 * 1024);
+	}
+
 
 #pragma mark -- Events
 
@@ -162,28 +238,28 @@ void TraceWidget::_prepareToSimulate(NotifyData& nd)
 /*****************************************************************************\
 |* Signal handler: our selection changed
 \*****************************************************************************/
-void TraceWidget::_handleSelectionChanged(QListWidgetItem *current,
-										  QListWidgetItem *previous)
+void TraceWidget::_handleSelectionChanged(const QModelIndex& current,
+										  const QModelIndex& previous)
 	{
+	if (!current.isValid())
+		return;
+
+	const TraceStore& store = _traceModel->store();
+
 	if (_propagateSelection)
 		{
 		/*********************************************************************\
 		|* Clear any previous selection, and set single selection
 		\*********************************************************************/
 		_clearCurrentSelection();
-		TraceItem *theItem = static_cast<TraceItem *>(current);
 		setSelectionMode(QAbstractItemView::SingleSelection);
 
-		/*********************************************************************\
-		|* Add this to the selection list so it will be cleared later
-		\*********************************************************************/
-		_selected.push_back(theItem);
-
 		/*********************************************************************\
 		|* Tell the world that we have a selection
 		\*********************************************************************/
+		Simulator::Registers regs = store.record(current.row()).regs;
 		auto nc = NotifyCenter::defaultNotifyCenter();
-		nc->notify(NTFY_TRACE_SEL_CHG, theItem);
+		nc->notify(NTFY_TRACE_SEL_CHG, &regs);
 		}
 	else
 		_propagateSelection = true;
@@ -193,27 +269,17 @@ void TraceWidget::_handleSelectionChanged(QListWidgetItem *current,
 	|* and the current one
 	\*********************************************************************/
 	Simulator::MemOpList ops;
-	int thisRow		= currentRow();
+	int thisRow		= current.row();
 	bool forwards	= true;
 
 	if (_previousRow < thisRow)
 		for (int i=_previousRow; i<thisRow; i++)
-			{
-			TraceItem *ti = static_cast<TraceItem *>(item(i));
-			if (ti != nullptr)
-				for (MemoryOp op : ti->ops())
-					ops.push_back(op);
-			}
+			store.opsFor(i, ops);
 
 	else if (_previousRow > thisRow)
 		{
 		for (int i=_previousRow-1; i>=thisRow; i--)
-			{
-			TraceItem *ti = static_cast<TraceItem *>(item(i));
-			if (ti != nullptr)
-				for (MemoryOp op : ti->ops())
-					ops.push_back(op);
-			}
+			store.opsFor(i, ops);
 		forwards = false;
 		}
 
@@ -2,32 +2,25 @@
 #define TRACEWIDGET_H
 
 #include <QObject>
-#include <QListWidget>
+#include <QListView>
 
 #include "sim/atari.h"
+#include "sim/stepbatch.h"
 #include "NotifyCenter.h"
 
-class TraceItem;
-class TraceWidget : public QListWidget
+class TraceModel;
+class TraceWidget : public QListView
 	{
 	Q_OBJECT
 
-	/*************************************************************************\
-	|* Make the instruction collections easier on the fingers
-	\*************************************************************************/
-	typedef std::map<int,std::vector<TraceItem*>> ItemMap;
-	typedef std::vector<TraceItem *> SelectionList;
-
 	/*************************************************************************\
 	|* Properties
 	\*************************************************************************/
 	GET(Atari*, hw);				// Hardware being simulated
 	GET(QFont, font);				// Monospaced font
 	GET(bool, propagateSelection);	// Whether to send selection messages
-	GET(ItemMap, itemMap);			// Map of address to item
-	GET(SelectionList, selected);	// List of currently selected items
 	GET(int, previousRow);			// Previously selected row
-	GET(TraceItem *, lastItem);		// Last item in the widget
+	GET(TraceModel *, traceModel);	// Rows of the trace
 
 	private:
 
@@ -51,11 +44,16 @@ class TraceWidget : public QListWidget
 		\*********************************************************************/
 		void _reload(NotifyData &nd);
 
+		/*********************************************************************\
+		|* Notification: the preferences changed
+		\*********************************************************************/
+		void _prefsChanged(NotifyData &nd);
+
 		/*********************************************************************\
 		|* Handle selection
 		\*********************************************************************/
-		void _handleSelectionChanged(QListWidgetItem *current,
-									 QListWidgetItem *previous);
+		void _handleSelectionChanged(const QModelIndex& current,
+									 const QModelIndex& previous);
 
 		/*********************************************************************\
 		|* Clear the current selection before selecting any more
@@ -77,9 +75,14 @@ class TraceWidget : public QListWidget
 						  Simulator::Registers regs,
 						  Simulator::MemOpList ops);
 
+		void addTraceSteps(StepBatchPtr batch);
 
 		void simulationDone(uint32_t address);
 
+		void simulationSeek(uint64_t position);
+
+		void simulationTruncated(uint64_t position);
+
 	};
 
 #endif // TRACEWIDGET_H
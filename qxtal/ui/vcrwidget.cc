@@ -54,6 +54,7 @@ VcrWidget::VcrWidget(QWidget *parent)
 	auto nc = NotifyCenter::defaultNotifyCenter();
 	nc->addObserver([=](NotifyData &nd){_binaryLoaded(nd);}, NTFY_BINARY_LOADED);
 	nc->addObserver([=](NotifyData &nd){_simulatorReady(nd);}, NTFY_SIM_AVAILABLE);
+	nc->addObserver([=](NotifyData &nd){_simulationDone(nd);}, NTFY_SIM_DONE);
 	}
 
 
@@ -175,3 +176,18 @@ void VcrWidget::_simulatorReady(NotifyData& nd)
 	_hw = static_cast<Atari *>(nd.voidValue());
 	}
 
+/*****************************************************************************\
+|* A run finished, so there's some history to go back through
+\*****************************************************************************/
+void VcrWidget::_simulationDone(NotifyData& nd)
+	{
+	_normal[BTN_STOP] = ICON_OFF;
+	_current[BTN_STOP] = ICON_OFF;
+
+	_normal[BTN_PLAY_BACK] = ICON_ACTIVE;
+	_current[BTN_PLAY_BACK] = ICON_ACTIVE;
+
+	_normal[BTN_STEP_BACK] = ICON_ACTIVE;
+	_current[BTN_STEP_BACK] = ICON_ACTIVE;
+	repaint();
+	}
@@ -36,6 +36,11 @@ class VcrWidget : public QWidget
 		\*********************************************************************/
 		void _simulatorReady(NotifyData &nd);
 
+		/*********************************************************************\
+		|* Notification: a simulation run finished
+		\*********************************************************************/
+		void _simulationDone(NotifyData &nd);
+
 	public:
 		explicit VcrWidget(QWidget *parent = nullptr);
 
@@ -5,6 +5,7 @@
 //  Created by Thrud on 7/19/20.
 //  Copyright © 2020 All rights reserved.
 //
+#include <algorithm>
 #include <filesystem>
 namespace fs = std::filesystem;
 
@@ -0,0 +1,34 @@
+; ---------------------------------------------------------------------------
+; Switching the page at $82 swaps $E0..$EF: r40 ($E8) holds one value in
+; page 0 and another in page 1, and each comes back when its page does.
+; Without the expansion board the second value overwrites the first
+
+.reg reset
+.include stdmacros.s
+.include xtrt0.s
+
+.include modules/stdio/stdio.s
+call main
+rts
+
+.function main
+@main:
+	.reg r40 1 u
+	move.1 #$7 r40			; page 0
+	lda #1
+	sta $82
+	move.1 #$9 r40			; page 1
+	call printReg r40
+
+	lda #0
+	sta $82
+	call printReg r40		; page 0 again
+
+	lda #1
+	sta $82
+	call printReg r40		; page 1 again
+
+	lda #0
+	sta $82
+	rts
+.endfunction
@@ -496,9 +496,9 @@ void Scanner::_surfaceRegs3(TargetType t1,
 	int bank1	= (v1 % 64) / 16;	// 0 -> $80,	1 -> $81
 	int bank2 	= (v2 % 64) / 16;	// 2 -> $82, 	3 -> $83
 	int bank3 	= (v3 % 64) / 16;	// 2 -> $82, 	3 -> $83
-	int page1	= (int) v1 / 16;	// r0 -> 0,		r17 -> 1
-	int page2	= (int) v2 / 16;	// r1 -> 0, 	r18	-> 1
-	int page3	= (int) v3 / 16;	// r1 -> 0, 	r18	-> 1
+	int page1	= (int) v1 / 64;	// r0 -> 0,		r17 -> 1
+	int page2	= (int) v2 / 64;	// r1 -> 0, 	r18	-> 1
+	int page3	= (int) v3 / 64;	// r1 -> 0, 	r18	-> 1
 	
 	
 	if (t1 == REG_MAIN)
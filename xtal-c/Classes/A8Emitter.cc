@@ -7,11 +7,17 @@
 
 #include <sstream>
 #include <iomanip>
+#include <set>
 
 #include "sharedDefines.h"
 
 #include "ASTNode.h"
 #include "A8Emitter.h"
+#include "CallGraph.h"
+#include "HotGlobals.h"
+#include "PassManager.h"
+#include "Profile.h"
+#include "RegisterAllocator.h"
 #include "RegisterFile.h"
 #include "sharedDefines.h"
 #include "Stringutils.h"
@@ -21,6 +27,8 @@
 #define PARENT_IS(x)	(parentAstOp == ASTNode::x)
 #define REG				Register::RegType
 
+static Register::RegType _symbolSize(const Symbol& symbol);
+
 /*****************************************************************************\
 |* Constructor
 \*****************************************************************************/
@@ -38,212 +46,295 @@ A8Emitter::~A8Emitter()
 	}
 	
 /*****************************************************************************\
-|* Emit code
+|* Lower a function's IR to assembly
 \*****************************************************************************/
-Register A8Emitter::emit(ASTNode *node,
-						 Register reg,
-						 int parentAstOp,
-						 String label)
+void A8Emitter::lower(IRFunction& fn)
 	{
-	Register left, right;
 	Register none(Register::NO_REGISTER);
-	
-	// We now have specific AST node handling at the top
-	switch (node->op())
+	int funcId = fn.funcId();
+
+	/*************************************************************************\
+    |* Put the frame in the overlay if nothing it calls can call it back
+    \*************************************************************************/
+	_inOverlay = false;
+	if (_overlay)
 		{
-		case ASTNode::A_IF:
-			return _cgIfAST(node);
-    
-		case ASTNode::A_WHILE:
-			return _cgWhileAST(node);
-    
-		case ASTNode::A_FUNCCALL:
-			return _genFuncCall(node, label);
-    
-		case ASTNode::A_GLUE:
-			// Do each child statement, and free the
-			// registers after each child
-			emit(node->left(), none, node->op(), label);
-			RegisterFile::clear();
-			
-			emit(node->right(), none, node->op(), label);
-			RegisterFile::clear();
-			return (none);
-    
-		case ASTNode::A_FUNCTION:
-			{
-			int funcId  = node->value().identifier;
-			Symbol& symbol = SYMTAB->at(funcId);
-			if (symbol.pType() == PT_NONE)
-				FATAL(ERR_TYPE, "Unknown function for id %d", funcId);
-
-			functionPreamble(funcId);
-			emit(node->left(), none, node->op(), "");
-			functionPostamble(funcId);
-			return (none);
-			}
+		std::set<int> callees;
+		for (IRBlock& block : fn.blocks)
+			for (IRInstruction& insn : block.insns)
+				if (insn.op == IRInstruction::I_CALL)
+					callees.insert(insn.sym);
+		_inOverlay = _calls->place(funcId, callees, _stackOffset);
 		}
-	
-	if (node->left())
-		left = emit(node->left(), none, node->op(), label);
-		
-	if (node->right())
-		right = emit(node->right(), none, node->op(), label);
 
-	switch (node->op())
+	functionPreamble(funcId);
+
+	/*************************************************************************\
+    |* Give the most-used locals a register for the whole function
+    \*************************************************************************/
+	String fnName = SYMTAB->at(funcId).name();
+	RegisterAllocator allocator;
+	if (_passes->level() > 0)
+		allocator.run(fn, _profile->countsFor(fnName));
+
+	_homes.clear();
+	for (auto& home : allocator.homes())
+		_homes[home.first] = RegisterFile::pin(
+								_symbolSize(SYMTAB->at(home.first)),
+								home.second);
+
+	/*************************************************************************\
+    |* Only blocks that are jumped to need a label
+    \*************************************************************************/
+	std::set<int> targets;
+	for (IRBlock& block : fn.blocks)
+		for (IRInstruction& insn : block.insns)
+			if (insn.isTerminator() && (insn.target >= 0))
+				targets.insert(insn.target);
+
+	for (int b=0; b<(int)fn.blocks.size(); b++)
 		{
-		case ASTNode::A_ADD:			return _cgAdd(left, right);
-		case ASTNode::A_SUBTRACT:		return _cgSub(left, right);
-		case ASTNode::A_MULTIPLY:		return _cgMul(left, right);
-		case ASTNode::A_DIVIDE:			return _cgDiv(left, right);
-		case ASTNode::A_AND:			return _cgAnd(left, right);
-		case ASTNode::A_OR:				return _cgOr(left, right);
-		case ASTNode::A_XOR:			return _cgXor(left, right);
-		case ASTNode::A_LSHIFT:			return _cgShl(left, right);
-		case ASTNode::A_RSHIFT:			return _cgShr(left, right);
-		case ASTNode::A_EQ:
-		case ASTNode::A_NE:
-		case ASTNode::A_LT:
-		case ASTNode::A_GT:
-		case ASTNode::A_LE:
-		case ASTNode::A_GE:
-			if (PARENT_IS(A_IF) || PARENT_IS(A_WHILE))
-				return _cgCompareAndJump(left, right, node->op(), label);
-			else
-				return _cgCompareAndSet(left, right, node->op());
-				
-		case ASTNode::A_INTLIT:
+		IRBlock& block = fn.blocks[b];
+
+		// Nothing is held in registers from one block to the next
+		RegisterFile::clear();
+		_temps.clear();
+		if (targets.count(block.id) > 0)
+			cgLabel(block.label);
+
+		// The profiler counts the cycles of this NOP to tell us how often
+		// the block ran
+		if (_instrument)
 			{
-			return _cgLoadInt((int)node->value().intValue);
+			cgLabel(Profile::label(fnName, block.id));
+			fprintf(_ofp, "\tnop\n");
 			}
-				
-		case ASTNode::A_STRLIT:
+
+		if (b == 0)
+			for (int sym : allocator.entryLoads())
+				_cgReloadHome(sym);
+
+		/*********************************************************************\
+		|* Find where each temporary is used for the last time, as an
+		|* (instruction, operand) pair, so it can be handed over rather than
+		|* copied
+		\*********************************************************************/
+		_lastUse.clear();
+		for (int i=0; i<(int)block.insns.size(); i++)
 			{
-			return _cgLoadGlobalStr((int)node->value().intValue);
+			int pos = 0;
+			for (const IROperand *o : block.insns[i].operands())
+				{
+				if (o->isTemp())
+					_lastUse[o->temp] = std::make_pair(i, pos);
+				pos ++;
+				}
 			}
-		case ASTNode::A_IDENT:
+
+		for (int i=0; i<(int)block.insns.size(); i++)
 			{
-			if (node->isRValue() || (parentAstOp == ASTNode::A_DEREF))
-				{
-				int nodeId = node->value().identifier;
-				Symbol& sym = SYMTAB->at(nodeId);
-				if (sym.pType() == PT_NONE)
-					FATAL(ERR_TYPE, "Unknown identifier for id %d", nodeId);
+			IRInstruction& insn = block.insns[i];
 
-				if (sym.sClass() == C_LOCAL)
-					return _cgLoadLocal(nodeId, node->op());
+			// Shifts by a constant are done in-line, without loading the count
+			bool constShift	= ((insn.op == IRInstruction::I_SHL) ||
+							   (insn.op == IRInstruction::I_SHR))
+							&& insn.b.isConst();
+
+			std::vector<Register> regs;
+			int pos = 0;
+			for (const IROperand *o : insn.operands())
+				{
+				if (constShift && (pos == 1))
+					regs.push_back(none);
 				else
-					return _cgLoadGlob(nodeId, node->op());
+					regs.push_back(_cgOperand(*o, i, pos));
+				pos ++;
 				}
-			else
-				return none;
-			}
-		case ASTNode::A_ASSIGN:
-			// Are we assigning to an identifier, or through a pointer
-			switch (node->right()->op())
+
+			Register a 		= (regs.size() > 0) ? regs[0] : none;
+			Register b2		= (regs.size() > 1) ? regs[1] : none;
+			Register result	= none;
+			String label	= (insn.target >= 0)
+							? fn.blocks[fn.indexOf(insn.target)].label
+							: "";
+
+			switch (insn.op)
 				{
-				case ASTNode::A_IDENT:
+				case IRInstruction::I_NOP:
+					break;
+
+				case IRInstruction::I_COPY:
+					result = (insn.type == PT_NONE)
+						   ? a
+						   : _cgConvert(a, insn.type);
+					break;
+
+				case IRInstruction::I_LOAD:
+				case IRInstruction::I_LOADMOD:
 					{
-					int nodeId = node->right()->value().identifier;
-					Symbol& sym = SYMTAB->at(nodeId);
-					if (sym.pType() == PT_NONE)
-						FATAL(ERR_TYPE, "Unknown identifier for id %d", nodeId);
-					
-					if (sym.sClass() == C_LOCAL)
-						return (_cgStoreLocal(left, sym));
+					int op = (insn.op == IRInstruction::I_LOAD)
+						   ? (int)ASTNode::A_IDENT
+						   : insn.aux;
+					if (_homes.count(insn.sym) > 0)
+						result = _cgLoadHome(insn.sym, op);
+					else if (SYMTAB->at(insn.sym).sClass() == C_LOCAL)
+						result = _cgLoadLocal(insn.sym, op);
 					else
-						return _cgStoreGlobal(left, sym);
+						result = _cgLoadGlob(insn.sym, op);
+					break;
 					}
-				case ASTNode::A_DEREF:
-					return _cgStoreDeref(left, right, node->right()->type());
-				
-				default:
-					FATAL(ERR_PARSE, "Can't ASSIGN in emitter, op=%d",
-									 node->op());
-				}
-		case ASTNode::A_DEREF:
-			// if we're an r-value, dereference to get the value we point
-			// at, otherwise leave it for A_ASSIGN to store through the
-			// pointer
-			if (node->isRValue())
-				return _cgDeref(left, node->left()->type());
-			else
-				return left;
-		case ASTNode::A_PRINT:
-			{
-			printReg(left, node->type());
-			RegisterFile::clear();
-			return none;
-			}
-		case ASTNode::A_WIDEN:
-			left = _cgWiden(left, node->left()->type(), node->type());
-			return left;
-		case ASTNode::A_RETURN:
-			_cgReturn(left, SYMTAB->functionId());
-			return left;
-//		case ASTNode::A_FUNCCALL:
-//			return _cgCall(left, node->value().identifier);
-		case ASTNode::A_ADDR:
-			return _cgAddress(node->value().identifier);
-		case ASTNode::A_SCALE:
-			// Use a shift if the scale value is a known power of 2
-			switch (node->value().size)
-				{
-				case 1:		return left;
-				case 2:		return _cgShlConst(left, 1);
-				case 4:		return _cgShlConst(left, 2);
-				default:
-					right = _cgLoadInt(node->value().size);
-					right.setType(left.type());
-					return _cgMul(left, right);
-				}
-			break;
 
-		case ASTNode::A_POSTINC:
-		case ASTNode::A_POSTDEC:
-			// Load the variable's value into a register, then increment it
-			{
-			int nodeId = node->value().identifier;
-			Symbol& sym = SYMTAB->at(nodeId);
-			if (sym.pType() == PT_NONE)
-				FATAL(ERR_TYPE, "Unknown post-op identifier for id %d", nodeId);
-			if (sym.sClass() == C_LOCAL)
-				return _cgLoadLocal(nodeId, node->op());
-			
-			return _cgLoadGlob(nodeId, node->op());
-			}
-		case ASTNode::A_PREINC:
-		case ASTNode::A_PREDEC:
-			// Load and increment the variable's value into a register
-			{
-			int nodeId = node->left()->value().identifier;
-			Symbol& sym = SYMTAB->at(nodeId);
-			if (sym.pType() == PT_NONE)
-				FATAL(ERR_TYPE, "Unknown pre-op identifier for id %d", nodeId);
-			if (sym.sClass() == C_LOCAL)
-				return _cgLoadLocal(nodeId, node->op());
-			
-			return _cgLoadGlob(nodeId, node->op());
-			}
+				case IRInstruction::I_STORE:
+					{
+					Symbol& sym = SYMTAB->at(insn.sym);
+					if (_homes.count(insn.sym) > 0)
+						result = _cgStoreHome(a, insn.sym);
+					else if (sym.sClass() == C_LOCAL)
+						result = _cgStoreLocal(a, sym);
+					else
+						result = _cgStoreGlobal(a, sym);
+					break;
+					}
+
+				case IRInstruction::I_STOREIND:
+					result = _cgStoreDeref(a, b2, insn.type);
+					break;
+
+				case IRInstruction::I_DEREF:
+					result = _cgDeref(a, insn.type);
+					break;
+
+				case IRInstruction::I_ADDR:
+					result = _cgAddress(insn.sym);
+					break;
+
+				case IRInstruction::I_STRADDR:
+					result = _cgLoadGlobalStr(insn.sym);
+					break;
+
+				case IRInstruction::I_ADD:	result = _cgAdd(a, b2);		break;
+				case IRInstruction::I_SUB:	result = _cgSub(a, b2);		break;
+				case IRInstruction::I_MUL:	result = _cgMul(a, b2);		break;
+				case IRInstruction::I_DIV:	result = _cgDiv(a, b2);		break;
+				case IRInstruction::I_AND:	result = _cgAnd(a, b2);		break;
+				case IRInstruction::I_OR:	result = _cgOr(a, b2);		break;
+				case IRInstruction::I_XOR:	result = _cgXor(a, b2);		break;
+
+				case IRInstruction::I_SHL:
+					result = (constShift) ? _cgShlConst(a, (int)insn.b.value)
+										  : _cgShl(a, b2);
+					break;
+
+				case IRInstruction::I_SHR:
+					result = (constShift) ? _cgShrConst(a, (int)insn.b.value)
+										  : _cgShr(a, b2);
+					break;
+
+				case IRInstruction::I_CMP:
+					result = _cgCompareAndSet(a, b2, insn.aux);
+					break;
+
+				case IRInstruction::I_NEG:
+					result = _cgNegate(a);
+					break;
+
+				case IRInstruction::I_NOT:
+					result = _cgInvert(a);
+					break;
+
+				case IRInstruction::I_LOGNOT:
+					result = _cgLogNot(a);
+					break;
+
+				case IRInstruction::I_BOOL:
+					result = _cgBoolean(a, ASTNode::A_NONE, "");
+					break;
+
+				case IRInstruction::I_WIDEN:
+					result = _cgWiden(a, insn.aux, insn.type);
+					break;
+
+				case IRInstruction::I_SCALE:
+					// Use a shift if the scale value is a known power of 2
+					switch (insn.aux)
+						{
+						case 1:
+							result = a;
+							break;
+						case 2:
+							result = _cgShlConst(a, 1);
+							break;
+						case 4:
+							result = _cgShlConst(a, 2);
+							break;
+						default:
+							b2 = _cgLoadInt(insn.aux);
+							b2.setType(a.type());
+							result = _cgMul(a, b2);
+							break;
+						}
+					break;
+
+				case IRInstruction::I_PRINT:
+					printReg(a, insn.type);
+					break;
+
+				case IRInstruction::I_CALL:
+					{
+					// The callee is free to use any register
+					std::vector<int> saves = allocator.savesAround(b, i);
+					for (int sym : saves)
+						_cgSaveHome(sym);
+					result = _cgFuncCall(insn.sym, regs);
+					for (int sym : saves)
+						_cgReloadHome(sym);
+					break;
+					}
 
-		case ASTNode::A_NEGATE:
-			return _cgNegate(left);
+				case IRInstruction::I_RETURN:
+					{
+					// No need to jump to the end if that's where we are
+					bool last = (b == (int)fn.blocks.size()-1)
+							 && (i == (int)block.insns.size()-1);
+					_cgReturn(a, insn.sym, !last);
+					break;
+					}
 
-		case ASTNode::A_INVERT:
-			return _cgInvert(left);
+				case IRInstruction::I_JUMP:
+					_cgJump(label);
+					break;
 
-		case ASTNode::A_LOGNOT:
-			return _cgLogNot(left);
+				case IRInstruction::I_BRANCH:
+					_cgCompareAndJump(a, b2, insn.aux, label);
+					break;
 
-		case ASTNode::A_TOBOOL:
-			// If the parent AST node is an A_IF or A_WHILE, generate
-			// a compare followed by a jump. Otherwise, set the register
-			// to 0 or 1 based on it's zeroeness or non-zeroeness
-			return (_cgBoolean(left, parentAstOp, label));
+				case IRInstruction::I_BRANCHZ:
+					_cgBoolean(a, ASTNode::A_IF, label);
+					break;
 
-		default:
-			FATAL(ERR_AST_UNKNOWN_OPERATOR, "Unknown AST operator %d", node->op());
+				default:
+					FATAL(ERR_EMIT, "Unknown IR operation %d", insn.op);
+				}
+
+			/*****************************************************************\
+			|* Keep the result if it's used later, and give back every other
+			|* register
+			\*****************************************************************/
+			if (insn.dst && (_lastUse.count(insn.dst) > 0))
+				_temps[insn.dst] = result;
+
+			std::vector<Register> live;
+			for (auto& held : _temps)
+				live.push_back(held.second);
+			RegisterFile::retain(live);
+			}
 		}
+
+	functionPostamble(funcId);
+
+	RegisterFile::unpinAll();
+	_homes.clear();
+	_inOverlay = false;
 	}
 
 	
@@ -328,33 +419,36 @@ void A8Emitter::genSymbol(int idx)
 		
 	String name 	= symbol.name();
 	snprintf(buf, 1024, "@S_%s:\n", name.c_str());
-	append(buf, POSTAMBLE);
+	String storage	= buf;
 	
 	for (int i=0; i<symbol.size(); i++)
 		{
-		String str;
-		
 		switch (_symbolSize(symbol))
 			{
 			case Register::UNSIGNED_4BYTE:
 			case Register::SIGNED_4BYTE:
-				str = "\t.word 0,0\n";
+				storage += "\t.word 0,0\n";
 				break;
 			case Register::UNSIGNED_2BYTE:
 			case Register::SIGNED_2BYTE:
-				str = "\t.word 0\n";
+				storage += "\t.word 0\n";
 				break;
 			case Register::UNSIGNED_1BYTE:
 			case Register::SIGNED_1BYTE:
-				str = "\t.byte 0\n";
+				storage += "\t.byte 0\n";
 				break;
 			default:
 				{
 				FATAL(ERR_TYPE, "Unknown size for symbol %s", symbol.name().c_str());
 				}
 			}
-		append(str, POSTAMBLE);
 		}
+	
+	// With a profile, wait to see if it's used enough to go in zero page
+	if (_profile->loaded())
+		_globals->add(idx, storage);
+	else
+		append(storage, POSTAMBLE);
 	}
 
 /*****************************************************************************\
@@ -396,20 +490,164 @@ int A8Emitter::genGlobalString(String content)
 \*****************************************************************************/
 Register A8Emitter::_cgLoadInt(int val, int primitiveType)
 	{
-	(void)primitiveType;
-	
+	// With no type given, use the smallest register the value fits in
 	REG type 	= ((val >= 0) && (val <= 255))   ? Register::UNSIGNED_1BYTE
 				: ((val >= -128) && (val <= 127))   ? Register::SIGNED_1BYTE
 				: ((val >= 0) && (val <= 65535)) ? Register::UNSIGNED_2BYTE
 				: ((val >= -32768) && (val <= 32767)) ? Register::SIGNED_2BYTE
 				: (val > 2147483647) ? Register::UNSIGNED_4BYTE
 				: Register::SIGNED_4BYTE;
-	Register r	= _regs->allocate(type);
+	Register r	= (primitiveType == PT_NONE)
+				? _regs->allocate(type)
+				: _regs->allocateForPrimitiveType(primitiveType);
 	
 	fprintf(_ofp, "\tmove.%d #$%x %s\n", r.size(), val, r.name().c_str());
 	return r;
 	}
 
+/*****************************************************************************\
+|* Get an IR operand into a register. A temporary is handed over on its last
+|* use, and copied before that so the original survives
+\*****************************************************************************/
+Register A8Emitter::_cgOperand(const IROperand& o, int insn, int pos)
+	{
+	if (o.isConst())
+		return _cgLoadInt((int)o.value, o.type);
+
+	auto it = _temps.find(o.temp);
+	if (it == _temps.end())
+		FATAL(ERR_EMIT, "Temporary t%d used before it's set", o.temp);
+
+	Register r = it->second;
+	if (_lastUse[o.temp] == std::make_pair(insn, pos))
+		{
+		_temps.erase(it);
+		return r;
+		}
+
+	Register copy = _regs->allocate(r.type());
+	fprintf(_ofp, "\tmove.%d %s %s\n",
+				  r.size(),
+				  r.name().c_str(),
+				  copy.name().c_str());
+	return copy;
+	}
+
+/*****************************************************************************\
+|* Convert a register to a primitive type, extending or truncating it, and
+|* making sure the register has the right signedness
+\*****************************************************************************/
+Register A8Emitter::_cgConvert(Register r, int pType)
+	{
+	r = _cgExtendIfNeeded(r, pType);
+
+	Register want = _regs->allocateForPrimitiveType(pType);
+	if (want.type() == r.type())
+		{
+		_regs->free(want);
+		return r;
+		}
+
+	fprintf(_ofp, "\tmove.%d %s %s\n",
+				  want.size(),
+				  r.name().c_str(),
+				  want.name().c_str());
+	_regs->free(r);
+	return want;
+	}
+
+/*****************************************************************************\
+|* Read a local that lives in a register, into a register of its own
+\*****************************************************************************/
+Register A8Emitter::_cgLoadHome(int identifier, int op)
+	{
+	Register& home	= _homes[identifier];
+	Symbol& s		= SYMTAB->at(identifier);
+	const char *name = home.name().c_str();
+
+	/*************************************************************************\
+    |* Work out the ++/-- for the type. Pointers step by what they point to
+    \*************************************************************************/
+	int step = (s.pType() > 0xFF) ? Types::typeSize(Types::valueAt(s.pType())) : 1;
+	String modify = "";
+	bool up = (op == ASTNode::A_PREINC) || (op == ASTNode::A_POSTINC);
+	if (up || (op == ASTNode::A_PREDEC) || (op == ASTNode::A_POSTDEC))
+		{
+		char buf[1024];
+		switch (home.size())
+			{
+			case 1:
+				snprintf(buf, 1024, "\t%s %s\n", up ? "inc" : "dec", name);
+				break;
+			case 2:
+				if (step == 1)
+					snprintf(buf, 1024, "\t%s %s\n",
+							 up ? "_inc16" : "_dec16", name);
+				else
+					snprintf(buf, 1024, "\t%s %d,%s\n",
+							 up ? "_add16i" : "_sub16i", step, name);
+				break;
+			default:
+				snprintf(buf, 1024, "\t%s %s\n", up ? "_inc32" : "_dec32", name);
+				break;
+			}
+		modify = buf;
+		}
+
+	bool pre = (op == ASTNode::A_PREINC) || (op == ASTNode::A_PREDEC);
+	if (pre)
+		fprintf(_ofp, "%s", modify.c_str());
+
+	Register r = _regs->allocate(home.type());
+	fprintf(_ofp, "\tmove.%d %s %s\n", r.size(), name, r.name().c_str());
+
+	if (!pre)
+		fprintf(_ofp, "%s", modify.c_str());
+	return r;
+	}
+
+/*****************************************************************************\
+|* Write a value to a local that lives in a register. Like a store to memory,
+|* this keeps the low bytes of a wider value
+\*****************************************************************************/
+Register A8Emitter::_cgStoreHome(Register r, int identifier)
+	{
+	Register& home	= _homes[identifier];
+	Symbol& s		= SYMTAB->at(identifier);
+
+	if (r.size() < home.size())
+		r = _cgExtendIfNeeded(r, s.pType());
+
+	fprintf(_ofp, "\tmove.%d %s %s\n",
+				  home.size(),
+				  r.name().c_str(),
+				  home.name().c_str());
+	return r;
+	}
+
+/*****************************************************************************\
+|* Write a local's register back to the stack
+\*****************************************************************************/
+void A8Emitter::_cgSaveHome(int identifier)
+	{
+	Register home = _homes[identifier];
+	_cgStoreLocal(home, SYMTAB->at(identifier));
+	}
+
+/*****************************************************************************\
+|* Load a local's register from the stack
+\*****************************************************************************/
+void A8Emitter::_cgReloadHome(int identifier)
+	{
+	Register& home	= _homes[identifier];
+	Register r		= _cgLoadLocal(identifier, ASTNode::A_IDENT);
+	fprintf(_ofp, "\tmove.%d %s %s\n",
+				  home.size(),
+				  r.name().c_str(),
+				  home.name().c_str());
+	_regs->free(r);
+	}
+
 /*****************************************************************************\
 |* Generate a load-value-to-register
 \*****************************************************************************/
@@ -431,6 +669,7 @@ Register A8Emitter::_cgStoreGlobal(Register& r, const Symbol& symbol)
 	{
 	Symbol s 	= (Symbol)symbol;
 	REG size	= _symbolSize(symbol);
+	String name	= _symbolLabel(symbol);
 
 	/*************************************************************************\
     |* Do some zeroing checks if the register size and the symbol size do not
@@ -445,23 +684,23 @@ Register A8Emitter::_cgStoreGlobal(Register& r, const Symbol& symbol)
 		{
 		case Register::SIGNED_1BYTE:
 		case Register::UNSIGNED_1BYTE:
-			fprintf(_ofp, "\tmove.1 %s S_%s\n",
+			fprintf(_ofp, "\tmove.1 %s %s\n",
 						r.name().c_str(),
-						s.name().c_str());
+						name.c_str());
 			break;
 			
 		case Register::SIGNED_2BYTE:
 		case Register::UNSIGNED_2BYTE:
-			fprintf(_ofp, "\tmove.2 %s S_%s\n",
+			fprintf(_ofp, "\tmove.2 %s %s\n",
 						r.name().c_str(),
-						s.name().c_str());
+						name.c_str());
 			break;
 			
 		case Register::SIGNED_4BYTE:
 		case Register::UNSIGNED_4BYTE:
-			fprintf(_ofp, "\tmove.4 %s S_%s\n",
+			fprintf(_ofp, "\tmove.4 %s %s\n",
 						r.name().c_str(),
-						s.name().c_str());
+						name.c_str());
 			break;
 		
 		default:
@@ -478,6 +717,9 @@ Register A8Emitter::_cgStoreGlobal(Register& r, const Symbol& symbol)
 \*****************************************************************************/
 Register A8Emitter::_cgStoreLocal(Register& r, const Symbol& symbol)
 	{
+	if (_inOverlay)
+		return _cgStoreGlobal(r, symbol);
+
 	Symbol s 	= (Symbol)symbol;
 
 	/*************************************************************************\
@@ -979,6 +1221,7 @@ Register A8Emitter::_cgCompareAndJump(Register r1,
 									  String label)
 	{
 	Register none(Register::NO_REGISTER);
+	String skip			= label+"_skip_"+randomString(8);
 	String criteria 	= "beq skip\n";
 	
 	switch (how)
@@ -1018,15 +1261,17 @@ Register A8Emitter::_cgCompareAndJump(Register r1,
 	/*************************************************************************\
 	|* Write out the compare logic
 	\*************************************************************************/
+	criteria = replace(criteria, "skip", skip);
 	fprintf(_ofp,	"\t_cmp%d %s,%s\n"
 					"\t%s\n"
 					"\tjmp %s\n"
-					"skip:\n",
+					"%s:\n",
 					r1.size()*8,
 					r1.name().c_str(),
 					r2.name().c_str(),
 					criteria.c_str(),
-					label.c_str());
+					label.c_str(),
+					skip.c_str());
 	
 	_regs->free(r1);
 	return none;
@@ -1144,75 +1389,6 @@ void A8Emitter::_cgJump(String label)
 	fprintf(_ofp, "\tjmp %s\n", label.c_str());
 	}
 	
-/****************************************************************************\
-|* Private method - generate an IF-statement AST
-\****************************************************************************/
-Register A8Emitter::_cgIfAST(ASTNode *node)
-	{
-	Register none(Register::NO_REGISTER);
-
-	_cgPushContext(C_IF, "if");
-
-	// Generate the condition code followed
-	// by a zero jump to the false label.
-	emit(node->left(), none, node->op(), "ifNot");
-	RegisterFile::clear();
-	
-	// Generate the true compound statement
-	emit(node->mid(), none, node->op(), "ifNot");
-	RegisterFile::clear();
-
-	// If there is an optional ELSE clause,
-	// generate the jump to skip to the end
-	if (node->right())
-		_cgJump("ifEnd");
-	
-	// Now the false label
-	cgLabel("ifNot");
-	
-	// Optional ELSE clause: generate the
-	// false compound statement and the
-	// end label
-	if (node->right())
-		{
-		emit(node->right(), none, node->op(), "ifNot");
-		RegisterFile::clear();
-		cgLabel("ifEnd");
-		}
-	
-	_cgPopContext();
-	return none;
-	}
-	
-/****************************************************************************\
-|* Private method - generate a WHILE-statement AST
-\****************************************************************************/
-Register A8Emitter::_cgWhileAST(ASTNode *node)
-	{
-	Register none(Register::NO_REGISTER);
-
-	_cgPushContext(C_WHILE, "while");
-	cgLabel("start");
-
-	// Generate the condition code followed
-	// by a jump to the end label.
-	emit(node->left(), none, node->op(), "end");
-	RegisterFile::clear();
-	
-	// Generate the body compound statement
-	emit(node->right(), none, node->op(), "");
-	RegisterFile::clear();
-
-	// Output the jump back to the start
-	_cgJump("start");
-	
-	// Now the loop-exit label
-	cgLabel("end");
-		
-	_cgPopContext();
-	return none;
-	}
-
 /*****************************************************************************\
 |* Call a function
 \*****************************************************************************/
@@ -1261,7 +1437,7 @@ Register A8Emitter::_cgCall(int symIdx)
 /*****************************************************************************\
 |* Return a value from a function
 \*****************************************************************************/
-void A8Emitter::_cgReturn(Register r1, int funcId)
+void A8Emitter::_cgReturn(Register r1, int funcId, bool jump)
 	{
 	Symbol& s = SYMTAB->at(funcId);
 	if (s.pType() == PT_NONE)
@@ -1288,7 +1464,8 @@ void A8Emitter::_cgReturn(Register r1, int funcId)
 			FATAL(ERR_FUNCTION, "Incorrect return type");
 			break;
 		}
-	_cgJump(s.endLabel());
+	if (jump)
+		_cgJump(s.endLabel());
 	}
 
 /*****************************************************************************\
@@ -1303,7 +1480,7 @@ Register A8Emitter::_cgAddress(int identifier)
 	Symbol s 	= SYMTAB->at(identifier);
 	if (s.pType() == PT_NONE)
 		FATAL(ERR_TYPE, "Unknown address identifier for id %d", identifier);
-	if (s.sClass() == C_LOCAL)
+	if ((s.sClass() == C_LOCAL) && !_inOverlay)
 		{
 		if (s.position() != 0)
 			fprintf(_ofp, "\tmove.2 " STACK_PTR " %s; offset = %d\n"
@@ -1315,8 +1492,8 @@ Register A8Emitter::_cgAddress(int identifier)
 					, r.name().c_str());
 		}
 	else
-		fprintf(_ofp, "\tmove.2 #S_%s %s\n",
-						s.name().c_str(),
+		fprintf(_ofp, "\tmove.2 #%s %s\n",
+						_symbolLabel(s).c_str(),
 						r.name().c_str());
 	return r;
 	}
@@ -1411,7 +1588,7 @@ Register A8Emitter::_cgShlConst(Register r1, int amount)
 	{
 	int size = r1.size() * 8;		// bits not bytes
 	
-	for (int i=0; i<amount; i++)
+	for (int i=0; i<amount && i<size; i++)
 		fprintf(_ofp, "\t_asl%d %s,%s\n",
 					  size,
 					  r1.name().c_str(),
@@ -1419,6 +1596,21 @@ Register A8Emitter::_cgShlConst(Register r1, int amount)
 	return r1;
 	}
 
+/*****************************************************************************\
+|* Shift a register right by a constant
+\*****************************************************************************/
+Register A8Emitter::_cgShrConst(Register r1, int amount)
+	{
+	int size = r1.size() * 8;		// bits not bytes
+	
+	for (int i=0; i<amount && i<size; i++)
+		fprintf(_ofp, "\t_lsr%d %s,%s\n",
+					  size,
+					  r1.name().c_str(),
+					  r1.name().c_str());
+	return r1;
+	}
+
 /*****************************************************************************\
 |* Perform an AND
 \*****************************************************************************/
@@ -1516,6 +1708,9 @@ Register A8Emitter::_cgShr(Register r1, Register r2)
 \*****************************************************************************/
 Register A8Emitter::_cgLoadLocal(int identifier, int op)
 	{
+	if (_inOverlay)
+		return _cgLoadGlob(identifier, op);
+
 	Symbol s  			= SYMTAB->at(identifier);
 	if (s.pType() == PT_NONE)
 		FATAL(ERR_TYPE, "Unknown local identifier for id %d", identifier);
@@ -1703,6 +1898,28 @@ Register A8Emitter::_cgLoadLocal(int identifier, int op)
 	return var;
 	}
 	
+/*****************************************************************************\
+|* The address of a variable that isn't reached through the stack: globals
+|* by their label, parameters in the argument space, and locals in the
+|* overlay from the start of the function's frame
+\*****************************************************************************/
+String A8Emitter::_symbolLabel(const Symbol& symbol)
+	{
+	Symbol s = (Symbol)symbol;
+	if (s.sClass() == C_PARAM)
+		return toHexString(s.location(), "$");
+
+	if (s.sClass() == C_LOCAL)
+		{
+		String frame = CallGraph::label(SYMTAB->functionId());
+		return (s.position() == 0)
+			 ? frame
+			 : frame + "+" + std::to_string(s.position());
+		}
+
+	return "S_" + s.name();
+	}
+
 /*****************************************************************************\
 |* Load a symbol into a register, given an identifier. Return the register
 |* If the operation is pre/post inc/dec also perform that operation
@@ -1715,10 +1932,7 @@ Register A8Emitter::_cgLoadGlob(int identifier, int op)
 		
 	Register r 			= _regs->allocateForPrimitiveType(s.pType());
 	
-	String symName		= "S_"+s.name();
-	if (s.sClass() == C_PARAM)
-		symName = toHexString(s.location(), "$");
-		
+	String symName		= _symbolLabel(s);
 	const char *name 	= (char *) symName.c_str();
 	const char *reg		= r.name().c_str();
 	
@@ -2174,11 +2388,8 @@ Register A8Emitter::_cgExtendIfNeeded(Register r, int pType)
 /*****************************************************************************\
 |* Copy any function arguments to the correct memory, and call a function
 \*****************************************************************************/
-Register A8Emitter::_genFuncCall(ASTNode *node, String label)
+Register A8Emitter::_cgFuncCall(int symIdx, std::vector<Register>& args)
 	{
-	ASTNode *gluetree 	= node->left();
-	Register none(Register::NO_REGISTER);
-
 	StringList saves;
 	StringList moves;
 	StringList restore;
@@ -2189,10 +2400,8 @@ Register A8Emitter::_genFuncCall(ASTNode *node, String label)
     |* If there is a list of arguments, walk this list
 	\************************************************************************/
 	int sv = FN_PARAM_MIN;
-	while (gluetree)
+	for (Register& reg : args)
 		{
-		// Calculate the expression's value
-		Register reg 	= emit(gluetree->right(), none, gluetree->op(), label);
 		int at			= functionParameterLocation(reg.primitiveType());
 		
 		switch (reg.size())
@@ -2242,8 +2451,6 @@ Register A8Emitter::_genFuncCall(ASTNode *node, String label)
 			default:
 				FATAL(ERR_PARSE, "Unknown register size %d", reg.size());
 			}
-			
-		gluetree = gluetree->left();
 		}
 
 	/************************************************************************\
@@ -2258,10 +2465,33 @@ Register A8Emitter::_genFuncCall(ASTNode *node, String label)
 	\************************************************************************/
 	int bytes = sv-FN_PARAM_MIN;
 
-	int nodeId = node->value().identifier;
-	Symbol sFn = SYMTAB->at(nodeId);
+	/************************************************************************\
+    |* A function in the overlay keeps the args it's saving in its own frame,
+    |* after its locals
+	\************************************************************************/
+	if (_inOverlay && (SYMTAB->currentFunction().name() != "main"))
+		{
+		saves.clear();
+		restore.clear();
+
+		int funcId	= SYMTAB->functionId();
+		String slot	= CallGraph::label(funcId) + "+";
+		int at		= FN_PARAM_MIN;
+		for (Register& reg : args)
+			{
+			String size	= "\tmove." + std::to_string(reg.size());
+			String save	= slot + std::to_string(_stackOffset + at - FN_PARAM_MIN);
+			saves.push_back(size + toHexString(at, " $") + " " + save);
+			restore.insert(restore.begin(),
+						   size + " " + save + toHexString(at, " $"));
+			at += reg.size();
+			}
+		_calls->reserve(funcId, _stackOffset + bytes);
+		}
+
+	Symbol sFn = SYMTAB->at(symIdx);
 	if (sFn.pType() == PT_NONE)
-		FATAL(ERR_TYPE, "Unknown function identifier for id %d", nodeId);
+		FATAL(ERR_TYPE, "Unknown function identifier for id %d", symIdx);
 
 	const char * fnName = sFn.name().c_str();
 	fprintf(_ofp, "\n; Function call %s [%d bytes]\n;\n", fnName, bytes);
@@ -2274,7 +2504,7 @@ Register A8Emitter::_genFuncCall(ASTNode *node, String label)
 	if (SYMTAB->currentFunction().name() != "main")
 		{
 		// Adjust the stack pointer down by the number of bytes we need
-		if (bytes > 0)
+		if ((bytes > 0) && !_inOverlay)
 			fprintf(_ofp, "\t;push stack by %d\n"
 						  "\t_sub16i %d,SP\n", bytes, bytes);
 			
@@ -2292,7 +2522,7 @@ Register A8Emitter::_genFuncCall(ASTNode *node, String label)
 	/************************************************************************\
     |* Call the function and return its result
 	\************************************************************************/
-	Register ret = _cgCall(node->value().identifier);
+	Register ret = _cgCall(symIdx);
 
 
 	/************************************************************************\
@@ -2305,7 +2535,7 @@ Register A8Emitter::_genFuncCall(ASTNode *node, String label)
 			fprintf(_ofp, "%s\n", cmd.c_str());
 
 		// Adjust the stack pointer down by the number of bytes we used
-		if (bytes > 0)
+		if ((bytes > 0) && !_inOverlay)
 			fprintf(_ofp, "\t; pop stack by %d\n"
 						  "\t_add16i %d,SP\n", bytes, bytes);
 		}
@@ -9,13 +9,16 @@
 #define A8Emitter_h
 
 #include <cstdio>
+#include <map>
 #include <string>
+#include <vector>
 
 #include "properties.h"
 #include "macros.h"
 #include "sharedDefines.h"
 
 #include "Emitter.h"
+#include "IR.h"
 #include "Register.h"
 
 class ASTNode;
@@ -31,17 +34,61 @@ class A8Emitter : public Emitter
     \*************************************************************************/
     
     private:
+		/*********************************************************************\
+        |* Registers holding the temporaries of the block being lowered, and
+        |* where each temporary is last used: (instruction, operand)
+        \*********************************************************************/
+		std::map<int, Register> _temps;
+		std::map<int, std::pair<int,int>> _lastUse;
+
+		/*********************************************************************\
+        |* Registers holding locals for the whole function, by symbol
+        \*********************************************************************/
+		std::map<int, Register> _homes;
+        
+		/*********************************************************************\
+        |* Generate a register load immediate. With no type, the register is
+        |* the smallest the value fits in
+        \*********************************************************************/
+        Register _cgLoadInt(int value, int type = PT_NONE);
+        
+		/*********************************************************************\
+        |* Get an IR operand of instruction 'insn' into a register
+        \*********************************************************************/
+        Register _cgOperand(const IROperand& o, int insn, int pos);
+        
+		/*********************************************************************\
+        |* Convert a register to a primitive type
+        \*********************************************************************/
+        Register _cgConvert(Register r, int pType);
+        
+		/*********************************************************************\
+        |* Read a local held in a register, handling any ++/--
+        \*********************************************************************/
+        Register _cgLoadHome(int identifier, int op);
+        
+		/*********************************************************************\
+        |* Write a register to a local held in a register
+        \*********************************************************************/
+        Register _cgStoreHome(Register r, int identifier);
         
 		/*********************************************************************\
-        |* Generate a register load immediate
+        |* Write a local held in a register back to its memory, or reload it
+        |* from there, around a call
         \*********************************************************************/
-        Register _cgLoadInt(int value, int type = PT_S8);
+        void _cgSaveHome(int identifier);
+        void _cgReloadHome(int identifier);
         
 		/*********************************************************************\
         |* Generate a global string load immediate
         \*********************************************************************/
         Register _cgLoadGlobalStr(int value);
         
+		/*********************************************************************\
+        |* The address a variable is reached at by name
+        \*********************************************************************/
+        String _symbolLabel(const Symbol& symbol);
+
 		/*********************************************************************\
         |* Load the variable's value into a register
         \*********************************************************************/
@@ -162,19 +209,9 @@ class A8Emitter : public Emitter
         Register _cgCall(int symIdx);
          
 		/*********************************************************************\
-        |* Handle a function call
+        |* Return from a function, jumping to its end unless told not to
         \*********************************************************************/
-        void _cgReturn(Register r1, int funcId);
-			
-		/*********************************************************************\
-        |* Generate an IF statement AST.
-		\*********************************************************************/
-		Register _cgIfAST(ASTNode *node);
-
-		/*********************************************************************\
-        |* Generate a WHILE statement AST.
-		\*********************************************************************/
-		Register _cgWhileAST(ASTNode *node);
+        void _cgReturn(Register r1, int funcId, bool jump = true);
 
 		/*********************************************************************\
         |* Handle the compare part of an IF statement
@@ -206,6 +243,11 @@ class A8Emitter : public Emitter
         \*********************************************************************/
         Register _cgShlConst(Register r1, int amount);
         
+		/*********************************************************************\
+        |* Shift a register right by a constant amount
+        \*********************************************************************/
+        Register _cgShrConst(Register r1, int amount);
+        
 		/*********************************************************************\
         |* Perform an AND op on two registers
         \*********************************************************************/
@@ -257,9 +299,9 @@ class A8Emitter : public Emitter
         Register _cgExtendIfNeeded(Register r, int pType);
 
 		/*********************************************************************\
-        |* Generate a function call
+        |* Generate a function call, with the arguments already in registers
         \*********************************************************************/
-        Register _genFuncCall(ASTNode *node, String label);
+        Register _cgFuncCall(int symIdx, std::vector<Register>& args);
 
 		
     public:
@@ -275,12 +317,9 @@ class A8Emitter : public Emitter
         void printReg(Register r, int type);
 
         /*********************************************************************\
-        |* Generate the code
+        |* Lower a function's IR to assembly
         \*********************************************************************/
-        Register emit(ASTNode *node,
-					  Register reg,
-					  int parentAstOp,
-					  String label);
+        void lower(IRFunction& fn);
 
         /*********************************************************************\
         |* Generate a global symbol by reference to the symbol table index
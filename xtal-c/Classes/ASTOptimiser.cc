@@ -0,0 +1,424 @@
+//
+//  ASTOptimiser.cc
+//  xtal-c
+//
+
+#include "ASTNode.h"
+#include "ASTOptimiser.h"
+#include "IR.h"
+#include "SymbolTable.h"
+#include "Types.h"
+
+/*****************************************************************************\
+|* Whether a node is an integer literal
+\*****************************************************************************/
+static bool _isLiteral(ASTNode *node)
+	{
+	return (node != nullptr) && (node->op() == ASTNode::A_INTLIT);
+	}
+
+/*****************************************************************************\
+|* The type of register a literal node will be loaded into
+\*****************************************************************************/
+static int _registerType(ASTNode *node)
+	{
+	return IR::literalType((int)node->value().intValue, node->type());
+	}
+
+/*****************************************************************************\
+|* If a value is a power of 2, return which one, otherwise -1
+\*****************************************************************************/
+static int _log2(int64_t value)
+	{
+	if ((value <= 0) || ((value & (value - 1)) != 0))
+		return -1;
+
+	int bit = 0;
+	while ((1LL << bit) != value)
+		bit ++;
+	return bit;
+	}
+
+/*****************************************************************************\
+|* Operator names, for the debug output
+\*****************************************************************************/
+static const char * _opName(int op)
+	{
+	switch (op)
+		{
+		case ASTNode::A_ADD:		return "+";
+		case ASTNode::A_SUBTRACT:	return "-";
+		case ASTNode::A_MULTIPLY:	return "*";
+		case ASTNode::A_DIVIDE:		return "/";
+		case ASTNode::A_AND:		return "&";
+		case ASTNode::A_OR:			return "|";
+		case ASTNode::A_XOR:		return "^";
+		case ASTNode::A_LSHIFT:		return "<<";
+		case ASTNode::A_RSHIFT:		return ">>";
+		case ASTNode::A_NEGATE:		return "negate";
+		case ASTNode::A_INVERT:		return "invert";
+		case ASTNode::A_WIDEN:		return "widen";
+		case ASTNode::A_SCALE:		return "scale";
+		default:					return "?";
+		}
+	}
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+ASTOptimiser::ASTOptimiser(void)
+			 :_changes(0)
+	{
+	}
+
+/*****************************************************************************\
+|* Optimise the body of a function
+\*****************************************************************************/
+int ASTOptimiser::run(ASTNode *function)
+	{
+	_fnName = SYMTAB->at(function->value().identifier).name();
+	function->setLeft(_optimise(function->left()));
+	return _changes;
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* Optimise a sub-tree, children first so literals bubble up
+\*****************************************************************************/
+ASTNode * ASTOptimiser::_optimise(ASTNode *node)
+	{
+	if (node == nullptr)
+		return nullptr;
+
+	node->setLeft(_optimise(node->left()));
+	node->setMid(_optimise(node->mid()));
+	node->setRight(_optimise(node->right()));
+
+	ASTNode *result = _fold(node);
+	if (result == nullptr)
+		result = _simplify(node);
+	return (result == nullptr) ? node : result;
+	}
+
+/*****************************************************************************\
+|* Fold a node with literal operands into a literal. This follows what the
+|* emitter would do at run-time, so values wrap at the width of the register
+|* the left operand is held in
+\*****************************************************************************/
+ASTNode * ASTOptimiser::_fold(ASTNode *node)
+	{
+	ASTNode *left	= node->left();
+	ASTNode *right	= node->right();
+	if (!_isLiteral(left))
+		return nullptr;
+
+	int64_t a		= left->value().intValue;
+	ASTNode *result	= nullptr;
+
+	switch (node->op())
+		{
+		case ASTNode::A_WIDEN:
+			result = _literal(node, a, node->type());
+			break;
+
+		case ASTNode::A_SCALE:
+			// The scaled offset is added to a pointer, so make it that wide
+			result = _literal(node, a * node->value().size, PT_U16);
+			break;
+
+		case ASTNode::A_NEGATE:
+			{
+			int size = Types::typeSize(_registerType(left));
+			result = _literal(node, -a,
+						(size == 1) ? PT_S8 : (size == 2) ? PT_S16 : PT_S32);
+			break;
+			}
+
+		case ASTNode::A_INVERT:
+			result = _literal(node, ~a, _registerType(left));
+			break;
+
+		case ASTNode::A_ADD:
+		case ASTNode::A_SUBTRACT:
+		case ASTNode::A_MULTIPLY:
+		case ASTNode::A_DIVIDE:
+		case ASTNode::A_AND:
+		case ASTNode::A_OR:
+		case ASTNode::A_XOR:
+		case ASTNode::A_LSHIFT:
+		case ASTNode::A_RSHIFT:
+			{
+			if (!_isLiteral(right) || !Types::isInt(node->type()))
+				return nullptr;
+
+			// Both sides have already been widened to match
+			int type	= node->type();
+			int size	= Types::typeSize(type);
+			if ((Types::typeSize(_registerType(left)) != size) ||
+				(Types::typeSize(_registerType(right)) != size))
+				return nullptr;
+
+			int64_t b	= right->value().intValue;
+			int bits	= size * 8;
+			uint64_t mask = (bits >= 64) ? ~0ULL : ((1ULL << bits) - 1);
+			int64_t value;
+			switch (node->op())
+				{
+				case ASTNode::A_ADD:		value = a + b; break;
+				case ASTNode::A_SUBTRACT:	value = a - b; break;
+				case ASTNode::A_MULTIPLY:	value = a * b; break;
+				case ASTNode::A_AND:		value = a & b; break;
+				case ASTNode::A_OR:			value = a | b; break;
+				case ASTNode::A_XOR:		value = a ^ b; break;
+
+				case ASTNode::A_DIVIDE:
+					// Leave signed division and division by zero to run-time
+					if ((a < 0) || (b <= 0))
+						return nullptr;
+					value = a / b;
+					break;
+
+				case ASTNode::A_LSHIFT:
+					if (b < 0)
+						return nullptr;
+					value = (b >= bits) ? 0 : (int64_t)((uint64_t)a << b);
+					break;
+
+				default:
+					// The emitter's right-shift is always a logical one
+					if (b < 0)
+						return nullptr;
+					value = (b >= bits) ? 0 : (int64_t)(((uint64_t)a & mask) >> b);
+					break;
+				}
+
+			result = _literal(node, value, type);
+			DBG_DEFAULT("AST %s: folded %lld %s %lld into %lld",
+						_fnName.c_str(), (long long)a, _opName(node->op()),
+						(long long)b, (long long)result->value().intValue);
+			_changes ++;
+			return result;
+			}
+
+		default:
+			return nullptr;
+		}
+
+	// Widening a literal is just the parser's type-matching, so only
+	// mention it when asked for more detail
+	if (node->op() == ASTNode::A_WIDEN)
+		DBG_CHATTY("AST %s: widened literal %lld",
+				   _fnName.c_str(), (long long)a);
+	else
+		DBG_DEFAULT("AST %s: folded %s %lld into %lld",
+					_fnName.c_str(), _opName(node->op()), (long long)a,
+					(long long)result->value().intValue);
+	_changes ++;
+	return result;
+	}
+
+/*****************************************************************************\
+|* Simplify an operation with one literal operand
+\*****************************************************************************/
+ASTNode * ASTOptimiser::_simplify(ASTNode *node)
+	{
+	ASTNode *lit	= nullptr;
+	ASTNode *var	= nullptr;
+	int op			= node->op();
+
+	switch (op)
+		{
+		case ASTNode::A_ADD:
+		case ASTNode::A_MULTIPLY:
+		case ASTNode::A_AND:
+		case ASTNode::A_OR:
+		case ASTNode::A_XOR:
+			// Either way round
+			if (_isLiteral(node->left()))
+				{
+				lit = node->left();
+				var = node->right();
+				break;
+				}
+			[[fallthrough]];
+
+		case ASTNode::A_SUBTRACT:
+		case ASTNode::A_DIVIDE:
+		case ASTNode::A_LSHIFT:
+		case ASTNode::A_RSHIFT:
+			if (_isLiteral(node->right()))
+				{
+				lit = node->right();
+				var = node->left();
+				}
+			break;
+		}
+
+	// The result has to be held exactly as the other operand is
+	int type = node->type();
+	if ((lit == nullptr) || (var == nullptr) || (var->type() != type)
+		|| !Types::isInt(type))
+		return nullptr;
+
+	int64_t value	= lit->value().intValue;
+	int shift		= _log2(value);
+	ASTNode *result	= nullptr;
+
+	switch (op)
+		{
+		case ASTNode::A_ADD:
+		case ASTNode::A_SUBTRACT:
+		case ASTNode::A_OR:
+		case ASTNode::A_XOR:
+		case ASTNode::A_LSHIFT:
+		case ASTNode::A_RSHIFT:
+			if (value == 0)
+				result = var;
+			break;
+
+		case ASTNode::A_AND:
+			if ((value == 0) && _pure(var))
+				result = _literal(node, 0, type);
+			break;
+
+		case ASTNode::A_MULTIPLY:
+			if ((value == 0) && _pure(var))
+				result = _literal(node, 0, type);
+			else if (value == 1)
+				result = var;
+			else if (shift > 0)
+				result = _shiftLeft(var, shift, type);
+			else
+				result = _multiply(node, var, value);
+			break;
+
+		case ASTNode::A_DIVIDE:
+			// A logical shift only divides an unsigned value
+			if (value == 1)
+				result = var;
+			else if ((shift > 0) && !IR::isSigned(type)
+					 && !IR::isSigned(_registerType(lit)))
+				{
+				ASTNode *by = new ASTNode(ASTNode::A_INTLIT, PT_U8, shift);
+				by->setIsRValue(true);
+				result = new ASTNode(ASTNode::A_RSHIFT, type,
+									 var, nullptr, by, 0);
+				result->setIsRValue(node->isRValue());
+				}
+			break;
+		}
+
+	if (result != nullptr)
+		{
+		DBG_DEFAULT("AST %s: rewrote %s %lld as %s",
+					_fnName.c_str(), _opName(op), (long long)value,
+					(result->op() == ASTNode::A_INTLIT) ? "a constant"
+					: (result == var) ? "a no-op"
+					: (result->op() == ASTNode::A_LSHIFT) ? "a shift left"
+					: (result->op() == ASTNode::A_RSHIFT) ? "a shift right"
+					: "shifts and adds");
+		_changes ++;
+		}
+	return result;
+	}
+
+/*****************************************************************************\
+|* Turn a multiply by a small constant into shifts and adds. This needs the
+|* other operand twice, so it's only done when that's a plain variable
+\*****************************************************************************/
+ASTNode * ASTOptimiser::_multiply(ASTNode *node, ASTNode *var, int64_t by)
+	{
+	if ((var->op() != ASTNode::A_IDENT) || (by < 3) || (by > 255))
+		return nullptr;
+
+	int type		= node->type();
+	ASTNode *copy	= new ASTNode(ASTNode::A_IDENT,
+								  var->type(),
+								  var->value().identifier);
+	copy->setIsRValue(true);
+
+	ASTNode *result	= nullptr;
+	int high		= 0;
+	while ((by >> (high + 1)) != 0)
+		high ++;
+
+	int64_t rest = by - (1LL << high);
+	if (_log2(rest) >= 0)
+		{
+		// Two bits set: x * (2^h + 2^l) = (x << h) + (x << l)
+		result = new ASTNode(ASTNode::A_ADD, type,
+							 _shiftLeft(var, high, type),
+							 nullptr,
+							 _shiftLeft(copy, _log2(rest), type),
+							 0);
+		}
+	else if (_log2(by + 1) > 0)
+		{
+		// All ones: x * (2^n - 1) = (x << n) - x
+		result = new ASTNode(ASTNode::A_SUBTRACT, type,
+							 _shiftLeft(var, _log2(by + 1), type),
+							 nullptr,
+							 copy,
+							 0);
+		}
+	else
+		return nullptr;
+
+	result->setIsRValue(node->isRValue());
+	return result;
+	}
+
+/*****************************************************************************\
+|* Make a literal node like another one
+\*****************************************************************************/
+ASTNode * ASTOptimiser::_literal(ASTNode *like, int64_t value, int type)
+	{
+	ASTNode *node = new ASTNode(ASTNode::A_INTLIT,
+								type,
+								(int)IR::normalise(value, type));
+	node->setIsRValue(like->isRValue());
+	return node;
+	}
+
+/*****************************************************************************\
+|* Shift a tree left by a constant amount
+\*****************************************************************************/
+ASTNode * ASTOptimiser::_shiftLeft(ASTNode *tree, int by, int type)
+	{
+	if (by == 0)
+		return tree;
+
+	ASTNode *amount = new ASTNode(ASTNode::A_INTLIT, PT_U8, by);
+	amount->setIsRValue(true);
+
+	ASTNode *node = new ASTNode(ASTNode::A_LSHIFT, type,
+								tree, nullptr, amount, 0);
+	node->setIsRValue(true);
+	return node;
+	}
+
+/*****************************************************************************\
+|* Whether a tree can be dropped without changing anything
+\*****************************************************************************/
+bool ASTOptimiser::_pure(ASTNode *node)
+	{
+	if (node == nullptr)
+		return true;
+
+	switch (node->op())
+		{
+		case ASTNode::A_ASSIGN:
+		case ASTNode::A_FUNCCALL:
+		case ASTNode::A_PREINC:
+		case ASTNode::A_PREDEC:
+		case ASTNode::A_POSTINC:
+		case ASTNode::A_POSTDEC:
+			return false;
+
+		default:
+			return _pure(node->left())
+				&& _pure(node->mid())
+				&& _pure(node->right());
+		}
+	}
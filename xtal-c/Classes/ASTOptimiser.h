@@ -0,0 +1,81 @@
+//
+//  ASTOptimiser.h
+//  xtal-c
+//
+//  Fold constant sub-expressions in a function's AST, and replace multiplies
+//  and divides by constants with cheaper shifts and adds, before the IR is
+//  built
+//
+
+#ifndef ASTOptimiser_h
+#define ASTOptimiser_h
+
+#include <cstdio>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+
+class ASTNode;
+
+class ASTOptimiser
+	{
+    NON_COPYABLE_NOR_MOVEABLE(ASTOptimiser)
+
+	/************************************************************************\
+    |* Properties
+    \************************************************************************/
+    GET(int, changes);						// Rewrites made so far
+
+    private:
+		String _fnName;						// Function, for the debug output
+
+        /********************************************************************\
+        |* Optimise a sub-tree, returning what should replace it
+        \********************************************************************/
+		ASTNode * _optimise(ASTNode *node);
+
+        /********************************************************************\
+        |* Fold a node whose children are all literals, if possible
+        \********************************************************************/
+		ASTNode * _fold(ASTNode *node);
+
+        /********************************************************************\
+        |* Simplify an operation with one literal operand, if possible
+        \********************************************************************/
+		ASTNode * _simplify(ASTNode *node);
+
+        /********************************************************************\
+        |* Turn a multiply by a constant into shifts and adds, if that's
+        |* cheaper
+        \********************************************************************/
+		ASTNode * _multiply(ASTNode *node, ASTNode *var, int64_t by);
+
+        /********************************************************************\
+        |* Make a literal node, with the value brought into range for the type
+        \********************************************************************/
+		ASTNode * _literal(ASTNode *like, int64_t value, int type);
+
+        /********************************************************************\
+        |* Make a shift-left node, or return the tree if there's no shift
+        \********************************************************************/
+		ASTNode * _shiftLeft(ASTNode *tree, int by, int type);
+
+        /********************************************************************\
+        |* Whether evaluating a tree has no side effects
+        \********************************************************************/
+		bool _pure(ASTNode *node);
+
+    public:
+        /********************************************************************\
+        |* Constructor
+        \********************************************************************/
+        explicit ASTOptimiser(void);
+
+        /********************************************************************\
+        |* Optimise the body of a function, returning the number of rewrites
+        \********************************************************************/
+		int run(ASTNode *function);
+	};
+
+#endif /* ASTOptimiser_h */
@@ -0,0 +1,134 @@
+//
+//  BlockLayout.cc
+//  xtal-c
+//
+
+#include <vector>
+
+#include "ASTNode.h"
+#include "BlockLayout.h"
+#include "SymbolTable.h"
+
+/*****************************************************************************\
+|* Whether control never falls out of the bottom of a block
+\*****************************************************************************/
+static bool _leaves(IRBlock& block)
+	{
+	IRInstruction *insn = block.terminator();
+	return (insn != nullptr) && ((insn->op == IRInstruction::I_JUMP) ||
+								 (insn->op == IRInstruction::I_RETURN));
+	}
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+BlockLayout::BlockLayout(const Profile::Counts& counts)
+			:_counts(counts)
+	{
+	}
+
+/*****************************************************************************\
+|* Run the pass. A branch from block B to F, with blocks T..F-1 in between,
+|* becomes a branch to T on the opposite condition, with T..F-1 moved to the
+|* end and a jump back to F added if they used to fall into it
+\*****************************************************************************/
+int BlockLayout::run(IRFunction& fn)
+	{
+	const char *fnName = SYMTAB->at(fn.funcId()).name().c_str();
+	int changes = 0;
+
+	// Whatever ends up after the last block mustn't be fallen into
+	if ((fn.blocks.size() == 0) || !_leaves(fn.blocks.back()))
+		return 0;
+
+	std::vector<std::vector<int>> preds = fn.predecessors();
+	for (int i=0; i+1<(int)fn.blocks.size(); i++)
+		{
+		IRInstruction *insn = fn.blocks[i].terminator();
+		if ((insn == nullptr) || (insn->op != IRInstruction::I_BRANCH))
+			continue;
+
+		int target	= fn.indexOf(insn->target);
+		if ((target <= i+1) || (preds[i+1].size() != 1))
+			continue;
+
+		/*********************************************************************\
+		|* The block after the branch is only reached by falling into it, so
+		|* its count is how often the branch wasn't taken
+		\*********************************************************************/
+		int64_t runs	= _count(fn, i);
+		int64_t falls	= _count(fn, i+1);
+		if (falls * 2 >= runs)
+			continue;
+
+		if (!_invert(*insn))
+			continue;
+
+		int from		= i+1;
+		int into		= insn->target;
+		insn->target	= fn.blocks[from].id;
+
+		std::vector<IRBlock> moved(fn.blocks.begin() + from,
+								   fn.blocks.begin() + target);
+		fn.blocks.erase(fn.blocks.begin() + from, fn.blocks.begin() + target);
+		fn.blocks.insert(fn.blocks.end(), moved.begin(), moved.end());
+
+		if (!_leaves(fn.blocks.back()))
+			{
+			IRBlock& jump = fn.newBlock("bb");
+			jump.insns.push_back(IRInstruction(IRInstruction::I_JUMP));
+			jump.insns.back().target = into;
+			}
+
+		DBG_DEFAULT("Layout %s: branch in %s taken %lld of %lld, %d blocks "
+					"moved to the end",
+					fnName, fn.blocks[i].label.c_str(),
+					(long long)(runs - falls), (long long)runs,
+					(int)moved.size());
+
+		preds = fn.predecessors();
+		changes ++;
+		}
+
+	return changes;
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* The count for a block, or zero if the profile doesn't have it
+\*****************************************************************************/
+int64_t BlockLayout::_count(IRFunction& fn, int idx)
+	{
+	auto it = _counts.find(fn.blocks[idx].id);
+	return (it == _counts.end()) ? 0 : it->second;
+	}
+
+/*****************************************************************************\
+|* Turn a branch round. 'a > b' is jumped on as 'b < a' and 'a <= b' as
+|* 'b >= a', since those are the comparisons with a single branch each way
+\*****************************************************************************/
+bool BlockLayout::_invert(IRInstruction& insn)
+	{
+	switch (insn.aux)
+		{
+		case ASTNode::A_EQ:	insn.aux = ASTNode::A_NE;	break;
+		case ASTNode::A_NE:	insn.aux = ASTNode::A_EQ;	break;
+		case ASTNode::A_LT:	insn.aux = ASTNode::A_GE;	break;
+		case ASTNode::A_GE:	insn.aux = ASTNode::A_LT;	break;
+
+		case ASTNode::A_GT:
+			std::swap(insn.a, insn.b);
+			insn.aux = ASTNode::A_GE;
+			break;
+
+		case ASTNode::A_LE:
+			std::swap(insn.a, insn.b);
+			insn.aux = ASTNode::A_LT;
+			break;
+
+		default:
+			return false;
+		}
+	return true;
+	}
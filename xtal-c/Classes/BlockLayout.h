@@ -0,0 +1,49 @@
+//
+//  BlockLayout.h
+//  xtal-c
+//
+//  Use a profile to choose the polarity of conditional branches. Where a
+//  branch is taken more often than not, the condition is turned round and
+//  the blocks it used to fall into are moved to the end of the function, so
+//  the common path falls through
+//
+
+#ifndef BlockLayout_h
+#define BlockLayout_h
+
+#include <cstdio>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+
+#include "PassManager.h"
+#include "Profile.h"
+
+class BlockLayout : public IRPass
+	{
+    private:
+		const Profile::Counts& _counts;		// Times each block ran
+
+        /********************************************************************\
+        |* How often a block ran, by layout index
+        \********************************************************************/
+		int64_t _count(IRFunction& fn, int idx);
+
+        /********************************************************************\
+        |* Turn a branch round, if its condition has an opposite that's
+        |* generated exactly
+        \********************************************************************/
+		bool _invert(IRInstruction& insn);
+
+    public:
+        /********************************************************************\
+        |* Constructor
+        \********************************************************************/
+        explicit BlockLayout(const Profile::Counts& counts);
+
+		const char * name(void)		{ return "block-layout"; }
+		int run(IRFunction& fn);
+	};
+
+#endif /* BlockLayout_h */
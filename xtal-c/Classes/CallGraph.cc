@@ -0,0 +1,136 @@
+//
+//  CallGraph.cc
+//  xtal-c
+//
+
+#include <algorithm>
+#include <vector>
+
+#include "CallGraph.h"
+#include "SymbolTable.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+CallGraph::CallGraph(void)
+		  :_size(0)
+	{
+	}
+
+/*****************************************************************************\
+|* Place a function's frame. Everything it calls has already been placed
+|* unless it was only declared, so the frame can go straight above the
+|* highest of them
+\*****************************************************************************/
+bool CallGraph::place(int funcId, const std::set<int>& callees, int bytes)
+	{
+	const char *name = SYMTAB->at(funcId).name().c_str();
+
+	Frame frame;
+	frame.base		= 0;
+	frame.size		= bytes;
+	frame.reach		= 0;
+	frame.closed	= true;
+	frame.inOverlay	= false;
+
+	bool recursive	= false;
+	for (int callee : callees)
+		{
+		if (callee == funcId)
+			{
+			recursive = true;
+			continue;
+			}
+
+		auto it = _frames.find(callee);
+		if ((it == _frames.end()) || !it->second.closed)
+			{
+			DBG_DEFAULT("Overlay %s: %s could call back, frame stays on stack",
+						name, SYMTAB->at(callee).name().c_str());
+			frame.closed = false;
+			continue;
+			}
+		frame.reach = std::max(frame.reach, _top(it->second));
+		}
+
+	if (recursive)
+		DBG_DEFAULT("Overlay %s: recursive, frame stays on stack", name);
+
+	frame.inOverlay = frame.closed && !recursive;
+	if (frame.inOverlay)
+		{
+		frame.base	= frame.reach;
+		_size		= std::max(_size, frame.base + frame.size);
+		DBG_DEFAULT("Overlay %s: %d bytes at offset %d",
+					name, frame.size, frame.base);
+		}
+
+	_frames[funcId] = frame;
+	return frame.inOverlay;
+	}
+
+/*****************************************************************************\
+|* Grow a frame, for the argument bytes a function saves around its calls
+\*****************************************************************************/
+void CallGraph::reserve(int funcId, int bytes)
+	{
+	Frame& frame = _frames[funcId];
+	if (frame.inOverlay && (bytes > frame.size))
+		{
+		frame.size	= bytes;
+		_size		= std::max(_size, frame.base + frame.size);
+		}
+	}
+
+/*****************************************************************************\
+|* The label for a function's frame
+\*****************************************************************************/
+String CallGraph::label(int funcId)
+	{
+	return "F_" + SYMTAB->at(funcId).name();
+	}
+
+/*****************************************************************************\
+|* Write out the overlay. Frames that start at the same offset share their
+|* bytes, so each run of zeroes is only as long as the gap to the next frame
+\*****************************************************************************/
+String CallGraph::layout(void)
+	{
+	std::vector<std::pair<int, int>> starts;
+	for (auto& entry : _frames)
+		if (entry.second.inOverlay && (entry.second.size > 0))
+			starts.push_back(std::make_pair(entry.second.base, entry.first));
+	std::sort(starts.begin(), starts.end());
+
+	if (starts.size() == 0)
+		return "";
+
+	String text = "; Overlay frames, " + std::to_string(_size) + " bytes\n";
+	for (int i=0; i<(int)starts.size(); i++)
+		{
+		text += "@" + label(starts[i].second) + ":\n";
+
+		int next = (i+1 < (int)starts.size()) ? starts[i+1].first : _size;
+		for (int at=starts[i].first; at<next; at+=16)
+			{
+			String comma = "\t.byte ";
+			for (int j=at; (j<next) && (j<at+16); j++)
+				{
+				text += comma + "0";
+				comma = ",";
+				}
+			text += "\n";
+			}
+		}
+	return text;
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* Frames on the stack don't add to the top, but what they call might
+\*****************************************************************************/
+int CallGraph::_top(const Frame& frame)
+	{
+	return (frame.inOverlay) ? frame.base + frame.size : frame.reach;
+	}
@@ -0,0 +1,83 @@
+//
+//  CallGraph.h
+//  xtal-c
+//
+//  Lay out the frames of non-recursive functions in a static overlay, so
+//  their locals are reached with absolute addressing rather than through the
+//  stack pointer. Functions are placed as they're compiled: a callee is
+//  always complete by then, so each frame goes just above the frames of
+//  everything it can call, and frames that are never live together share
+//  memory. A function that can reach itself, or calls something not yet
+//  defined (which might call back), keeps its frame on the stack
+//
+
+#ifndef CallGraph_h
+#define CallGraph_h
+
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+
+class CallGraph
+	{
+    NON_COPYABLE_NOR_MOVEABLE(CallGraph)
+
+	/************************************************************************\
+    |* Properties
+    \************************************************************************/
+    GET(int, size);							// Bytes in the overlay
+
+    private:
+		/*********************************************************************\
+		|* What we know about each function compiled so far
+		\*********************************************************************/
+		typedef struct
+			{
+			int base;						// Offset in the overlay
+			int size;						// Bytes in the frame
+			int reach;						// Top of everything it calls
+			bool closed;					// All callees known, none open
+			bool inOverlay;					// Frame is in the overlay
+			} Frame;
+
+		std::map<int, Frame> _frames;		// Frames, by function id
+
+        /********************************************************************\
+        |* The first byte past this function's frame and all it can call
+        \********************************************************************/
+		int _top(const Frame& frame);
+
+    public:
+        /********************************************************************\
+        |* Constructor
+        \********************************************************************/
+        explicit CallGraph(void);
+
+        /********************************************************************\
+        |* Place a function that's about to be emitted, given what it calls
+        |* and the bytes of its locals. Returns true if its frame went in the
+        |* overlay
+        \********************************************************************/
+		bool place(int funcId, const std::set<int>& callees, int bytes);
+
+        /********************************************************************\
+        |* Grow a function's frame to at least 'bytes'
+        \********************************************************************/
+		void reserve(int funcId, int bytes);
+
+        /********************************************************************\
+        |* The label for the start of a function's frame
+        \********************************************************************/
+		static String label(int funcId);
+
+        /********************************************************************\
+        |* The assembly for the overlay, with a label for each frame
+        \********************************************************************/
+		String layout(void);
+	};
+
+#endif /* CallGraph_h */
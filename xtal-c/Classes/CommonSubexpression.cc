@@ -0,0 +1,115 @@
+//
+//  CommonSubexpression.cc
+//  xtal-c
+//
+
+#include "CommonSubexpression.h"
+
+/*****************************************************************************\
+|* Run the pass
+\*****************************************************************************/
+int CommonSubexpression::run(IRFunction& fn)
+	{
+	int changes = 0;
+	for (IRBlock& block : fn.blocks)
+		changes += _block(fn, block);
+	return changes;
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* Run over a block
+\*****************************************************************************/
+int CommonSubexpression::_block(IRFunction& fn, IRBlock& block)
+	{
+	std::map<Key, int> available;		// Values computed so far
+	std::map<int, IROperand> replace;	// Temporaries to use something else for
+	int changes = 0;
+
+	for (IRInstruction& insn : block.insns)
+		{
+		for (IROperand *o : insn.operands())
+			if (o->isTemp() && (replace.count(o->temp) > 0))
+				*o = replace[o->temp];
+
+		/*********************************************************************\
+		|* Reuse an earlier result if there is one
+		\*********************************************************************/
+		if (insn.dst && _reusable(insn))
+			{
+			Key key(insn.op, insn.a, insn.b, insn.type, insn.sym, insn.aux);
+			auto it = available.find(key);
+			if (it != available.end())
+				{
+				replace[insn.dst]	= IROperand::forTemp(it->second);
+				insn				= IRInstruction(IRInstruction::I_NOP);
+				changes ++;
+				continue;
+				}
+			available[key] = insn.dst;
+			}
+
+		/*********************************************************************\
+		|* Forget anything a write or a call could have changed
+		\*********************************************************************/
+		if (insn.isCall())
+			{
+			available.clear();
+			continue;
+			}
+
+		bool store = (insn.op == IRInstruction::I_STORE)
+				  || (insn.op == IRInstruction::I_LOADMOD);
+		if (store || (insn.op == IRInstruction::I_STOREIND))
+			for (auto it = available.begin(); it != available.end(); )
+				{
+				int op	= std::get<0>(it->first);
+				int sym	= std::get<4>(it->first);
+				bool killed = (op == IRInstruction::I_DEREF);
+				if (op == IRInstruction::I_LOAD)
+					killed = (store) ? (sym == insn.sym) : !fn.isPrivate(sym);
+
+				if (killed)
+					it = available.erase(it);
+				else
+					++it;
+				}
+		}
+
+	return changes;
+	}
+
+/*****************************************************************************\
+|* Whether an instruction can be reused
+\*****************************************************************************/
+bool CommonSubexpression::_reusable(const IRInstruction& insn)
+	{
+	switch (insn.op)
+		{
+		case IRInstruction::I_COPY:
+		case IRInstruction::I_LOAD:
+		case IRInstruction::I_DEREF:
+		case IRInstruction::I_ADDR:
+		case IRInstruction::I_STRADDR:
+		case IRInstruction::I_ADD:
+		case IRInstruction::I_SUB:
+		case IRInstruction::I_MUL:
+		case IRInstruction::I_DIV:
+		case IRInstruction::I_AND:
+		case IRInstruction::I_OR:
+		case IRInstruction::I_XOR:
+		case IRInstruction::I_SHL:
+		case IRInstruction::I_SHR:
+		case IRInstruction::I_CMP:
+		case IRInstruction::I_NEG:
+		case IRInstruction::I_NOT:
+		case IRInstruction::I_LOGNOT:
+		case IRInstruction::I_BOOL:
+		case IRInstruction::I_WIDEN:
+		case IRInstruction::I_SCALE:
+			return true;
+		default:
+			return false;
+		}
+	}
@@ -0,0 +1,48 @@
+//
+//  CommonSubexpression.h
+//  xtal-c
+//
+//  Within each block, reuse the result of an earlier instruction that
+//  computed the same thing, rather than computing it again
+//
+
+#ifndef CommonSubexpression_h
+#define CommonSubexpression_h
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <tuple>
+
+#include "properties.h"
+#include "macros.h"
+
+#include "PassManager.h"
+
+class CommonSubexpression : public IRPass
+	{
+	public:
+		/*********************************************************************\
+        |* What makes two instructions compute the same value:
+        |* op, a, b, type, sym, aux
+        \*********************************************************************/
+		typedef std::tuple<int, IROperand, IROperand, int, int, int> Key;
+
+    private:
+        /********************************************************************\
+        |* Run over one block, returning the number of changes
+        \********************************************************************/
+		int _block(IRFunction& fn, IRBlock& block);
+
+        /********************************************************************\
+        |* Whether an instruction's result depends only on its operands and
+        |* memory, so it can be reused
+        \********************************************************************/
+		bool _reusable(const IRInstruction& insn);
+
+    public:
+		const char * name(void)		{ return "common-subexpression"; }
+		int run(IRFunction& fn);
+	};
+
+#endif /* CommonSubexpression_h */
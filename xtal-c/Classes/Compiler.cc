@@ -17,6 +17,8 @@
 #include "A8Emitter.h"
 #include "Expression.h"
 #include "Locator.h"
+#include "PassManager.h"
+#include "Profile.h"
 #include "Register.h"
 #include "RegisterFile.h"
 #include "Stringutils.h"
@@ -80,6 +82,33 @@ int Compiler::main(int argc, const char *argv[])
 	_baseDir				= _ap->stringFor("-xb", "--xtal-base-dir", base,
 										  "Runtime",
 										  "Compiler base directory");
+    int optimise			= _ap->intFor("-O", "--optimise", 1,
+										  "Runtime",
+										  "Optimisation level, 0 to turn off");
+    bool dumpIR				= _ap->flagFor("-R", "--dump-IR", false,
+										   "Runtime",
+										   "Whether to dump the optimised IR");
+    bool overlay			= _ap->flagFor("-L", "--overlay", false,
+										   "Runtime",
+										   "Put non-recursive locals in static memory");
+    bool instrument			= _ap->flagFor("-pg", "--profile-generate", false,
+										   "Runtime",
+										   "Label every block for the profiler");
+    String profile			= _ap->stringFor("-pu", "--profile-use", "",
+										   "Runtime",
+										   "Simulator profile to optimise with");
+    String profileMap		= _ap->stringFor("-pm", "--profile-map", "",
+										   "Runtime",
+										   "Listing of the profiled build");
+	_emitter->passes()->setLevel(optimise);
+	_emitter->setDumpIR(dumpIR);
+	_emitter->setOverlay(overlay);
+	_emitter->setInstrument(instrument);
+	if (profile.length() > 0)
+		if (!_emitter->profile()->load(profile, profileMap))
+			{
+			WARN("Couldn't read profile %s, ignoring it\n", profile.c_str());
+			}
 	
 	/*************************************************************************\
 	|* Construct the input by catenating any argument names without switches
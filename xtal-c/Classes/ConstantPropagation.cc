@@ -0,0 +1,313 @@
+//
+//  ConstantPropagation.cc
+//  xtal-c
+//
+
+#include <algorithm>
+
+#include "ConstantPropagation.h"
+#include "SymbolTable.h"
+#include "Types.h"
+
+/*****************************************************************************\
+|* The signed type of a given size, which is what a negation produces
+\*****************************************************************************/
+static int _signedType(int size)
+	{
+	return (size == 1) ? PT_S8 : (size == 2) ? PT_S16 : PT_S32;
+	}
+
+/*****************************************************************************\
+|* Meet the states at the end of the predecessors of block 'idx' which have
+|* been reached. Returns false if none of them have, and it's not the entry
+\*****************************************************************************/
+static bool _entryState(int idx,
+						const std::vector<int>& preds,
+						const std::vector<ConstantPropagation::State>& out,
+						const std::vector<bool>& seen,
+						ConstantPropagation::State& in)
+	{
+	bool reached = false;
+	in.clear();
+
+	for (int p : preds)
+		if (seen[p])
+			{
+			if (!reached)
+				in = out[p];
+			else
+				for (auto it = in.begin(); it != in.end(); )
+					{
+					auto other = out[p].find(it->first);
+					if ((other == out[p].end()) || (other->second != it->second))
+						it = in.erase(it);
+					else
+						++it;
+					}
+			reached = true;
+			}
+
+	// Nothing is known on the way into the function
+	if (idx == 0)
+		{
+		in.clear();
+		reached = true;
+		}
+	return reached;
+	}
+
+/*****************************************************************************\
+|* Run the pass
+\*****************************************************************************/
+int ConstantPropagation::run(IRFunction& fn)
+	{
+	int count = (int) fn.blocks.size();
+	std::vector<std::vector<int>> preds = fn.predecessors();
+	std::vector<State> out(count);
+	std::vector<bool> seen(count, false);
+
+	/*************************************************************************\
+    |* Work out what's known at the end of each block. Blocks we haven't
+    |* reached yet are left out of the meet, so loops settle from above
+    \*************************************************************************/
+	bool changed = true;
+	while (changed)
+		{
+		changed = false;
+		for (int i=0; i<count; i++)
+			{
+			State in;
+			if (!_entryState(i, preds[i], out, seen, in))
+				continue;
+
+			_walk(fn, fn.blocks[i], in, false);
+			if (!seen[i] || (in != out[i]))
+				{
+				out[i]	= in;
+				seen[i]	= true;
+				changed	= true;
+				}
+			}
+		}
+
+	/*************************************************************************\
+    |* Then rewrite each block from what's known on entry to it
+    \*************************************************************************/
+	int changes = 0;
+	for (int i=0; i<count; i++)
+		{
+		State in;
+		if (!_entryState(i, preds[i], out, seen, in) || !seen[i])
+			in.clear();
+
+		changes += _walk(fn, fn.blocks[i], in, true);
+		}
+	return changes;
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* Walk a block
+\*****************************************************************************/
+int ConstantPropagation::_walk(IRFunction& fn,
+							   IRBlock& block,
+							   State& state,
+							   bool rewrite)
+	{
+	std::map<int, IROperand> temps;		// Temporaries known to be constant
+	int changes = 0;
+
+	for (IRInstruction& insn : block.insns)
+		{
+		/*********************************************************************\
+		|* Substitute any constant temporaries
+		\*********************************************************************/
+		IRInstruction work = insn;
+		for (IROperand *o : work.operands())
+			if (o->isTemp() && (temps.count(o->temp) > 0))
+				*o = temps[o->temp];
+
+		if (rewrite && !(work.a == insn.a && work.b == insn.b
+						 && work.args.size() == insn.args.size()
+						 && std::equal(work.args.begin(), work.args.end(),
+									   insn.args.begin())))
+			{
+			insn.a		= work.a;
+			insn.b		= work.b;
+			insn.args	= work.args;
+			changes ++;
+			}
+
+		/*********************************************************************\
+		|* Fold the result if we can
+		\*********************************************************************/
+		IROperand result;
+		bool folded = false;
+		if ((work.op == IRInstruction::I_LOAD) && (state.count(work.sym) > 0))
+			{
+			result	= IROperand::forConst(state[work.sym], work.type);
+			folded	= true;
+			}
+		else
+			folded = _fold(work, result);
+
+		if (folded && work.dst)
+			{
+			temps[work.dst] = result;
+			if (rewrite && !((insn.op == IRInstruction::I_COPY)
+							 && (insn.a == result)
+							 && (insn.type == result.type)))
+				{
+				insn.becomeCopy(result, result.type);
+				changes ++;
+				}
+			}
+
+		/*********************************************************************\
+		|* A test of a constant either always branches or never does. Only
+		|* the low byte of a 32-bit value is looked at
+		\*********************************************************************/
+		if ((work.op == IRInstruction::I_BRANCHZ) && work.a.isConst())
+			{
+			int64_t v = work.a.value;
+			if (Types::typeSize(work.a.type) == 4)
+				v &= 0xFF;
+
+			if (rewrite)
+				{
+				insn.a = IROperand();
+				if (v == 0)
+					insn.op = IRInstruction::I_JUMP;
+				else
+					{
+					insn.op		= IRInstruction::I_NOP;
+					insn.target	= -1;
+					}
+				changes ++;
+				}
+			}
+
+		/*********************************************************************\
+		|* Track what's in the variables
+		\*********************************************************************/
+		switch (work.op)
+			{
+			case IRInstruction::I_STORE:
+				{
+				int type = SYMTAB->at(work.sym).pType();
+				if (work.a.isConst() &&
+					(Types::typeSize(work.a.type) == Types::typeSize(type)))
+					state[work.sym] = IR::normalise(work.a.value, type);
+				else
+					state.erase(work.sym);
+				break;
+				}
+
+			case IRInstruction::I_LOADMOD:
+				state.erase(work.sym);
+				break;
+
+			case IRInstruction::I_STOREIND:
+			case IRInstruction::I_CALL:
+				_clobber(fn, state);
+				break;
+			}
+		}
+
+	return changes;
+	}
+
+/*****************************************************************************\
+|* Fold an instruction
+\*****************************************************************************/
+bool ConstantPropagation::_fold(const IRInstruction& insn, IROperand& result)
+	{
+	const IROperand& a = insn.a;
+	const IROperand& b = insn.b;
+
+	switch (insn.op)
+		{
+		case IRInstruction::I_COPY:
+			if (!a.isConst())
+				return false;
+			result = IROperand::forConst(a.value,
+							(insn.type == PT_NONE) ? a.type : insn.type);
+			return true;
+
+		case IRInstruction::I_ADD:
+		case IRInstruction::I_SUB:
+		case IRInstruction::I_AND:
+		case IRInstruction::I_OR:
+		case IRInstruction::I_XOR:
+			{
+			// Only when no widening is needed. The sum and difference come
+			// back in the type of the first operand, the others the second
+			if (!a.isConst() || !b.isConst())
+				return false;
+			if (Types::typeSize(a.type) != Types::typeSize(b.type))
+				return false;
+
+			switch (insn.op)
+				{
+				case IRInstruction::I_ADD:
+					result = IROperand::forConst(a.value + b.value, a.type);
+					break;
+				case IRInstruction::I_SUB:
+					result = IROperand::forConst(a.value - b.value, a.type);
+					break;
+				case IRInstruction::I_AND:
+					result = IROperand::forConst(a.value & b.value, b.type);
+					break;
+				case IRInstruction::I_OR:
+					result = IROperand::forConst(a.value | b.value, b.type);
+					break;
+				default:
+					result = IROperand::forConst(a.value ^ b.value, b.type);
+					break;
+				}
+			return true;
+			}
+
+		case IRInstruction::I_NEG:
+			if (!a.isConst())
+				return false;
+			result = IROperand::forConst(-a.value,
+										 _signedType(Types::typeSize(a.type)));
+			return true;
+
+		case IRInstruction::I_NOT:
+			if (!a.isConst())
+				return false;
+			result = IROperand::forConst(~a.value, a.type);
+			return true;
+
+		case IRInstruction::I_WIDEN:
+			// The register is only replaced if the size changes
+			if (!a.isConst())
+				return false;
+			if ((insn.aux == insn.type) ||
+				(Types::typeSize(a.type) == Types::typeSize(insn.type)))
+				result = a;
+			else
+				result = IROperand::forConst(a.value, insn.type);
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+/*****************************************************************************\
+|* Forget anything reachable other than by name
+\*****************************************************************************/
+void ConstantPropagation::_clobber(IRFunction& fn, State& state)
+	{
+	for (auto it = state.begin(); it != state.end(); )
+		{
+		if (fn.isPrivate(it->first))
+			++it;
+		else
+			it = state.erase(it);
+		}
+	}
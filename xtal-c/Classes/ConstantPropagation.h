@@ -0,0 +1,54 @@
+//
+//  ConstantPropagation.h
+//  xtal-c
+//
+//  Track variables holding known constants across the function, replace
+//  loads of them with the constant, and fold operations on constants
+//
+
+#ifndef ConstantPropagation_h
+#define ConstantPropagation_h
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+
+#include "PassManager.h"
+
+class ConstantPropagation : public IRPass
+	{
+	public:
+		/*********************************************************************\
+        |* Variables known to hold a constant, by symbol. Anything not in the
+        |* map could hold anything
+        \*********************************************************************/
+		typedef std::map<int, int64_t> State;
+
+    private:
+        /********************************************************************\
+        |* Walk a block from the state on entry, updating the state as we go.
+        |* If 'rewrite' is set, change the instructions as well, and return
+        |* the number of changes
+        \********************************************************************/
+		int _walk(IRFunction& fn, IRBlock& block, State& state, bool rewrite);
+
+        /********************************************************************\
+        |* Work out the result of an instruction whose operands are constant,
+        |* returning false if it can't be folded
+        \********************************************************************/
+		bool _fold(const IRInstruction& insn, IROperand& result);
+
+        /********************************************************************\
+        |* Forget anything that might have changed behind our back
+        \********************************************************************/
+		void _clobber(IRFunction& fn, State& state);
+
+    public:
+		const char * name(void)		{ return "constant-propagation"; }
+		int run(IRFunction& fn);
+	};
+
+#endif /* ConstantPropagation_h */
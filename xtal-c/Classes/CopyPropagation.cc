@@ -0,0 +1,131 @@
+//
+//  CopyPropagation.cc
+//  xtal-c
+//
+
+#include "CopyPropagation.h"
+#include "SymbolTable.h"
+#include "Types.h"
+
+/*****************************************************************************\
+|* The type of register an operand is held in, if we know it
+\*****************************************************************************/
+static int _typeOf(const IROperand& o, std::map<int, int>& types)
+	{
+	if (o.isConst())
+		return o.type;
+	if (o.isTemp() && (types.count(o.temp) > 0))
+		return types[o.temp];
+	return PT_NONE;
+	}
+
+/*****************************************************************************\
+|* Run the pass
+\*****************************************************************************/
+int CopyPropagation::run(IRFunction& fn)
+	{
+	int changes = 0;
+	for (IRBlock& block : fn.blocks)
+		changes += _block(fn, block);
+	return changes;
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* Run over a block
+\*****************************************************************************/
+int CopyPropagation::_block(IRFunction& fn, IRBlock& block)
+	{
+	std::map<int, IROperand> replace;	// Temporaries to use something else for
+	std::map<int, int> types;			// Register types where they're known
+	std::map<int, IROperand> stored;	// Last value stored, by variable
+	int changes = 0;
+
+	for (IRInstruction& insn : block.insns)
+		{
+		for (IROperand *o : insn.operands())
+			if (o->isTemp() && (replace.count(o->temp) > 0))
+				{
+				*o = replace[o->temp];
+				changes ++;
+				}
+
+		/*********************************************************************\
+		|* A load of a variable we've just stored to can use what we stored
+		\*********************************************************************/
+		if ((insn.op == IRInstruction::I_LOAD) && (stored.count(insn.sym) > 0))
+			{
+			insn.becomeCopy(stored[insn.sym], insn.type);
+			changes ++;
+			}
+
+		/*********************************************************************\
+		|* Use the source of a copy directly, if it's held the same way
+		\*********************************************************************/
+		if (insn.op == IRInstruction::I_COPY)
+			{
+			if (insn.a.isConst())
+				replace[insn.dst] = IROperand::forConst(insn.a.value,
+					(insn.type == PT_NONE) ? insn.a.type : insn.type);
+			else if ((insn.type == PT_NONE) ||
+					 IR::sameRepresentation(_typeOf(insn.a, types), insn.type))
+				replace[insn.dst] = insn.a;
+			}
+
+		if (insn.dst)
+			{
+			int type = IR::resultType(insn,
+									  _typeOf(insn.a, types),
+									  _typeOf(insn.b, types));
+			if (type != PT_NONE)
+				types[insn.dst] = type;
+			}
+
+		/*********************************************************************\
+		|* Track what's been stored, so long as it fits the variable exactly
+		\*********************************************************************/
+		switch (insn.op)
+			{
+			case IRInstruction::I_STORE:
+				{
+				int varType = SYMTAB->at(insn.sym).pType();
+				int srcType = _typeOf(insn.a, types);
+				if ((srcType != PT_NONE) &&
+					(Types::typeSize(srcType) == Types::typeSize(varType)))
+					stored[insn.sym] = insn.a;
+				else
+					stored.erase(insn.sym);
+				break;
+				}
+
+			case IRInstruction::I_LOADMOD:
+				stored.erase(insn.sym);
+				break;
+
+			case IRInstruction::I_STOREIND:
+			case IRInstruction::I_CALL:
+				for (auto it = stored.begin(); it != stored.end(); )
+					{
+					if (fn.isPrivate(it->first))
+						++it;
+					else
+						it = stored.erase(it);
+					}
+				break;
+			}
+
+		// Registers don't survive a call, so only constants can be forwarded
+		// past one
+		if (insn.isCall())
+			for (auto it = stored.begin(); it != stored.end(); )
+				{
+				if (it->second.isTemp())
+					it = stored.erase(it);
+				else
+					++it;
+				}
+		}
+
+	return changes;
+	}
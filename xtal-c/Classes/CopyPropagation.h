@@ -0,0 +1,34 @@
+//
+//  CopyPropagation.h
+//  xtal-c
+//
+//  Within each block, use the source of a copy in place of its result, and
+//  forward the value stored to a variable to later loads of it
+//
+
+#ifndef CopyPropagation_h
+#define CopyPropagation_h
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+
+#include "PassManager.h"
+
+class CopyPropagation : public IRPass
+	{
+    private:
+        /********************************************************************\
+        |* Run over one block, returning the number of changes
+        \********************************************************************/
+		int _block(IRFunction& fn, IRBlock& block);
+
+    public:
+		const char * name(void)		{ return "copy-propagation"; }
+		int run(IRFunction& fn);
+	};
+
+#endif /* CopyPropagation_h */
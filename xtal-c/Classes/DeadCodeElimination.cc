@@ -0,0 +1,189 @@
+//
+//  DeadCodeElimination.cc
+//  xtal-c
+//
+
+#include <vector>
+
+#include "DeadCodeElimination.h"
+
+/*****************************************************************************\
+|* Run the pass
+\*****************************************************************************/
+int DeadCodeElimination::run(IRFunction& fn)
+	{
+	int changes = _unreachableBlocks(fn);
+	changes += _redundantJumps(fn);
+	changes += _deadStores(fn);
+	changes += _unusedResults(fn);
+	return changes;
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* Remove unused results. Temporaries never leave their block, so we can
+|* work backwards through each block on its own
+\*****************************************************************************/
+int DeadCodeElimination::_unusedResults(IRFunction& fn)
+	{
+	int changes = 0;
+
+	for (IRBlock& block : fn.blocks)
+		{
+		std::set<int> used;
+		for (int i=(int)block.insns.size()-1; i>=0; i--)
+			{
+			IRInstruction& insn = block.insns[i];
+			if (!insn.hasSideEffects() && (used.count(insn.dst) == 0))
+				{
+				block.insns.erase(block.insns.begin() + i);
+				changes ++;
+				continue;
+				}
+
+			for (const IROperand *o : insn.operands())
+				if (o->isTemp())
+					used.insert(o->temp);
+			}
+		}
+	return changes;
+	}
+
+/*****************************************************************************\
+|* Remove dead stores. Only locals whose address is never taken are looked
+|* at, since anything else could be read through a pointer or by a call
+\*****************************************************************************/
+int DeadCodeElimination::_deadStores(IRFunction& fn)
+	{
+	int count = (int) fn.blocks.size();
+	std::vector<std::set<int>> liveIn(count);
+
+	/*************************************************************************\
+    |* Find out which variables are live on the way into each block
+    \*************************************************************************/
+	bool changed = true;
+	while (changed)
+		{
+		changed = false;
+		for (int i=count-1; i>=0; i--)
+			{
+			std::set<int> live;
+			for (int s : fn.successors(i))
+				live.insert(liveIn[s].begin(), liveIn[s].end());
+
+			std::vector<IRInstruction>& insns = fn.blocks[i].insns;
+			for (int j=(int)insns.size()-1; j>=0; j--)
+				{
+				if (insns[j].op == IRInstruction::I_STORE)
+					live.erase(insns[j].sym);
+				else if ((insns[j].op == IRInstruction::I_LOAD) ||
+						 (insns[j].op == IRInstruction::I_LOADMOD))
+					live.insert(insns[j].sym);
+				}
+
+			if (live != liveIn[i])
+				{
+				liveIn[i]	= live;
+				changed		= true;
+				}
+			}
+		}
+
+	/*************************************************************************\
+    |* Then remove the stores that nothing reads, unless the value of the
+    |* assignment itself is used
+    \*************************************************************************/
+	int changes = 0;
+	for (int i=0; i<count; i++)
+		{
+		std::vector<IRInstruction>& insns = fn.blocks[i].insns;
+
+		std::set<int> used;
+		for (IRInstruction& insn : insns)
+			for (const IROperand *o : insn.operands())
+				if (o->isTemp())
+					used.insert(o->temp);
+
+		std::set<int> live;
+		for (int s : fn.successors(i))
+			live.insert(liveIn[s].begin(), liveIn[s].end());
+
+		for (int j=(int)insns.size()-1; j>=0; j--)
+			{
+			IRInstruction& insn = insns[j];
+			if (insn.op == IRInstruction::I_STORE)
+				{
+				if (fn.isPrivate(insn.sym) && (live.count(insn.sym) == 0)
+					&& (used.count(insn.dst) == 0))
+					{
+					insns.erase(insns.begin() + j);
+					changes ++;
+					continue;
+					}
+				live.erase(insn.sym);
+				}
+			else if ((insn.op == IRInstruction::I_LOAD) ||
+					 (insn.op == IRInstruction::I_LOADMOD))
+				live.insert(insn.sym);
+			}
+		}
+	return changes;
+	}
+
+/*****************************************************************************\
+|* Remove jumps to the next block
+\*****************************************************************************/
+int DeadCodeElimination::_redundantJumps(IRFunction& fn)
+	{
+	int changes = 0;
+
+	for (int i=0; i<(int)fn.blocks.size()-1; i++)
+		{
+		IRInstruction *last = fn.blocks[i].terminator();
+		if ((last != nullptr) && (last->op != IRInstruction::I_RETURN)
+			&& (last->target == fn.blocks[i+1].id))
+			{
+			fn.blocks[i].insns.pop_back();
+			changes ++;
+			}
+		}
+	return changes;
+	}
+
+/*****************************************************************************\
+|* Remove unreachable blocks
+\*****************************************************************************/
+int DeadCodeElimination::_unreachableBlocks(IRFunction& fn)
+	{
+	int count = (int) fn.blocks.size();
+	std::vector<bool> reached(count, false);
+	std::vector<int> work;
+
+	if (count > 0)
+		{
+		reached[0] = true;
+		work.push_back(0);
+		}
+
+	while (work.size() > 0)
+		{
+		int idx = work.back();
+		work.pop_back();
+		for (int s : fn.successors(idx))
+			if (!reached[s])
+				{
+				reached[s] = true;
+				work.push_back(s);
+				}
+		}
+
+	int changes = 0;
+	for (int i=count-1; i>0; i--)
+		if (!reached[i])
+			{
+			fn.blocks.erase(fn.blocks.begin() + i);
+			changes ++;
+			}
+	return changes;
+	}
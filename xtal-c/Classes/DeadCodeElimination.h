@@ -0,0 +1,50 @@
+//
+//  DeadCodeElimination.h
+//  xtal-c
+//
+//  Remove instructions whose results are never used, stores to locals that
+//  are never read again, jumps to the next block, and blocks that can't be
+//  reached
+//
+
+#ifndef DeadCodeElimination_h
+#define DeadCodeElimination_h
+
+#include <cstdio>
+#include <set>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+
+#include "PassManager.h"
+
+class DeadCodeElimination : public IRPass
+	{
+    private:
+        /********************************************************************\
+        |* Remove side-effect free instructions whose result isn't used
+        \********************************************************************/
+		int _unusedResults(IRFunction& fn);
+
+        /********************************************************************\
+        |* Remove stores to private locals which are never loaded again
+        \********************************************************************/
+		int _deadStores(IRFunction& fn);
+
+        /********************************************************************\
+        |* Remove jumps and branches to the following block
+        \********************************************************************/
+		int _redundantJumps(IRFunction& fn);
+
+        /********************************************************************\
+        |* Remove blocks that can't be reached from the entry
+        \********************************************************************/
+		int _unreachableBlocks(IRFunction& fn);
+
+    public:
+		const char * name(void)		{ return "dead-code-elimination"; }
+		int run(IRFunction& fn);
+	};
+
+#endif /* DeadCodeElimination_h */
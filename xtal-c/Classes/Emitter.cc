@@ -10,7 +10,15 @@
 
 
 #include "ASTNode.h"
+#include "ASTOptimiser.h"
+#include "BlockLayout.h"
+#include "CallGraph.h"
 #include "Emitter.h"
+#include "HotGlobals.h"
+#include "Inliner.h"
+#include "IRBuilder.h"
+#include "PassManager.h"
+#include "Profile.h"
 #include "RegisterFile.h"
 #include "SymbolTable.h"
 #include "Types.h"
@@ -21,9 +29,18 @@
 Emitter::Emitter()
 		:_preamble("")
 		,_postamble("")
+		,_dumpIR(false)
+		,_overlay(false)
+		,_instrument(false)
 		,_ofp(nullptr)
 	{
 	_regs 			= new RegisterFile();
+	_passes			= new PassManager();
+	_calls			= new CallGraph();
+	_profile		= new Profile();
+	_inliner		= new Inliner(_profile);
+	_globals		= new HotGlobals();
+	_inOverlay		= false;
 	_xtrt0			= "xtrt0.s";
 	_stackOffset	= 0;
 	_fnParamAt		= FN_PARAM_MIN;
@@ -34,9 +51,60 @@ Emitter::Emitter()
 \****************************************************************************/
 Emitter::~Emitter()
 	{
+	delete _globals;
+	delete _inliner;
+	delete _profile;
+	delete _calls;
+	delete _passes;
 	delete _regs;
 	}
 
+/****************************************************************************\
+|* Generate the code for a function
+\****************************************************************************/
+void Emitter::generate(ASTNode *function)
+	{
+	int funcId = function->value().identifier;
+	if (SYMTAB->at(funcId).pType() == PT_NONE)
+		FATAL(ERR_TYPE, "Unknown function for id %d", funcId);
+
+	// Copy small functions the profile says are called often into their
+	// callers, and remember this one if it's small enough to copy
+	bool inlining = (_passes->level() > 0) && _profile->loaded();
+	if (inlining)
+		_inliner->run(function);
+
+	if (_passes->level() > 0)
+		{
+		ASTOptimiser optimiser;
+		optimiser.run(function);
+		}
+
+	if (inlining)
+		_inliner->learn(function);
+
+	IRFunction fn(funcId);
+	IRBuilder builder;
+	builder.build(function, fn);
+
+	_passes->run(fn);
+
+	// Let the profile, if there is one, decide which way branches go
+	const Profile::Counts *counts = _profile->countsFor(SYMTAB->at(funcId).name());
+	if ((counts != nullptr) && (_passes->level() > 0))
+		{
+		BlockLayout layout(*counts);
+		layout.run(fn);
+		}
+	if (counts != nullptr)
+		_globals->count(fn, *counts);
+
+	if (_dumpIR)
+		fn.dump();
+
+	lower(fn);
+	}
+
 /****************************************************************************\
 |* Output a default preamble
 \****************************************************************************/
@@ -47,6 +115,9 @@ void Emitter::preamble(void)
 	RegisterFile::setOutputFile(_ofp);
 	RegisterFile::clear();
 	
+	// Globals moved to zero page start off as garbage, so clear them first
+	String clear = _profile->loaded() ? "jsr " + HotGlobals::label() + "\n" : "";
+
 	if (_ofp != nullptr)
 		{
 		fprintf(_ofp, "; Assembly code produced at %s on %s\n"
@@ -58,12 +129,14 @@ void Emitter::preamble(void)
 					  ".include %s\n"
 					  "\n"
 					  "%s\n"
+					  "%s"
 					  "call main\n"
 					  "rts\n",
 					  __TIME__, __DATE__,
 					  _stdMacrosFile.c_str(),
 					  _xtrt0.c_str(),
-					  _preamble.c_str());
+					  _preamble.c_str(),
+					  clear.c_str());
 		}
 	else
 		FATAL(ERR_OUTPUT, "No file handle available for preamble output!");
@@ -74,12 +147,18 @@ void Emitter::preamble(void)
 \****************************************************************************/
 void Emitter::postamble(void)
 	{
+	String globals = _profile->loaded() ? _globals->layout() : "";
+
 	if (_ofp != nullptr)
 		{
 		fprintf(_ofp, "%s\n"
+					  "%s"
+					  "%s"
 					  "; -------------\n"
 					  "; Assembly ends\n\n",
-					  _postamble.c_str());
+					  _postamble.c_str(),
+					  _calls->layout().c_str(),
+					  globals.c_str());
 		}
 	else
 		FATAL(ERR_OUTPUT, "No file handle available for postamble output!");
@@ -169,7 +248,7 @@ void Emitter::functionPreamble(int funcId)
 					  name);
 		
 		// Manipulate the stack if necessary
-		if (_stackOffset > 0)
+		if ((_stackOffset > 0) && !_inOverlay)
 			fprintf(_ofp, "\t_sub16i $%x," STACK_PTR "\n", _stackOffset);
 
 		}
@@ -190,7 +269,7 @@ void Emitter::functionPostamble(int funcId)
 
 		cgLabel(s.endLabel());
 		
-		if (_stackOffset > 0)
+		if ((_stackOffset > 0) && !_inOverlay)
 			fprintf(_ofp, "\t_add16i $%x," STACK_PTR "\n", _stackOffset);
 			
 		fprintf(_ofp, "\trts\n"
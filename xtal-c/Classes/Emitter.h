@@ -16,6 +16,12 @@
 #include "macros.h"
 
 class ASTNode;
+class CallGraph;
+class HotGlobals;
+class Inliner;
+class IRFunction;
+class PassManager;
+class Profile;
 class RegisterFile;
 class Register;
 
@@ -65,11 +71,24 @@ class Emitter
         |* Next function parameter location
         \*********************************************************************/
         int _fnParamAt;		// Actual memory location
+
+		/*********************************************************************\
+        |* Whether the current function's frame is in the overlay
+        \*********************************************************************/
+        bool _inOverlay;
 		
 	/************************************************************************\
     |* Properties
     \************************************************************************/
     GET(RegisterFile *, regs);
+    GET(PassManager *, passes);			// Optimisations to run on the IR
+    GETSET(bool, dumpIR, DumpIR);		// Whether to dump the optimised IR
+    GET(CallGraph *, calls);			// Frames placed in the overlay
+    GETSET(bool, overlay, Overlay);		// Whether to use the overlay
+    GET(Profile *, profile);			// Block counts from a profiling run
+    GETSET(bool, instrument, Instrument);	// Label blocks for the profiler
+    GET(Inliner *, inliner);			// Copies hot calls into the caller
+    GET(HotGlobals *, globals);			// Puts hot globals in zero page
     GETSET(FILE *, ofp, Ofp);
     GETSET(String, xtrt0, Xtrt0);		// XT runtime 0 setup file
     
@@ -88,12 +107,15 @@ class Emitter
         virtual void printReg(Register r, int type) = 0;
 
         /*********************************************************************\
-        |* Generate the code
+        |* Generate the code for a function: build the IR from the AST, run
+        |* the optimisation passes over it, then lower it to assembly
+        \*********************************************************************/
+        void generate(ASTNode *function);
+
+        /*********************************************************************\
+        |* Lower a function's IR to assembly
         \*********************************************************************/
-        virtual Register emit(ASTNode *node,
-							  Register reg,
-							  int parentAstOp,
-							  String label) =0;
+        virtual void lower(IRFunction& fn) = 0;
 	
         /*********************************************************************\
         |* Generate the code preamble
@@ -0,0 +1,116 @@
+//
+//  HotGlobals.cc
+//  xtal-c
+//
+
+#include <algorithm>
+#include <vector>
+
+#include "HotGlobals.h"
+#include "IR.h"
+#include "SymbolTable.h"
+#include "Types.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+HotGlobals::HotGlobals(void)
+	{
+	}
+
+/*****************************************************************************\
+|* Hold on to a global until we know how often it's used
+\*****************************************************************************/
+void HotGlobals::add(int symIdx, const String& storage)
+	{
+	_storage[symIdx] = storage;
+	}
+
+/*****************************************************************************\
+|* Count the loads and stores of each global, weighted by how often the
+|* block they're in ran
+\*****************************************************************************/
+void HotGlobals::count(IRFunction& fn, const Profile::Counts& counts)
+	{
+	for (IRBlock& block : fn.blocks)
+		{
+		auto ran = counts.find(block.id);
+		if (ran == counts.end())
+			continue;
+
+		for (IRInstruction& insn : block.insns)
+			{
+			switch (insn.op)
+				{
+				case IRInstruction::I_LOAD:
+				case IRInstruction::I_LOADMOD:
+				case IRInstruction::I_STORE:
+					if (SYMTAB->at(insn.sym).sClass() == C_GLOBAL)
+						_uses[insn.sym] += ran->second;
+					break;
+
+				default:
+					break;
+				}
+			}
+		}
+	}
+
+/*****************************************************************************\
+|* The label of the routine that clears the zero-page globals
+\*****************************************************************************/
+String HotGlobals::label(void)
+	{
+	return "G_zero";
+	}
+
+/*****************************************************************************\
+|* Write out the globals. The most-used scalars that fit go in zero page
+|* as equates, and the rest get storage as usual
+\*****************************************************************************/
+String HotGlobals::layout(void)
+	{
+	std::vector<std::pair<int64_t, int>> hot;
+	for (auto& entry : _uses)
+		if ((entry.second >= HOT_USES) && (_storage.count(entry.first) > 0)
+		 && (SYMTAB->at(entry.first).sType() == ST_VARIABLE))
+			hot.push_back(std::make_pair(-entry.second, entry.first));
+	std::sort(hot.begin(), hot.end());
+
+	char buf[1024];
+	String text		= "";
+	String clear	= "";
+	int at			= ZP_MIN;
+	for (auto& use : hot)
+		{
+		int symIdx	= use.second;
+		int bytes	= Types::typeSize(SYMTAB->at(symIdx).pType());
+		if (at + bytes > ZP_MAX + 1)
+			continue;
+
+		snprintf(buf, 1024, "S_%s = $%02X\n",
+				 SYMTAB->at(symIdx).name().c_str(), at);
+		text += buf;
+		for (int i=0; i<bytes; i++)
+			{
+			snprintf(buf, 1024, "\tsta $%02X\n", at + i);
+			clear += buf;
+			}
+
+		_storage.erase(symIdx);
+		at += bytes;
+		}
+
+	if (text != "")
+		text = "; Zero-page globals, " + std::to_string(at - ZP_MIN)
+			 + " bytes\n" + text;
+
+	text += "@" + label() + ":\n";
+	if (clear != "")
+		text += "\tlda #0\n" + clear;
+	text += "\trts\n";
+
+	for (auto& entry : _storage)
+		text += entry.second;
+	return text;
+	}
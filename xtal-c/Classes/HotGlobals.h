@@ -0,0 +1,73 @@
+//
+//  HotGlobals.h
+//  xtal-c
+//
+//  Move the most-used scalar globals into the free bytes of zero page, so
+//  they're reached with the shorter, faster zero-page addressing. How often
+//  each global is used comes from the profile: every load and store counts
+//  once for each time its block ran. Zero page isn't part of the binary, so
+//  the globals that go there are cleared by a routine run before main
+//
+
+#ifndef HotGlobals_h
+#define HotGlobals_h
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+#include "Profile.h"
+
+class IRFunction;
+
+class HotGlobals
+	{
+    NON_COPYABLE_NOR_MOVEABLE(HotGlobals)
+
+    public:
+		/*********************************************************************\
+		|* The zero-page bytes kept for globals
+		\*********************************************************************/
+		static const int ZP_MIN			= 0x97;
+		static const int ZP_MAX			= 0x9F;
+
+		/*********************************************************************\
+		|* Each access saves a cycle, and clearing a byte costs three, so a
+		|* global has to be used more often than that to be worth moving
+		\*********************************************************************/
+		static const int HOT_USES		= 4;
+
+    private:
+		std::map<int, String> _storage;		// Where not in zero page, by id
+		std::map<int, int64_t> _uses;		// Weighted uses, by id
+
+    public:
+        /********************************************************************\
+        |* Constructor
+        \********************************************************************/
+        explicit HotGlobals(void);
+
+        /********************************************************************\
+        |* Hold on to a global, with the assembly for it if it's not placed
+        \********************************************************************/
+		void add(int symIdx, const String& storage);
+
+        /********************************************************************\
+        |* Count the uses of globals in a function, given its block counts
+        \********************************************************************/
+		void count(IRFunction& fn, const Profile::Counts& counts);
+
+        /********************************************************************\
+        |* The label of the routine that clears the zero-page globals
+        \********************************************************************/
+		static String label(void);
+
+        /********************************************************************\
+        |* The assembly for the globals, and for the routine to clear them
+        \********************************************************************/
+		String layout(void);
+	};
+
+#endif /* HotGlobals_h */
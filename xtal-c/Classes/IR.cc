@@ -0,0 +1,556 @@
+//
+//  IR.cc
+//  xtal-c
+//
+
+#include <algorithm>
+
+#include "ASTNode.h"
+#include "IR.h"
+#include "SymbolTable.h"
+#include "Types.h"
+
+/*****************************************************************************\
+|* Names for the dump
+\*****************************************************************************/
+static const char * _opNames[] =
+	{
+	"NOP", "COPY", "LOAD", "LOADMOD", "STORE", "STOREIND", "DEREF", "ADDR",
+	"STRADDR", "ADD", "SUB", "MUL", "DIV", "AND", "OR", "XOR", "SHL", "SHR",
+	"CMP", "NEG", "NOT", "LOGNOT", "BOOL", "WIDEN", "SCALE", "PRINT", "CALL",
+	"RETURN", "JUMP", "BRANCH", "BRANCHZ"
+	};
+
+static String _typeName(int type)
+	{
+	switch (type)
+		{
+		case PT_S8:		return "s8";
+		case PT_U8:		return "u8";
+		case PT_S16:	return "s16";
+		case PT_U16:	return "u16";
+		case PT_S32:	return "s32";
+		case PT_U32:	return "u32";
+		case PT_NONE:	return "-";
+		default:		return (type > 0xFF) ? "ptr" : "?";
+		}
+	}
+
+static String _howName(int how)
+	{
+	switch (how)
+		{
+		case ASTNode::A_EQ:			return "==";
+		case ASTNode::A_NE:			return "!=";
+		case ASTNode::A_LT:			return "<";
+		case ASTNode::A_GT:			return ">";
+		case ASTNode::A_LE:			return "<=";
+		case ASTNode::A_GE:			return ">=";
+		case ASTNode::A_PREINC:		return "++x";
+		case ASTNode::A_PREDEC:		return "--x";
+		case ASTNode::A_POSTINC:	return "x++";
+		case ASTNode::A_POSTDEC:	return "x--";
+		default:					return std::to_string(how);
+		}
+	}
+
+static String _symName(int sym)
+	{
+	return SYMTAB->isValid(sym) ? SYMTAB->at(sym).name() : std::to_string(sym);
+	}
+
+
+#pragma mark - IROperand
+
+
+/*****************************************************************************\
+|* Constructors
+\*****************************************************************************/
+IROperand::IROperand(void)
+		  :kind(NONE)
+		  ,temp(0)
+		  ,value(0)
+		  ,type(PT_NONE)
+	{
+	}
+
+IROperand IROperand::forTemp(int temp)
+	{
+	IROperand op;
+	op.kind		= TEMP;
+	op.temp		= temp;
+	return op;
+	}
+
+IROperand IROperand::forConst(int64_t value, int type)
+	{
+	IROperand op;
+	op.kind		= CONST;
+	op.value	= IR::normalise(value, type);
+	op.type		= type;
+	return op;
+	}
+
+/*****************************************************************************\
+|* Comparison, so operands can be used as keys
+\*****************************************************************************/
+bool IROperand::operator == (const IROperand& other) const
+	{
+	if (kind != other.kind)
+		return false;
+	if (kind == TEMP)
+		return temp == other.temp;
+	if (kind == CONST)
+		return (value == other.value) && (type == other.type);
+	return true;
+	}
+
+bool IROperand::operator < (const IROperand& other) const
+	{
+	if (kind != other.kind)
+		return kind < other.kind;
+	if (kind == TEMP)
+		return temp < other.temp;
+	if (kind == CONST)
+		return (value != other.value) ? value < other.value : type < other.type;
+	return false;
+	}
+
+/*****************************************************************************\
+|* Describe the operand
+\*****************************************************************************/
+String IROperand::toString(void) const
+	{
+	switch (kind)
+		{
+		case TEMP:
+			return "t" + std::to_string(temp);
+		case CONST:
+			return "#" + std::to_string(value) + ":" + _typeName(type);
+		default:
+			return "";
+		}
+	}
+
+
+#pragma mark - IRInstruction
+
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+IRInstruction::IRInstruction(int op)
+			  :op(op)
+			  ,dst(0)
+			  ,type(PT_NONE)
+			  ,sym(-1)
+			  ,aux(0)
+			  ,target(-1)
+	{
+	}
+
+/*****************************************************************************\
+|* Whether the instruction does anything beyond defining 'dst'
+\*****************************************************************************/
+bool IRInstruction::hasSideEffects(void) const
+	{
+	switch (op)
+		{
+		case I_LOADMOD:
+		case I_STORE:
+		case I_STOREIND:
+		case I_PRINT:
+		case I_CALL:
+		case I_RETURN:
+		case I_JUMP:
+		case I_BRANCH:
+		case I_BRANCHZ:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+/*****************************************************************************\
+|* Whether the instruction ends a block
+\*****************************************************************************/
+bool IRInstruction::isTerminator(void) const
+	{
+	return (op == I_JUMP) || (op == I_BRANCH) ||
+		   (op == I_BRANCHZ) || (op == I_RETURN);
+	}
+
+/*****************************************************************************\
+|* Whether the instruction calls a routine
+\*****************************************************************************/
+bool IRInstruction::isCall(void) const
+	{
+	return (op == I_CALL) || (op == I_PRINT);
+	}
+
+/*****************************************************************************\
+|* The operands read
+\*****************************************************************************/
+std::vector<IROperand *> IRInstruction::operands(void)
+	{
+	std::vector<IROperand *> ops;
+	if (a.kind != IROperand::NONE)
+		ops.push_back(&a);
+	if (b.kind != IROperand::NONE)
+		ops.push_back(&b);
+	for (IROperand& arg : args)
+		ops.push_back(&arg);
+	return ops;
+	}
+
+std::vector<const IROperand *> IRInstruction::operands(void) const
+	{
+	std::vector<const IROperand *> ops;
+	if (a.kind != IROperand::NONE)
+		ops.push_back(&a);
+	if (b.kind != IROperand::NONE)
+		ops.push_back(&b);
+	for (const IROperand& arg : args)
+		ops.push_back(&arg);
+	return ops;
+	}
+
+/*****************************************************************************\
+|* Turn this into a copy
+\*****************************************************************************/
+void IRInstruction::becomeCopy(const IROperand& from, int newType)
+	{
+	op		= I_COPY;
+	a		= from;
+	b		= IROperand();
+	type	= newType;
+	sym		= -1;
+	aux		= 0;
+	args.clear();
+	}
+
+/*****************************************************************************\
+|* Describe the instruction
+\*****************************************************************************/
+String IRInstruction::toString(void) const
+	{
+	String s = (dst) ? "t" + std::to_string(dst) + " = " : "";
+	s += (op >= 0 && op < I_MAXVAL) ? _opNames[op] : "???";
+
+	switch (op)
+		{
+		case I_LOAD:
+		case I_STORE:
+		case I_ADDR:
+		case I_STRADDR:
+		case I_CALL:
+			s += " " + _symName(sym);
+			break;
+		case I_LOADMOD:
+			s += " " + _symName(sym) + " " + _howName(aux);
+			break;
+		case I_CMP:
+		case I_BRANCH:
+			s += " " + _howName(aux);
+			break;
+		case I_WIDEN:
+			s += " " + _typeName(aux) + "->";
+			break;
+		case I_SCALE:
+			s += " *" + std::to_string(aux);
+			break;
+		}
+	if (type != PT_NONE)
+		s += ":" + _typeName(type);
+
+	String comma = " ";
+	for (const IROperand *o : operands())
+		{
+		s	 += comma + o->toString();
+		comma = ", ";
+		}
+	if (target >= 0)
+		s += " -> B" + std::to_string(target);
+	return s;
+	}
+
+
+#pragma mark - IRBlock
+
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+IRBlock::IRBlock(int id, const String& label)
+		:id(id)
+		,label(label)
+	{
+	}
+
+/*****************************************************************************\
+|* The last instruction, if it ends the block
+\*****************************************************************************/
+IRInstruction * IRBlock::terminator(void)
+	{
+	if (insns.size() && insns.back().isTerminator())
+		return &(insns.back());
+	return nullptr;
+	}
+
+
+#pragma mark - IRFunction
+
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+IRFunction::IRFunction(int funcId)
+		   :_funcId(funcId)
+		   ,_nextTemp(1)
+		   ,_nextBlock(0)
+	{
+	}
+
+/*****************************************************************************\
+|* Allocate a temporary
+\*****************************************************************************/
+int IRFunction::newTemp(void)
+	{
+	return _nextTemp ++;
+	}
+
+/*****************************************************************************\
+|* Allocate a block id
+\*****************************************************************************/
+int IRFunction::reserveBlock(void)
+	{
+	return _nextBlock ++;
+	}
+
+/*****************************************************************************\
+|* Lay out a block at the end of the function
+\*****************************************************************************/
+IRBlock& IRFunction::newBlock(const String& label, int id)
+	{
+	if (id < 0)
+		id = reserveBlock();
+	blocks.push_back(IRBlock(id, label + "_" + std::to_string(id)));
+	return blocks.back();
+	}
+
+/*****************************************************************************\
+|* Find a block by id
+\*****************************************************************************/
+int IRFunction::indexOf(int blockId) const
+	{
+	for (int i=0; i<(int)blocks.size(); i++)
+		if (blocks[i].id == blockId)
+			return i;
+	return -1;
+	}
+
+/*****************************************************************************\
+|* Where control can go after a block
+\*****************************************************************************/
+std::vector<int> IRFunction::successors(int idx)
+	{
+	std::vector<int> next;
+	IRInstruction *last	= blocks[idx].terminator();
+	bool fallsThrough	= true;
+
+	if (last != nullptr)
+		{
+		if (last->op != IRInstruction::I_RETURN)
+			next.push_back(indexOf(last->target));
+		fallsThrough = (last->op == IRInstruction::I_BRANCH) ||
+					   (last->op == IRInstruction::I_BRANCHZ);
+		}
+
+	if (fallsThrough && (idx+1 < (int)blocks.size()))
+		if (std::find(next.begin(), next.end(), idx+1) == next.end())
+			next.push_back(idx+1);
+	return next;
+	}
+
+/*****************************************************************************\
+|* Where control can come from, for each block
+\*****************************************************************************/
+std::vector<std::vector<int>> IRFunction::predecessors(void)
+	{
+	std::vector<std::vector<int>> preds(blocks.size());
+	for (int i=0; i<(int)blocks.size(); i++)
+		for (int s : successors(i))
+			preds[s].push_back(i);
+	return preds;
+	}
+
+/*****************************************************************************\
+|* Whether a variable is only reachable by name
+\*****************************************************************************/
+bool IRFunction::isPrivate(int sym) const
+	{
+	if (!SYMTAB->isValid(sym) || (SYMTAB->at(sym).sClass() != C_LOCAL))
+		return false;
+	return std::find(_addressTaken.begin(), _addressTaken.end(), sym)
+		== _addressTaken.end();
+	}
+
+/*****************************************************************************\
+|* Note that a variable has had its address taken
+\*****************************************************************************/
+void IRFunction::addressTaken(int sym)
+	{
+	_addressTaken.push_back(sym);
+	}
+
+/*****************************************************************************\
+|* Dump the function
+\*****************************************************************************/
+void IRFunction::dump(void)
+	{
+	printf("IR for %s\n", _symName(_funcId).c_str());
+	for (IRBlock& block : blocks)
+		{
+		printf("  B%d (%s):\n", block.id, block.label.c_str());
+		for (IRInstruction& insn : block.insns)
+			printf("\t%s\n", insn.toString().c_str());
+		}
+	printf("\n");
+	}
+
+
+#pragma mark - Typed constants
+
+
+/*****************************************************************************\
+|* Bring a value into range for a type
+\*****************************************************************************/
+int64_t IR::normalise(int64_t value, int type)
+	{
+	if (type == PT_NONE)
+		return value;
+
+	int bits		= Types::typeSize(type) * 8;
+	uint64_t mask	= (bits >= 64) ? ~0ULL : ((1ULL << bits) - 1);
+	uint64_t v		= ((uint64_t)value) & mask;
+
+	if (isSigned(type) && (v & (1ULL << (bits-1))))
+		v |= ~mask;
+	return (int64_t)v;
+	}
+
+/*****************************************************************************\
+|* Register type for a literal, as the emitter has always chosen it
+\*****************************************************************************/
+int IR::literalType(int value)
+	{
+	if ((value >= 0) && (value <= 255))
+		return PT_U8;
+	if ((value >= -128) && (value <= 127))
+		return PT_S8;
+	if ((value >= 0) && (value <= 65535))
+		return PT_U16;
+	if ((value >= -32768) && (value <= 32767))
+		return PT_S16;
+	return PT_S32;
+	}
+
+/*****************************************************************************\
+|* Register type for a literal node
+\*****************************************************************************/
+int IR::literalType(int value, int nodeType)
+	{
+	int type = literalType(value);
+	if (Types::isInt(nodeType) &&
+		(Types::typeSize(nodeType) > Types::typeSize(type)))
+		type = nodeType;
+	return type;
+	}
+
+/*****************************************************************************\
+|* Whether two types are held the same way
+\*****************************************************************************/
+bool IR::sameRepresentation(int type1, int type2)
+	{
+	if ((type1 == PT_NONE) || (type2 == PT_NONE))
+		return false;
+	return (Types::typeSize(type1) == Types::typeSize(type2))
+		&& (isSigned(type1) == isSigned(type2));
+	}
+
+/*****************************************************************************\
+|* Whether a type is signed
+\*****************************************************************************/
+bool IR::isSigned(int type)
+	{
+	return (type == PT_S8) || (type == PT_S16) || (type == PT_S32);
+	}
+
+/*****************************************************************************\
+|* The type of an instruction's result
+\*****************************************************************************/
+int IR::resultType(const IRInstruction& insn, int typeA, int typeB)
+	{
+	switch (insn.op)
+		{
+		case IRInstruction::I_LOAD:
+		case IRInstruction::I_LOADMOD:
+		case IRInstruction::I_CALL:
+			return insn.type;
+
+		case IRInstruction::I_COPY:
+			return (insn.type == PT_NONE) ? typeA : insn.type;
+
+		case IRInstruction::I_DEREF:
+			return insn.type & 0xFF;
+
+		case IRInstruction::I_ADDR:
+		case IRInstruction::I_STRADDR:
+			return PT_U16;
+
+		case IRInstruction::I_ADD:
+		case IRInstruction::I_SUB:
+		case IRInstruction::I_MUL:
+		case IRInstruction::I_DIV:
+			// Operands are brought up to the larger of the two
+			if ((typeA == PT_NONE) || (typeB == PT_NONE))
+				return PT_NONE;
+			return (Types::typeSize(typeB) > Types::typeSize(typeA))
+				? typeB : typeA;
+
+		case IRInstruction::I_AND:
+		case IRInstruction::I_OR:
+		case IRInstruction::I_XOR:
+			return typeB;
+
+		case IRInstruction::I_SHL:
+		case IRInstruction::I_SHR:
+		case IRInstruction::I_CMP:
+		case IRInstruction::I_NOT:
+		case IRInstruction::I_LOGNOT:
+		case IRInstruction::I_BOOL:
+		case IRInstruction::I_SCALE:
+			return typeA;
+
+		case IRInstruction::I_NEG:
+			if (typeA == PT_NONE)
+				return PT_NONE;
+			switch (Types::typeSize(typeA))
+				{
+				case 1:		return PT_S8;
+				case 2:		return PT_S16;
+				default:	return PT_S32;
+				}
+
+		case IRInstruction::I_WIDEN:
+			if (typeA == PT_NONE)
+				return PT_NONE;
+			if ((insn.aux == insn.type) ||
+				(Types::typeSize(typeA) == Types::typeSize(insn.type)))
+				return typeA;
+			return insn.type;
+
+		default:
+			return PT_NONE;
+		}
+	}
@@ -0,0 +1,299 @@
+//
+//  IR.h
+//  xtal-c
+//
+//  Three-address intermediate representation, sitting between the parsed
+//  AST and the emitter.
+//
+/*****************************************************************************\
+|* IR
+|* ==
+|*
+|* Each function is turned into a list of basic blocks, each of which is a
+|* straight run of instructions ending (optionally) in a jump, branch or
+|* return. Instructions are of the form
+|*
+|*		tN = op a, b
+|*
+|* where tN is a temporary, and 'a' and 'b' are either temporaries or typed
+|* constants. Variables only ever live in memory - they are read with LOAD
+|* and written with STORE - so every temporary is defined exactly once, and
+|* never outlives the block it was defined in.
+|*
+|* Constants carry the primitive type of the register they'll be loaded into,
+|* so folding them is exact: a constant is always held normalised to its type
+\*****************************************************************************/
+#ifndef IR_h
+#define IR_h
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "properties.h"
+#include "macros.h"
+#include "sharedDefines.h"
+
+/*****************************************************************************\
+|* An operand: nothing, a temporary, or a constant
+\*****************************************************************************/
+class IROperand
+	{
+	public:
+		typedef enum
+			{
+			NONE	= 0,
+			TEMP,
+			CONST
+			} Kind;
+
+		Kind kind;					// What this is
+		int temp;					// Temporary, for TEMP
+		int64_t value;				// Value, for CONST
+		int type;					// Primitive type, for CONST
+
+		/*********************************************************************\
+        |* Constructors
+        \*********************************************************************/
+		IROperand(void);
+		static IROperand forTemp(int temp);
+		static IROperand forConst(int64_t value, int type);
+
+		/*********************************************************************\
+        |* Tests
+        \*********************************************************************/
+		inline bool isTemp(void) const	{ return kind == TEMP; }
+		inline bool isConst(void) const	{ return kind == CONST; }
+		bool operator == (const IROperand& other) const;
+		bool operator < (const IROperand& other) const;
+
+		/*********************************************************************\
+        |* Describe the operand
+        \*********************************************************************/
+		String toString(void) const;
+	};
+
+/*****************************************************************************\
+|* An instruction
+\*****************************************************************************/
+class IRInstruction
+	{
+	public:
+		enum
+			{
+			I_NOP		= 0,		// Removed, or nothing to do
+			I_COPY,					// dst = a, converted to 'type'
+			I_LOAD,					// dst = variable 'sym'
+			I_LOADMOD,				// dst = variable 'sym', ++/-- per 'aux'
+			I_STORE,				// variable 'sym' = a, dst = stored value
+			I_STOREIND,				// *b = a, 'type' is pointed-to type
+			I_DEREF,				// dst = *a, 'type' is pointer type
+			I_ADDR,					// dst = &sym
+			I_STRADDR,				// dst = &string 'sym'
+
+			I_ADD,					// dst = a + b
+			I_SUB,					// dst = a - b
+			I_MUL,					// dst = a * b
+			I_DIV,					// dst = a / b
+			I_AND,					// dst = a & b
+			I_OR,					// dst = a | b
+			I_XOR,					// dst = a ^ b
+			I_SHL,					// dst = a << b
+			I_SHR,					// dst = a >> b
+			I_CMP,					// dst = a 'aux' b, as 0 or 1
+
+			I_NEG,					// dst = -a
+			I_NOT,					// dst = ~a
+			I_LOGNOT,				// dst = !a
+			I_BOOL,					// dst = a as a truth value
+			I_WIDEN,				// dst = a, widened from 'aux' to 'type'
+			I_SCALE,				// dst = a * 'aux' for pointer arithmetic
+
+			I_PRINT,				// print a as 'type'
+			I_CALL,					// dst = function 'sym' (args)
+			I_RETURN,				// return a from function 'sym'
+
+			I_JUMP,					// goto 'target'
+			I_BRANCH,				// if !(a 'aux' b) goto 'target'
+			I_BRANCHZ,				// if (a == 0) goto 'target'
+
+			I_MAXVAL
+			};
+
+		int op;						// What to do
+		int dst;					// Result temporary, or 0 for none
+		IROperand a;				// First operand
+		IROperand b;				// Second operand
+		int type;					// Primitive type, per op
+		int sym;					// Symbol-table index, per op
+		int aux;					// Extra per-op information
+		int target;					// Block id for jumps and branches
+		std::vector<IROperand> args;// Arguments to a call
+
+		/*********************************************************************\
+        |* Constructor
+        \*********************************************************************/
+		IRInstruction(int op = I_NOP);
+
+		/*********************************************************************\
+        |* Whether the instruction does anything beyond defining 'dst'
+        \*********************************************************************/
+		bool hasSideEffects(void) const;
+
+		/*********************************************************************\
+        |* Whether the instruction ends a block
+        \*********************************************************************/
+		bool isTerminator(void) const;
+
+		/*********************************************************************\
+        |* Whether the instruction calls out of the function. Any temporaries
+        |* held in registers over one of these risk being trampled
+        \*********************************************************************/
+		bool isCall(void) const;
+
+		/*********************************************************************\
+        |* The operands read, in the order they're evaluated
+        \*********************************************************************/
+		std::vector<IROperand *> operands(void);
+		std::vector<const IROperand *> operands(void) const;
+
+		/*********************************************************************\
+        |* Turn this into 'dst = COPY from', keeping dst
+        \*********************************************************************/
+		void becomeCopy(const IROperand& from, int newType);
+
+		/*********************************************************************\
+        |* Describe the instruction
+        \*********************************************************************/
+		String toString(void) const;
+	};
+
+/*****************************************************************************\
+|* A basic block
+\*****************************************************************************/
+class IRBlock
+	{
+	public:
+		int id;								// Unique within the function
+		String label;						// Assembly label, if targeted
+		std::vector<IRInstruction> insns;	// Instructions, in order
+
+		IRBlock(int id, const String& label);
+
+		/*********************************************************************\
+        |* The last instruction, if it ends the block, or nullptr
+        \*********************************************************************/
+		IRInstruction * terminator(void);
+	};
+
+/*****************************************************************************\
+|* A function
+\*****************************************************************************/
+class IRFunction
+	{
+    NON_COPYABLE_NOR_MOVEABLE(IRFunction)
+
+	/************************************************************************\
+    |* Properties
+    \************************************************************************/
+    GET(int, funcId);						// Symbol-table index of function
+    GET(int, nextTemp);						// Next temporary to hand out
+    GET(int, nextBlock);					// Next block id to hand out
+
+	public:
+		std::vector<IRBlock> blocks;		// Blocks, in layout order
+
+		/*********************************************************************\
+        |* Constructor
+        \*********************************************************************/
+		explicit IRFunction(int funcId);
+
+		/*********************************************************************\
+        |* Allocate a temporary, or a block id to be laid out later
+        \*********************************************************************/
+		int newTemp(void);
+		int reserveBlock(void);
+
+		/*********************************************************************\
+        |* Lay out a new block at the end of the function, optionally using an
+        |* id reserved earlier so it can be branched to before it exists
+        \*********************************************************************/
+		IRBlock& newBlock(const String& label, int id = -1);
+
+		/*********************************************************************\
+        |* Return the layout index of a block id, or -1
+        \*********************************************************************/
+		int indexOf(int blockId) const;
+
+		/*********************************************************************\
+        |* Return the layout indices of the blocks following block 'idx'
+        \*********************************************************************/
+		std::vector<int> successors(int idx);
+
+		/*********************************************************************\
+        |* Return the layout indices of the blocks leading to each block
+        \*********************************************************************/
+		std::vector<std::vector<int>> predecessors(void);
+
+		/*********************************************************************\
+        |* Whether a variable can only be reached by name, ie: it's a local
+        |* whose address is never taken. Anything else might be changed by a
+        |* store through a pointer or by a call
+        \*********************************************************************/
+		bool isPrivate(int sym) const;
+
+		/*********************************************************************\
+        |* Note that a variable has had its address taken
+        \*********************************************************************/
+		void addressTaken(int sym);
+
+		/*********************************************************************\
+        |* Dump the function to stdout
+        \*********************************************************************/
+		void dump(void);
+
+	private:
+		std::vector<int> _addressTaken;		// Locals we've seen &x for
+	};
+
+/*****************************************************************************\
+|* Helpers for typed constants
+\*****************************************************************************/
+namespace IR
+	{
+	/*************************************************************************\
+    |* Bring a value into range for a primitive type, sign-extending if the
+    |* type is signed
+    \*************************************************************************/
+	int64_t normalise(int64_t value, int type);
+
+	/*************************************************************************\
+    |* The type of register an integer literal is loaded into
+    \*************************************************************************/
+	int literalType(int value);
+
+	/*************************************************************************\
+    |* The type of register a literal node is loaded into. A literal that
+    |* has been folded from a wider expression keeps that width
+    \*************************************************************************/
+	int literalType(int value, int nodeType);
+
+	/*************************************************************************\
+    |* Whether values of two primitive types are held in the same way: the
+    |* same size and signedness. Pointers are held as unsigned 16-bit values
+    \*************************************************************************/
+	bool sameRepresentation(int type1, int type2);
+
+	/*************************************************************************\
+    |* Whether a primitive type is signed
+    \*************************************************************************/
+	bool isSigned(int type);
+
+	/*************************************************************************\
+    |* The type of register the emitter leaves an instruction's result in,
+    |* given the types of its operands, or PT_NONE if it can't be known
+    \*************************************************************************/
+	int resultType(const IRInstruction& insn, int typeA, int typeB);
+	}
+
+#endif /* IR_h */
@@ -0,0 +1,402 @@
+//
+//  IRBuilder.cc
+//  xtal-c
+//
+
+#include "ASTNode.h"
+#include "IRBuilder.h"
+#include "SymbolTable.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+IRBuilder::IRBuilder(void)
+		  :_fn(nullptr)
+		  ,_block(0)
+	{
+	}
+
+/*****************************************************************************\
+|* Build the IR for a function
+\*****************************************************************************/
+void IRBuilder::build(ASTNode *tree, IRFunction& fn)
+	{
+	_fn		= &fn;
+	_startBlock("entry");
+
+	if (tree->left())
+		_statement(tree->left());
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* Append an instruction, starting a new block if the current one has ended
+\*****************************************************************************/
+IRInstruction& IRBuilder::_append(int op)
+	{
+	if (_fn->blocks[_block].terminator() != nullptr)
+		_startBlock("bb");
+
+	_fn->blocks[_block].insns.push_back(IRInstruction(op));
+	return _fn->blocks[_block].insns.back();
+	}
+
+/*****************************************************************************\
+|* Append an instruction defining a new temporary
+\*****************************************************************************/
+IROperand IRBuilder::_define(int op, int type)
+	{
+	IRInstruction& insn	= _append(op);
+	insn.dst			= _fn->newTemp();
+	insn.type			= type;
+	return IROperand::forTemp(insn.dst);
+	}
+
+/*****************************************************************************\
+|* Start a new block
+\*****************************************************************************/
+void IRBuilder::_startBlock(const String& label, int id)
+	{
+	_fn->newBlock(label, id);
+	_block = (int)_fn->blocks.size() - 1;
+	}
+
+/*****************************************************************************\
+|* Build a statement
+\*****************************************************************************/
+void IRBuilder::_statement(ASTNode *node)
+	{
+	if (node == nullptr)
+		return;
+
+	switch (node->op())
+		{
+		case ASTNode::A_GLUE:
+			_statement(node->left());
+			_statement(node->right());
+			break;
+
+		case ASTNode::A_IF:
+			_if(node);
+			break;
+
+		case ASTNode::A_WHILE:
+			_while(node);
+			break;
+
+		case ASTNode::A_PRINT:
+			{
+			IROperand a 		= _expression(node->left(), node->op());
+			IRInstruction& insn	= _append(IRInstruction::I_PRINT);
+			insn.a				= a;
+			insn.type			= node->type();
+			break;
+			}
+
+		case ASTNode::A_RETURN:
+			{
+			IROperand a 		= _expression(node->left(), node->op());
+			IRInstruction& insn	= _append(IRInstruction::I_RETURN);
+			insn.a				= a;
+			insn.sym			= _fn->funcId();
+			break;
+			}
+
+		default:
+			_expression(node, ASTNode::A_GLUE);
+			break;
+		}
+	}
+
+/*****************************************************************************\
+|* Build an expression
+\*****************************************************************************/
+IROperand IRBuilder::_expression(ASTNode *node, int parentAstOp)
+	{
+	IROperand none;
+	int op = node->op();
+
+	switch (op)
+		{
+		case ASTNode::A_INTLIT:
+			{
+			int value = (int)node->value().intValue;
+			return IROperand::forConst(value,
+									   IR::literalType(value, node->type()));
+			}
+
+		case ASTNode::A_STRLIT:
+			{
+			IROperand r = _define(IRInstruction::I_STRADDR, PT_U16);
+			_fn->blocks[_block].insns.back().sym = (int)node->value().intValue;
+			return r;
+			}
+
+		case ASTNode::A_IDENT:
+			{
+			if (!node->isRValue() && (parentAstOp != ASTNode::A_DEREF))
+				return none;
+
+			int nodeId = node->value().identifier;
+			Symbol& sym = SYMTAB->at(nodeId);
+			if (sym.pType() == PT_NONE)
+				FATAL(ERR_TYPE, "Unknown identifier for id %d", nodeId);
+
+			IROperand r = _define(IRInstruction::I_LOAD, sym.pType());
+			_fn->blocks[_block].insns.back().sym = nodeId;
+			return r;
+			}
+
+		case ASTNode::A_ASSIGN:
+			{
+			IROperand value = _expression(node->left(), op);
+			ASTNode *target = node->right();
+
+			switch (target->op())
+				{
+				case ASTNode::A_IDENT:
+					{
+					int nodeId = target->value().identifier;
+					if (SYMTAB->at(nodeId).pType() == PT_NONE)
+						FATAL(ERR_TYPE, "Unknown identifier for id %d", nodeId);
+
+					IROperand r = _define(IRInstruction::I_STORE);
+					IRInstruction& insn = _fn->blocks[_block].insns.back();
+					insn.sym	= nodeId;
+					insn.a		= value;
+					return r;
+					}
+
+				case ASTNode::A_DEREF:
+					{
+					IROperand ptr = _expression(target, op);
+					IROperand r = _define(IRInstruction::I_STOREIND,
+										  target->type());
+					IRInstruction& insn = _fn->blocks[_block].insns.back();
+					insn.a		= value;
+					insn.b		= ptr;
+					return r;
+					}
+
+				default:
+					FATAL(ERR_PARSE, "Can't ASSIGN in IR builder, op=%d", op);
+				}
+			}
+
+		case ASTNode::A_DEREF:
+			{
+			// If we're an r-value, fetch what we point at, otherwise leave
+			// the pointer for A_ASSIGN to store through
+			IROperand ptr = _expression(node->left(), op);
+			if (!node->isRValue())
+				return ptr;
+
+			IROperand r = _define(IRInstruction::I_DEREF, node->left()->type());
+			_fn->blocks[_block].insns.back().a = ptr;
+			return r;
+			}
+
+		case ASTNode::A_ADDR:
+			{
+			IROperand r = _define(IRInstruction::I_ADDR, PT_U16);
+			_fn->blocks[_block].insns.back().sym = node->value().identifier;
+			_fn->addressTaken(node->value().identifier);
+			return r;
+			}
+
+		case ASTNode::A_WIDEN:
+			{
+			IROperand a = _expression(node->left(), op);
+			IROperand r = _define(IRInstruction::I_WIDEN, node->type());
+			IRInstruction& insn = _fn->blocks[_block].insns.back();
+			insn.a		= a;
+			insn.aux	= node->left()->type();
+			return r;
+			}
+
+		case ASTNode::A_SCALE:
+			{
+			IROperand a = _expression(node->left(), op);
+			IROperand r = _define(IRInstruction::I_SCALE);
+			IRInstruction& insn = _fn->blocks[_block].insns.back();
+			insn.a		= a;
+			insn.aux	= node->value().size;
+			return r;
+			}
+
+		case ASTNode::A_POSTINC:
+		case ASTNode::A_POSTDEC:
+		case ASTNode::A_PREINC:
+		case ASTNode::A_PREDEC:
+			{
+			int nodeId = ((op == ASTNode::A_POSTINC) || (op == ASTNode::A_POSTDEC))
+					   ? node->value().identifier
+					   : node->left()->value().identifier;
+			Symbol& sym = SYMTAB->at(nodeId);
+			if (sym.pType() == PT_NONE)
+				FATAL(ERR_TYPE, "Unknown inc/dec identifier for id %d", nodeId);
+
+			IROperand r = _define(IRInstruction::I_LOADMOD, sym.pType());
+			IRInstruction& insn = _fn->blocks[_block].insns.back();
+			insn.sym	= nodeId;
+			insn.aux	= op;
+			return r;
+			}
+
+		case ASTNode::A_FUNCCALL:
+			{
+			// Arguments hang off a glue list, first argument at the top
+			std::vector<IROperand> args;
+			for (ASTNode *glue = node->left(); glue; glue = glue->left())
+				args.push_back(_expression(glue->right(), glue->op()));
+
+			int nodeId = node->value().identifier;
+			Symbol& fn = SYMTAB->at(nodeId);
+			if (fn.pType() == PT_NONE)
+				FATAL(ERR_TYPE, "Unknown function identifier for id %d", nodeId);
+
+			IRInstruction& insn = _append(IRInstruction::I_CALL);
+			insn.sym	= nodeId;
+			insn.args	= args;
+			if (fn.pType() == PT_VOID)
+				return none;
+
+			insn.dst	= _fn->newTemp();
+			insn.type	= fn.pType();
+			return IROperand::forTemp(insn.dst);
+			}
+
+		case ASTNode::A_NEGATE:
+		case ASTNode::A_INVERT:
+		case ASTNode::A_LOGNOT:
+		case ASTNode::A_TOBOOL:
+			{
+			int irOp = (op == ASTNode::A_NEGATE) ? IRInstruction::I_NEG
+					 : (op == ASTNode::A_INVERT) ? IRInstruction::I_NOT
+					 : (op == ASTNode::A_LOGNOT) ? IRInstruction::I_LOGNOT
+					 : IRInstruction::I_BOOL;
+
+			IROperand a = _expression(node->left(), op);
+			IROperand r = _define(irOp);
+			_fn->blocks[_block].insns.back().a = a;
+			return r;
+			}
+
+		case ASTNode::A_ADD:
+		case ASTNode::A_SUBTRACT:
+		case ASTNode::A_MULTIPLY:
+		case ASTNode::A_DIVIDE:
+		case ASTNode::A_AND:
+		case ASTNode::A_OR:
+		case ASTNode::A_XOR:
+		case ASTNode::A_LSHIFT:
+		case ASTNode::A_RSHIFT:
+		case ASTNode::A_EQ:
+		case ASTNode::A_NE:
+		case ASTNode::A_LT:
+		case ASTNode::A_GT:
+		case ASTNode::A_LE:
+		case ASTNode::A_GE:
+			{
+			int irOp	= IRInstruction::I_CMP;
+			int how		= 0;
+			switch (op)
+				{
+				case ASTNode::A_ADD:		irOp = IRInstruction::I_ADD; break;
+				case ASTNode::A_SUBTRACT:	irOp = IRInstruction::I_SUB; break;
+				case ASTNode::A_MULTIPLY:	irOp = IRInstruction::I_MUL; break;
+				case ASTNode::A_DIVIDE:		irOp = IRInstruction::I_DIV; break;
+				case ASTNode::A_AND:		irOp = IRInstruction::I_AND; break;
+				case ASTNode::A_OR:			irOp = IRInstruction::I_OR;  break;
+				case ASTNode::A_XOR:		irOp = IRInstruction::I_XOR; break;
+				case ASTNode::A_LSHIFT:		irOp = IRInstruction::I_SHL; break;
+				case ASTNode::A_RSHIFT:		irOp = IRInstruction::I_SHR; break;
+				default:					how  = op; break;
+				}
+
+			IROperand a = _expression(node->left(), op);
+			IROperand b = _expression(node->right(), op);
+			IROperand r = _define(irOp);
+			IRInstruction& insn = _fn->blocks[_block].insns.back();
+			insn.a		= a;
+			insn.b		= b;
+			insn.aux	= how;
+			return r;
+			}
+
+		default:
+			FATAL(ERR_AST_UNKNOWN_OPERATOR, "Unknown AST operator %d", op);
+		}
+	return none;
+	}
+
+/*****************************************************************************\
+|* Build a condition, which jumps to 'target' when it's false
+\*****************************************************************************/
+void IRBuilder::_condition(ASTNode *node, int target)
+	{
+	int op = node->op();
+
+	if ((op >= ASTNode::A_EQ) && (op <= ASTNode::A_GE))
+		{
+		IROperand a = _expression(node->left(), op);
+		IROperand b = _expression(node->right(), op);
+		IRInstruction& insn = _append(IRInstruction::I_BRANCH);
+		insn.a		= a;
+		insn.b		= b;
+		insn.aux	= op;
+		insn.target	= target;
+		}
+	else
+		{
+		ASTNode *value	= (op == ASTNode::A_TOBOOL) ? node->left() : node;
+		IROperand a		= _expression(value, op);
+		IRInstruction& insn = _append(IRInstruction::I_BRANCHZ);
+		insn.a		= a;
+		insn.target	= target;
+		}
+	}
+
+/*****************************************************************************\
+|* Build an IF statement
+\*****************************************************************************/
+void IRBuilder::_if(ASTNode *node)
+	{
+	int ifNot	= _fn->reserveBlock();
+	int ifEnd	= (node->right()) ? _fn->reserveBlock() : -1;
+
+	// The condition jumps to the false label, and the true compound
+	// statement follows on
+	_condition(node->left(), ifNot);
+	_startBlock("ifTrue");
+	_statement(node->mid());
+
+	// If there's an ELSE clause, skip over it at the end of the true one
+	if (node->right())
+		_append(IRInstruction::I_JUMP).target = ifEnd;
+
+	_startBlock("ifNot", ifNot);
+	if (node->right())
+		{
+		_statement(node->right());
+		_startBlock("ifEnd", ifEnd);
+		}
+	}
+
+/*****************************************************************************\
+|* Build a WHILE statement
+\*****************************************************************************/
+void IRBuilder::_while(ASTNode *node)
+	{
+	int start	= _fn->reserveBlock();
+	int end		= _fn->reserveBlock();
+
+	_startBlock("while", start);
+	_condition(node->left(), end);
+	_startBlock("whileBody");
+	_statement(node->right());
+
+	_append(IRInstruction::I_JUMP).target = start;
+	_startBlock("whileEnd", end);
+	}
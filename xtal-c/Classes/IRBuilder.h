@@ -0,0 +1,82 @@
+//
+//  IRBuilder.h
+//  xtal-c
+//
+//  Turn a function's AST into IR
+//
+
+#ifndef IRBuilder_h
+#define IRBuilder_h
+
+#include <cstdio>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+
+#include "IR.h"
+
+class ASTNode;
+
+class IRBuilder
+	{
+    NON_COPYABLE_NOR_MOVEABLE(IRBuilder)
+
+	/************************************************************************\
+    |* Properties
+    \************************************************************************/
+    private:
+		IRFunction *_fn;					// Function being built
+		int _block;							// Layout index being appended to
+
+        /********************************************************************\
+        |* Append an instruction to the current block
+        \********************************************************************/
+		IRInstruction& _append(int op);
+
+        /********************************************************************\
+        |* Append an instruction which defines a new temporary, and return
+        |* the temporary as an operand
+        \********************************************************************/
+		IROperand _define(int op, int type = PT_NONE);
+
+        /********************************************************************\
+        |* Start a new block, and make it the current one. The id can be one
+        |* reserved earlier, if the block has already been branched to
+        \********************************************************************/
+		void _startBlock(const String& label, int id = -1);
+
+        /********************************************************************\
+        |* Build a statement, which leaves no value
+        \********************************************************************/
+		void _statement(ASTNode *node);
+
+        /********************************************************************\
+        |* Build an expression, returning where its value is
+        \********************************************************************/
+		IROperand _expression(ASTNode *node, int parentAstOp);
+
+        /********************************************************************\
+        |* Build a condition, branching to 'target' if it's false
+        \********************************************************************/
+		void _condition(ASTNode *node, int target);
+
+        /********************************************************************\
+        |* Build the control-flow statements
+        \********************************************************************/
+		void _if(ASTNode *node);
+		void _while(ASTNode *node);
+
+    public:
+        /********************************************************************\
+        |* Constructors and Destructor
+        \********************************************************************/
+        explicit IRBuilder(void);
+
+        /********************************************************************\
+        |* Build the IR for an A_FUNCTION tree into 'fn'
+        \********************************************************************/
+		void build(ASTNode *tree, IRFunction& fn);
+	};
+
+#endif /* IRBuilder_h */
@@ -0,0 +1,294 @@
+//
+//  Inliner.cc
+//  xtal-c
+//
+
+#include "ASTNode.h"
+#include "Inliner.h"
+#include "Profile.h"
+#include "SymbolTable.h"
+#include "Types.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+Inliner::Inliner(Profile *profile)
+		:_changes(0)
+		,_profile(profile)
+	{
+	}
+
+/*****************************************************************************\
+|* Remember a function whose body is one statement we know how to copy. The
+|* parameters are only visible while the function is being compiled, so
+|* their uses are found now rather than at the call
+\*****************************************************************************/
+void Inliner::learn(ASTNode *function)
+	{
+	int funcId		= function->value().identifier;
+	Symbol& fn		= SYMTAB->at(funcId);
+	ASTNode *stmt	= function->left();
+	if (stmt == nullptr)
+		return;
+
+	ASTNode *expr	= nullptr;
+	if ((fn.pType() == PT_VOID) && (stmt->op() == ASTNode::A_ASSIGN))
+		{
+		ASTNode *target = stmt->right();
+		if ((target->op() == ASTNode::A_IDENT)
+		 && (SYMTAB->at(target->value().identifier).sClass() == C_GLOBAL))
+			expr = stmt->left();
+		}
+	else if ((fn.pType() != PT_VOID) && (stmt->op() == ASTNode::A_RETURN))
+		expr = stmt->left();
+	if (expr == nullptr)
+		return;
+
+	Body body;
+	for (int i=0; i<fn.numParams(); i++)
+		{
+		body.types.push_back(SYMTAB->at(funcId + 1 + i).pType());
+		body.uses.push_back(0);
+		}
+
+	int nodes		= 0;
+	body.body		= _learn(expr, funcId, body, nodes);
+	if ((body.body == nullptr) || (nodes > MAX_NODES))
+		return;
+
+	if (stmt->op() == ASTNode::A_ASSIGN)
+		{
+		ASTNode *assign = new ASTNode(*stmt);
+		assign->setLeft(body.body);
+		assign->setRight(_copy(stmt->right()));
+		body.body = assign;
+		}
+	else if (body.body->type() != fn.pType())
+		return;
+
+	_bodies[funcId] = body;
+	}
+
+/*****************************************************************************\
+|* Inline the hot calls in a function
+\*****************************************************************************/
+int Inliner::run(ASTNode *function)
+	{
+	function->setLeft(_inline(function->left(), true));
+	return _changes;
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* Inline the calls in a sub-tree. A void function can only be called as a
+|* statement, and anything else only inside an expression
+\*****************************************************************************/
+ASTNode * Inliner::_inline(ASTNode *node, bool statement)
+	{
+	if (node == nullptr)
+		return nullptr;
+
+	int op = node->op();
+	node->setLeft(_inline(node->left(), statement && (op == ASTNode::A_GLUE)));
+	node->setMid(_inline(node->mid(), op == ASTNode::A_IF));
+	node->setRight(_inline(node->right(),
+						   (statement && (op == ASTNode::A_GLUE))
+						|| (op == ASTNode::A_IF)
+						|| (op == ASTNode::A_WHILE)));
+
+	if (op == ASTNode::A_FUNCCALL)
+		{
+		ASTNode *copy = _expand(node, statement);
+		if (copy != nullptr)
+			return copy;
+		}
+	return node;
+	}
+
+/*****************************************************************************\
+|* Copy a function's body for a call. The arguments are evaluated once per
+|* use of the parameter rather than once per call, so they have to be free
+|* of side effects, and only leaves may be used more than once
+\*****************************************************************************/
+ASTNode * Inliner::_expand(ASTNode *call, bool statement)
+	{
+	int funcId = call->value().identifier;
+	auto found = _bodies.find(funcId);
+	if (found == _bodies.end())
+		return nullptr;
+
+	const Body& body = found->second;
+	if ((body.body->op() == ASTNode::A_ASSIGN) != statement)
+		return nullptr;
+
+	// Block 0 is the entry, so its count is the number of calls
+	const Profile::Counts *counts = _profile->countsFor(SYMTAB->at(funcId).name());
+	if (counts == nullptr)
+		return nullptr;
+	auto entry = counts->find(0);
+	if ((entry == counts->end()) || (entry->second < HOT_CALLS))
+		return nullptr;
+
+	// Arguments hang off a glue list, first argument at the top
+	std::vector<ASTNode *> args;
+	for (ASTNode *glue = call->left(); glue; glue = glue->left())
+		args.push_back(glue->right());
+	if (args.size() != body.types.size())
+		return nullptr;
+
+	for (int i=0; i<(int)args.size(); i++)
+		{
+		ASTNode *arg	= args[i];
+		int from		= arg->type();
+		int to			= body.types[i];
+		if (!_pure(arg))
+			return nullptr;
+
+		// Only widen: a narrower parameter would truncate the argument
+		if ((from != to) && !(Types::isInt(from) && Types::isInt(to)
+						 && (Types::typeSize(from) < Types::typeSize(to))))
+			return nullptr;
+
+		if ((body.uses[i] > 1)
+		 && (arg->op() != ASTNode::A_INTLIT)
+		 && (arg->op() != ASTNode::A_IDENT))
+			return nullptr;
+		}
+
+	_changes ++;
+	return _copy(body.body, &body, &args);
+	}
+
+/*****************************************************************************\
+|* Copy part of a function being learned. Parameters are the function's
+|* locals, and any other local would be gone by the time of the call
+\*****************************************************************************/
+ASTNode * Inliner::_learn(ASTNode *node, int funcId, Body& body, int& nodes)
+	{
+	nodes ++;
+	int slot = -1;
+
+	switch (node->op())
+		{
+		case ASTNode::A_IDENT:
+			{
+			Symbol& sym = SYMTAB->at(node->value().identifier);
+			if ((sym.sClass() == C_GLOBAL) && (sym.sType() == ST_VARIABLE))
+				break;
+			if ((sym.sClass() != C_PARAM) || !node->isRValue())
+				return nullptr;
+
+			for (int i=0; i<(int)body.types.size(); i++)
+				if (SYMTAB->at(funcId + 1 + i).name() == sym.name())
+					slot = i;
+			if (slot < 0)
+				return nullptr;
+			body.uses[slot] ++;
+			break;
+			}
+
+		case ASTNode::A_ADDR:
+			if (SYMTAB->at(node->value().identifier).sClass() != C_GLOBAL)
+				return nullptr;
+			break;
+
+		case ASTNode::A_INTLIT:
+		case ASTNode::A_DEREF:
+		case ASTNode::A_WIDEN:
+		case ASTNode::A_SCALE:
+		case ASTNode::A_NEGATE:
+		case ASTNode::A_INVERT:
+		case ASTNode::A_LOGNOT:
+		case ASTNode::A_TOBOOL:
+		case ASTNode::A_ADD:
+		case ASTNode::A_SUBTRACT:
+		case ASTNode::A_MULTIPLY:
+		case ASTNode::A_DIVIDE:
+		case ASTNode::A_AND:
+		case ASTNode::A_OR:
+		case ASTNode::A_XOR:
+		case ASTNode::A_LSHIFT:
+		case ASTNode::A_RSHIFT:
+		case ASTNode::A_EQ:
+		case ASTNode::A_NE:
+		case ASTNode::A_LT:
+		case ASTNode::A_GT:
+		case ASTNode::A_LE:
+		case ASTNode::A_GE:
+			break;
+
+		default:
+			return nullptr;
+		}
+
+	ASTNode *copy = new ASTNode(*node);
+	ASTNode *children[3] = {node->left(), node->mid(), node->right()};
+	for (int i=0; i<3; i++)
+		{
+		if (children[i] == nullptr)
+			continue;
+		children[i] = _learn(children[i], funcId, body, nodes);
+		if (children[i] == nullptr)
+			return nullptr;
+		}
+	copy->setLeft(children[0]);
+	copy->setMid(children[1]);
+	copy->setRight(children[2]);
+
+	if (slot >= 0)
+		body.slots[copy] = slot;
+	return copy;
+	}
+
+/*****************************************************************************\
+|* Copy a sub-tree. Each use of a parameter becomes a copy of its argument,
+|* widened to the parameter's type
+\*****************************************************************************/
+ASTNode * Inliner::_copy(ASTNode *node,
+						 const Body *body,
+						 const std::vector<ASTNode *> *args)
+	{
+	if (node == nullptr)
+		return nullptr;
+
+	if (body != nullptr)
+		{
+		auto slot = body->slots.find(node);
+		if (slot != body->slots.end())
+			return Types::modify(_copy((*args)[slot->second]),
+								 body->types[slot->second],
+								 0);
+		}
+
+	ASTNode *copy = new ASTNode(*node);
+	copy->setLeft(_copy(node->left(), body, args));
+	copy->setMid(_copy(node->mid(), body, args));
+	copy->setRight(_copy(node->right(), body, args));
+	return copy;
+	}
+
+/*****************************************************************************\
+|* Whether evaluating a tree has no side effects
+\*****************************************************************************/
+bool Inliner::_pure(ASTNode *node)
+	{
+	if (node == nullptr)
+		return true;
+
+	switch (node->op())
+		{
+		case ASTNode::A_ASSIGN:
+		case ASTNode::A_FUNCCALL:
+		case ASTNode::A_PREINC:
+		case ASTNode::A_PREDEC:
+		case ASTNode::A_POSTINC:
+		case ASTNode::A_POSTDEC:
+			return false;
+
+		default:
+			return _pure(node->left())
+				&& _pure(node->mid())
+				&& _pure(node->right());
+		}
+	}
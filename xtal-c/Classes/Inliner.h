@@ -0,0 +1,104 @@
+//
+//  Inliner.h
+//  xtal-c
+//
+//  Replace calls to small functions with a copy of their body, where the
+//  profile says the function is called often enough to be worth it. Only
+//  functions that are a single 'return (expr)', or for void functions a
+//  single assignment to a global, with no side effects beyond that are
+//  copied, so a call becomes an expression in the caller with the
+//  arguments in place of the parameters, and no new blocks
+//
+
+#ifndef Inliner_h
+#define Inliner_h
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "properties.h"
+#include "macros.h"
+
+class ASTNode;
+class Profile;
+
+class Inliner
+	{
+    NON_COPYABLE_NOR_MOVEABLE(Inliner)
+
+    public:
+		/*********************************************************************\
+		|* How often a function must be called, and how big it can be
+		\*********************************************************************/
+		static const int HOT_CALLS		= 4;
+		static const int MAX_NODES		= 16;
+
+	/************************************************************************\
+    |* Properties
+    \************************************************************************/
+    GET(int, changes);						// Calls replaced so far
+
+    private:
+		/*********************************************************************\
+		|* What we keep of each function that can be inlined
+		\*********************************************************************/
+		typedef struct
+			{
+			ASTNode *body;					// Copy of the expression
+			std::map<ASTNode *, int> slots;	// Parameter uses in the copy
+			std::vector<int> types;			// Type of each parameter
+			std::vector<int> uses;			// Times each one is used
+			} Body;
+
+		std::map<int, Body> _bodies;		// Inlinable functions, by id
+		Profile *_profile;					// Call counts
+
+        /********************************************************************\
+        |* Inline the calls in a sub-tree, returning what should replace it
+        \********************************************************************/
+		ASTNode * _inline(ASTNode *node, bool statement);
+
+        /********************************************************************\
+        |* The copy of a function's body for a call, or nullptr if this call
+        |* shouldn't be inlined
+        \********************************************************************/
+		ASTNode * _expand(ASTNode *call, bool statement);
+
+        /********************************************************************\
+        |* Copy a sub-tree of a function that's being learned, noting where
+        |* its parameters are used. Returns nullptr if it can't be inlined
+        \********************************************************************/
+		ASTNode * _learn(ASTNode *node, int funcId, Body& body, int& nodes);
+
+        /********************************************************************\
+        |* Copy a sub-tree, putting the arguments in place of the parameters
+        \********************************************************************/
+		ASTNode * _copy(ASTNode *node,
+						const Body *body = nullptr,
+						const std::vector<ASTNode *> *args = nullptr);
+
+        /********************************************************************\
+        |* Whether evaluating a tree has no side effects
+        \********************************************************************/
+		bool _pure(ASTNode *node);
+
+    public:
+        /********************************************************************\
+        |* Constructor
+        \********************************************************************/
+        explicit Inliner(Profile *profile);
+
+        /********************************************************************\
+        |* Remember a function if it's small enough to inline
+        \********************************************************************/
+		void learn(ASTNode *function);
+
+        /********************************************************************\
+        |* Inline the hot calls in a function, returning the number replaced
+        \********************************************************************/
+		int run(ASTNode *function);
+	};
+
+#endif /* Inliner_h */
@@ -0,0 +1,66 @@
+//
+//  PassManager.cc
+//  xtal-c
+//
+
+#include "CommonSubexpression.h"
+#include "ConstantPropagation.h"
+#include "CopyPropagation.h"
+#include "DeadCodeElimination.h"
+#include "PassManager.h"
+#include "SymbolTable.h"
+
+/*****************************************************************************\
+|* Constructor. Set up the standard passes
+\*****************************************************************************/
+PassManager::PassManager(void)
+			:_level(1)
+	{
+	add(new ConstantPropagation());
+	add(new CopyPropagation());
+	add(new CommonSubexpression());
+	add(new DeadCodeElimination());
+	}
+
+/*****************************************************************************\
+|* Destructor
+\*****************************************************************************/
+PassManager::~PassManager(void)
+	{
+	for (IRPass *pass : _passes)
+		delete pass;
+	}
+
+/*****************************************************************************\
+|* Add a pass
+\*****************************************************************************/
+void PassManager::add(IRPass *pass)
+	{
+	_passes.push_back(pass);
+	}
+
+/*****************************************************************************\
+|* Run the passes to a fixed point
+\*****************************************************************************/
+void PassManager::run(IRFunction& fn)
+	{
+	if (_level <= 0)
+		return;
+
+	String fnName = SYMTAB->at(fn.funcId()).name();
+	for (int round=0; round<MAX_ROUNDS; round++)
+		{
+		int changes = 0;
+		for (IRPass *pass : _passes)
+			{
+			int changed = pass->run(fn);
+			if (changed > 0)
+				DBG_DEFAULT("IR %s: %s made %d change(s)",
+							fnName.c_str(), pass->name(), changed);
+			changes += changed;
+			}
+
+		if (changes == 0)
+			break;
+		}
+	}
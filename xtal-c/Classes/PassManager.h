@@ -0,0 +1,75 @@
+//
+//  PassManager.h
+//  xtal-c
+//
+//  Runs the optimisation passes over a function's IR
+//
+
+#ifndef PassManager_h
+#define PassManager_h
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "properties.h"
+#include "macros.h"
+
+#include "IR.h"
+
+/*****************************************************************************\
+|* A pass over the IR. Each one returns how many changes it made, so the
+|* manager knows when there's nothing left to do
+\*****************************************************************************/
+class IRPass
+	{
+	public:
+		virtual ~IRPass() {}
+
+		/*********************************************************************\
+        |* The name of the pass, for the debug output
+        \*********************************************************************/
+		virtual const char * name(void) = 0;
+
+		/*********************************************************************\
+        |* Run the pass over a function
+        \*********************************************************************/
+		virtual int run(IRFunction& fn) = 0;
+	};
+
+class PassManager
+	{
+    NON_COPYABLE_NOR_MOVEABLE(PassManager)
+
+	/************************************************************************\
+    |* Properties
+    \************************************************************************/
+    GETSET(int, level, Level);				// 0 = no optimisation
+
+    private:
+		std::vector<IRPass *> _passes;		// Passes, in the order to run
+
+    public:
+		/*********************************************************************\
+		|* Maximum times round the list of passes for any one function
+		\*********************************************************************/
+		static const int MAX_ROUNDS		= 8;
+
+        /********************************************************************\
+        |* Constructors and Destructor
+        \********************************************************************/
+        explicit PassManager(void);
+		~PassManager(void);
+
+        /********************************************************************\
+        |* Add a pass. The manager owns it from here on
+        \********************************************************************/
+		void add(IRPass *pass);
+
+        /********************************************************************\
+        |* Run the passes over a function until none of them change anything
+        \********************************************************************/
+		void run(IRFunction& fn);
+	};
+
+#endif /* PassManager_h */
@@ -0,0 +1,126 @@
+//
+//  Profile.cc
+//  xtal-c
+//
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "Profile.h"
+#include "Stringutils.h"
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+Profile::Profile(void)
+	{
+	}
+
+/*****************************************************************************\
+|* Load the profile. The simulator writes a header, the size of memory, then
+|* the cycles spent at each address
+\*****************************************************************************/
+bool Profile::load(const String& profile, const String& listing)
+	{
+	std::map<String, int> labels;
+	if (!_readMap(listing, labels))
+		return false;
+
+	FILE *fp = fopen(profile.c_str(), "rb");
+	if (fp == NULL)
+		return false;
+
+	char magic[16];
+	uint16_t version	= 0;
+	int maxRam			= 0;
+	bool ok				= (fgets(magic, sizeof(magic), fp) != NULL)
+					   && (strcmp(magic, "SIM:PROF\n") == 0)
+					   && (fread(&version, sizeof(version), 1, fp) == 1)
+					   && (fread(&maxRam, sizeof(maxRam), 1, fp) == 1)
+					   && (maxRam > 0);
+
+	std::vector<uint64_t> cycles(ok ? maxRam : 0);
+	if (ok)
+		ok = (fread(&cycles[0], sizeof(cycles[0]), maxRam, fp) == (size_t)maxRam);
+	fclose(fp);
+	if (!ok)
+		return false;
+
+	/*************************************************************************\
+    |* Each profiling label is P_<function>_<block>
+    \*************************************************************************/
+	for (auto& entry : labels)
+		{
+		const String& name = entry.first;
+		size_t split = name.rfind('_');
+		if (!name.starts_with("P_") || (split == String::npos) || (split < 3))
+			continue;
+		if ((entry.second < 0) || (entry.second >= maxRam))
+			continue;
+
+		String function	= name.substr(2, split-2);
+		int block		= atoi(name.substr(split+1).c_str());
+		_counts[function][block] = cycles[entry.second] / NOP_CYCLES;
+		}
+
+	DBG_DEFAULT("Profile: %d functions from %s",
+				(int)_counts.size(), profile.c_str());
+	return true;
+	}
+
+/*****************************************************************************\
+|* The counts for a function
+\*****************************************************************************/
+const Profile::Counts * Profile::countsFor(const String& function)
+	{
+	auto it = _counts.find(function);
+	return (it == _counts.end()) ? nullptr : &(it->second);
+	}
+
+/*****************************************************************************\
+|* Whether a profile has been loaded
+\*****************************************************************************/
+bool Profile::loaded(void)
+	{
+	return !_counts.empty();
+	}
+
+/*****************************************************************************\
+|* The label for a block
+\*****************************************************************************/
+String Profile::label(const String& function, int block)
+	{
+	return "P_" + function + "_" + std::to_string(block);
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* The listing has a line of 'label: $addr' for each label, with the label
+|* prefixed by the id of the file it's in
+\*****************************************************************************/
+bool Profile::_readMap(const String& path, std::map<String, int>& labels)
+	{
+	std::ifstream in(path);
+	if (!in)
+		return false;
+
+	String line;
+	while (std::getline(in, line))
+		{
+		size_t at = line.find(": $");
+		if ((at == String::npos) || ::isspace(line[0]))
+			continue;
+
+		String name = line.substr(0, at);
+		size_t idx	= 1;
+		while ((name[0] == 'F') && (idx < name.length()) && ::isdigit(name[idx]))
+			idx ++;
+		if ((idx > 1) && (idx < name.length()) && (name[idx] == '_'))
+			name = name.substr(idx+1);
+
+		labels[name] = (int) strtol(line.c_str() + at + 3, NULL, 16);
+		}
+	return true;
+	}
@@ -0,0 +1,69 @@
+//
+//  Profile.h
+//  xtal-c
+//
+//  How often each block of each function ran, read back from a simulator
+//  profile. A build made with --profile-generate starts every block with a
+//  label and a NOP, so the cycles the profiler charged to that NOP give the
+//  number of times the block ran, and the assembler listing gives the
+//  address of the label
+//
+
+#ifndef Profile_h
+#define Profile_h
+
+#include <cstdio>
+#include <map>
+#include <string>
+
+#include "properties.h"
+#include "macros.h"
+
+class Profile
+	{
+    NON_COPYABLE_NOR_MOVEABLE(Profile)
+
+    public:
+		typedef std::map<int, int64_t> Counts;	// Times run, by block id
+
+		/*********************************************************************\
+		|* Cycles taken by the NOP at the start of each block
+		\*********************************************************************/
+		static const int NOP_CYCLES		= 2;
+
+    private:
+		std::map<String, Counts> _counts;	// Block counts, by function
+
+        /********************************************************************\
+        |* Read the label addresses from an assembler listing
+        \********************************************************************/
+		bool _readMap(const String& path, std::map<String, int>& labels);
+
+    public:
+        /********************************************************************\
+        |* Constructor
+        \********************************************************************/
+        explicit Profile(void);
+
+        /********************************************************************\
+        |* Load a profile, and the listing of the build it came from
+        \********************************************************************/
+		bool load(const String& profile, const String& listing);
+
+        /********************************************************************\
+        |* The block counts for a function, or nullptr if it wasn't profiled
+        \********************************************************************/
+		const Counts * countsFor(const String& function);
+
+        /********************************************************************\
+        |* Whether there's a profile to use
+        \********************************************************************/
+		bool loaded(void);
+
+        /********************************************************************\
+        |* The label at the start of a block in a profiling build
+        \********************************************************************/
+		static String label(const String& function, int block);
+	};
+
+#endif /* Profile_h */
@@ -0,0 +1,270 @@
+//
+//  RegisterAllocator.cc
+//  xtal-c
+//
+
+#include <algorithm>
+#include <set>
+
+#include "RegisterAllocator.h"
+#include "SymbolTable.h"
+#include "Types.h"
+
+/*****************************************************************************\
+|* Whether an instruction reads or writes a named variable
+\*****************************************************************************/
+static bool _touchesVariable(const IRInstruction& insn)
+	{
+	return (insn.op == IRInstruction::I_LOAD)
+		|| (insn.op == IRInstruction::I_LOADMOD)
+		|| (insn.op == IRInstruction::I_STORE);
+	}
+
+/*****************************************************************************\
+|* Constructor
+\*****************************************************************************/
+RegisterAllocator::RegisterAllocator(void)
+	{
+	}
+
+/*****************************************************************************\
+|* Decide where the locals of a function live
+\*****************************************************************************/
+void RegisterAllocator::run(IRFunction& fn, const Profile::Counts *counts)
+	{
+	_findCandidates(fn);
+	if (_candidates.size() == 0)
+		return;
+
+	_liveness(fn, counts);
+	_assign(fn);
+	}
+
+/*****************************************************************************\
+|* The locals that need saving around a call
+\*****************************************************************************/
+std::vector<int> RegisterAllocator::savesAround(int block, int insn)
+	{
+	std::vector<int> saves;
+	auto it = _saves.find(std::make_pair(block, insn));
+	if (it != _saves.end())
+		for (int sym : it->second)
+			if (_homes.count(sym) > 0)
+				saves.push_back(sym);
+	return saves;
+	}
+
+#pragma mark - Private Methods
+
+/*****************************************************************************\
+|* Find the scalar locals which are only ever reached by name
+\*****************************************************************************/
+void RegisterAllocator::_findCandidates(IRFunction& fn)
+	{
+	for (IRBlock& block : fn.blocks)
+		for (IRInstruction& insn : block.insns)
+			{
+			if (!_touchesVariable(insn) || !fn.isPrivate(insn.sym))
+				continue;
+			if (_candidates.count(insn.sym) > 0)
+				continue;
+
+			Symbol& s = SYMTAB->at(insn.sym);
+			if (s.sType() != ST_VARIABLE)
+				continue;
+
+			Candidate c;
+			c.sym		= insn.sym;
+			c.size		= Types::typeSize(s.pType());
+			c.first		= -1;
+			c.last		= -1;
+			c.weight	= 0;
+			c.cost		= 0;
+			_candidates[insn.sym] = c;
+			}
+	}
+
+/*****************************************************************************\
+|* Work out which candidates are live where. Points are numbered through the
+|* instructions in layout order, so a loop's points are contiguous and a
+|* local live around the loop is live over all of them
+\*****************************************************************************/
+void RegisterAllocator::_liveness(IRFunction& fn, const Profile::Counts *counts)
+	{
+	int count = (int) fn.blocks.size();
+
+	/*************************************************************************\
+    |* How often each block runs: measured if there's a profile, otherwise
+    |* guessed from how deeply nested in loops it is
+    \*************************************************************************/
+	std::vector<int64_t> scale(count, 1);
+	if (counts != nullptr)
+		for (int i=0; i<count; i++)
+			{
+			auto it		= counts->find(fn.blocks[i].id);
+			scale[i]	= (it == counts->end()) ? 0 : it->second;
+			}
+	else
+		for (int i=0; i<count; i++)
+			for (int s : fn.successors(i))
+				if (s <= i)
+					for (int j=s; j<=i; j++)
+						scale[j] *= LOOP_WEIGHT;
+
+	/*************************************************************************\
+    |* Which candidates are live on the way into each block
+    \*************************************************************************/
+	std::vector<std::set<int>> liveIn(count);
+	bool changed = true;
+	while (changed)
+		{
+		changed = false;
+		for (int i=count-1; i>=0; i--)
+			{
+			std::set<int> live;
+			for (int s : fn.successors(i))
+				live.insert(liveIn[s].begin(), liveIn[s].end());
+
+			std::vector<IRInstruction>& insns = fn.blocks[i].insns;
+			for (int j=(int)insns.size()-1; j>=0; j--)
+				{
+				if (_candidates.count(insns[j].sym) == 0)
+					continue;
+				if (insns[j].op == IRInstruction::I_STORE)
+					live.erase(insns[j].sym);
+				else if ((insns[j].op == IRInstruction::I_LOAD) ||
+						 (insns[j].op == IRInstruction::I_LOADMOD))
+					live.insert(insns[j].sym);
+				}
+
+			if (live != liveIn[i])
+				{
+				liveIn[i]	= live;
+				changed		= true;
+				}
+			}
+		}
+
+	/*************************************************************************\
+    |* Walk each block backwards to find the live points, weights and the
+    |* cost of keeping each one across the calls it's live over
+    \*************************************************************************/
+	std::vector<int> start(count, 0);
+	for (int i=1; i<count; i++)
+		start[i] = start[i-1] + (int)fn.blocks[i-1].insns.size();
+
+	for (int i=0; i<count; i++)
+		{
+		std::set<int> live;
+		for (int s : fn.successors(i))
+			live.insert(liveIn[s].begin(), liveIn[s].end());
+
+		std::vector<IRInstruction>& insns = fn.blocks[i].insns;
+		for (int j=(int)insns.size()-1; j>=0; j--)
+			{
+			IRInstruction& insn = insns[j];
+			int point			= start[i] + j;
+
+			// A store before the call, then a load and a move back after it
+			if (insn.op == IRInstruction::I_CALL)
+				for (int sym : live)
+					{
+					_saves[std::make_pair(i, j)].push_back(sym);
+					_candidates[sym].cost += 3 * scale[i];
+					}
+
+			std::vector<int> here(live.begin(), live.end());
+			if (_touchesVariable(insn) && (_candidates.count(insn.sym) > 0))
+				{
+				_candidates[insn.sym].weight += scale[i];
+				here.push_back(insn.sym);
+
+				if (insn.op == IRInstruction::I_STORE)
+					live.erase(insn.sym);
+				else
+					live.insert(insn.sym);
+				}
+
+			for (int sym : here)
+				{
+				Candidate& c = _candidates[sym];
+				if ((c.first < 0) || (point < c.first))
+					c.first = point;
+				if (point > c.last)
+					c.last = point;
+				}
+			}
+		}
+
+	/*************************************************************************\
+    |* Anything live on entry has to be loaded from memory first
+    \*************************************************************************/
+	if (count > 0)
+		for (int sym : liveIn[0])
+			{
+			_entryLoads.push_back(sym);
+			_candidates[sym].cost += scale[0];
+			}
+	}
+
+/*****************************************************************************\
+|* Place the candidates, most valuable first, in the lowest bytes that
+|* nothing else live at the same time is using
+\*****************************************************************************/
+void RegisterAllocator::_assign(IRFunction& fn)
+	{
+	std::vector<Candidate> order;
+	for (auto& entry : _candidates)
+		order.push_back(entry.second);
+
+	std::stable_sort(order.begin(), order.end(),
+		[](const Candidate& a, const Candidate& b)
+			{ return (a.weight - a.cost) > (b.weight - b.cost); });
+
+	String fnName = SYMTAB->at(fn.funcId()).name();
+	std::vector<Candidate> placed;
+	for (Candidate& c : order)
+		{
+		const char *name = SYMTAB->at(c.sym).name().c_str();
+		if ((c.first < 0) || (c.weight <= c.cost))
+			{
+			DBG_DEFAULT("Regs %s: %s stays in memory (weight %lld, cost %lld)",
+						fnName.c_str(), name,
+						(long long)c.weight, (long long)c.cost);
+			continue;
+			}
+
+		int at = -1;
+		for (int offset=0; (at < 0) && (offset + c.size <= MAX_BYTES); offset++)
+			{
+			bool clash = false;
+			for (Candidate& p : placed)
+				if ((p.first <= c.last) && (c.first <= p.last)
+					&& (_homes[p.sym] < offset + c.size)
+					&& (offset < _homes[p.sym] + p.size))
+					clash = true;
+			if (!clash)
+				at = offset;
+			}
+
+		if (at < 0)
+			{
+			DBG_DEFAULT("Regs %s: no room for %s, it stays in memory",
+						fnName.c_str(), name);
+			continue;
+			}
+
+		_homes[c.sym] = at;
+		placed.push_back(c);
+		DBG_DEFAULT("Regs %s: %s lives in r%d (weight %lld, cost %lld)",
+					fnName.c_str(), name, at,
+					(long long)c.weight, (long long)c.cost);
+		}
+
+	// Only the locals that got a register need loading
+	std::vector<int> loads;
+	for (int sym : _entryLoads)
+		if (_homes.count(sym) > 0)
+			loads.push_back(sym);
+	_entryLoads = loads;
+	}
@@ -0,0 +1,103 @@
+//
+//  RegisterAllocator.h
+//  xtal-c
+//
+//  Decide which locals live in a zero-page register for the whole of a
+//  function. Each local whose address isn't taken gets a live interval, and
+//  the most-used go first into the lowest bytes of the register file, sharing
+//  bytes when their intervals don't overlap. Registers don't survive a call,
+//  so locals live across one are written back and reloaded around it
+//
+
+#ifndef RegisterAllocator_h
+#define RegisterAllocator_h
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "properties.h"
+#include "macros.h"
+
+#include "IR.h"
+#include "Profile.h"
+
+class RegisterAllocator
+	{
+    NON_COPYABLE_NOR_MOVEABLE(RegisterAllocator)
+
+    public:
+		typedef std::map<int, int> HomeMap;	// Register offset, by symbol
+
+	/************************************************************************\
+    |* Properties
+    \************************************************************************/
+    GET(HomeMap, homes);					// Where each local lives
+    GET(std::vector<int>, entryLoads);		// Locals to load on entry
+
+    public:
+		/*********************************************************************\
+		|* Bytes of the register file locals may use. The rest is left for
+		|* the temporaries in expressions
+		\*********************************************************************/
+		static const int MAX_BYTES		= 24;
+
+		/*********************************************************************\
+		|* How much more a use inside a loop counts, per level of nesting
+		\*********************************************************************/
+		static const int LOOP_WEIGHT	= 8;
+
+    private:
+		/*********************************************************************\
+		|* What we know about each candidate
+		\*********************************************************************/
+		typedef struct
+			{
+			int sym;						// Symbol-table index
+			int size;						// Bytes in a register
+			int first;						// First point it's live or set
+			int last;						// Last point it's live or set
+			int64_t weight;					// Benefit of a register
+			int64_t cost;					// Saves, restores and loads
+			} Candidate;
+
+		std::map<int, Candidate> _candidates;
+		std::map<std::pair<int,int>, std::vector<int>> _saves;
+
+        /********************************************************************\
+        |* Find the locals that could go in a register
+        \********************************************************************/
+		void _findCandidates(IRFunction& fn);
+
+        /********************************************************************\
+        |* Work out the live intervals, weights and call costs
+        \********************************************************************/
+		void _liveness(IRFunction& fn, const Profile::Counts *counts);
+
+        /********************************************************************\
+        |* Place the candidates in the register file
+        \********************************************************************/
+		void _assign(IRFunction& fn);
+
+    public:
+        /********************************************************************\
+        |* Constructor
+        \********************************************************************/
+        explicit RegisterAllocator(void);
+
+        /********************************************************************\
+        |* Decide where the locals of a function live. With a profile, uses
+        |* are weighed by how often their block ran rather than by how deep
+        |* in loops it is
+        \********************************************************************/
+		void run(IRFunction& fn, const Profile::Counts *counts = nullptr);
+
+        /********************************************************************\
+        |* The locals held in registers that need saving around the call at
+        |* instruction 'insn' of the block at layout index 'block'
+        \********************************************************************/
+		std::vector<int> savesAround(int block, int insn);
+	};
+
+#endif /* RegisterAllocator_h */
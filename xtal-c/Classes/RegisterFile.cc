@@ -14,6 +14,7 @@
 
 static uint32_t _regSpace[REG_PAGE_SPACE];		// Space to allocate to regs
 static std::vector<Register>	_allocated;		// List of current registers
+static std::vector<Register>	_pinned;		// Registers held for a function
 static FILE * _ofp;								// Asembly output file
 
 /*****************************************************************************\
@@ -39,6 +40,15 @@ void RegisterFile::clear(void)
 
 	if (_ofp != nullptr)
 		fprintf(_ofp, "\t.reg reset\n");
+
+	/************************************************************************\
+    |* Anything pinned stays where it is
+    \************************************************************************/
+	for (Register& r : _pinned)
+		{
+		_populate(r);
+		_hint(r);
+		}
 	}
 
 /*****************************************************************************\
@@ -105,46 +115,38 @@ Register RegisterFile::allocate(Register::RegType type)
 	//printf("Allocated: %d\n\n\n", offset);
 	
 	if (offset >= 0)
-		{
-		int set = offset / 16;
-		switch (set)
-			{
-			case 0:
-				r.setSet(Register::SET_C0CF);
-				break;
-			case 1:
-				r.setSet(Register::SET_D0DF);
-				break;
-			case 2:
-				r.setSet(Register::SET_E0EF);
-				break;
-			case 3:
-				r.setSet(Register::SET_F0FF);
-				break;
-			default:
-				FATAL(ERR_REG_ALLOC, "Ran out of register space!");
-			}
-		r.setOffset(offset);
-		
-		char buf[1024];
-		snprintf(buf, 1024, "r%d", offset);
-		r.setName(buf);
-		r.setIdentifier(offset);
-		_populate(r);
-		}
+		_place(r, offset);
 	else
 		FATAL(ERR_REG_ALLOC, "Cannot allocate register");
 
-	if (_ofp != nullptr)
-		fprintf(_ofp, "\t.reg %s %d %c\n",
-			r.name().c_str(),
-			r.size(),
-			r.type() > 0xFF ? 's' : 'u');
-
+	_hint(r);
 	_allocated.push_back(r);
 	return _allocated[_allocated.size()-1];
 	}
 	
+/*****************************************************************************\
+|* Pin a register at a given offset for the rest of the function
+\*****************************************************************************/
+Register RegisterFile::pin(Register::RegType type, int offset)
+	{
+	Register r;
+	r.setType(type);
+	_place(r, offset);
+	_hint(r);
+	_pinned.push_back(r);
+	return r;
+	}
+	
+/*****************************************************************************\
+|* Release all the pinned registers
+\*****************************************************************************/
+void RegisterFile::unpinAll(void)
+	{
+	for (Register& r : _pinned)
+		_populate(r, true);
+	_pinned.clear();
+	}
+	
 /*****************************************************************************\
 |* Widen a register
 \*****************************************************************************/
@@ -215,8 +217,78 @@ bool RegisterFile::free(Register& reg)
 	return ok;
 	}
 	
+/*****************************************************************************\
+|* Free everything except the given registers, which are left where they are.
+|* If that's what is allocated already there's nothing to do
+\*****************************************************************************/
+void RegisterFile::retain(std::vector<Register>& live)
+	{
+	bool same = (live.size() == _allocated.size());
+	for (size_t i=0; same && i<live.size(); i++)
+		{
+		same = false;
+		for (Register& r : _allocated)
+			if ((r.offset() == live[i].offset()) && (r.type() == live[i].type()))
+				same = true;
+		}
+	if (same)
+		return;
+	
+	clear();
+	for (Register r : live)
+		{
+		_populate(r);
+		_allocated.push_back(r);
+		_hint(r);
+		}
+	}
+
 #pragma mark - Private Methods
 
+/*****************************************************************************\
+|* Name a register for an offset and mark its space as used
+\*****************************************************************************/
+void RegisterFile::_place(Register& r, int offset)
+	{
+	int set = offset / 16;
+	switch (set)
+		{
+		case 0:
+			r.setSet(Register::SET_C0CF);
+			break;
+		case 1:
+			r.setSet(Register::SET_D0DF);
+			break;
+		case 2:
+			r.setSet(Register::SET_E0EF);
+			break;
+		case 3:
+			r.setSet(Register::SET_F0FF);
+			break;
+		default:
+			FATAL(ERR_REG_ALLOC, "Ran out of register space!");
+		}
+	r.setOffset(offset);
+	
+	char buf[1024];
+	snprintf(buf, 1024, "r%d", offset);
+	r.setName(buf);
+	r.setIdentifier(offset);
+	_populate(r);
+	}
+
+/*****************************************************************************\
+|* Tell the assembler the size and signedness of a register
+\*****************************************************************************/
+void RegisterFile::_hint(Register& r)
+	{
+	if (_ofp != nullptr)
+		fprintf(_ofp, "\t.reg %s %d %c\n",
+			r.name().c_str(),
+			r.size(),
+			r.type() > 0xFF ? 's' : 'u');
+	}
+	
 /*****************************************************************************\
 |* Populate the map with the given register
 \*****************************************************************************/
@@ -44,6 +44,7 @@
 
 #include <cstdio>
 #include <string>
+#include <vector>
 
 #include "properties.h"
 #include "macros.h"
@@ -69,6 +70,16 @@ class RegisterFile
         \********************************************************************/
         static int _findSpace(int bytes);
 		
+        /********************************************************************\
+        |* Name a register for an offset, and mark the space as used
+        \********************************************************************/
+        static void _place(Register &r, int offset);
+		
+        /********************************************************************\
+        |* Give the assembler the size and signedness of a register
+        \********************************************************************/
+        static void _hint(Register &r);
+		
     public:
         /***********************************************************************\
         |* Constructors and Destructor
@@ -100,6 +111,18 @@ class RegisterFile
         |* Free up a register
         \***********************************************************************/
         static bool free(Register& reg);
+        
+        /***********************************************************************\
+        |* Free everything except the given registers
+        \***********************************************************************/
+        static void retain(std::vector<Register>& live);
+            
+        /***********************************************************************\
+        |* Pin a register at a fixed offset, so it survives clear() and
+        |* retain() until it's released with unpinAll()
+        \***********************************************************************/
+        static Register pin(Register::RegType type, int offset);
+        static void unpinAll(void);
             
         /***********************************************************************\
         |* Debugging: dump out register allocations
@@ -125,7 +125,6 @@ ASTNode * Statement::returnStatement(Token& token)
 \****************************************************************************/
 ASTNode * Statement::globalDeclaration(Token& token)
 	{
-	Register none(Register::NO_REGISTER);
 	ASTNode *tree = nullptr;
 	
 	forever
@@ -143,7 +142,7 @@ ASTNode * Statement::globalDeclaration(Token& token)
 			// Check for a function prototype
 			if (tree == nullptr)
 				continue;
-			_emitter->emit(tree, none, 0, "");
+			_emitter->generate(tree);
 			}
 		else
 			{
@@ -69,6 +69,10 @@ int Driver::main(int argc, const char *argv[])
     _dumpTree		= _ap->flagFor("-T", "--dump-ast", false,
 										"General",
 										 "Output Abstract Syntax Tree");
+    _pgo			= _ap->flagFor("-pgo", "--pgo", false,
+										"General",
+										 "Profile in the simulator, then "
+										 "rebuild using the profile");
 
 	/*************************************************************************\
 	|* Check for help
@@ -99,10 +103,17 @@ int Driver::main(int argc, const char *argv[])
 		_symbols.push_back(buf);
 		}
 		
+	/*************************************************************************\
+	|* If we're optimising from a profile, get one first
+	\*************************************************************************/
+	String cFlags = "";
+	if (_pgo && _profile())
+		cFlags = "-pu '" + _profileData + "' -pm '" + _profileMap + "' ";
+
 	/*************************************************************************\
 	|* Construct a commandline arg and call the compiler
 	\*************************************************************************/
-	String cCmd = _cCmd();
+	String cCmd = _cCmd(cFlags);
 	if (_debugLevel > 0)
 		printf("%s\n", cCmd.c_str());
 	
@@ -110,11 +121,17 @@ int Driver::main(int argc, const char *argv[])
 	
 	if  (status == 0)
 		{
-		String aCmd = _aCmd();
+		String aCmd = _aCmd(_output, _listFile);
 		if (_debugLevel > 0)
 			printf("%s\n", aCmd.c_str());
 		system(aCmd.c_str());
 		}
+
+	if (cFlags != "")
+		{
+		remove(_profileData.c_str());
+		remove(_profileMap.c_str());
+		}
 	//remove(_asmFile.c_str());
 	return ok;
 	}
@@ -125,7 +142,7 @@ int Driver::main(int argc, const char *argv[])
 /*****************************************************************************\
 |* Create the commandline for the compiler
 \*****************************************************************************/
-String Driver::_cCmd(void)
+String Driver::_cCmd(const String& flags)
 	{
 	char buf[1024];
 	snprintf(buf, 1024, "%s/bin/xtal-c ", _baseDir.c_str());
@@ -136,8 +153,10 @@ String Driver::_cCmd(void)
 	
 	if (_dumpTree)
 		cCmd += "-T ";
+	
+	cCmd += flags;
 		
-	_asmFile = fs::temp_directory_path().string() + randomString(8) + ".asm";
+	_asmFile = (fs::temp_directory_path() / (randomString(8) + ".asm")).string();
 	cCmd += "-o " + _asmFile + " ";
 	
 	cCmd += "-xb " + _baseDir + " ";
@@ -151,7 +170,7 @@ String Driver::_cCmd(void)
 /*****************************************************************************\
 |* Create the commandline for the assembler
 \*****************************************************************************/
-String Driver::_aCmd(void)
+String Driver::_aCmd(const String& output, const String& listFile)
 	{
 	char buf[1024];
 	snprintf(buf, 1024, "%s/bin/xtal-a ", _baseDir.c_str());
@@ -168,13 +187,13 @@ String Driver::_aCmd(void)
 	for (int i=0; i<_debugLevel; i++)
 		aCmd += "-d ";
 	
-	aCmd += "-o '" + _output + "' ";
+	aCmd += "-o '" + output + "' ";
 	
-	if (_hexOutput != "")
+	if ((_hexOutput != "") && (output == _output))
 		aCmd += "-oh '" + _hexOutput + "' ";
 	
-	if (_listFile != "")
-		aCmd += "-l '" + _listFile + "' ";
+	if (listFile != "")
+		aCmd += "-l '" + listFile + "' ";
 	
 	aCmd += "-xb " + _baseDir + " ";
 	
@@ -182,3 +201,46 @@ String Driver::_aCmd(void)
 	
 	return aCmd;
 	}
+
+/*****************************************************************************\
+|* Make a build that labels each block for the profiler, and run it in the
+|* headless simulator. The listing maps the labels in the profile back to
+|* the blocks when we rebuild
+\*****************************************************************************/
+bool Driver::_profile(void)
+	{
+	String cCmd = _cCmd("-pg ");
+	if (_debugLevel > 0)
+		printf("%s\n", cCmd.c_str());
+	if (system(cCmd.c_str()) != 0)
+		return false;
+
+	String stem		= fs::path(_asmFile).replace_extension("").string();
+	String binary	= stem + ".xex";
+	_profileMap		= stem + ".lst";
+	_profileData	= stem + ".prof";
+
+	String aCmd = _aCmd(binary, _profileMap);
+	if (_debugLevel > 0)
+		printf("%s\n", aCmd.c_str());
+	int status = system(aCmd.c_str());
+
+	if (status == 0)
+		{
+		String sCmd = _baseDir + "/bin/qxsim -p '" + binary + "' > /dev/null";
+		if (_debugLevel > 0)
+			printf("%s\n", sCmd.c_str());
+		system(sCmd.c_str());
+		}
+
+	remove(_asmFile.c_str());
+	remove(binary.c_str());
+	if (!fs::exists(_profileData))
+		{
+		fprintf(stderr, "No profile for %s, building without one\n",
+				binary.c_str());
+		remove(_profileMap.c_str());
+		return false;
+		}
+	return true;
+	}
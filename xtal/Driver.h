@@ -33,17 +33,26 @@ class Driver
     GET(String, listFile);				// Output listing filename
 	GET(String, asmFile);				// Intermediate assembly file
 	GET(bool, dumpTree);				// Dump out the AS tree
+	GET(bool, pgo);						// Build, profile, then rebuild
+	GET(String, profileData);			// Profile from the simulator
+	GET(String, profileMap);			// Listing of the profiled build
 	
     private:
 		/*********************************************************************\
         |* Generate the commandline for the compiler command
         \*********************************************************************/
-		String _cCmd(void);
+		String _cCmd(const String& flags);
        
 		/*********************************************************************\
         |* Generate the commandline for the assembler command
         \*********************************************************************/
-		String _aCmd(void);
+		String _aCmd(const String& output, const String& listFile);
+       
+		/*********************************************************************\
+        |* Build with profiling labels and run it in the simulator, returning
+        |* true if there's a profile to rebuild with
+        \*********************************************************************/
+		bool _profile(void);
        
     public:
         /********************************************************************\